@@ -226,6 +226,16 @@ static void HASH_SHA256D64_1024(benchmark::Bench& bench)
     });
 }
 
+/* Hash 1024 blobs 64 bytes each via single SHA256 */
+
+static void HASH_SHA256S64_1024(benchmark::Bench& bench)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    bench.minEpochIterations(1000).run([&] {
+        SHA256S64(in.data(), in.data(), 1024);
+    });
+}
+
 /* FastRandom for uint32_t and bool */
 
 static void FastRandom_32bit(benchmark::Bench& bench)
@@ -269,6 +279,7 @@ BENCHMARK(HASH_SHA256_32b);
 BENCHMARK(HASH_SipHash_32b);
 
 BENCHMARK(HASH_SHA256D64_1024);
+BENCHMARK(HASH_SHA256S64_1024);
 
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
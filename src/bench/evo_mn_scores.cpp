@@ -0,0 +1,66 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <evo/deterministicmns.h>
+#include <evo/dmnstate.h>
+#include <random.h>
+
+#include <memory>
+
+static constexpr size_t LLMQ_BENCH_SIZE = 50;
+
+// A list of confirmed masternodes with random proTxHashes, collaterals and owner keys
+static CDeterministicMNList MakeBenchMNList(size_t count)
+{
+    FastRandomContext rng(true);
+    CDeterministicMNList mnList(uint256(), 0, 0);
+    for (size_t i = 0; i < count; i++) {
+        auto dmn = std::make_shared<CDeterministicMN>(i);
+        dmn->proTxHash = rng.rand256();
+        dmn->collateralOutpoint = COutPoint(rng.rand256(), 0);
+        auto state = std::make_shared<CDeterministicMNState>();
+        state->keyIDOwner = CKeyID(uint160(rng.randbytes(20)));
+        state->UpdateConfirmedHash(dmn->proTxHash, rng.rand256());
+        dmn->pdmnState = state;
+        mnList.AddMN(dmn);
+    }
+    return mnList;
+}
+
+static void CalculateScores(benchmark::Bench& bench, size_t count)
+{
+    const CDeterministicMNList mnList = MakeBenchMNList(count);
+    uint256 modifier;
+    bench.run([&] {
+        *((uint64_t*)modifier.begin()) += 1;
+        auto scores = mnList.CalculateScores(modifier);
+        ankerl::nanobench::doNotOptimizeAway(scores);
+    });
+}
+
+static void CalculateQuorum(benchmark::Bench& bench, size_t count, size_t maxSize)
+{
+    const CDeterministicMNList mnList = MakeBenchMNList(count);
+    uint256 modifier;
+    bench.run([&] {
+        *((uint64_t*)modifier.begin()) += 1;
+        auto members = mnList.CalculateQuorum(maxSize, modifier);
+        ankerl::nanobench::doNotOptimizeAway(members);
+    });
+}
+
+static void DeterministicMNList_CalculateScores_1000(benchmark::Bench& bench) { CalculateScores(bench, 1000); }
+static void DeterministicMNList_CalculateScores_10000(benchmark::Bench& bench) { CalculateScores(bench, 10000); }
+static void DeterministicMNList_CalculateQuorum_1000(benchmark::Bench& bench) { CalculateQuorum(bench, 1000, LLMQ_BENCH_SIZE); }
+static void DeterministicMNList_CalculateQuorum_10000(benchmark::Bench& bench) { CalculateQuorum(bench, 10000, LLMQ_BENCH_SIZE); }
+static void DeterministicMNList_CalculateQuorumAll_1000(benchmark::Bench& bench) { CalculateQuorum(bench, 1000, 1000); }
+static void DeterministicMNList_CalculateQuorumAll_10000(benchmark::Bench& bench) { CalculateQuorum(bench, 10000, 10000); }
+
+BENCHMARK(DeterministicMNList_CalculateScores_1000);
+BENCHMARK(DeterministicMNList_CalculateScores_10000);
+BENCHMARK(DeterministicMNList_CalculateQuorum_1000);
+BENCHMARK(DeterministicMNList_CalculateQuorum_10000);
+BENCHMARK(DeterministicMNList_CalculateQuorumAll_1000);
+BENCHMARK(DeterministicMNList_CalculateQuorumAll_10000);
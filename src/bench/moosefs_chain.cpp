@@ -0,0 +1,86 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <libmoosefs/mfscommon/sockets.h>
+
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+static const uint32_t CHAIN_TIMEOUT = 5000;
+static const uint32_t CHAIN_PACKETS = 256;
+static const uint32_t CHAIN_PACKET_SIZE = 8 + 8 + 4 + 2 + 2 + 4 + 4 + 65536; // CLTOCS_WRITE_DATA with whole block
+
+/* connected pair of non-blocking sockets on loopback */
+static void LoopbackPair(int& out, int& in)
+{
+    uint16_t port;
+    int r;
+    int lsock = tcpsocket();
+    r = tcpnumlisten(lsock, 0x7F000001, 0, 1);
+    assert(r == 0);
+    r = tcpgetmyaddr(lsock, NULL, &port);
+    assert(r == 0);
+    out = tcpsocket();
+    r = tcpnumtoconnect(out, 0x7F000001, port, CHAIN_TIMEOUT);
+    assert(r == 0);
+    in = tcptoaccept(lsock, CHAIN_TIMEOUT);
+    assert(in >= 0);
+    tcpnonblock(in);
+    tcpnodelay(out);
+    tcpnodelay(in);
+    tcpclose(lsock);
+}
+
+/* client -> cs1 -> cs2 -> cs3: first two chunkservers forward every packet and keep a copy (as mainserv_write_middle does), last one only receives */
+static void MFS_WRITE_CHAIN(benchmark::Bench& bench)
+{
+    int sock[6];
+    std::vector<uint8_t> packet(CHAIN_PACKET_SIZE, 0x5A);
+
+    for (uint32_t i = 0; i < 3; i++) {
+        LoopbackPair(sock[2 * i], sock[2 * i + 1]);
+    }
+    bench.batch(uint64_t(CHAIN_PACKETS) * CHAIN_PACKET_SIZE).unit("byte").run([&] {
+        std::vector<std::thread> threads;
+        threads.emplace_back([&] {
+            for (uint32_t p = 0; p < CHAIN_PACKETS; p++) {
+                tcptowrite(sock[0], packet.data(), CHAIN_PACKET_SIZE, CHAIN_TIMEOUT);
+            }
+        });
+        for (uint32_t h = 0; h < 2; h++) {
+            threads.emplace_back([&, h] {
+                std::vector<uint8_t> buff(CHAIN_PACKET_SIZE);
+                int src = sock[2 * h + 1];
+                int dst = sock[2 * h + 2];
+                for (uint32_t p = 0; p < CHAIN_PACKETS; p++) {
+                    int32_t r;
+                    tcptoread(src, buff.data(), 8, CHAIN_TIMEOUT);
+                    r = tcptoforward(src, dst, buff.data(), CHAIN_PACKET_SIZE, 8, 0, CHAIN_TIMEOUT);
+                    assert(r == (int32_t)CHAIN_PACKET_SIZE);
+                    assert(buff[CHAIN_PACKET_SIZE - 1] == 0x5A);
+                }
+            });
+        }
+        threads.emplace_back([&] {
+            std::vector<uint8_t> buff(CHAIN_PACKET_SIZE);
+            for (uint32_t p = 0; p < CHAIN_PACKETS; p++) {
+                tcptoread(sock[5], buff.data(), CHAIN_PACKET_SIZE, CHAIN_TIMEOUT);
+            }
+        });
+        for (auto& t : threads) {
+            t.join();
+        }
+    });
+    for (uint32_t i = 0; i < 6; i++) {
+        tcpclose(sock[i]);
+    }
+}
+
+BENCHMARK(MFS_WRITE_CHAIN);
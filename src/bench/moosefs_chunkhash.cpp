@@ -0,0 +1,60 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <random.h>
+
+#include <libmoosefs/mfschunkserver/hddspacemgr.h>
+
+#include <thread>
+#include <vector>
+
+/* roughly what a well filled chunkserver keeps in memory */
+static const uint32_t HASH_CHUNKS = 1000000;
+static const uint32_t LOOKUPS_PER_THREAD = 100000;
+static const uint64_t FIRST_CHUNKID = 0x1000000;
+
+static void ChunkHashBench(benchmark::Bench& bench, uint32_t threads)
+{
+    std::vector<std::vector<uint64_t>> ids(threads);
+    FastRandomContext rng(true);
+    for (auto& v : ids) {
+        v.resize(LOOKUPS_PER_THREAD);
+        for (auto& id : v) {
+            id = FIRST_CHUNKID + rng.randrange(HASH_CHUNKS);
+        }
+    }
+    hdd_test_hash_fill(FIRST_CHUNKID, HASH_CHUNKS);
+    bench.batch(threads * LOOKUPS_PER_THREAD).unit("lookup").run([&] {
+        std::vector<std::thread> workers;
+        for (uint32_t t = 0; t < threads; t++) {
+            workers.emplace_back([&ids, t] {
+                uint32_t found = 0;
+                for (uint64_t id : ids[t]) {
+                    found += hdd_test_hash_lookup(id);
+                }
+                assert(found == LOOKUPS_PER_THREAD);
+            });
+        }
+        for (auto& w : workers) {
+            w.join();
+        }
+    });
+    hdd_test_hash_clear();
+}
+
+/* Lookup throughput with a single client thread */
+static void MFS_CHUNKHASH_LOOKUP_1THREAD(benchmark::Bench& bench)
+{
+    ChunkHashBench(bench, 1);
+}
+
+/* Lookup throughput with several threads hitting the table at once (lock striping) */
+static void MFS_CHUNKHASH_LOOKUP_8THREADS(benchmark::Bench& bench)
+{
+    ChunkHashBench(bench, 8);
+}
+
+BENCHMARK(MFS_CHUNKHASH_LOOKUP_1THREAD);
+BENCHMARK(MFS_CHUNKHASH_LOOKUP_8THREADS);
@@ -0,0 +1,64 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <random.h>
+
+#include <libmoosefs/mfscommon/crc.h>
+
+#include <vector>
+
+/* Chunkserver block size (MFSBLOCKSIZE) */
+static const uint32_t BLOCK_SIZE = 65536;
+
+static std::vector<uint8_t> RandomBlock(uint32_t size)
+{
+    FastRandomContext rng(true);
+    std::vector<uint8_t> in(size);
+    for (auto& b : in) {
+        b = rng.randbits(8);
+    }
+    return in;
+}
+
+/* Slice-by-8 table implementation */
+static void MFS_CRC32_64KB_TABLE(benchmark::Bench& bench)
+{
+    mycrc32_init();
+    std::vector<uint8_t> in = RandomBlock(BLOCK_SIZE);
+    uint32_t crc = 0;
+    bench.batch(in.size()).unit("byte").run([&] {
+        crc = mycrc32_generic(crc, in.data(), in.size());
+    });
+}
+
+/* Runtime selected implementation (pclmulqdq/vpclmulqdq/armv8-crc32 when available) */
+static void MFS_CRC32_64KB_AUTODETECT(benchmark::Bench& bench)
+{
+    mycrc32_init();
+    std::vector<uint8_t> in = RandomBlock(BLOCK_SIZE);
+    uint32_t crc = 0;
+    bench.batch(in.size()).unit("byte").run([&] {
+        crc = mycrc32(crc, in.data(), in.size());
+    });
+}
+
+/* hdd_read partial read pattern: pre, mid and post range of one block */
+static void MFS_CRC32_PARTIAL_READ(benchmark::Bench& bench)
+{
+    mycrc32_init();
+    std::vector<uint8_t> in = RandomBlock(BLOCK_SIZE);
+    const uint32_t offset = 4096, size = 32768;
+    uint32_t crc = 0;
+    bench.batch(in.size()).unit("byte").run([&] {
+        uint32_t precrc = mycrc32(0, in.data(), offset);
+        uint32_t midcrc = mycrc32(0, in.data() + offset, size);
+        uint32_t postcrc = mycrc32(0, in.data() + offset + size, BLOCK_SIZE - (offset + size));
+        crc ^= mycrc32_combine(mycrc32_combine(precrc, midcrc, size), postcrc, BLOCK_SIZE - (offset + size));
+    });
+}
+
+BENCHMARK(MFS_CRC32_64KB_TABLE);
+BENCHMARK(MFS_CRC32_64KB_AUTODETECT);
+BENCHMARK(MFS_CRC32_PARTIAL_READ);
@@ -0,0 +1,59 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <random.h>
+
+#include <libmoosefs/mfscommon/gf256.h>
+
+#include <vector>
+
+/* replicator builds one whole block (MFSBLOCKSIZE) of a Reed-Solomon part per row */
+static const uint32_t BLOCK_SIZE = 65536;
+static const uint8_t EC_DATA_PARTS = 4;
+static const uint8_t EC_PARITY_PARTS = 2;
+
+static void RSBench(benchmark::Bench& bench, bool generic)
+{
+    FastRandomContext rng(true);
+    // packet layout puts data at offset 20 - keep sources misaligned the same way
+    std::vector<std::vector<uint8_t>> parts(EC_DATA_PARTS, std::vector<uint8_t>(BLOCK_SIZE + 20));
+    std::vector<const uint8_t*> srcs;
+    for (auto& part : parts) {
+        for (auto& b : part) {
+            b = rng.randbits(8);
+        }
+        srcs.push_back(part.data() + 20);
+    }
+    std::vector<uint8_t> dst(BLOCK_SIZE + 4);
+    std::vector<uint8_t> avail{0, 1, 2, 3};
+    uint8_t coefs[EC_DATA_PARTS];
+    gf256_init();
+    // second parity part - every coefficient is a real multiplication
+    bool ok = gf256_rs_coefs(EC_DATA_PARTS, EC_PARITY_PARTS, avail.data(), EC_DATA_PARTS + 1, coefs) == 0;
+    assert(ok);
+    (void)ok;
+    bench.batch(BLOCK_SIZE * EC_DATA_PARTS).unit("byte").run([&] {
+        if (generic) {
+            gf256_region_generic(dst.data() + 4, srcs.data(), coefs, EC_DATA_PARTS, BLOCK_SIZE);
+        } else {
+            gf256_region(dst.data() + 4, srcs.data(), coefs, EC_DATA_PARTS, BLOCK_SIZE);
+        }
+    });
+}
+
+/* Portable multiplication table implementation */
+static void MFS_RS_4P2_PARITY_GENERIC(benchmark::Bench& bench)
+{
+    RSBench(bench, true);
+}
+
+/* Runtime selected implementation (avx2/neon when available) */
+static void MFS_RS_4P2_PARITY_AUTODETECT(benchmark::Bench& bench)
+{
+    RSBench(bench, false);
+}
+
+BENCHMARK(MFS_RS_4P2_PARITY_GENERIC);
+BENCHMARK(MFS_RS_4P2_PARITY_AUTODETECT);
@@ -0,0 +1,781 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/*
+ * Loopback load generator for libmoosefs. The chunkserver runs inside this process on temporary folders and
+ * registers with a mock master (register, create, chunkop, replicate). Client threads issue CLTOCS_READ and
+ * CLTOCS_WRITE against csserv/mainserv, replications are served by a mock source chunkserver with synthetic
+ * data. At the end throughput and latency percentiles of every operation type are reported.
+ * Built only with --enable-moosefs-loadgen, which also lets the chunkserver accept a master on 127.0.0.1.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config/dash-config.h>
+#endif
+
+#if !defined(ENABLE_MOOSEFS_LOADGEN)
+#error "chunkserver refuses a loopback master - configure with --enable-moosefs-loadgen"
+#endif
+
+#include <libmoosefs/mfscommon/MFSCommunication.h>
+#include <libmoosefs/mfscommon/clocks.h>
+#include <libmoosefs/mfscommon/crc.h>
+#include <libmoosefs/mfscommon/datapack.h>
+#include <libmoosefs/mfscommon/mainthread.h>
+#include <libmoosefs/mfscommon/mfsstrerr.h>
+#include <libmoosefs/mfscommon/portable.h>
+#include <libmoosefs/mfscommon/sockets.h>
+#include <libmoosefs/mfschunkserver/hddspacemgr.h>
+#include <libmoosefs/mfsnode/init.h>
+
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+static const uint32_t LOOPBACK_IP = 0x7F000001;
+static const uint32_t IO_TIMEOUT = 30000;
+static const uint32_t REGISTER_TIMEOUT = 60;
+static const uint32_t EXIT_TIMEOUT = 30;
+static const uint64_t REPLICA_CHUNKID_BASE = UINT64_C(0x100000000);
+
+enum { OP_READ, OP_WRITE, OP_REPLICATE, OP_COUNT };
+static const char* const opname[OP_COUNT] = { "read", "write", "replicate" };
+
+struct loadgen_config {
+    std::string dir = "/tmp";
+    uint32_t threads = 8;
+    uint32_t seconds = 10;
+    uint32_t chunks = 32;
+    uint32_t chunkblocks = 128; // filled blocks of every chunk (and blocks of replicated chunks)
+    uint32_t opblocks = 16;
+    uint32_t weight[OP_COUNT] = { 70, 30, 0 };
+    bool keep = false;
+    bool verbose = false;
+};
+
+struct op_stats {
+    uint64_t ops = 0;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    std::vector<uint32_t> latusec;
+};
+
+static loadgen_config cfg;
+static uint16_t csport;
+static uint16_t srcport;
+static std::atomic<bool> stopping(false);
+static std::atomic<uint64_t> nextreplica(REPLICA_CHUNKID_BASE);
+
+/* block of synthetic data (with crc) used by writes and mock source */
+static uint8_t patternblock[MFSBLOCKSIZE];
+static uint32_t patterncrc;
+
+/* ---------------------------------------------------------------- packets */
+
+static bool send_packet(int sock, uint32_t type, const uint8_t* data, uint32_t leng)
+{
+    std::vector<uint8_t> packet(8 + leng);
+    uint8_t* wptr = packet.data();
+    put32bit(&wptr, type);
+    put32bit(&wptr, leng);
+    if (leng > 0) {
+        memcpy(wptr, data, leng);
+    }
+    return tcptowrite(sock, packet.data(), 8 + leng, IO_TIMEOUT) == (int32_t)(8 + leng);
+}
+
+static bool recv_packet(int sock, uint32_t& type, std::vector<uint8_t>& data, uint32_t msecto)
+{
+    uint8_t hdr[8];
+    const uint8_t* rptr = hdr;
+    uint32_t leng;
+
+    if (tcptoread(sock, hdr, 8, msecto) != 8) {
+        return false;
+    }
+    type = get32bit(&rptr);
+    leng = get32bit(&rptr);
+    if (leng > CSTOMA_MAXPACKETSIZE) {
+        return false;
+    }
+    data.resize(leng);
+    return leng == 0 || tcptoread(sock, data.data(), leng, msecto) == (int32_t)leng;
+}
+
+static int connect_loopback(uint16_t port)
+{
+    int sock = tcpsocket();
+    if (sock < 0) {
+        return -1;
+    }
+    tcpnonblock(sock);
+    tcpnodelay(sock);
+    if (tcpnumtoconnect(sock, LOOPBACK_IP, port, IO_TIMEOUT) < 0) {
+        tcpclose(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static int listen_loopback(uint16_t& port)
+{
+    int sock = tcpsocket();
+    if (sock < 0) {
+        return -1;
+    }
+    tcpnonblock(sock);
+    tcpreuseaddr(sock);
+    if (tcpnumlisten(sock, LOOPBACK_IP, 0, 100) < 0 || tcpgetmyaddr(sock, NULL, &port) < 0) {
+        tcpclose(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* ---------------------------------------------------------------- mock master */
+
+static int mastersock = -1;
+static std::mutex masterwlock;
+static std::mutex masterlock;
+static std::condition_variable mastercond;
+static std::map<uint64_t, uint8_t> masterreplies; // chunkid -> status of finished master command
+static bool masterregistered = false;
+static bool masterclosed = false;
+
+static void master_ack(void)
+{
+    uint8_t ack[9];
+    uint8_t* wptr = ack;
+    put8bit(&wptr, 0);
+    put32bit(&wptr, get_node_version());
+    put16bit(&wptr, 10); // timeout
+    put16bit(&wptr, 1); // csid
+    std::lock_guard<std::mutex> lock(masterwlock);
+    send_packet(mastersock, MATOCS_MASTER_ACK, ack, sizeof(ack));
+}
+
+static void master_reply(uint64_t chunkid, uint8_t status)
+{
+    std::lock_guard<std::mutex> lock(masterlock);
+    masterreplies[chunkid] = status;
+    mastercond.notify_all();
+}
+
+static void master_serve(int lsock)
+{
+    std::vector<uint8_t> data;
+    const uint8_t* rptr;
+    struct pollfd pfd;
+    uint32_t type;
+    uint64_t chunkid;
+    double lastnop;
+
+    mastersock = tcptoaccept(lsock, REGISTER_TIMEOUT * 1000);
+    tcpclose(lsock);
+    if (mastersock >= 0) {
+        tcpnonblock(mastersock);
+        tcpnodelay(mastersock);
+        lastnop = monotonic_seconds();
+        while (1) {
+            if (lastnop + 1.0 < monotonic_seconds()) {
+                std::lock_guard<std::mutex> lock(masterwlock);
+                send_packet(mastersock, ANTOAN_NOP, NULL, 0);
+                lastnop = monotonic_seconds();
+            }
+            pfd.fd = mastersock;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if (poll(&pfd, 1, 250) <= 0) {
+                continue;
+            }
+            if (!recv_packet(mastersock, type, data, IO_TIMEOUT)) {
+                break;
+            }
+            rptr = data.data();
+            switch (type) {
+            case CSTOMA_REGISTER:
+                if (data.size() >= 1 && (data[0] == 60 || data[0] == 61)) {
+                    master_ack();
+                } else if (data.size() == 1 && data[0] == 62) {
+                    std::lock_guard<std::mutex> lock(masterlock);
+                    masterregistered = true;
+                    mastercond.notify_all();
+                }
+                break;
+            case CSTOMA_CREATE:
+            case CSTOMA_DELETE:
+                if (data.size() == 8 + 1) {
+                    chunkid = get64bit(&rptr);
+                    master_reply(chunkid, data[8]);
+                }
+                break;
+            case CSTOMA_REPLICATE:
+                if (data.size() == 8 + 4 + 1) {
+                    chunkid = get64bit(&rptr);
+                    master_reply(chunkid, data[12]);
+                }
+                break;
+            case CSTOMA_CHUNKOP:
+                if (data.size() == 8 + 4 + 4 + 8 + 4 + 4 + 1) {
+                    chunkid = get64bit(&rptr);
+                    master_reply(chunkid, data[32]);
+                }
+                break;
+            default: // load, space and chunk state reports
+                break;
+            }
+        }
+        tcpclose(mastersock);
+    }
+    std::lock_guard<std::mutex> lock(masterlock);
+    masterclosed = true;
+    mastercond.notify_all();
+}
+
+static bool master_wait_registered(void)
+{
+    std::unique_lock<std::mutex> lock(masterlock);
+    mastercond.wait_for(lock, std::chrono::seconds(REGISTER_TIMEOUT), [] { return masterregistered || masterclosed; });
+    return masterregistered && !masterclosed;
+}
+
+/* sends command concerning chunkid and waits for its status */
+static uint8_t master_command(uint32_t type, const uint8_t* data, uint32_t leng, uint64_t chunkid)
+{
+    {
+        std::lock_guard<std::mutex> lock(masterwlock);
+        if (!send_packet(mastersock, type, data, leng)) {
+            return MFS_ERROR_DISCONNECTED;
+        }
+    }
+    std::unique_lock<std::mutex> lock(masterlock);
+    if (!mastercond.wait_for(lock, std::chrono::milliseconds(IO_TIMEOUT), [chunkid] { return masterreplies.count(chunkid) > 0 || masterclosed; })) {
+        return MFS_ERROR_DISCONNECTED;
+    }
+    auto it = masterreplies.find(chunkid);
+    if (it == masterreplies.end()) {
+        return MFS_ERROR_DISCONNECTED;
+    }
+    uint8_t status = it->second;
+    masterreplies.erase(it);
+    return status;
+}
+
+static uint8_t master_create(uint64_t chunkid, uint32_t version)
+{
+    uint8_t buff[8 + 4];
+    uint8_t* wptr = buff;
+    put64bit(&wptr, chunkid);
+    put32bit(&wptr, version);
+    return master_command(MATOCS_CREATE, buff, sizeof(buff), chunkid);
+}
+
+static uint8_t master_chunkop_delete(uint64_t chunkid, uint32_t version)
+{
+    uint8_t buff[8 + 4 + 4 + 8 + 4 + 4];
+    uint8_t* wptr = buff;
+    put64bit(&wptr, chunkid);
+    put32bit(&wptr, version);
+    put32bit(&wptr, 0); // newversion
+    put64bit(&wptr, 0); // copychunkid
+    put32bit(&wptr, 0); // copyversion
+    put32bit(&wptr, 0); // length - delete
+    return master_command(MATOCS_CHUNKOP, buff, sizeof(buff), chunkid);
+}
+
+static uint8_t master_replicate(uint64_t chunkid, uint32_t version, uint32_t ip, uint16_t port)
+{
+    uint8_t buff[8 + 4 + 4 + 2];
+    uint8_t* wptr = buff;
+    put64bit(&wptr, chunkid);
+    put32bit(&wptr, version);
+    put32bit(&wptr, ip);
+    put16bit(&wptr, port);
+    return master_command(MATOCS_REPLICATE, buff, sizeof(buff), chunkid);
+}
+
+/* ---------------------------------------------------------------- mock source chunkserver */
+
+static void source_connection(int sock)
+{
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> packet(8 + 20 + MFSBLOCKSIZE);
+    const uint8_t* rptr;
+    uint8_t* wptr;
+    uint8_t reply[8 + 4 + 2 + 1];
+    uint32_t type, version, offset, size, b;
+    uint64_t chunkid;
+
+    tcpnonblock(sock);
+    tcpnodelay(sock);
+    while (!stopping && recv_packet(sock, type, data, IO_TIMEOUT)) {
+        rptr = data.data();
+        if (type == ANTOCS_GET_CHUNK_BLOCKS && data.size() == 12) {
+            chunkid = get64bit(&rptr);
+            version = get32bit(&rptr);
+            wptr = reply;
+            put64bit(&wptr, chunkid);
+            put32bit(&wptr, version);
+            put16bit(&wptr, cfg.chunkblocks);
+            put8bit(&wptr, MFS_STATUS_OK);
+            if (!send_packet(sock, CSTOAN_CHUNK_BLOCKS, reply, sizeof(reply))) {
+                break;
+            }
+        } else if (type == CLTOCS_READ && (data.size() == 20 || data.size() == 21)) {
+            if (data.size() == 21) {
+                rptr++;
+            }
+            chunkid = get64bit(&rptr);
+            version = get32bit(&rptr);
+            offset = get32bit(&rptr);
+            size = get32bit(&rptr);
+            for (b = offset >> MFSBLOCKBITS; b < ((offset + size) >> MFSBLOCKBITS); b++) {
+                wptr = packet.data();
+                put32bit(&wptr, CSTOCL_READ_DATA);
+                put32bit(&wptr, 20 + MFSBLOCKSIZE);
+                put64bit(&wptr, chunkid);
+                put16bit(&wptr, b);
+                put16bit(&wptr, 0);
+                put32bit(&wptr, MFSBLOCKSIZE);
+                put32bit(&wptr, patterncrc);
+                memcpy(wptr, patternblock, MFSBLOCKSIZE);
+                if (tcptowrite(sock, packet.data(), packet.size(), IO_TIMEOUT) != (int32_t)packet.size()) {
+                    break;
+                }
+            }
+            wptr = reply;
+            put64bit(&wptr, chunkid);
+            put8bit(&wptr, MFS_STATUS_OK);
+            if (!send_packet(sock, CSTOCL_READ_STATUS, reply, 8 + 1)) {
+                break;
+            }
+        } else if (type != ANTOAN_NOP) {
+            break;
+        }
+    }
+    tcpclose(sock);
+}
+
+static void source_serve(int lsock)
+{
+    int sock;
+    while (!stopping) {
+        sock = tcptoaccept(lsock, 250);
+        if (sock >= 0) {
+            std::thread(source_connection, sock).detach();
+        }
+    }
+    tcpclose(lsock);
+}
+
+/* ---------------------------------------------------------------- client */
+
+static uint8_t client_read(int sock, uint64_t chunkid, uint32_t version, uint32_t blocknum, uint32_t blocks, std::vector<uint8_t>& data)
+{
+    uint8_t buff[8 + 4 + 4 + 4];
+    uint8_t* wptr = buff;
+    const uint8_t* rptr;
+    uint32_t type, size, crc;
+
+    put64bit(&wptr, chunkid);
+    put32bit(&wptr, version);
+    put32bit(&wptr, blocknum << MFSBLOCKBITS);
+    put32bit(&wptr, blocks << MFSBLOCKBITS);
+    if (!send_packet(sock, CLTOCS_READ, buff, sizeof(buff))) {
+        return MFS_ERROR_DISCONNECTED;
+    }
+    while (1) {
+        if (!recv_packet(sock, type, data, IO_TIMEOUT)) {
+            return MFS_ERROR_DISCONNECTED;
+        }
+        rptr = data.data();
+        if (type == CSTOCL_READ_STATUS && data.size() == 9) {
+            return data[8];
+        }
+        if (type != CSTOCL_READ_DATA || data.size() < 20) {
+            return MFS_ERROR_DISCONNECTED;
+        }
+        rptr += 8 + 2 + 2;
+        size = get32bit(&rptr);
+        crc = get32bit(&rptr);
+        if (data.size() != 20 + size || crc != mycrc32(0, rptr, size)) {
+            return MFS_ERROR_CRC;
+        }
+    }
+}
+
+static uint8_t client_write(int sock, uint64_t chunkid, uint32_t version, uint32_t blocknum, uint32_t blocks, std::vector<uint8_t>& packet)
+{
+    uint8_t buff[8 + 4];
+    uint8_t* wptr;
+    std::vector<uint8_t> data;
+    uint32_t type, b;
+
+    wptr = buff;
+    put64bit(&wptr, chunkid);
+    put32bit(&wptr, version);
+    if (!send_packet(sock, CLTOCS_WRITE, buff, sizeof(buff))) {
+        return MFS_ERROR_DISCONNECTED;
+    }
+    if (!recv_packet(sock, type, data, IO_TIMEOUT) || type != CSTOCL_WRITE_STATUS || data.size() != 13) {
+        return MFS_ERROR_DISCONNECTED;
+    }
+    if (data[12] != MFS_STATUS_OK) {
+        return data[12];
+    }
+    // whole blocks are pipelined - every one is acknowledged separately
+    for (b = 0; b < blocks; b++) {
+        wptr = packet.data();
+        put32bit(&wptr, CLTOCS_WRITE_DATA);
+        put32bit(&wptr, 8 + 4 + 2 + 2 + 4 + 4 + MFSBLOCKSIZE);
+        put64bit(&wptr, chunkid);
+        put32bit(&wptr, b + 1);
+        put16bit(&wptr, blocknum + b);
+        put16bit(&wptr, 0);
+        put32bit(&wptr, MFSBLOCKSIZE);
+        put32bit(&wptr, patterncrc);
+        if (tcptowrite(sock, packet.data(), packet.size(), IO_TIMEOUT) != (int32_t)packet.size()) {
+            return MFS_ERROR_DISCONNECTED;
+        }
+    }
+    for (b = 0; b < blocks; b++) {
+        if (!recv_packet(sock, type, data, IO_TIMEOUT) || type != CSTOCL_WRITE_STATUS || data.size() != 13) {
+            return MFS_ERROR_DISCONNECTED;
+        }
+        if (data[12] != MFS_STATUS_OK) {
+            return data[12];
+        }
+    }
+    wptr = buff;
+    put64bit(&wptr, chunkid);
+    put32bit(&wptr, version);
+    return send_packet(sock, CLTOCS_WRITE_FINISH, buff, sizeof(buff)) ? MFS_STATUS_OK : MFS_ERROR_DISCONNECTED;
+}
+
+static std::vector<uint8_t> write_packet(void)
+{
+    std::vector<uint8_t> packet(8 + 8 + 4 + 2 + 2 + 4 + 4 + MFSBLOCKSIZE);
+    memcpy(packet.data() + packet.size() - MFSBLOCKSIZE, patternblock, MFSBLOCKSIZE);
+    return packet;
+}
+
+/* writes blocks of chunks first, first+step, ... so reads never hit holes */
+static void client_prefill(uint32_t first, uint32_t step, std::atomic<uint32_t>& errors)
+{
+    std::vector<uint8_t> packet = write_packet();
+    uint32_t c, b, cnt;
+    int sock = -1;
+
+    for (c = first; c < cfg.chunks; c += step) {
+        for (b = 0; b < cfg.chunkblocks; b += cnt) {
+            cnt = std::min(cfg.opblocks, cfg.chunkblocks - b);
+            if (sock < 0) {
+                sock = connect_loopback(csport);
+            }
+            if (sock < 0 || client_write(sock, c + 1, 1, b, cnt, packet) != MFS_STATUS_OK) {
+                errors++;
+                if (sock >= 0) {
+                    tcpclose(sock);
+                    sock = -1;
+                }
+            }
+        }
+    }
+    if (sock >= 0) {
+        tcpclose(sock);
+    }
+}
+
+static void client_run(uint32_t id, double deadline, op_stats* stats)
+{
+    std::mt19937 rng(id * 7919 + 1);
+    std::vector<uint8_t> packet = write_packet();
+    std::vector<uint8_t> data;
+    uint32_t wsum, r, op, chunk, blocknum, blocks;
+    uint64_t start, chunkid;
+    uint8_t status;
+    int sock = -1;
+
+    wsum = cfg.weight[OP_READ] + cfg.weight[OP_WRITE] + cfg.weight[OP_REPLICATE];
+    blocks = std::min(cfg.opblocks, cfg.chunkblocks);
+    while (monotonic_seconds() < deadline) {
+        r = rng() % wsum;
+        for (op = 0; op < OP_COUNT - 1 && r >= cfg.weight[op]; op++) {
+            r -= cfg.weight[op];
+        }
+        chunk = rng() % cfg.chunks;
+        blocknum = ((rng() % (cfg.chunkblocks - blocks + 1)) / blocks) * blocks;
+        if (op != OP_REPLICATE && sock < 0) {
+            sock = connect_loopback(csport);
+            if (sock < 0) {
+                stats[op].errors++;
+                continue;
+            }
+        }
+        start = monotonic_useconds();
+        if (op == OP_READ) {
+            status = client_read(sock, chunk + 1, 1, blocknum, blocks, data);
+        } else if (op == OP_WRITE) {
+            status = client_write(sock, chunk + 1, 1, blocknum, blocks, packet);
+        } else {
+            chunkid = nextreplica++;
+            status = master_replicate(chunkid, 1, LOOPBACK_IP, srcport);
+        }
+        uint64_t lat = monotonic_useconds() - start;
+        if (status != MFS_STATUS_OK) {
+            stats[op].errors++;
+            if (sock >= 0 && op != OP_REPLICATE) {
+                tcpclose(sock);
+                sock = -1;
+            }
+            continue;
+        }
+        stats[op].ops++;
+        stats[op].bytes += (uint64_t)(op == OP_REPLICATE ? cfg.chunkblocks : blocks) << MFSBLOCKBITS;
+        stats[op].latusec.push_back(lat > UINT32_MAX ? UINT32_MAX : (uint32_t)lat);
+        if (op == OP_REPLICATE) {
+            master_chunkop_delete(chunkid, 1); // keep used space constant - not measured
+        }
+    }
+    if (sock >= 0) {
+        tcpclose(sock);
+    }
+}
+
+/* ---------------------------------------------------------------- driver */
+
+static uint32_t percentile(const std::vector<uint32_t>& sorted, double q)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t i = (size_t)(q * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+static void report(const std::vector<op_stats>& perthread, double elapsed)
+{
+    printf("%-10s %10s %8s %10s %10s %9s %9s %9s %9s %9s\n", "op", "ops", "errors", "ops/s", "MiB/s", "p50us", "p90us", "p99us", "p999us", "maxus");
+    for (uint32_t op = 0; op < OP_COUNT; op++) {
+        op_stats total;
+        for (uint32_t t = op; t < perthread.size(); t += OP_COUNT) {
+            total.ops += perthread[t].ops;
+            total.errors += perthread[t].errors;
+            total.bytes += perthread[t].bytes;
+            total.latusec.insert(total.latusec.end(), perthread[t].latusec.begin(), perthread[t].latusec.end());
+        }
+        if (total.ops == 0 && total.errors == 0) {
+            continue;
+        }
+        std::sort(total.latusec.begin(), total.latusec.end());
+        printf("%-10s %10" PRIu64 " %8" PRIu64 " %10.1f %10.1f %9" PRIu32 " %9" PRIu32 " %9" PRIu32 " %9" PRIu32 " %9" PRIu32 "\n",
+            opname[op], total.ops, total.errors, total.ops / elapsed, total.bytes / elapsed / (1024.0 * 1024.0),
+            percentile(total.latusec, 0.50), percentile(total.latusec, 0.90), percentile(total.latusec, 0.99), percentile(total.latusec, 0.999),
+            total.latusec.empty() ? 0 : total.latusec.back());
+    }
+}
+
+static int remove_entry(const char* path, const struct stat*, int, struct FTW*)
+{
+    return remove(path);
+}
+
+static void usage(const char* appname)
+{
+    fprintf(stderr,
+        "usage: %s [-d dir] [-t threads] [-s seconds] [-c chunks] [-f blocks] [-b blocks] [-m read:write:replicate] [-k] [-v]\n"
+        "\n"
+        "-d dir: parent of temporary chunkserver folder (default: /tmp)\n"
+        "-t threads: number of client threads (default: 8)\n"
+        "-s seconds: duration of measured phase (default: 10)\n"
+        "-c chunks: number of chunks used by reads and writes (default: 32)\n"
+        "-f blocks: 64KiB blocks written to every chunk before the test and blocks of replicated chunks (default: 128)\n"
+        "-b blocks: 64KiB blocks per read/write operation (default: 16)\n"
+        "-m r:w:p: weights of reads, writes and replications (default: 70:30:0)\n"
+        "-k: keep temporary folder\n"
+        "-v: show chunkserver log\n",
+        appname);
+}
+
+int main(int argc, char** argv)
+{
+    char tmpl[PATH_MAX];
+    char* base;
+    int ch, lsock, msock, ssock;
+    uint16_t mport;
+
+    while ((ch = getopt(argc, argv, "d:t:s:c:f:b:m:kvh")) != -1) {
+        switch (ch) {
+        case 'd':
+            cfg.dir = optarg;
+            break;
+        case 't':
+            cfg.threads = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            cfg.seconds = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            cfg.chunks = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            cfg.chunkblocks = strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            cfg.opblocks = strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            if (sscanf(optarg, "%" SCNu32 ":%" SCNu32 ":%" SCNu32, cfg.weight + OP_READ, cfg.weight + OP_WRITE, cfg.weight + OP_REPLICATE) != 3) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'k':
+            cfg.keep = true;
+            break;
+        case 'v':
+            cfg.verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.threads == 0 || cfg.chunks == 0 || cfg.opblocks == 0 || cfg.chunkblocks == 0 || cfg.chunkblocks > MFSBLOCKSINCHUNK || cfg.weight[OP_READ] + cfg.weight[OP_WRITE] + cfg.weight[OP_REPLICATE] == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    base = realpath(cfg.dir.c_str(), NULL);
+    if (base == NULL) {
+        fprintf(stderr, "can't resolve %s: %s\n", cfg.dir.c_str(), strerror(errno));
+        return 1;
+    }
+    snprintf(tmpl, sizeof(tmpl), "%s/moosefs_loadgen.XXXXXX", base);
+    free(base);
+    if (mkdtemp(tmpl) == NULL) {
+        fprintf(stderr, "can't create temporary folder: %s\n", strerror(errno));
+        return 1;
+    }
+
+    mycrc32_init();
+    std::mt19937 rng(12345);
+    for (uint32_t i = 0; i < MFSBLOCKSIZE; i++) {
+        patternblock[i] = rng();
+    }
+    patterncrc = mycrc32(0, patternblock, MFSBLOCKSIZE);
+
+    // free port for csserv (it has to be known before chunkserver registers)
+    lsock = listen_loopback(csport);
+    msock = listen_loopback(mport);
+    ssock = listen_loopback(srcport);
+    if (lsock < 0 || msock < 0 || ssock < 0) {
+        fprintf(stderr, "can't listen on loopback: %s\n", strerror(errno));
+        return 1;
+    }
+    tcpclose(lsock);
+
+    node_info.masterhost.push_back("127.0.0.1");
+    snprintf(node_info.masterport, sizeof(node_info.masterport), "%" PRIu16, mport);
+    snprintf(node_info.bindhost, sizeof(node_info.bindhost), "*");
+    snprintf(node_info.listenhost, sizeof(node_info.listenhost), "127.0.0.1");
+    snprintf(node_info.listenport, sizeof(node_info.listenport), "%" PRIu16, csport);
+    snprintf(node_info.syslogident, sizeof(node_info.syslogident), "moosefs_loadgen");
+    snprintf(node_info.basepath, sizeof(node_info.basepath), "%s", tmpl);
+    snprintf(node_info.datapath, sizeof(node_info.datapath), "%s/data", tmpl);
+    snprintf(node_info.chunkpath, sizeof(node_info.chunkpath), "%s/chunks", tmpl);
+    if (mkdir(node_info.datapath, 0700) < 0 || mkdir(node_info.chunkpath, 0700) < 0) {
+        fprintf(stderr, "can't create folders in %s: %s\n", tmpl, strerror(errno));
+        return 1;
+    }
+    if (!cfg.verbose) {
+        setlogmask(LOG_UPTO(LOG_WARNING));
+    }
+
+    printf("chunkserver folder: %s\n", tmpl);
+    std::atomic<bool> csfinished(false);
+    std::thread(master_serve, msock).detach();
+    std::thread(source_serve, ssock).detach();
+    std::thread([&csfinished] {
+        mfschunkserver();
+        csfinished = true;
+    }).detach();
+
+    int ret = 1;
+    if (!master_wait_registered()) {
+        fprintf(stderr, "chunkserver didn't register with mock master\n");
+    } else {
+        uint8_t status = MFS_STATUS_OK;
+        for (uint32_t c = 0; c < cfg.chunks && status == MFS_STATUS_OK; c++) {
+            // folders may still be scanned - retry for a while
+            for (uint32_t retry = 0; retry < 100; retry++) {
+                status = master_create(c + 1, 1);
+                if (status == MFS_STATUS_OK || status == MFS_ERROR_DISCONNECTED) {
+                    break;
+                }
+                portable_usleep(100000);
+            }
+        }
+        if (status != MFS_STATUS_OK) {
+            fprintf(stderr, "can't create chunks: %s\n", mfsstrerr(status));
+        } else {
+            std::vector<std::thread> threads;
+            std::atomic<uint32_t> errors(0);
+            double start = monotonic_seconds();
+            for (uint32_t t = 0; t < cfg.threads; t++) {
+                threads.emplace_back(client_prefill, t, cfg.threads, std::ref(errors));
+            }
+            for (auto& th : threads) {
+                th.join();
+            }
+            threads.clear();
+            double elapsed = monotonic_seconds() - start;
+            printf("prefill: %" PRIu32 " chunks x %" PRIu32 " blocks in %.2fs (%.1f MiB/s), errors: %" PRIu32 "\n", cfg.chunks, cfg.chunkblocks, elapsed,
+                ((double)cfg.chunks * cfg.chunkblocks * MFSBLOCKSIZE) / elapsed / (1024.0 * 1024.0), errors.load());
+
+            std::vector<op_stats> stats(cfg.threads * OP_COUNT);
+            start = monotonic_seconds();
+            for (uint32_t t = 0; t < cfg.threads; t++) {
+                threads.emplace_back(client_run, t, start + cfg.seconds, stats.data() + t * OP_COUNT);
+            }
+            for (auto& th : threads) {
+                th.join();
+            }
+            elapsed = monotonic_seconds() - start;
+            printf("threads: %" PRIu32 " ; block size: %u ; blocks per op: %" PRIu32 " ; mix (r:w:p): %" PRIu32 ":%" PRIu32 ":%" PRIu32 " ; time: %.2fs\n", cfg.threads, MFSBLOCKSIZE, cfg.opblocks,
+                cfg.weight[OP_READ], cfg.weight[OP_WRITE], cfg.weight[OP_REPLICATE], elapsed);
+            report(stats, elapsed);
+            ret = 0;
+        }
+    }
+
+    stopping = true;
+    main_exit();
+    for (uint32_t i = 0; i < EXIT_TIMEOUT * 10 && !csfinished; i++) {
+        portable_usleep(100000);
+    }
+    if (!csfinished) {
+        fprintf(stderr, "chunkserver didn't exit in %" PRIu32 " seconds\n", EXIT_TIMEOUT);
+        _exit(ret ? ret : 2);
+    }
+    if (!cfg.keep) {
+        nftw(tmpl, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+    return ret;
+}
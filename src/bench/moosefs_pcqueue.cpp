@@ -0,0 +1,85 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <libmoosefs/mfscommon/pcqueue.h>
+
+#include <assert.h>
+
+#include <thread>
+#include <vector>
+
+static const uint32_t QUEUE_ITEMS = 100000;
+
+/* job queue pattern - several submitting threads, several workers; throughput in elements */
+static void QueueContention(benchmark::Bench& bench, uint32_t producers, uint32_t consumers)
+{
+    void* q = queue_new(0);
+    bench.batch(QUEUE_ITEMS).unit("element").run([&] {
+        std::vector<std::thread> threads;
+        for (uint32_t p = 0; p < producers; p++) {
+            threads.emplace_back([q, p, producers] {
+                for (uint32_t i = p; i < QUEUE_ITEMS; i += producers) {
+                    queue_put(q, i + 1, 0, NULL, 1);
+                }
+            });
+        }
+        for (uint32_t c = 0; c < consumers; c++) {
+            threads.emplace_back([q, c, consumers] {
+                uint32_t id;
+                // every consumer takes its share - total matches number of produced elements
+                for (uint32_t i = c; i < QUEUE_ITEMS; i += consumers) {
+                    queue_get(q, &id, NULL, NULL, NULL);
+                    assert(id > 0);
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+    });
+    assert(queue_isempty(q));
+    queue_delete(q);
+}
+
+static void MFS_PCQUEUE_1P_1C(benchmark::Bench& bench)
+{
+    QueueContention(bench, 1, 1);
+}
+
+static void MFS_PCQUEUE_4P_4C(benchmark::Bench& bench)
+{
+    QueueContention(bench, 4, 4);
+}
+
+/* job submission -> status return round trip (two queues, one thread on each side) */
+static void MFS_PCQUEUE_ROUNDTRIP(benchmark::Bench& bench)
+{
+    const uint32_t rounds = 10000;
+    void* jobs = queue_new(0);
+    void* status = queue_new(0);
+    std::thread worker([jobs, status] {
+        uint32_t id, op;
+        while (queue_get(jobs, &id, &op, NULL, NULL) == 0) {
+            queue_put(status, id, op, NULL, 1);
+        }
+    });
+    bench.batch(rounds).unit("roundtrip").run([&] {
+        uint32_t id;
+        for (uint32_t i = 1; i <= rounds; i++) {
+            queue_put(jobs, i, 0, NULL, 1);
+            queue_get(status, &id, NULL, NULL, NULL);
+            assert(id == i);
+        }
+    });
+    queue_close(jobs);
+    worker.join();
+    queue_delete(jobs);
+    queue_delete(status);
+}
+
+BENCHMARK(MFS_PCQUEUE_1P_1C);
+BENCHMARK(MFS_PCQUEUE_4P_4C);
+BENCHMARK(MFS_PCQUEUE_ROUNDTRIP);
@@ -0,0 +1,424 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <bench/bench.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/consensus.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <evo/evodb.h>
+#include <keystore.h>
+#include <miner.h>
+#include <pos/kernel.h>
+#include <pos/signature.h>
+#include <random.h>
+#include <script/sign.h>
+#include <storage/manager.h>
+#include <test/util.h>
+#include <tinyformat.h>
+#include <validation.h>
+
+#include <memory>
+#include <vector>
+
+static constexpr int POS_SYNC_BLOCKS = 2000;
+static constexpr int POS_SYNC_STORAGE_NODES = 16;
+static constexpr CAmount POS_SYNC_STAKE = 1000 * COIN;
+static constexpr uint32_t POS_SLOT_SPACING = nStakeTimestampMask + 1;
+
+// Compact target under which about every other kernel of nValue wins
+static uint32_t EasyStakeBits(CAmount nValue)
+{
+    const arith_uint256 bnTarget = ~arith_uint256() / nValue / 2;
+    return bnTarget.GetCompact();
+}
+
+static void AddStorageProof(CBlock& block, int nHeight, FastRandomContext& rng)
+{
+    CNetworkProof& netProof = block.netProof;
+    netProof.height = nHeight;
+    for (int n = 0; n < POS_SYNC_STORAGE_NODES; n++) {
+        StorageNode node{};
+        node.id = n;
+        node.ip = rng.rand32();
+        node.chunks = rng.randrange(100000);
+        node.space = 1024;
+        netProof.proof.nodes.push_back(node);
+    }
+    netProof.CalculateHash();
+    proofs.push_back(netProof);
+    block.nProof = netProof.hash;
+}
+
+// A synthetic chain of signed proof-of-stake blocks on top of the regtest
+// genesis. Every block carries a coinstake spending its own funding coin,
+// timed so its kernel meets the target, and a storage proof. The funding
+// coins live in a private view on top of the chain tip. The proofs are seeded
+// into the proof cache the way relayed proofs would be, since regtest has no
+// proof signing key.
+struct SyntheticPoSBlocks
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    CScript scriptPubKey;
+    uint256 hashTip;
+    CBlockIndex indexTip;
+    std::unique_ptr<CCoinsViewCache> view;
+    std::vector<CBlock> vBlocks;
+
+    SyntheticPoSBlocks()
+    {
+        FastRandomContext rng(true);
+        const CBlock& genesis = Params().GenesisBlock();
+
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+        scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+        // Deep enough for kernel maturity, stakes are checked against this tip
+        hashTip = rng.rand256();
+        indexTip.phashBlock = &hashTip;
+        indexTip.nHeight = 2 * COINBASE_MATURITY + POS_SYNC_BLOCKS;
+        indexTip.nTime = genesis.nTime + 24 * 60 * 60;
+        indexTip.nStakeModifier = rng.rand256();
+
+        const uint32_t nBits = EasyStakeBits(POS_SYNC_STAKE);
+
+        LOCK(cs_main);
+        view = MakeUnique<CCoinsViewCache>(&::ChainstateActive().CoinsTip());
+        vBlocks.resize(POS_SYNC_BLOCKS);
+        for (int i = 0; i < POS_SYNC_BLOCKS; i++) {
+            CMutableTransaction funding;
+            funding.vin.resize(1);
+            funding.vin[0].prevout = COutPoint(rng.rand256(), 0);
+            funding.vout.emplace_back(POS_SYNC_STAKE, scriptPubKey);
+            AddCoins(*view, CTransaction(funding), 0);
+
+            CMutableTransaction coinbase;
+            coinbase.vin.resize(1);
+            coinbase.vin[0].prevout.SetNull();
+            coinbase.vin[0].scriptSig = CScript() << (indexTip.nHeight + 1) << OP_0;
+            coinbase.vout.resize(1);
+            coinbase.vout[0].SetEmpty();
+
+            CMutableTransaction coinstake;
+            coinstake.vin.emplace_back(COutPoint(funding.GetHash(), 0));
+            coinstake.vout.resize(2);
+            coinstake.vout[0].SetEmpty();
+            coinstake.vout[1] = CTxOut(funding.vout[0].nValue + COIN, scriptPubKey);
+            bool fSigned = SignSignature(keystore, CTransaction(funding), coinstake, 0, SIGHASH_ALL);
+            assert(fSigned);
+
+            // The funding coin sits at height 0, so its block time is the genesis time
+            uint32_t nTime = (indexTip.nTime + POS_SLOT_SPACING) & ~nStakeTimestampMask;
+            uint256 hashProofOfStake, targetProofOfStake;
+            while (!CheckStakeKernelHash(&indexTip, nBits, genesis.nTime, POS_SYNC_STAKE, coinstake.vin[0].prevout, nTime, hashProofOfStake, targetProofOfStake)) {
+                nTime += POS_SLOT_SPACING;
+            }
+
+            CBlock& block = vBlocks[i];
+            AddStorageProof(block, indexTip.nHeight + 1 + i, rng);
+            block.nVersion = 1;
+            block.hashPrevBlock = hashTip;
+            block.nTime = nTime;
+            block.nBits = nBits;
+            block.nNonce = 0;
+            block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+            block.vtx.push_back(MakeTransactionRef(std::move(coinstake)));
+            block.hashMerkleRoot = BlockMerkleRoot(block);
+            bool fBlockSigned = SignBlockWithKey(block, key);
+            assert(fBlockSigned);
+        }
+    }
+
+    ~SyntheticPoSBlocks()
+    {
+        proofs.clear();
+    }
+};
+
+// Context free checks of a received PoS block, including the block signature
+static void PoSCheckBlock(benchmark::Bench& bench)
+{
+    SyntheticPoSBlocks pos;
+    const Consensus::Params& params = Params().GetConsensus();
+    bench.batch(POS_SYNC_BLOCKS).unit("block").run([&] {
+        for (const auto& block : pos.vBlocks) {
+            CValidationState state;
+            bool fValid = CheckBlock(block, state, params, false, true, true, false);
+            assert(fValid);
+        }
+    });
+}
+
+// Kernel lookup, coinstake script verification and kernel hash per block
+static void PoSCheckProofOfStake(benchmark::Bench& bench)
+{
+    SyntheticPoSBlocks pos;
+    const Consensus::Params& params = Params().GetConsensus();
+    LOCK(cs_main);
+    bench.batch(POS_SYNC_BLOCKS).unit("block").run([&] {
+        for (const auto& block : pos.vBlocks) {
+            CValidationState state;
+            uint256 hashProofOfStake, targetProofOfStake;
+            bool fValid = CheckProofOfStake(state, &pos.indexTip, *block.vtx[1], block.nTime, block.nBits, hashProofOfStake, targetProofOfStake, params, *pos.view);
+            assert(fValid);
+        }
+    });
+}
+
+// Storage proof acceptance as done by ConnectBlock for every PoS block
+static void PoSStorageProofValidate(benchmark::Bench& bench)
+{
+    SyntheticPoSBlocks pos;
+    bench.batch(POS_SYNC_BLOCKS).unit("block").run([&] {
+        for (const auto& block : pos.vBlocks) {
+            CNetworkProof netProof = block.netProof;
+            bool fValid = proofManager.Validate(netProof) && netProof.hash == block.nProof;
+            assert(fValid);
+        }
+    });
+}
+
+static constexpr int POS_CONNECT_BLOCKS = 200;
+
+// A regtest chain mined up to the last PoW height, whose matured coinbases
+// are staked by signed PoS blocks for the next height. The blocks are
+// connected with fJustCheck on a private view inside a rolled back evodb
+// transaction, as TestBlockValidity does, so the same height can be
+// connected over and over without touching the chain state.
+struct PoSStakeChain
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    CScript scriptPubKey;
+    std::vector<COutPoint> vCoinbase; //!< coinbase of height n at n - 1
+    CBlockIndex* pindexPrev;
+    int nHeight;
+
+    PoSStakeChain()
+    {
+        const Consensus::Params& params = Params().GetConsensus();
+
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+        scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+        while (::ChainActive().Height() < params.nLastPoWBlock) {
+            vCoinbase.push_back(MineBlock(scriptPubKey).prevout);
+        }
+
+        LOCK(cs_main);
+        pindexPrev = ::ChainActive().Tip();
+        nHeight = pindexPrev->nHeight + 1;
+    }
+
+    ~PoSStakeChain()
+    {
+        proofs.clear();
+    }
+
+    //! Coinbases deep enough to be staked at nHeight
+    int MatureCoins() const
+    {
+        return nHeight - COINBASE_MATURITY;
+    }
+
+    Coin GetCoin(const COutPoint& prevout) const EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        Coin coin;
+        bool fHaveCoin = ::ChainstateActive().CoinsTip().GetCoin(prevout, coin);
+        assert(fHaveCoin);
+        return coin;
+    }
+
+    // Signed block for nHeight staking prevout at nTime, which has to meet nBits
+    CBlock CreateBlock(const COutPoint& prevout, uint32_t nTime, uint32_t nBits, FastRandomContext& rng) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        const Coin coin = GetCoin(prevout);
+
+        CMutableTransaction coinstake;
+        coinstake.vin.emplace_back(prevout);
+        coinstake.vout.resize(2);
+        coinstake.vout[0].SetEmpty();
+        coinstake.vout[1] = CTxOut(coin.out.nValue, scriptPubKey);
+        bool fSigned = SignSignature(keystore, coin.out.scriptPubKey, coinstake, 0, coin.out.nValue, SIGHASH_ALL);
+        assert(fSigned);
+
+        CBlock block = BlockAssembler(Params()).CreateNewBlock(scriptPubKey, true)->block;
+        AddStorageProof(block, nHeight, rng);
+        block.nTime = nTime;
+        block.nBits = nBits;
+        block.vtx.insert(block.vtx.begin() + 1, MakeTransactionRef(std::move(coinstake)));
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        bool fBlockSigned = SignBlockWithKey(block, key);
+        assert(fBlockSigned);
+        return block;
+    }
+
+    // First slot at or after nTime where prevout meets nBits
+    uint32_t FindStakeTime(const COutPoint& prevout, uint32_t nBits, uint32_t nTime) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        const Coin coin = GetCoin(prevout);
+        const uint32_t nBlockFromTime = ::ChainActive()[coin.nHeight]->GetBlockTime();
+        uint256 hashProofOfStake, targetProofOfStake;
+        nTime &= ~nStakeTimestampMask;
+        while (!CheckStakeKernelHash(pindexPrev, nBits, nBlockFromTime, coin.out.nValue, prevout, nTime, hashProofOfStake, targetProofOfStake)) {
+            nTime += POS_SLOT_SPACING;
+        }
+        return nTime;
+    }
+
+    // Index entry of block for nHeight, hash is the storage its phashBlock points to
+    void MakeIndex(const CBlock& block, uint256& hash, CBlockIndex& index) const
+    {
+        hash = block.GetHash();
+        index = CBlockIndex(block);
+        index.pprev = pindexPrev;
+        index.nHeight = nHeight;
+        index.phashBlock = &hash;
+    }
+
+    bool Connect(const CBlock& block, CBlockIndex& index) const EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        CCoinsViewCache view(&::ChainstateActive().CoinsTip());
+        // begin tx and let it rollback
+        auto dbTx = evoDb->BeginTransaction();
+        CValidationState state;
+        return ::ChainstateActive().ConnectBlock(block, state, &index, view, Params(), true);
+    }
+};
+
+// Full ConnectBlock of a PoS block: kernel, storage proof, special txes,
+// coinstake inputs and scripts, block value and payee checks. Every
+// candidate stakes a different matured coinbase.
+static void PoSConnectBlock(benchmark::Bench& bench)
+{
+    PoSStakeChain chain;
+    const Consensus::Params& params = Params().GetConsensus();
+    FastRandomContext rng(true);
+    LOCK(cs_main);
+    assert(chain.MatureCoins() >= POS_CONNECT_BLOCKS);
+
+    std::vector<CBlock> vBlocks(POS_CONNECT_BLOCKS);
+    for (int i = 0; i < POS_CONNECT_BLOCKS; i++) {
+        const COutPoint& prevout = chain.vCoinbase[i];
+        const Coin coin = chain.GetCoin(prevout);
+        const uint32_t nBits = EasyStakeBits(coin.out.nValue);
+        const uint32_t nBlockFromTime = ::ChainActive()[coin.nHeight]->GetBlockTime();
+        const uint32_t nTime = chain.FindStakeTime(prevout, nBits, nBlockFromTime + params.nStakeMinAge + POS_SLOT_SPACING);
+        vBlocks[i] = chain.CreateBlock(prevout, nTime, nBits, rng);
+    }
+
+    // Hashes first, the indexes point into them
+    std::vector<uint256> vHashes(POS_CONNECT_BLOCKS);
+    std::vector<CBlockIndex> vIndex(POS_CONNECT_BLOCKS);
+    for (int i = 0; i < POS_CONNECT_BLOCKS; i++) {
+        chain.MakeIndex(vBlocks[i], vHashes[i], vIndex[i]);
+    }
+
+    bench.batch(POS_CONNECT_BLOCKS).unit("block").run([&] {
+        for (int i = 0; i < POS_CONNECT_BLOCKS; i++) {
+            bool fValid = chain.Connect(vBlocks[i], vIndex[i]);
+            assert(fValid);
+        }
+    });
+}
+
+static constexpr int POS_STAKERS = 16;
+static constexpr int POS_COINS_PER_STAKER = 32;
+static constexpr int POS_RACE_SLOTS = 64;
+static constexpr int POS_RACE_SLOTS_PER_BLOCK = 4;
+
+// Many stakers racing for the next height within a single process. Each
+// slot every staker tries its matured coinbases with the real kernel code,
+// and every staker that wins publishes a signed block, which is connected
+// the way each node would. The first block of a slot counts as the block
+// for that slot, further winners are orphans. Connected blocks are not made
+// active, so all slots race on the same tip. Mean block interval and orphan
+// rate of the race are reported in the benchmark name.
+static void PoSStakerRace(benchmark::Bench& bench)
+{
+    struct Published {
+        CBlock block;
+        uint256 hash;
+        CBlockIndex index;
+    };
+
+    PoSStakeChain chain;
+    const Consensus::Params& params = Params().GetConsensus();
+    FastRandomContext rng(true);
+    LOCK(cs_main);
+
+    // The newest matured coinbases, all of the same value, dealt out to the stakers
+    const int nCoins = POS_STAKERS * POS_COINS_PER_STAKER;
+    assert(chain.MatureCoins() >= nCoins);
+    std::vector<std::vector<COutPoint>> vStakers(POS_STAKERS);
+    for (int i = 0; i < nCoins; i++) {
+        vStakers[i % POS_STAKERS].push_back(chain.vCoinbase[chain.MatureCoins() - nCoins + i]);
+    }
+    const Coin coinFirst = chain.GetCoin(vStakers[0][0]);
+    const Coin coinLast = chain.GetCoin(vStakers.back().back());
+    assert(coinFirst.out.nValue == coinLast.out.nValue);
+
+    // About one slot in POS_RACE_SLOTS_PER_BLOCK has a winner
+    const uint32_t nBits = arith_uint256(~arith_uint256() / coinFirst.out.nValue / nCoins / POS_RACE_SLOTS_PER_BLOCK).GetCompact();
+    const uint32_t nStartTime = (::ChainActive()[coinLast.nHeight]->GetBlockTime() + params.nStakeMinAge) & ~nStakeTimestampMask;
+
+    // Kernel search of every staker over all slots, stakers publish at most one block per slot
+    auto race = [&](const std::function<void(int slot, int staker, const COutPoint& prevout, uint32_t nTime)>& publish) {
+        for (int slot = 0; slot < POS_RACE_SLOTS; slot++) {
+            const uint32_t nTime = nStartTime + (slot + 1) * POS_SLOT_SPACING;
+            for (int staker = 0; staker < POS_STAKERS; staker++) {
+                for (const auto& prevout : vStakers[staker]) {
+                    const Coin coin = chain.GetCoin(prevout);
+                    const uint32_t nBlockFromTime = ::ChainActive()[coin.nHeight]->GetBlockTime();
+                    uint256 hashProofOfStake, targetProofOfStake;
+                    if (CheckStakeKernelHash(chain.pindexPrev, nBits, nBlockFromTime, coin.out.nValue, prevout, nTime, hashProofOfStake, targetProofOfStake)) {
+                        publish(slot, staker, prevout, nTime);
+                        break;
+                    }
+                }
+            }
+        }
+    };
+
+    // Untimed first pass creates the published blocks
+    std::vector<std::unique_ptr<Published>> vPublished;
+    std::vector<int> vSlotWinners(POS_RACE_SLOTS);
+    race([&](int slot, int staker, const COutPoint& prevout, uint32_t nTime) {
+        vPublished.push_back(MakeUnique<Published>());
+        Published& pub = *vPublished.back();
+        pub.block = chain.CreateBlock(prevout, nTime, nBits, rng);
+        chain.MakeIndex(pub.block, pub.hash, pub.index);
+        vSlotWinners[slot]++;
+    });
+
+    int nBlocks = 0, nOrphans = 0;
+    for (int nWinners : vSlotWinners) {
+        nBlocks += nWinners > 0;
+        nOrphans += std::max(nWinners - 1, 0);
+    }
+    assert(nBlocks > 0);
+    bench.name(strprintf("PoSStakerRace (%d stakers, %d blocks in %d slots, mean interval %.1fs, orphan rate %.2f%%)",
+        POS_STAKERS, nBlocks, POS_RACE_SLOTS, (double)POS_RACE_SLOTS * POS_SLOT_SPACING / nBlocks, 100.0 * nOrphans / (nBlocks + nOrphans)));
+
+    bench.batch(POS_RACE_SLOTS).unit("slot").run([&] {
+        size_t n = 0;
+        race([&](int slot, int staker, const COutPoint& prevout, uint32_t nTime) {
+            Published& pub = *vPublished[n++];
+            bool fValid = chain.Connect(pub.block, pub.index);
+            assert(fValid);
+        });
+        assert(n == vPublished.size());
+    });
+}
+
+BENCHMARK(PoSCheckBlock);
+BENCHMARK(PoSCheckProofOfStake);
+BENCHMARK(PoSConnectBlock);
+BENCHMARK(PoSStorageProofValidate);
+BENCHMARK(PoSStakerRace);
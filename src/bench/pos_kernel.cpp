@@ -0,0 +1,142 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <pos/kernel.h>
+#include <pos/kernelcache.h>
+#include <random.h>
+
+#include <vector>
+
+static constexpr int POS_CHAIN_LENGTH = 5000;
+static constexpr int POS_OUTPUTS_PER_BLOCK = 4;
+static constexpr uint32_t POS_BLOCK_SPACING = 16;
+static constexpr uint32_t POS_KERNEL_BITS = 0x1e0fffff;
+
+// A synthetic proof-of-stake chain: a block index with stake modifiers and,
+// for every block, a transaction paying a few stakeable outputs.
+struct SyntheticPoSChain
+{
+    std::vector<uint256> vHashes;
+    std::vector<CBlockIndex> vIndex;
+    std::vector<CBlock> vBlocks;
+    CChain chain;
+
+    SyntheticPoSChain()
+    {
+        FastRandomContext rng(true);
+        vHashes.resize(POS_CHAIN_LENGTH);
+        vIndex.resize(POS_CHAIN_LENGTH);
+        vBlocks.resize(POS_CHAIN_LENGTH);
+        for (int i = 0; i < POS_CHAIN_LENGTH; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(rng.rand256(), 0);
+            tx.vout.resize(POS_OUTPUTS_PER_BLOCK);
+            for (auto& out : tx.vout) {
+                out.nValue = (1000 + rng.randrange(1000)) * COIN;
+            }
+            vBlocks[i].vtx.push_back(MakeTransactionRef(tx));
+
+            vHashes[i] = rng.rand256();
+            CBlockIndex& index = vIndex[i];
+            index.phashBlock = &vHashes[i];
+            index.pprev = i > 0 ? &vIndex[i - 1] : nullptr;
+            index.nHeight = i;
+            index.nTime = 1600000000 + i * POS_BLOCK_SPACING;
+            index.nBits = POS_KERNEL_BITS;
+            index.prevoutStake = tx.vin[0].prevout;
+            index.nStakeModifier = ComputeStakeModifier(index.pprev, index.prevoutStake.hash);
+        }
+        chain.SetTip(&vIndex.back());
+    }
+
+    COutPoint Kernel(size_t n) const
+    {
+        const CBlock& block = vBlocks[n / POS_OUTPUTS_PER_BLOCK];
+        return COutPoint(block.vtx[0]->GetHash(), n % POS_OUTPUTS_PER_BLOCK);
+    }
+};
+
+static void PoSStakeModifierChain(benchmark::Bench& bench)
+{
+    SyntheticPoSChain pos;
+    bench.batch(POS_CHAIN_LENGTH).unit("block").run([&] {
+        for (auto& index : pos.vIndex) {
+            index.nStakeModifier = ComputeStakeModifier(index.pprev, index.prevoutStake.hash);
+        }
+    });
+}
+
+// Kernel checks resolving each input through the coins view and block index,
+// as done before the kernel cache
+static void PoSKernelCoinsView(benchmark::Bench& bench)
+{
+    SyntheticPoSChain pos;
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins(&coinsDummy);
+    for (int i = 0; i < POS_CHAIN_LENGTH; i++) {
+        AddCoins(coins, *pos.vBlocks[i].vtx[0], i);
+    }
+
+    const CBlockIndex* pindexPrev = pos.chain.Tip();
+    const uint32_t nTime = pindexPrev->nTime + POS_BLOCK_SPACING;
+    const size_t nKernels = POS_CHAIN_LENGTH * POS_OUTPUTS_PER_BLOCK;
+    bench.batch(nKernels).unit("kernel").run([&] {
+        uint256 hashProofOfStake, targetProofOfStake;
+        for (size_t n = 0; n < nKernels; n++) {
+            const COutPoint prevout = pos.Kernel(n);
+            Coin coin;
+            bool fFound = coins.GetCoin(prevout, coin);
+            assert(fFound);
+            const CBlockIndex* pindex = pos.chain[coin.nHeight];
+            CheckStakeKernelHash(pindexPrev, POS_KERNEL_BITS, pindex->nTime, coin.out.nValue, prevout, nTime, hashProofOfStake, targetProofOfStake);
+        }
+    });
+}
+
+// The same kernel checks answered from the kernel cache
+static void PoSKernelCache(benchmark::Bench& bench)
+{
+    SyntheticPoSChain pos;
+    CStakeKernelCache cache(POS_CHAIN_LENGTH * POS_OUTPUTS_PER_BLOCK);
+    for (int i = 0; i < POS_CHAIN_LENGTH; i++) {
+        cache.ConnectBlock(pos.vBlocks[i], &pos.vIndex[i], Params().GetConsensus());
+    }
+
+    const CBlockIndex* pindexPrev = pos.chain.Tip();
+    const uint32_t nTime = pindexPrev->nTime + POS_BLOCK_SPACING;
+    const size_t nKernels = POS_CHAIN_LENGTH * POS_OUTPUTS_PER_BLOCK;
+    bench.batch(nKernels).unit("kernel").run([&] {
+        uint256 hashProofOfStake, targetProofOfStake;
+        for (size_t n = 0; n < nKernels; n++) {
+            const COutPoint prevout = pos.Kernel(n);
+            CStakeKernelInput input;
+            bool fFound = cache.Lookup(prevout, input);
+            assert(fFound);
+            CheckStakeKernelHash(pindexPrev, POS_KERNEL_BITS, input.nBlockTime, input.nValue, prevout, nTime, hashProofOfStake, targetProofOfStake);
+        }
+    });
+}
+
+// Cost of keeping the cache up to date while connecting the chain
+static void PoSKernelCacheConnect(benchmark::Bench& bench)
+{
+    SyntheticPoSChain pos;
+    bench.batch(POS_CHAIN_LENGTH).unit("block").run([&] {
+        CStakeKernelCache cache(POS_CHAIN_LENGTH * POS_OUTPUTS_PER_BLOCK);
+        for (int i = 0; i < POS_CHAIN_LENGTH; i++) {
+            cache.ConnectBlock(pos.vBlocks[i], &pos.vIndex[i], Params().GetConsensus());
+        }
+        assert(cache.Size() == POS_CHAIN_LENGTH * POS_OUTPUTS_PER_BLOCK);
+    });
+}
+
+BENCHMARK(PoSStakeModifierChain);
+BENCHMARK(PoSKernelCoinsView);
+BENCHMARK(PoSKernelCache);
+BENCHMARK(PoSKernelCacheConnect);
@@ -20,14 +20,21 @@
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
-        shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block), vchBlockSig(block.vchBlockSig), netProof(block.netProof)
+        header(block), vchBlockSig(block.vchBlockSig), netProof(block.netProof)
 {
     FillShortTxIDSelector();
     //TODO: Use our mempool prior to block acceptance to predictively fill more than just the coinbase
-    prefilledtxn[0] = {0, block.vtx[0]};
-    for (size_t i = 1; i < block.vtx.size(); i++) {
+    // Proof-of-stake blocks also carry the coinstake, so peers can pre-validate
+    // the kernel and block signature before requesting the remaining txn
+    const size_t nPrefilled = block.IsProofOfStake() ? 2 : 1;
+    prefilledtxn.resize(nPrefilled);
+    shorttxids.resize(block.vtx.size() - nPrefilled);
+    for (size_t i = 0; i < nPrefilled; i++) {
+        prefilledtxn[i] = {0, block.vtx[i]};
+    }
+    for (size_t i = nPrefilled; i < block.vtx.size(); i++) {
         const CTransaction& tx = *block.vtx[i];
-        shorttxids[i - 1] = GetShortID(tx.GetHash());
+        shorttxids[i - nPrefilled] = GetShortID(tx.GetHash());
     }
 }
 
@@ -42,6 +49,13 @@ void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const {
     shorttxidk1 = shorttxidhash.GetUint64(1);
 }
 
+CTransactionRef CBlockHeaderAndShortTxIDs::GetCoinStake() const {
+    // The coinstake is only usable when prefilled directly after the coinbase
+    if (prefilledtxn.size() < 2 || prefilledtxn[0].index != 0 || prefilledtxn[1].index != 0)
+        return nullptr;
+    return prefilledtxn[1].tx;
+}
+
 uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids calculation assumes 6-byte shorttxids");
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
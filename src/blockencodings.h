@@ -112,6 +112,9 @@ public:
 
     size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
 
+    // Returns the prefilled coinstake of a proof-of-stake block, or nullptr if not present
+    CTransactionRef GetCoinStake() const;
+
     SERIALIZE_METHODS(CBlockHeaderAndShortTxIDs, obj)
     {
         READWRITE(obj.header, obj.nonce, obj.vchBlockSig, obj.netProof, Using<VectorFormatter<CustomUintFormatter<SHORTTXIDS_LENGTH>>>(obj.shorttxids), obj.prefilledtxn);
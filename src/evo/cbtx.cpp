@@ -107,7 +107,6 @@ bool CalcCbTxMerkleRootMNList(const CBlock& block, const CBlockIndex* pindexPrev
 
     try {
         static int64_t nTimeDMN = 0;
-        static int64_t nTimeSMNL = 0;
         static int64_t nTimeMerkle = 0;
 
         int64_t nTime1 = GetTimeMicros();
@@ -121,32 +120,63 @@ bool CalcCbTxMerkleRootMNList(const CBlock& block, const CBlockIndex* pindexPrev
         int64_t nTime2 = GetTimeMicros(); nTimeDMN += nTime2 - nTime1;
         LogPrint(BCLog::BENCHMARK, "            - BuildNewListFromBlock: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeDMN * 0.000001);
 
-        CSimplifiedMNList sml(tmpMNList);
-
-        int64_t nTime3 = GetTimeMicros(); nTimeSMNL += nTime3 - nTime2;
-        LogPrint(BCLog::BENCHMARK, "            - CSimplifiedMNList: %.2fms [%.2fs]\n", 0.001 * (nTime3 - nTime2), nTimeSMNL * 0.000001);
-
-        static CSimplifiedMNList smlCached;
-        static uint256 merkleRootCached;
-        static bool mutatedCached{false};
-
-        if (sml.mnList == smlCached.mnList) {
-            merkleRootRet = merkleRootCached;
-            if (mutatedCached) {
-                return state.DoS(100, false, REJECT_INVALID, "mutated-cached-calc-cb-mnmerkleroot");
+        // The tree follows the list it was last updated for (the previous block, a block template or another fork).
+        // When that list is the one of pindexPrev, the tree is moved to the new list by the diff of this block, so only
+        // MNs touched by the block are rehashed. The diff of a connected block was already made by ProcessBlock, only
+        // block templates and blocks checked without connecting them need one built here.
+        static CDeterministicMNList mnListCached;
+        static uint256 mnListCachedBlockHash;
+        static CSimplifiedMNListMerkleTree merkleTreeCached;
+
+        uint256 blockHash = block.GetHash();
+        bool fRebuild = mnListCachedBlockHash.IsNull() || mnListCachedBlockHash != pindexPrev->GetBlockHash();
+        CDeterministicMNListDiff diff;
+        if (!fRebuild && !deterministicMNManager->GetCachedListDiff(blockHash, diff)) {
+            diff = mnListCached.BuildDiff(tmpMNList);
+        }
+        mnListCachedBlockHash.SetNull();
+        if (fRebuild) {
+            merkleTreeCached.Build(tmpMNList);
+        } else {
+            std::vector<CSimplifiedMNListEntry> smlEntries;
+            std::vector<uint256> removed;
+            for (const auto& dmn : diff.addedMNs) {
+                smlEntries.emplace_back(*dmn);
+            }
+            for (const auto& p : diff.updatedMNs) {
+                auto dmn = tmpMNList.GetMNByInternalId(p.first);
+                auto oldDmn = mnListCached.GetMNByInternalId(p.first);
+                if (!dmn || !oldDmn) {
+                    throw std::runtime_error(strprintf("can't find an updated masternode, id=%d", p.first));
+                }
+                // most updates (e.g. payments) don't touch fields of the SML entry
+                CSimplifiedMNListEntry sme(*dmn);
+                if (sme != CSimplifiedMNListEntry(*oldDmn)) {
+                    smlEntries.emplace_back(std::move(sme));
+                }
+            }
+            for (const auto& id : diff.removedMns) {
+                auto dmn = mnListCached.GetMNByInternalId(id);
+                if (!dmn) {
+                    throw std::runtime_error(strprintf("can't find a removed masternode, id=%d", id));
+                }
+                removed.emplace_back(dmn->proTxHash);
+            }
+            merkleTreeCached.Update(smlEntries, removed);
+            if (merkleTreeCached.Size() != tmpMNList.GetAllMNsCount()) {
+                // the diff didn't lead to the new list - never trust such a tree
+                fRebuild = true;
+                merkleTreeCached.Build(tmpMNList);
             }
-            return true;
         }
+        mnListCached = tmpMNList;
+        mnListCachedBlockHash = blockHash;
 
         bool mutated = false;
-        merkleRootRet = sml.CalcMerkleRoot(&mutated);
-
-        int64_t nTime4 = GetTimeMicros(); nTimeMerkle += nTime4 - nTime3;
-        LogPrint(BCLog::BENCHMARK, "            - CalcMerkleRoot: %.2fms [%.2fs]\n", 0.001 * (nTime4 - nTime3), nTimeMerkle * 0.000001);
+        merkleRootRet = merkleTreeCached.GetMerkleRoot(&mutated);
 
-        smlCached = std::move(sml);
-        merkleRootCached = merkleRootRet;
-        mutatedCached = mutated;
+        int64_t nTime3 = GetTimeMicros(); nTimeMerkle += nTime3 - nTime2;
+        LogPrint(BCLog::BENCHMARK, "            - %s: %.2fms [%.2fs]\n", fRebuild ? "BuildMerkleTree" : "UpdateMerkleTree", 0.001 * (nTime3 - nTime2), nTimeMerkle * 0.000001);
 
         if (mutated) {
             return state.DoS(100, false, REJECT_INVALID, "mutated-calc-cb-mnmerkleroot");
@@ -14,6 +14,7 @@
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <crypto/sha256.h>
 #include <script/standard.h>
 #include <ui_interface.h>
 #include <validation.h>
@@ -218,13 +219,19 @@ std::vector<CDeterministicMNCPtr> CDeterministicMNList::CalculateQuorum(size_t m
     auto scores = CalculateScores(modifier);
 
     // sort is descending order
-    std::sort(scores.rbegin(), scores.rend(), [](const std::pair<arith_uint256, CDeterministicMNCPtr>& a, const std::pair<arith_uint256, CDeterministicMNCPtr>& b) {
+    auto cmp = [](const std::pair<arith_uint256, CDeterministicMNCPtr>& a, const std::pair<arith_uint256, CDeterministicMNCPtr>& b) {
         if (a.first == b.first) {
             // this should actually never happen, but we should stay compatible with how the non-deterministic MNs did the sorting
-            return a.second->collateralOutpoint < b.second->collateralOutpoint;
+            return b.second->collateralOutpoint < a.second->collateralOutpoint;
         }
-        return a.first < b.first;
-    });
+        return b.first < a.first;
+    };
+    if (maxSize < scores.size()) {
+        // only the top maxSize entries are needed (LLMQ members out of all MNs)
+        std::partial_sort(scores.begin(), scores.begin() + maxSize, scores.end(), cmp);
+    } else {
+        std::sort(scores.begin(), scores.end(), cmp);
+    }
 
     // take top maxSize entries and return it
     std::vector<CDeterministicMNCPtr> result;
@@ -237,27 +244,38 @@ std::vector<CDeterministicMNCPtr> CDeterministicMNList::CalculateQuorum(size_t m
 
 std::vector<std::pair<arith_uint256, CDeterministicMNCPtr>> CDeterministicMNList::CalculateScores(const uint256& modifier) const
 {
-    std::vector<std::pair<arith_uint256, CDeterministicMNCPtr>> scores;
-    scores.reserve(GetAllMNsCount());
+    std::vector<CDeterministicMNCPtr> dmns;
+    dmns.reserve(GetAllMNsCount());
     ForEachMNShared(true, [&](const CDeterministicMNCPtr& dmn) {
         if (dmn->pdmnState->confirmedHash.IsNull()) {
             // we only take confirmed MNs into account to avoid hash grinding on the ProRegTxHash to sneak MNs into a
             // future quorums
             return;
         }
-        // calculate sha256(sha256(proTxHash, confirmedHash), modifier) per MN
-        // Please note that this is not a double-sha256 but a single-sha256
-        // The first part is already precalculated (confirmedHashWithProRegTxHash)
-        // TODO When https://github.com/bitcoin/bitcoin/pull/13191 gets backported, implement something that is similar but for single-sha256
-        uint256 h;
-        CSHA256 sha256;
-        sha256.Write(dmn->pdmnState->confirmedHashWithProRegTxHash.begin(), dmn->pdmnState->confirmedHashWithProRegTxHash.size());
-        sha256.Write(modifier.begin(), modifier.size());
-        sha256.Finalize(h.begin());
-
-        scores.emplace_back(UintToArith256(h), dmn);
+        dmns.emplace_back(dmn);
     });
 
+    // calculate sha256(sha256(proTxHash, confirmedHash), modifier) per MN
+    // Please note that this is not a double-sha256 but a single-sha256
+    // The first part is already precalculated (confirmedHashWithProRegTxHash), so every input is exactly 64 bytes
+    // and all of them are hashed in one batch by the multi-way SHA256 implementations
+    std::vector<unsigned char> buf(dmns.size() * 64);
+    for (size_t i = 0; i < dmns.size(); i++) {
+        const uint256& confirmedHashWithProRegTxHash = dmns[i]->pdmnState->confirmedHashWithProRegTxHash;
+        memcpy(buf.data() + i * 64, confirmedHashWithProRegTxHash.begin(), 32);
+        memcpy(buf.data() + i * 64 + 32, modifier.begin(), 32);
+    }
+    std::vector<unsigned char> hashes(dmns.size() * 32);
+    SHA256S64(hashes.data(), buf.data(), dmns.size());
+
+    std::vector<std::pair<arith_uint256, CDeterministicMNCPtr>> scores;
+    scores.reserve(dmns.size());
+    for (size_t i = 0; i < dmns.size(); i++) {
+        uint256 h;
+        memcpy(h.begin(), hashes.data() + i * 32, 32);
+        scores.emplace_back(UintToArith256(h), std::move(dmns[i]));
+    }
+
     return scores;
 }
 
@@ -991,6 +1009,18 @@ CDeterministicMNList CDeterministicMNManager::GetListAtChainTip()
     return GetListForBlock(tipIndex);
 }
 
+bool CDeterministicMNManager::GetCachedListDiff(const uint256& blockHash, CDeterministicMNListDiff& diffRet)
+{
+    AssertLockHeld(cs);
+
+    auto it = mnListDiffsCache.find(blockHash);
+    if (it == mnListDiffsCache.end()) {
+        return false;
+    }
+    diffRet = it->second;
+    return true;
+}
+
 bool CDeterministicMNManager::IsProTxWithCollateral(const CTransactionRef& tx, uint32_t n)
 {
     const Consensus::Params& params = Params().GetConsensus();
@@ -550,6 +550,8 @@ public:
 
     CDeterministicMNList GetListForBlock(const CBlockIndex* pindex);
     CDeterministicMNList GetListAtChainTip();
+    // diff against its parent of a block processed by ProcessBlock (only looks into the cache, never reads from disk)
+    bool GetCachedListDiff(const uint256& blockHash, CDeterministicMNListDiff& diffRet) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     // Test if given TX is a ProRegTx which also contains the collateral at index n
     static bool IsProTxWithCollateral(const CTransactionRef& tx, uint32_t n);
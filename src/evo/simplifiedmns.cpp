@@ -18,6 +18,7 @@
 #include <base58.h>
 #include <chainparams.h>
 #include <consensus/merkle.h>
+#include <crypto/sha256.h>
 #include <univalue.h>
 #include <validation.h>
 #include <key_io.h>
@@ -93,6 +94,183 @@ uint256 CSimplifiedMNList::CalcMerkleRoot(bool* pmutated) const
     return ComputeMerkleRoot(leaves, pmutated);
 }
 
+void CSimplifiedMNListMerkleTree::Build(const std::vector<CSimplifiedMNListEntry>& smlEntries)
+{
+    std::vector<std::pair<uint256, uint256>> leaves;
+    leaves.reserve(smlEntries.size());
+    for (const auto& e : smlEntries) {
+        leaves.emplace_back(e.proRegTxHash, e.CalcHash());
+    }
+    std::sort(leaves.begin(), leaves.end());
+
+    proRegTxHashes.resize(leaves.size());
+    levels.assign(1, std::vector<uint256>(leaves.size()));
+    equalPairs.clear();
+    nEqualPairs = 0;
+    std::vector<size_t> dirty(leaves.size());
+    for (size_t i = 0; i < leaves.size(); i++) {
+        proRegTxHashes[i] = leaves[i].first;
+        levels[0][i] = leaves[i].second;
+        dirty[i] = i;
+    }
+    Rehash(std::move(dirty), true);
+}
+
+void CSimplifiedMNListMerkleTree::Build(const CDeterministicMNList& dmnList)
+{
+    std::vector<CSimplifiedMNListEntry> smlEntries;
+    smlEntries.reserve(dmnList.GetAllMNsCount());
+    dmnList.ForEachMN(false, [&smlEntries](auto& dmn) {
+        smlEntries.emplace_back(dmn);
+    });
+    Build(smlEntries);
+}
+
+void CSimplifiedMNListMerkleTree::Update(const std::vector<CSimplifiedMNListEntry>& entries, const std::vector<uint256>& removed)
+{
+    std::vector<std::pair<uint256, uint256>> changed;
+    changed.reserve(entries.size());
+    for (const auto& e : entries) {
+        changed.emplace_back(e.proRegTxHash, e.CalcHash());
+    }
+    // stable - the last of entries with the same proRegTxHash wins
+    std::stable_sort(changed.begin(), changed.end(), [](const std::pair<uint256, uint256>& a, const std::pair<uint256, uint256>& b) {
+        return a.first < b.first;
+    });
+
+    std::vector<uint256>& leaves = levels[0];
+    std::vector<std::pair<uint256, uint256>> added;
+    std::vector<size_t> dirty;
+    for (const auto& p : changed) {
+        auto it = std::lower_bound(proRegTxHashes.begin(), proRegTxHashes.end(), p.first);
+        if (it == proRegTxHashes.end() || *it != p.first) {
+            if (!added.empty() && added.back().first == p.first) {
+                added.back() = p;
+            } else {
+                added.emplace_back(p);
+            }
+            continue;
+        }
+        size_t pos = it - proRegTxHashes.begin();
+        leaves[pos] = p.second;
+        if (dirty.empty() || dirty.back() != pos) {
+            dirty.emplace_back(pos);
+        }
+    }
+    std::vector<uint256> deleted;
+    for (const auto& proRegTxHash : removed) {
+        if (std::binary_search(proRegTxHashes.begin(), proRegTxHashes.end(), proRegTxHash)) {
+            deleted.emplace_back(proRegTxHash);
+        }
+    }
+    if (added.empty() && deleted.empty()) {
+        Rehash(std::move(dirty), false);
+        return;
+    }
+    std::sort(deleted.begin(), deleted.end());
+
+    // merge - everything from the first added or removed position on moves
+    size_t oldSize = proRegTxHashes.size();
+    size_t first = oldSize + added.size();
+    std::vector<uint256> newHashes, newLeaves;
+    newHashes.reserve(first);
+    newLeaves.reserve(first);
+    size_t i = 0, a = 0, d = 0;
+    while (i < oldSize || a < added.size()) {
+        if (a < added.size() && (i == oldSize || added[a].first < proRegTxHashes[i])) {
+            first = std::min(first, newHashes.size());
+            newHashes.emplace_back(added[a].first);
+            newLeaves.emplace_back(added[a].second);
+            a++;
+            continue;
+        }
+        while (d < deleted.size() && deleted[d] < proRegTxHashes[i]) {
+            d++;
+        }
+        if (d < deleted.size() && deleted[d] == proRegTxHashes[i]) {
+            first = std::min(first, newHashes.size());
+            i++;
+            continue;
+        }
+        newHashes.emplace_back(proRegTxHashes[i]);
+        newLeaves.emplace_back(leaves[i]);
+        i++;
+    }
+    dirty.erase(std::lower_bound(dirty.begin(), dirty.end(), first), dirty.end());
+    for (size_t pos = first; pos < newHashes.size(); pos++) {
+        dirty.emplace_back(pos);
+    }
+    proRegTxHashes.swap(newHashes);
+    leaves.swap(newLeaves);
+    Rehash(std::move(dirty), proRegTxHashes.size() != oldSize);
+}
+
+void CSimplifiedMNListMerkleTree::Rehash(std::vector<size_t> dirty, bool resized)
+{
+    unsigned char pair[64];
+    size_t level = 0;
+    while (levels[level].size() > 1) {
+        if (levels.size() == level + 1) {
+            levels.emplace_back();
+            equalPairs.emplace_back();
+        }
+        const std::vector<uint256>& cur = levels[level];
+        std::vector<uint256>& next = levels[level + 1];
+        std::vector<bool>& equal = equalPairs[level];
+        size_t n = cur.size();
+        if (resized && (dirty.empty() || dirty.back() != n - 1)) {
+            // last node could have been paired with itself before (or is now)
+            dirty.emplace_back(n - 1);
+        }
+        resized = next.size() != (n + 1) / 2;
+        next.resize((n + 1) / 2);
+        for (size_t j = n / 2; j < equal.size(); j++) {
+            nEqualPairs -= equal[j];
+        }
+        equal.resize(n / 2, false);
+
+        size_t cnt = 0;
+        for (size_t pos : dirty) {
+            size_t j = pos / 2;
+            if (cnt > 0 && dirty[cnt - 1] == j) {
+                continue;
+            }
+            dirty[cnt++] = j;
+            if (2 * j + 1 < n) {
+                bool eq = cur[2 * j] == cur[2 * j + 1];
+                nEqualPairs = nEqualPairs - equal[j] + eq;
+                equal[j] = eq;
+                SHA256D64(next[j].begin(), cur[2 * j].begin(), 1);
+            } else {
+                memcpy(pair, cur[2 * j].begin(), 32);
+                memcpy(pair + 32, cur[2 * j].begin(), 32);
+                SHA256D64(next[j].begin(), pair, 1);
+            }
+        }
+        dirty.resize(cnt);
+        level++;
+    }
+    // tree got lower
+    for (size_t l = level; l < equalPairs.size(); l++) {
+        for (bool eq : equalPairs[l]) {
+            nEqualPairs -= eq;
+        }
+    }
+    levels.resize(level + 1);
+    equalPairs.resize(level);
+}
+
+uint256 CSimplifiedMNListMerkleTree::GetMerkleRoot(bool* pmutated) const
+{
+    if (pmutated) {
+        *pmutated = nEqualPairs > 0;
+    }
+    if (levels[0].empty()) {
+        return uint256();
+    }
+    return levels.back()[0];
+}
+
 CSimplifiedMNListDiff::CSimplifiedMNListDiff() = default;
 
 CSimplifiedMNListDiff::~CSimplifiedMNListDiff() = default;
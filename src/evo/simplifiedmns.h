@@ -78,6 +78,34 @@ public:
     uint256 CalcMerkleRoot(bool* pmutated = nullptr) const;
 };
 
+/**
+ * Merkle tree over SML entries (sorted by proRegTxHash) which is kept between blocks and updated in place.
+ * Only leaves of changed entries are rehashed and only nodes on their paths to the root are recomputed. Adding or
+ * removing an entry shifts all leaves behind it, so nodes right of it are recomputed too (from cached leaf hashes).
+ * The root is the same as CSimplifiedMNList::CalcMerkleRoot() for the same entries, including mutation detection.
+ */
+class CSimplifiedMNListMerkleTree
+{
+private:
+    std::vector<uint256> proRegTxHashes;
+    // levels[0] are leaf hashes, the last level holds the root
+    std::vector<std::vector<uint256>> levels{1};
+    // equalPairs[l][i] - levels[l][2i] == levels[l][2i + 1], which ComputeMerkleRoot() reports as mutation
+    std::vector<std::vector<bool>> equalPairs;
+    size_t nEqualPairs{0};
+
+    void Rehash(std::vector<size_t> dirty, bool resized);
+
+public:
+    void Build(const std::vector<CSimplifiedMNListEntry>& smlEntries);
+    void Build(const CDeterministicMNList& dmnList);
+    /** entries are added or replace entries with the same proRegTxHash, removed are proRegTxHashes of deleted entries */
+    void Update(const std::vector<CSimplifiedMNListEntry>& entries, const std::vector<uint256>& removed);
+
+    size_t Size() const { return proRegTxHashes.size(); }
+    uint256 GetMerkleRoot(bool* pmutated = nullptr) const;
+};
+
 /// P2P messages
 
 class CGetSimplifiedMNListDiff
@@ -90,7 +90,9 @@
 #include <llmq/utils.h>
 
 #ifdef __linux__
+#include <libmoosefs/mfschunkserver/bgjobs.h>
 #include <libmoosefs/mfsnode/node.h>
+#include <storage/stats.h>
 #endif
 
 #include <statsd_client.h>
@@ -723,6 +725,11 @@ void SetupServerArgs()
     gArgs.AddArg("-llmq-qvvec-sync=<quorum_name>:<mode>", strprintf("Defines from which LLMQ type the masternode should sync quorum verification vectors. Can be used multiple times with different LLMQ types. <mode>: %d (sync always from all quorums of the type defined by <quorum_name>), %d (sync from all quorums of the type defined by <quorum_name> if a member of any of the quorums)", (int32_t)llmq::QvvecSyncMode::Always, (int32_t)llmq::QvvecSyncMode::OnlyIfTypeMember), ArgsManager::ALLOW_ANY, OptionsCategory::MASTERNODE);
     gArgs.AddArg("-masternodeblsprivkey=<hex>", "Set the masternode BLS private key and enable the client to act as a masternode", ArgsManager::ALLOW_ANY, OptionsCategory::MASTERNODE);
     gArgs.AddArg("-masternodestoragespace=<n>", "Storage space to provide to the network in multiples of 25GiB (default: 1)", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-masternodestoragecheckthreads=<n>", "Number of threads verifying chunk files at startup (0 = number of cores, default: 0)", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-masternodestoragecheckbackground", "Start serving chunks while changed chunk files are still verified (default: 0)", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-masternodestorageworkersmin=<n>", "Number of chunkserver workers started up front and always kept (default: 16)", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-masternodestorageworkersmax=<n>", "Maximum number of chunkserver workers (default: 250)", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-masternodestorageworkersidle=<n>", "Number of idle chunkserver workers kept above the minimum (default: 40)", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-platform-user=<user>", "Set the username for the \"platform user\", a restricted user intended to be used by datos Platform, to the specified username.", ArgsManager::ALLOW_ANY, OptionsCategory::MASTERNODE);
 
     gArgs.AddArg("-acceptnonstdtxn", strprintf("Relay and mine \"non-standard\" transactions (%sdefault: %u)", "testnet/regtest only; ", !testnetChainParams->RequireStandard()), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::NODE_RELAY);
@@ -2284,7 +2291,14 @@ bool AppInitMain(InitInterfaces& interfaces)
             space_mode = 1;
         }
         bool net_type = chainparams.NetworkIDString() == CBaseChainParams::MAIN;
-        libmoosefs = std::thread(&launch_chunkserver, std::ref(space_mode), std::ref(net_type));
+        unsigned int check_threads = std::max<int64_t>(0, gArgs.GetArg("-masternodestoragecheckthreads", 0));
+        bool check_background = gArgs.GetBoolArg("-masternodestoragecheckbackground", false);
+        uint32_t minworkers, maxworkers, maxidle;
+        job_get_limits(&minworkers, &maxworkers, &maxidle);
+        job_set_limits(std::max<int64_t>(0, gArgs.GetArg("-masternodestorageworkersmin", minworkers)),
+                       std::max<int64_t>(1, gArgs.GetArg("-masternodestorageworkersmax", maxworkers)),
+                       std::max<int64_t>(0, gArgs.GetArg("-masternodestorageworkersidle", maxidle)));
+        libmoosefs = std::thread(&launch_chunkserver, space_mode, net_type, check_threads, check_background);
         libmoosefs.detach();
     }
 #endif
@@ -2370,6 +2384,11 @@ bool AppInitMain(InitInterfaces& interfaces)
     if (gArgs.GetBoolArg("-statsenabled", DEFAULT_STATSD_ENABLE)) {
         int nStatsPeriod = std::min(std::max((int)gArgs.GetArg("-statsperiod", DEFAULT_STATSD_PERIOD), MIN_STATSD_PERIOD), MAX_STATSD_PERIOD);
         scheduler.scheduleEvery(PeriodicStats, nStatsPeriod * 1000);
+#ifdef __linux__
+        if (fMasternodeMode) {
+            scheduler.scheduleEvery(PeriodicStorageStats, nStatsPeriod * 1000);
+        }
+#endif
     }
 
     llmq::StartLLMQSystem();
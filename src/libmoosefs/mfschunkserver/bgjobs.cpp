@@ -24,12 +24,14 @@
 #include <syslog.h>
 #include <unistd.h>
 
+#include "clocks.h"
 #include "datapack.h"
 #include "defaults.h"
 #include "mainthread.h"
 #include "massert.h"
 #include "pcqueue.h"
 
+#include "hddsched.h"
 #include "hddspacemgr.h"
 #include "mainserv.h"
 #include "masterconn.h"
@@ -38,6 +40,18 @@
 #define JHASHSIZE 0x400
 #define JHASHPOS(id) ((id)&0x3FF)
 
+/*
+ * Pool is pre-warmed to workers_min and resized only by job_adjust (main thread, every JOB_ADJUST_MSEC).
+ * It grows when jobs wait in queue longer than JOB_QUEUE_WAIT_TARGET - by at most 1/8 of the pool per tick and
+ * by one worker when disks are already saturated (more threads would only deepen disk queues). Wait time is taken
+ * from dequeued jobs and from the oldest job still in queue, so the pool also grows when every worker is stuck in
+ * a long job and nothing is dequeued. A job queued while no worker is idle spawns one at once. Idle workers above
+ * workers_max_idle are retired gradually (half of the surplus seen during whole JOB_SHRINK_TICKS window).
+ */
+#define JOB_ADJUST_MSEC 50
+#define JOB_SHRINK_TICKS 20
+#define JOB_SPAWN_BURST 16
+
 enum {
     JSTATE_DISABLED,
     JSTATE_ENABLED,
@@ -55,6 +69,7 @@ enum {
     OP_GETCHECKSUM,
     OP_GETCHECKSUMTAB,
     OP_CHUNKMOVE,
+    OP_REPLICATE_EC,
 };
 
 // for OP_CHUNKOP
@@ -79,6 +94,14 @@ typedef struct _chunk_rp_args {
     uint8_t srccnt;
 } chunk_rp_args;
 
+// for OP_REPLICATE_EC
+typedef struct _chunk_ec_args {
+    uint64_t chunkid;
+    uint32_t version;
+    uint8_t k, m, part;
+    uint8_t srccnt;
+} chunk_ec_args;
+
 // for OP_GETBLOCKS, OP_GETCHECKSUM and OP_GETCHECKSUMTAB
 typedef struct _chunk_ij_args {
     uint64_t chunkid;
@@ -97,20 +120,32 @@ typedef struct _job {
     void (*callback)(uint8_t status, void* extra);
     void* extra;
     void* args;
+    uint64_t enqueued;
     uint8_t jstate;
     struct _job* next;
+    struct _job* qnext;
+    struct _job** qprev;
 } job;
 
 typedef struct _jobpool {
     int rpipe, wpipe;
     int32_t fdpdescpos;
+    uint32_t workers_min;
     uint32_t workers_max;
     uint32_t workers_himark;
     uint32_t workers_lomark;
     uint32_t workers_max_idle;
     uint32_t workers_avail;
     uint32_t workers_total;
+    uint32_t workers_exiting;
+    uint32_t workers_minavail;
     uint32_t workers_term_waiting;
+    uint32_t ticks;
+    uint64_t qwaitsum;
+    uint32_t qwaitcnt;
+    uint32_t qwaitavg;
+    job* qhead;
+    job** qtail;
     pthread_cond_t worker_term_cond;
     pthread_mutex_t pipelock;
     pthread_mutex_t jobslock;
@@ -129,6 +164,12 @@ static jobpool* globalpool = NULL;
 
 static uint32_t stats_maxjobscnt = 0;
 
+// limits can be changed from other threads at any time - job_adjust applies them
+static pthread_mutex_t limitslock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t limit_min = WORKERS_MIN;
+static uint32_t limit_max = WORKERS_MAX;
+static uint32_t limit_max_idle = WORKERS_MAX_IDLE;
+
 // static uint8_t exiting;
 
 void job_stats(uint32_t* maxjobscnt)
@@ -167,15 +208,17 @@ void* job_worker(void* arg);
 
 static uint32_t lastnotify = 0;
 
-static inline void job_spawn_worker(jobpool* jp)
+// lock:jobslock
+static inline int job_spawn_worker(jobpool* jp)
 {
     worker* w;
 
     w = (worker*)malloc(sizeof(worker));
     passert(w);
     w->jp = jp;
-    if (pthread_create(&(w->thread_id), 0, job_worker, w) < 0) {
-        return;
+    if (pthread_create(&(w->thread_id), 0, job_worker, w) != 0) {
+        free(w);
+        return -1;
     }
     jp->workers_avail++;
     jp->workers_total++;
@@ -183,7 +226,27 @@ static inline void job_spawn_worker(jobpool* jp)
         syslog(LOG_NOTICE, "workers: %" PRIu32 "+", jp->workers_total);
         lastnotify = jp->workers_total;
     }
-    syslog(LOG_NOTICE, "jobs: spawn worker (total: %" PRIu32 ")", jp->workers_total);
+    return 0;
+}
+
+// lock:jobslock
+static inline void job_queue_link(jobpool* jp, job* jptr)
+{
+    jptr->qnext = NULL;
+    jptr->qprev = jp->qtail;
+    *(jp->qtail) = jptr;
+    jp->qtail = &(jptr->qnext);
+}
+
+// lock:jobslock
+static inline void job_queue_unlink(jobpool* jp, job* jptr)
+{
+    if (jptr->qnext) {
+        jptr->qnext->qprev = jptr->qprev;
+    } else {
+        jp->qtail = jptr->qprev;
+    }
+    *(jptr->qprev) = jptr->qnext;
 }
 
 static inline void job_close_worker(worker* w)
@@ -191,6 +254,12 @@ static inline void job_close_worker(worker* w)
     jobpool* jp = w->jp;
     jp->workers_avail--;
     jp->workers_total--;
+    if (jp->workers_exiting > 0) {
+        jp->workers_exiting--;
+    }
+    if (jp->workers_avail < jp->workers_minavail) {
+        jp->workers_minavail = jp->workers_avail;
+    }
     if (jp->workers_total == 0 && jp->workers_term_waiting) {
         zassert(pthread_cond_signal(&(jp->worker_term_cond)));
         jp->workers_term_waiting--;
@@ -201,12 +270,12 @@ static inline void job_close_worker(worker* w)
         syslog(LOG_NOTICE, "workers: %" PRIu32 "-", jp->workers_total);
         lastnotify = jp->workers_total;
     }
-    syslog(LOG_NOTICE, "jobs: close worker (total: %" PRIu32 ")", jp->workers_total);
 }
 
 #define opargs ((chunk_op_args*)(jptr->args))
 #define rwargs ((chunk_rw_args*)(jptr->args))
 #define rpargs ((chunk_rp_args*)(jptr->args))
+#define ecargs ((chunk_ec_args*)(jptr->args))
 #define ijargs ((chunk_ij_args*)(jptr->args))
 #define mvargs ((chunk_mv_args*)(jptr->args))
 void* job_worker(void* arg)
@@ -218,23 +287,28 @@ void* job_worker(void* arg)
     uint8_t status, jstate;
     uint32_t jobid;
     uint32_t op;
+    uint64_t now;
 
-    syslog(LOG_NOTICE, "worker %p started (jobqueue:%p; jptr:%p; jptrarg:%p; status:%p)", (void*)pthread_self(), jp->jobqueue, (void*)&jptr, (void*)&jptrarg, (void*)&status);
     for (;;) {
         queue_get(jp->jobqueue, &jobid, &op, &jptrarg, NULL);
-        syslog(LOG_NOTICE, "job worker got job: %" PRIu32 ",%" PRIu32, jobid, op);
         jptr = (job*)jptrarg;
+        now = monotonic_useconds();
         zassert(pthread_mutex_lock(&(jp->jobslock)));
-        if (jobid == 0 && op == 0 && jptrarg == NULL) { // queue has been closed
+        if (jobid == 0 && op == 0 && jptrarg == NULL) { // queue has been closed or worker has been retired
             job_close_worker(w);
             zassert(pthread_mutex_unlock(&(jp->jobslock)));
             return NULL;
         }
         jp->workers_avail--;
-        if (jp->workers_avail == 0 && jp->workers_total < jp->workers_max) {
-            job_spawn_worker(jp);
+        if (jp->workers_avail < jp->workers_minavail) {
+            jp->workers_minavail = jp->workers_avail;
         }
         if (jptr != NULL) {
+            if (now > jptr->enqueued) {
+                jp->qwaitsum += now - jptr->enqueued;
+            }
+            jp->qwaitcnt++;
+            job_queue_unlink(jp, jptr);
             jstate = jptr->jstate;
             if (jptr->jstate == JSTATE_ENABLED) {
                 jptr->jstate = JSTATE_INPROGRESS;
@@ -272,7 +346,18 @@ void* job_worker(void* arg)
             if (jstate == JSTATE_DISABLED) {
                 status = MFS_ERROR_NOTDONE;
             } else {
+                hddsched_set_class(HDDSCHED_REPLICATION);
                 status = replicate(rpargs->chunkid, rpargs->version, rpargs->xormasks, rpargs->srccnt, ((uint8_t*)(jptr->args)) + sizeof(chunk_rp_args));
+                hddsched_set_class(HDDSCHED_CLIENT);
+            }
+            break;
+        case OP_REPLICATE_EC:
+            if (jstate == JSTATE_DISABLED) {
+                status = MFS_ERROR_NOTDONE;
+            } else {
+                hddsched_set_class(HDDSCHED_REPLICATION);
+                status = replicate_ec(ecargs->chunkid, ecargs->version, ecargs->k, ecargs->m, ecargs->part, ecargs->srccnt, ((uint8_t*)(jptr->args)) + sizeof(chunk_ec_args));
+                hddsched_set_class(HDDSCHED_CLIENT);
             }
             break;
         case OP_GETBLOCKS:
@@ -304,7 +389,6 @@ void* job_worker(void* arg)
             }
             break;
         default: // OP_EXIT
-            syslog(LOG_NOTICE, "worker %p exiting (jobqueue: %p)", (void*)pthread_self(), jp->jobqueue);
             zassert(pthread_mutex_lock(&(jp->jobslock)));
             job_close_worker(w);
             zassert(pthread_mutex_unlock(&(jp->jobslock)));
@@ -313,11 +397,6 @@ void* job_worker(void* arg)
         job_send_status(jp, jobid, status);
         zassert(pthread_mutex_lock(&(jp->jobslock)));
         jp->workers_avail++;
-        if (jp->workers_avail > jp->workers_max_idle) {
-            job_close_worker(w);
-            zassert(pthread_mutex_unlock(&(jp->jobslock)));
-            return NULL;
-        }
         zassert(pthread_mutex_unlock(&(jp->jobslock)));
     }
 }
@@ -348,6 +427,7 @@ static inline uint32_t job_new(jobpool* jp, uint32_t op, void* args, void (*call
     jptr->callback = callback;
     jptr->extra = extra;
     jptr->args = args;
+    jptr->enqueued = monotonic_useconds();
     jptr->jstate = JSTATE_ENABLED;
     jptr->next = jp->jobhash[jhpos];
     jp->jobhash[jhpos] = jptr;
@@ -378,6 +458,12 @@ static inline uint32_t job_new(jobpool* jp, uint32_t op, void* args, void (*call
             job_send_status(jp, jobid, errstatus);
         }
     } else {
+        zassert(pthread_mutex_lock(&(jp->jobslock)));
+        job_queue_link(jp, jptr);
+        if (jp->workers_avail == 0 && jp->workers_total - jp->workers_exiting < jp->workers_max) {
+            job_spawn_worker(jp); // all workers are busy - do not let this job wait for job_adjust
+        }
+        zassert(pthread_mutex_unlock(&(jp->jobslock)));
         queue_put(jp->jobqueue, jobid, op, (uint8_t*)jptr, 1);
     }
     return jobid;
@@ -399,9 +485,22 @@ void* job_pool_new(void)
     passert(jp);
     jp->rpipe = fd[0];
     jp->wpipe = fd[1];
+    jp->workers_min = 1;
+    jp->workers_max = 1;
+    jp->workers_himark = 1;
+    jp->workers_lomark = 1;
+    jp->workers_max_idle = 1;
     jp->workers_avail = 0;
     jp->workers_total = 0;
+    jp->workers_exiting = 0;
+    jp->workers_minavail = 0;
     jp->workers_term_waiting = 0;
+    jp->ticks = 0;
+    jp->qwaitsum = 0;
+    jp->qwaitcnt = 0;
+    jp->qwaitavg = 0;
+    jp->qhead = NULL;
+    jp->qtail = &(jp->qhead);
     zassert(pthread_cond_init(&(jp->worker_term_cond), NULL));
     zassert(pthread_mutex_init(&(jp->pipelock), NULL));
     zassert(pthread_mutex_init(&(jp->jobslock), NULL));
@@ -424,6 +523,7 @@ static uint32_t job_pool_jobs_count(void)
     uint32_t res;
     zassert(pthread_mutex_lock(&(jp->jobslock)));
     res = (jp->workers_total - jp->workers_avail) + queue_elements(jp->jobqueue);
+    res = (res > jp->workers_exiting) ? res - jp->workers_exiting : 0;
     zassert(pthread_mutex_unlock(&(jp->jobslock)));
     return res;
 }
@@ -605,6 +705,25 @@ uint32_t job_replicate_simple(void (*callback)(uint8_t status, void* extra), voi
     return job_new(jp, OP_REPLICATE, args, callback, extra, MFS_ERROR_NOTDONE, JOB_MODE_LIMITED_QUEUE);
 }
 
+uint32_t job_replicate_ec(void (*callback)(uint8_t status, void* extra), void* extra, uint64_t chunkid, uint32_t version, uint8_t k, uint8_t m, uint8_t part, uint8_t srccnt, const uint8_t* srcs)
+{
+    jobpool* jp = globalpool;
+    chunk_ec_args* args;
+    uint8_t* ptr;
+    ptr = (uint8_t*)malloc(sizeof(chunk_ec_args) + srccnt * 19);
+    passert(ptr);
+    args = (chunk_ec_args*)ptr;
+    ptr += sizeof(chunk_ec_args);
+    args->chunkid = chunkid;
+    args->version = version;
+    args->k = k;
+    args->m = m;
+    args->part = part;
+    args->srccnt = srccnt;
+    memcpy(ptr, srcs, srccnt * 19);
+    return job_new(jp, OP_REPLICATE_EC, args, callback, extra, MFS_ERROR_NOTDONE, JOB_MODE_LIMITED_QUEUE);
+}
+
 uint32_t job_get_chunk_blocks(void (*callback)(uint8_t status, void* extra), void* extra, uint64_t chunkid, uint32_t version, uint8_t* blocks)
 {
     jobpool* jp = globalpool;
@@ -717,20 +836,156 @@ int job_canexit(void)
 
 void job_term(void)
 {
-    job_pool_delete(globalpool);
+    jobpool* jp = globalpool;
+    globalpool = NULL;
+    job_pool_delete(jp);
 }
 
-void job_reload(void)
+// lock:jobslock
+static void job_apply_limits(jobpool* jp)
+{
+    zassert(pthread_mutex_lock(&limitslock));
+    jp->workers_min = limit_min;
+    jp->workers_max = limit_max;
+    jp->workers_max_idle = limit_max_idle;
+    zassert(pthread_mutex_unlock(&limitslock));
+    jp->workers_himark = (jp->workers_max * 3) / 4;
+    jp->workers_lomark = (jp->workers_max * 2) / 4;
+}
+
+void job_set_limits(uint32_t minworkers, uint32_t maxworkers, uint32_t maxidle)
+{
+    if (maxworkers == 0) {
+        maxworkers = 1;
+    }
+    if (minworkers > maxworkers) {
+        minworkers = maxworkers;
+    }
+    if (maxidle > maxworkers) {
+        maxidle = maxworkers;
+    }
+    zassert(pthread_mutex_lock(&limitslock));
+    limit_min = minworkers;
+    limit_max = maxworkers;
+    limit_max_idle = maxidle;
+    zassert(pthread_mutex_unlock(&limitslock));
+}
+
+void job_get_limits(uint32_t* minworkers, uint32_t* maxworkers, uint32_t* maxidle)
+{
+    zassert(pthread_mutex_lock(&limitslock));
+    *minworkers = limit_min;
+    *maxworkers = limit_max;
+    *maxidle = limit_max_idle;
+    zassert(pthread_mutex_unlock(&limitslock));
+}
+
+void job_pool_stats(uint32_t* total, uint32_t* idle, uint32_t* queued, uint32_t* qwaitusec)
 {
     jobpool* jp = globalpool;
 
+    if (jp == NULL) {
+        *total = *idle = *queued = *qwaitusec = 0;
+        return;
+    }
     zassert(pthread_mutex_lock(&(jp->jobslock)));
+    *total = jp->workers_total;
+    *idle = jp->workers_avail;
+    *queued = queue_elements(jp->jobqueue);
+    *queued = (*queued > jp->workers_exiting) ? *queued - jp->workers_exiting : 0;
+    *qwaitusec = jp->qwaitavg;
+    zassert(pthread_mutex_unlock(&(jp->jobslock)));
+}
 
-    jp->workers_max = WORKERS_MAX;
-    jp->workers_himark = (jp->workers_max * 3) / 4;
-    jp->workers_lomark = (jp->workers_max * 2) / 4;
-    jp->workers_max_idle = WORKERS_MAX_IDLE;
+void job_adjust(void)
+{
+    jobpool* jp = globalpool;
+    uint32_t saturation, queued, live, spare, spawn, retire, step;
+    uint32_t qwait, qage;
+    uint64_t now;
+
+    saturation = hdd_io_saturation();
+    zassert(pthread_mutex_lock(&(jp->jobslock)));
+    job_apply_limits(jp);
+    queued = queue_elements(jp->jobqueue);
+    queued = (queued > jp->workers_exiting) ? queued - jp->workers_exiting : 0;
+    if (jp->qwaitcnt > 0) {
+        qwait = jp->qwaitsum / jp->qwaitcnt;
+        jp->qwaitavg = (jp->qwaitavg * 7 + qwait) / 8;
+        jp->qwaitsum = 0;
+        jp->qwaitcnt = 0;
+    }
+    // average is updated only on dequeue - when all workers are stuck nothing is dequeued, so check the oldest queued job too
+    qage = 0;
+    if (jp->qhead != NULL) {
+        now = monotonic_useconds();
+        if (now > jp->qhead->enqueued) {
+            qage = (now - jp->qhead->enqueued > UINT32_MAX) ? UINT32_MAX : now - jp->qhead->enqueued;
+        }
+    }
+    qwait = (qage > jp->qwaitavg) ? qage : jp->qwaitavg;
+    live = jp->workers_total - jp->workers_exiting;
+
+    spawn = 0;
+    if (live < jp->workers_min) {
+        spawn = jp->workers_min - live;
+    } else if (((jp->workers_avail == 0 && queued > 0) || (queued > jp->workers_avail && qwait > JOB_QUEUE_WAIT_TARGET * 1000)) && live < jp->workers_max) {
+        if (saturation >= 100) {
+            step = 1;
+        } else {
+            step = live / 8;
+            if (step < 1) {
+                step = 1;
+            }
+            if (step > JOB_SPAWN_BURST) {
+                step = JOB_SPAWN_BURST;
+            }
+        }
+        spawn = queued - jp->workers_avail;
+        if (spawn > step) {
+            spawn = step;
+        }
+        if (spawn > jp->workers_max - live) {
+            spawn = jp->workers_max - live;
+        }
+    }
+    while (spawn > 0 && job_spawn_worker(jp) == 0) {
+        spawn--;
+    }
 
+    retire = 0;
+    live = jp->workers_total - jp->workers_exiting;
+    if (live > jp->workers_max) {
+        retire = live - jp->workers_max;
+    }
+    jp->ticks++;
+    if (jp->ticks >= JOB_SHRINK_TICKS) {
+        // workers that already got exit request are still counted as available
+        spare = (jp->workers_minavail > jp->workers_exiting) ? jp->workers_minavail - jp->workers_exiting : 0;
+        if (spare > jp->workers_max_idle + retire) {
+            retire += (spare - jp->workers_max_idle - retire + 1) / 2;
+        }
+        if (retire > live || live - retire < jp->workers_min) {
+            retire = (live > jp->workers_min) ? live - jp->workers_min : 0;
+        }
+        jp->workers_minavail = jp->workers_avail;
+        jp->ticks = 0;
+    }
+    while (retire > 0) {
+        queue_put(jp->jobqueue, 0, OP_EXIT, NULL, 1);
+        jp->workers_exiting++;
+        retire--;
+    }
+    zassert(pthread_mutex_unlock(&(jp->jobslock)));
+}
+
+void job_reload(void)
+{
+    jobpool* jp = globalpool;
+
+    zassert(pthread_mutex_lock(&(jp->jobslock)));
+    job_apply_limits(jp);
+    while (jp->workers_total < jp->workers_min && job_spawn_worker(jp) == 0) { }
     zassert(pthread_mutex_unlock(&(jp->jobslock)));
 }
 
@@ -741,10 +996,12 @@ int job_init(void)
         return -1;
     }
     job_reload();
+    syslog(LOG_NOTICE, "jobs: pre-warmed %" PRIu32 " workers", globalpool->workers_total);
     main_destruct_register(job_term);
     main_canexit_register(job_canexit);
     main_reload_register(job_reload);
     main_eachloop_register(job_heavyload_test);
+    main_msectime_register(JOB_ADJUST_MSEC, 0, job_adjust);
     main_poll_register(job_desc, job_serve);
     return 0;
 }
@@ -33,6 +33,10 @@
 
 void job_stats(uint32_t *maxjobscnt);
 void job_get_load_and_hlstatus(uint32_t *load,uint8_t *hlstatus);
+/* worker pool limits - may be changed from any thread, applied by pool within JOB_ADJUST_MSEC */
+void job_set_limits(uint32_t minworkers,uint32_t maxworkers,uint32_t maxidle);
+void job_get_limits(uint32_t *minworkers,uint32_t *maxworkers,uint32_t *maxidle);
+void job_pool_stats(uint32_t *total,uint32_t *idle,uint32_t *queued,uint32_t *qwaitusec);
 void job_pool_disable_job(uint32_t jobid);
 void job_pool_change_callback(uint32_t jobid,void (*callback)(uint8_t status,void *extra),void *extra);
 uint32_t job_inval(void (*callback)(uint8_t status,void *extra),void *extra);
@@ -41,6 +45,7 @@ uint32_t job_serv_read(void (*callback)(uint8_t status,void *extra),void *extra,
 uint32_t job_serv_write(void (*callback)(uint8_t status,void *extra),void *extra,int sock,const uint8_t *packet,uint32_t length);
 uint32_t job_replicate_raid(void (*callback)(uint8_t status,void *extra),void *extra,uint64_t chunkid,uint32_t version,uint8_t srccnt,const uint32_t xormasks[4],const uint8_t *srcs);
 uint32_t job_replicate_simple(void (*callback)(uint8_t status,void *extra),void *extra,uint64_t chunkid,uint32_t version,uint32_t ip,uint16_t port);
+uint32_t job_replicate_ec(void (*callback)(uint8_t status,void *extra),void *extra,uint64_t chunkid,uint32_t version,uint8_t k,uint8_t m,uint8_t part,uint8_t srccnt,const uint8_t *srcs);
 uint32_t job_get_chunk_blocks(void (*callback)(uint8_t status,void *extra),void *extra,uint64_t chunkid,uint32_t version,uint8_t *blocks);
 uint32_t job_get_chunk_checksum(void (*callback)(uint8_t status,void *extra),void *extra,uint64_t chunkid,uint32_t version,uint8_t *checksum);
 uint32_t job_get_chunk_checksum_tab(void (*callback)(uint8_t status,void *extra),void *extra,uint64_t chunkid,uint32_t version,uint8_t *checksum_tab);
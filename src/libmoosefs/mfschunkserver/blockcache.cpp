@@ -0,0 +1,314 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MFSCommunication.h"
+#include "blockcache.h"
+#include "massert.h"
+
+/*
+ * Blocks are kept only after their crc was checked against chunk crc table, so a hit needs neither I/O nor
+ * block crc. Cache is split into independently locked shards; 16 consecutive blocks of a chunk always land in
+ * the same shard, so dropping a whole chunk takes only MFSBLOCKSINCHUNK/16 shard locks.
+ */
+
+#define BLOCKCACHE_SHARDS 64
+#define BLOCKCACHE_GROUPBITS 4
+#define BLOCKCACHE_GROUPS (MFSBLOCKSINCHUNK >> BLOCKCACHE_GROUPBITS)
+
+typedef struct _cblock {
+    uint64_t chunkid;
+    uint32_t version;
+    uint16_t blocknum;
+    struct _cblock* hnext;
+    struct _cblock *lprev, *lnext; // lprev - more recently used
+    uint8_t data[MFSBLOCKSIZE];
+} cblock;
+
+typedef struct _cshard {
+    pthread_mutex_t lock;
+    cblock** hashtab;
+    uint32_t hashmask;
+    uint32_t entries;
+    uint32_t allocated;
+    uint32_t maxentries;
+    cblock *lruhead, *lrutail;
+    cblock* freelist;
+    uint64_t hits;
+    uint64_t misses;
+} __attribute__((aligned(64))) cshard;
+
+static cshard shards[BLOCKCACHE_SHARDS];
+static uint8_t enabled = 0;
+static uint64_t cachesize = 0;
+
+static inline uint64_t blockcache_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= UINT64_C(0xFF51AFD7ED558CCD);
+    x ^= x >> 33;
+    return x;
+}
+
+static inline cshard* blockcache_shard(uint64_t chunkid, uint16_t blocknum)
+{
+    return shards + (blockcache_mix(chunkid + ((uint64_t)(blocknum >> BLOCKCACHE_GROUPBITS) << 48)) % BLOCKCACHE_SHARDS);
+}
+
+static inline uint32_t blockcache_hashpos(cshard* s, uint64_t chunkid, uint16_t blocknum)
+{
+    return (uint32_t)(blockcache_mix(chunkid ^ ((uint64_t)blocknum << 50)) >> 16) & s->hashmask;
+}
+
+static inline cblock* blockcache_find(cshard* s, uint64_t chunkid, uint16_t blocknum)
+{
+    cblock* cb;
+    for (cb = s->hashtab[blockcache_hashpos(s, chunkid, blocknum)]; cb; cb = cb->hnext) {
+        if (cb->chunkid == chunkid && cb->blocknum == blocknum) {
+            return cb;
+        }
+    }
+    return NULL;
+}
+
+static inline void blockcache_lru_unlink(cshard* s, cblock* cb)
+{
+    if (cb->lprev) {
+        cb->lprev->lnext = cb->lnext;
+    } else {
+        s->lruhead = cb->lnext;
+    }
+    if (cb->lnext) {
+        cb->lnext->lprev = cb->lprev;
+    } else {
+        s->lrutail = cb->lprev;
+    }
+}
+
+static inline void blockcache_lru_front(cshard* s, cblock* cb)
+{
+    cb->lprev = NULL;
+    cb->lnext = s->lruhead;
+    if (s->lruhead) {
+        s->lruhead->lprev = cb;
+    } else {
+        s->lrutail = cb;
+    }
+    s->lruhead = cb;
+}
+
+/* unlinks block from hash and lru list and puts it on free list */
+static void blockcache_remove(cshard* s, cblock* cb)
+{
+    cblock** cbp;
+    cbp = s->hashtab + blockcache_hashpos(s, cb->chunkid, cb->blocknum);
+    while (*cbp != cb) {
+        cbp = &((*cbp)->hnext);
+    }
+    *cbp = cb->hnext;
+    blockcache_lru_unlink(s, cb);
+    cb->hnext = s->freelist;
+    s->freelist = cb;
+    s->entries--;
+}
+
+void blockcache_init(uint64_t maxbytes)
+{
+    uint32_t i, maxentries, hashsize;
+    cshard* s;
+
+    maxentries = maxbytes / MFSBLOCKSIZE / BLOCKCACHE_SHARDS;
+    enabled = (maxentries > 0) ? 1 : 0;
+    cachesize = (uint64_t)maxentries * MFSBLOCKSIZE * BLOCKCACHE_SHARDS;
+    hashsize = 16;
+    while (hashsize < maxentries) {
+        hashsize <<= 1;
+    }
+    for (i = 0; i < BLOCKCACHE_SHARDS; i++) {
+        s = shards + i;
+        zassert(pthread_mutex_init(&(s->lock), NULL));
+        s->hashtab = NULL;
+        if (enabled) {
+            s->hashtab = (cblock**)calloc(hashsize, sizeof(cblock*));
+            passert(s->hashtab);
+        }
+        s->hashmask = hashsize - 1;
+        s->entries = 0;
+        s->allocated = 0;
+        s->maxentries = maxentries;
+        s->lruhead = NULL;
+        s->lrutail = NULL;
+        s->freelist = NULL;
+        s->hits = 0;
+        s->misses = 0;
+    }
+}
+
+void blockcache_term(void)
+{
+    uint32_t i;
+    cshard* s;
+    cblock *cb, *ncb;
+
+    if (enabled == 0) {
+        return;
+    }
+    enabled = 0;
+    for (i = 0; i < BLOCKCACHE_SHARDS; i++) {
+        s = shards + i;
+        zassert(pthread_mutex_lock(&(s->lock)));
+        for (cb = s->lruhead; cb; cb = ncb) {
+            ncb = cb->lnext;
+            free(cb);
+        }
+        for (cb = s->freelist; cb; cb = ncb) {
+            ncb = cb->hnext;
+            free(cb);
+        }
+        free(s->hashtab);
+        s->hashtab = NULL;
+        s->lruhead = s->lrutail = s->freelist = NULL;
+        s->entries = 0;
+        s->allocated = 0;
+        zassert(pthread_mutex_unlock(&(s->lock)));
+    }
+}
+
+int blockcache_read(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* buffer, uint32_t offset, uint32_t size)
+{
+    cshard* s;
+    cblock* cb;
+
+    if (enabled == 0) {
+        return 0;
+    }
+    s = blockcache_shard(chunkid, blocknum);
+    zassert(pthread_mutex_lock(&(s->lock)));
+    cb = blockcache_find(s, chunkid, blocknum);
+    if (cb == NULL || cb->version != version) {
+        s->misses++;
+        zassert(pthread_mutex_unlock(&(s->lock)));
+        return 0;
+    }
+    if (s->lruhead != cb) {
+        blockcache_lru_unlink(s, cb);
+        blockcache_lru_front(s, cb);
+    }
+    if (size > 0) {
+        memcpy(buffer, cb->data + offset, size);
+    }
+    s->hits++;
+    zassert(pthread_mutex_unlock(&(s->lock)));
+    return 1;
+}
+
+void blockcache_store(uint64_t chunkid, uint32_t version, uint16_t blocknum, const uint8_t* block)
+{
+    cshard* s;
+    cblock* cb;
+    uint32_t hpos;
+
+    if (enabled == 0) {
+        return;
+    }
+    s = blockcache_shard(chunkid, blocknum);
+    zassert(pthread_mutex_lock(&(s->lock)));
+    cb = blockcache_find(s, chunkid, blocknum);
+    if (cb != NULL) {
+        if (s->lruhead != cb) {
+            blockcache_lru_unlink(s, cb);
+            blockcache_lru_front(s, cb);
+        }
+    } else {
+        if (s->freelist) {
+            cb = s->freelist;
+            s->freelist = cb->hnext;
+        } else if (s->allocated < s->maxentries) {
+            cb = (cblock*)malloc(sizeof(cblock));
+            passert(cb);
+            s->allocated++;
+        } else {
+            cb = s->lrutail;
+            blockcache_remove(s, cb);
+            s->freelist = cb->hnext;
+        }
+        cb->chunkid = chunkid;
+        cb->blocknum = blocknum;
+        hpos = blockcache_hashpos(s, chunkid, blocknum);
+        cb->hnext = s->hashtab[hpos];
+        s->hashtab[hpos] = cb;
+        blockcache_lru_front(s, cb);
+        s->entries++;
+    }
+    cb->version = version;
+    memcpy(cb->data, block, MFSBLOCKSIZE);
+    zassert(pthread_mutex_unlock(&(s->lock)));
+}
+
+void blockcache_invalidate_block(uint64_t chunkid, uint16_t blocknum)
+{
+    cshard* s;
+    cblock* cb;
+
+    if (enabled == 0) {
+        return;
+    }
+    s = blockcache_shard(chunkid, blocknum);
+    zassert(pthread_mutex_lock(&(s->lock)));
+    cb = blockcache_find(s, chunkid, blocknum);
+    if (cb != NULL) {
+        blockcache_remove(s, cb);
+    }
+    zassert(pthread_mutex_unlock(&(s->lock)));
+}
+
+void blockcache_invalidate_chunk(uint64_t chunkid)
+{
+    cshard* s;
+    cblock* cb;
+    uint32_t g, b;
+
+    if (enabled == 0) {
+        return;
+    }
+    for (g = 0; g < BLOCKCACHE_GROUPS; g++) {
+        s = blockcache_shard(chunkid, g << BLOCKCACHE_GROUPBITS);
+        zassert(pthread_mutex_lock(&(s->lock)));
+        if (s->entries > 0) {
+            for (b = g << BLOCKCACHE_GROUPBITS; b < ((g + 1) << BLOCKCACHE_GROUPBITS); b++) {
+                cb = blockcache_find(s, chunkid, b);
+                if (cb != NULL) {
+                    blockcache_remove(s, cb);
+                }
+            }
+        }
+        zassert(pthread_mutex_unlock(&(s->lock)));
+    }
+}
+
+void blockcache_stats(uint64_t* hits, uint64_t* misses, uint64_t* usedbytes, uint64_t* maxbytes)
+{
+    uint32_t i;
+    cshard* s;
+
+    *hits = 0;
+    *misses = 0;
+    *usedbytes = 0;
+    *maxbytes = cachesize;
+    if (enabled == 0) {
+        return;
+    }
+    for (i = 0; i < BLOCKCACHE_SHARDS; i++) {
+        s = shards + i;
+        zassert(pthread_mutex_lock(&(s->lock)));
+        *hits += s->hits;
+        *misses += s->misses;
+        *usedbytes += (uint64_t)(s->entries) * MFSBLOCKSIZE;
+        zassert(pthread_mutex_unlock(&(s->lock)));
+    }
+}
@@ -0,0 +1,26 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _BLOCKCACHE_H_
+#define _BLOCKCACHE_H_
+
+#include <inttypes.h>
+
+/* memory bounded LRU cache of whole (already crc checked) blocks; maxbytes==0 disables it */
+void blockcache_init(uint64_t maxbytes);
+void blockcache_term(void);
+
+/* copies [offset,offset+size) of cached block to buffer; returns 1 on hit, 0 on miss (size 0 only checks that block is cached - buffer may be NULL) */
+int blockcache_read(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* buffer, uint32_t offset, uint32_t size);
+
+/* stores MFSBLOCKSIZE bytes of verified block */
+void blockcache_store(uint64_t chunkid, uint32_t version, uint16_t blocknum, const uint8_t* block);
+
+/* has to be called (with chunk locked) before block or chunk is modified */
+void blockcache_invalidate_block(uint64_t chunkid, uint16_t blocknum);
+void blockcache_invalidate_chunk(uint64_t chunkid);
+
+void blockcache_stats(uint64_t* hits, uint64_t* misses, uint64_t* usedbytes, uint64_t* maxbytes);
+
+#endif
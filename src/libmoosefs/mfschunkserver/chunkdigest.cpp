@@ -0,0 +1,63 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <crypto/sha256.h>
+
+#include "MFSCommunication.h"
+#include "chunkdigest.h"
+
+#define CHUNKDIGEST_LEAF 0
+#define CHUNKDIGEST_NODE 1
+
+static_assert(CHUNKDIGEST_SIZE == CSHA256::OUTPUT_SIZE, "chunk digest is a sha256 hash");
+
+static inline void chunkdigest_leaf(const uint8_t* crcs, uint32_t cnt, uint8_t digest[CHUNKDIGEST_SIZE])
+{
+    const uint8_t prefix = CHUNKDIGEST_LEAF;
+
+    CSHA256().Write(&prefix, 1).Write(crcs, cnt * 4).Finalize(digest);
+}
+
+static inline void chunkdigest_node(const uint8_t left[CHUNKDIGEST_SIZE], const uint8_t right[CHUNKDIGEST_SIZE], uint8_t digest[CHUNKDIGEST_SIZE])
+{
+    const uint8_t prefix = CHUNKDIGEST_NODE;
+
+    CSHA256().Write(&prefix, 1).Write(left, CHUNKDIGEST_SIZE).Write(right, CHUNKDIGEST_SIZE).Finalize(digest);
+}
+
+void chunkdigest_blocks(const uint8_t* crctab, uint16_t blocks, uint8_t digest[CHUNKDIGEST_SIZE])
+{
+    uint8_t level[MFSBLOCKSINCHUNK / CHUNKDIGEST_LEAFBLOCKS][CHUNKDIGEST_SIZE];
+    uint32_t i, cnt, n;
+
+    if (blocks > MFSBLOCKSINCHUNK) {
+        blocks = MFSBLOCKSINCHUNK;
+    }
+    if (blocks == 0) {
+        chunkdigest_leaf(crctab, 0, digest);
+        return;
+    }
+    cnt = 0;
+    for (i = 0; i < blocks; i += CHUNKDIGEST_LEAFBLOCKS) {
+        chunkdigest_leaf(crctab + 4 * i, (blocks - i < CHUNKDIGEST_LEAFBLOCKS) ? blocks - i : CHUNKDIGEST_LEAFBLOCKS, level[cnt]);
+        cnt++;
+    }
+    // reduce levels in place
+    while (cnt > 1) {
+        n = 0;
+        for (i = 0; i + 1 < cnt; i += 2) {
+            chunkdigest_node(level[i], level[i + 1], level[n]);
+            n++;
+        }
+        if (i < cnt) {
+            memmove(level[n], level[i], CHUNKDIGEST_SIZE);
+            n++;
+        }
+        cnt = n;
+    }
+    memcpy(digest, level[0], CHUNKDIGEST_SIZE);
+}
@@ -0,0 +1,20 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _CHUNKDIGEST_H_
+#define _CHUNKDIGEST_H_
+
+#include <inttypes.h>
+
+#define CHUNKDIGEST_SIZE 32
+/* number of block crcs hashed into one leaf */
+#define CHUNKDIGEST_LEAFBLOCKS 16
+
+/*
+ * Merkle-style digest of chunk block crcs (sha256, leaves and inner nodes are domain separated, odd node is carried up).
+ * crctab holds 'blocks' crcs in the same format as the chunk file header (big endian, 4 bytes each).
+ */
+void chunkdigest_blocks(const uint8_t* crctab, uint16_t blocks, uint8_t digest[CHUNKDIGEST_SIZE]);
+
+#endif
@@ -38,6 +38,9 @@
 // connection timeout in seconds
 #define CSSERV_TIMEOUT 5
 
+// timeouts, keep-alives and closed connections are handled in this period (ms)
+#define CSSERV_CHECK_PERIOD 100
+
 #define MaxPacketSize CSTOCS_MAXPACKETSIZE
 
 #define MYSIZE(s, f, a) ((offsetof(s, f) + (a) < sizeof(s)) ? sizeof(s) : (offsetof(s, f) + (a)))
@@ -80,7 +83,7 @@ typedef struct csserventry {
     uint8_t mode;
 
     int sock;
-    int32_t pdescpos;
+    void* fdhandle; // main loop registration
     double lastread, lastwrite;
     uint32_t activity;
     uint8_t hdrbuff[8];
@@ -96,7 +99,7 @@ typedef struct csserventry {
 
 static csserventry* csservhead = NULL;
 static int lsock;
-static int32_t lsockpdescpos;
+static void* lsockhandle;
 
 static uint32_t mylistenip;
 static uint16_t mylistenport;
@@ -116,6 +119,19 @@ void csserv_stats(uint64_t* bin, uint64_t* bout)
     stats_bytesout = 0;
 }
 
+/* watch only connections owned by main thread - others (READ/WRITE/CLOSE) are silenced, so level triggered events can't spin */
+static inline void csserv_fdupdate(csserventry* eptr)
+{
+    short events = 0;
+    if (eptr->state == IDLE) {
+        events = POLLIN;
+        if (eptr->outputhead != NULL) {
+            events |= POLLOUT;
+        }
+    }
+    main_fd_change(eptr->fdhandle, events);
+}
+
 uint8_t* csserv_create_packet(csserventry* eptr, uint32_t type, uint32_t size)
 {
     packetstruct* outpacket;
@@ -141,6 +157,7 @@ uint8_t* csserv_create_packet(csserventry* eptr, uint32_t type, uint32_t size)
     outpacket->next = NULL;
     *(eptr->outputtail) = outpacket;
     eptr->outputtail = &(outpacket->next);
+    csserv_fdupdate(eptr);
     return ptr;
 }
 
@@ -214,6 +231,7 @@ void csserv_iothread_finished(uint8_t status, void* e)
         free(eptr->inputpacket.packet);
     }
     eptr->inputpacket.packet = NULL;
+    csserv_fdupdate(eptr);
 }
 
 void csserv_read_init(csserventry* eptr, const uint8_t* data, uint32_t length)
@@ -501,6 +519,8 @@ void csserv_gotpacket(csserventry* eptr, uint32_t type, const uint8_t* data, uin
 void csserv_wantexit(void)
 {
     syslog(LOG_NOTICE, "closing %s:%s", ListenHost, ListenPort);
+    main_fd_unregister(lsockhandle);
+    lsockhandle = NULL;
     tcpclose(lsock);
     lsock = -1;
 }
@@ -512,6 +532,7 @@ void csserv_term(void)
 
     eptr = csservhead;
     while (eptr) {
+        main_fd_unregister(eptr->fdhandle);
         tcpclose(eptr->sock);
         if (eptr->inputpacket.packet) {
             free(eptr->inputpacket.packet);
@@ -658,86 +679,76 @@ void csserv_write(csserventry* eptr)
     }
 }
 
-void csserv_desc(struct pollfd* pdesc, uint32_t* ndesc)
+void csserv_fdserve(void* arg, short revents)
 {
-    uint32_t pos = *ndesc;
-    csserventry* eptr;
+    csserventry* eptr = (csserventry*)arg;
+    double now;
 
-    if (lsock >= 0) {
-        pdesc[pos].fd = lsock;
-        pdesc[pos].events = POLLIN;
-        lsockpdescpos = pos;
-        pos++;
-    } else {
-        lsockpdescpos = 0;
+    now = monotonic_seconds();
+    if (revents & (POLLERR | POLLHUP)) {
+        eptr->state = CLOSE;
     }
-    for (eptr = csservhead; eptr; eptr = eptr->next) {
-        eptr->pdescpos = -1;
-        if (eptr->state == IDLE) {
-            pdesc[pos].events = POLLIN;
-            if (eptr->outputhead != NULL) {
-                pdesc[pos].events |= POLLOUT;
-            }
-            eptr->pdescpos = pos;
-            pdesc[pos].fd = eptr->sock;
-            pos++;
-        }
+    if ((revents & POLLIN) && eptr->state == IDLE) {
+        eptr->lastread = now;
+        csserv_read(eptr);
+    }
+    if ((revents & POLLOUT) && eptr->state == IDLE) {
+        eptr->lastwrite = now;
+        csserv_write(eptr);
     }
-    *ndesc = pos;
+    csserv_fdupdate(eptr);
 }
 
-void csserv_serve(struct pollfd* pdesc)
+void csserv_accept(void* arg, short revents)
 {
     double now;
-    csserventry *eptr, **kptr;
-    packetstruct *pptr, *paptr;
+    csserventry* eptr;
     int ns;
 
+    (void)arg;
+    if ((revents & POLLIN) == 0 || lsock < 0) {
+        return;
+    }
     now = monotonic_seconds();
+    ns = tcpaccept(lsock);
+    if (ns < 0) {
+        mfs_errlog_silent(LOG_NOTICE, "accept error");
+    } else {
+        tcpnonblock(ns);
+        tcpnodelay(ns);
+        eptr = (csserventry*)malloc(sizeof(csserventry));
+        passert(eptr);
+        eptr->next = csservhead;
+        csservhead = eptr;
+        eptr->state = IDLE;
+        eptr->mode = HEADER;
+        eptr->sock = ns;
+        eptr->lastread = now;
+        eptr->lastwrite = now;
+        eptr->inputpacket.bytesleft = 8;
+        eptr->inputpacket.startptr = eptr->hdrbuff;
+        eptr->inputpacket.packet = NULL;
+        eptr->outputhead = NULL;
+        eptr->outputtail = &(eptr->outputhead);
+        eptr->jobid = 0;
 
-    if (lsockpdescpos >= 0 && (pdesc[lsockpdescpos].revents & POLLIN) && lsock >= 0) {
-        ns = tcpaccept(lsock);
-        if (ns < 0) {
-            mfs_errlog_silent(LOG_NOTICE, "accept error");
-        } else {
-            tcpnonblock(ns);
-            tcpnodelay(ns);
-            eptr = (csserventry*)malloc(sizeof(csserventry));
-            passert(eptr);
-            eptr->next = csservhead;
-            csservhead = eptr;
-            eptr->state = IDLE;
-            eptr->mode = HEADER;
-            eptr->sock = ns;
-            eptr->pdescpos = -1;
-            eptr->lastread = now;
-            eptr->lastwrite = now;
-            eptr->inputpacket.bytesleft = 8;
-            eptr->inputpacket.startptr = eptr->hdrbuff;
-            eptr->inputpacket.packet = NULL;
-            eptr->outputhead = NULL;
-            eptr->outputtail = &(eptr->outputhead);
-            eptr->jobid = 0;
-
-            eptr->idlejobs = NULL;
-        }
+        eptr->idlejobs = NULL;
+        eptr->fdhandle = main_fd_register(ns, POLLIN, csserv_fdserve, eptr);
     }
+}
+
+void csserv_check(void)
+{
+    double now;
+    csserventry *eptr, **kptr;
+    packetstruct *pptr, *paptr;
+
+    now = monotonic_seconds();
 
     for (eptr = csservhead; eptr; eptr = eptr->next) {
-        if (eptr->pdescpos >= 0 && (pdesc[eptr->pdescpos].revents & (POLLERR | POLLHUP))) {
-            eptr->state = CLOSE;
-        }
-        if (eptr->pdescpos >= 0 && (pdesc[eptr->pdescpos].revents & POLLIN) && eptr->state == IDLE) {
-            eptr->lastread = now;
-            csserv_read(eptr);
-        }
         if (eptr->state == IDLE && eptr->lastwrite + (CSSERV_TIMEOUT / 3.0) < now && eptr->outputhead == NULL) {
             csserv_create_packet(eptr, ANTOAN_NOP, 0);
         }
-        if (eptr->pdescpos >= 0 && (pdesc[eptr->pdescpos].revents & POLLOUT) && eptr->state == IDLE) {
-            eptr->lastwrite = now;
-            csserv_write(eptr);
-        }
         if (eptr->state == IDLE && eptr->lastread + CSSERV_TIMEOUT < now) {
             syslog(LOG_NOTICE, "csserv: connection timed out");
             eptr->state = CLOSE;
@@ -747,6 +758,7 @@ void csserv_serve(struct pollfd* pdesc)
     kptr = &csservhead;
     while ((eptr = *kptr)) {
         if (eptr->state == CLOSE) {
+            main_fd_unregister(eptr->fdhandle);
             tcpclose(eptr->sock);
             csserv_close(eptr);
             if (eptr->inputpacket.packet) {
@@ -827,8 +839,10 @@ void csserv_reload(void)
     free(ListenPort);
     ListenHost = newListenHost;
     ListenPort = newListenPort;
+    main_fd_unregister(lsockhandle);
     tcpclose(lsock);
     lsock = newlsock;
+    lsockhandle = main_fd_register(lsock, POLLIN, csserv_accept, NULL);
     mylistenip = newmylistenip;
     mylistenport = newmylistenport;
     masterconn_forcereconnect();
@@ -863,7 +877,8 @@ int csserv_init(void)
     main_wantexit_register(csserv_wantexit);
     main_reload_register(csserv_reload);
     main_destruct_register(csserv_term);
-    main_poll_register(csserv_desc, csserv_serve);
+    lsockhandle = main_fd_register(lsock, POLLIN, csserv_accept, NULL);
+    main_msectime_register(CSSERV_CHECK_PERIOD, 0, csserv_check);
 
     return 0;
 }
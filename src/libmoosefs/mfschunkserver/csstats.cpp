@@ -0,0 +1,109 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "bgjobs.h"
+#include "blockcache.h"
+#include "clocks.h"
+#include "csserv.h"
+#include "csstats.h"
+#include "hddspacemgr.h"
+#include "mainserv.h"
+#include "mainthread.h"
+#include "massert.h"
+#include "masterconn.h"
+#include "replicator.h"
+
+/*
+ * Module stats are reset on read and some of them (csserv, masterconn) are not locked at all, so they are
+ * drained only here - in main thread. Readers from other threads get a copy of the last collected state.
+ */
+
+static pthread_mutex_t statslock = PTHREAD_MUTEX_INITIALIZER;
+static csstats_data current;
+
+void csstats_get(csstats_data* d)
+{
+    zassert(pthread_mutex_lock(&statslock));
+    *d = current;
+    zassert(pthread_mutex_unlock(&statslock));
+}
+
+void csstats_collect(void)
+{
+    csstats_data d;
+    uint64_t b64a, b64b, b64c, rtime, wtime, tdused, tdtotal, prevcollected;
+    uint32_t v32[8], tdchunks;
+
+    zassert(pthread_mutex_lock(&statslock));
+    d.total = current.total;
+    prevcollected = current.collected;
+    zassert(pthread_mutex_unlock(&statslock));
+
+    hdd_stats(&b64a, &b64b, v32 + 0, v32 + 1, v32 + 2, v32 + 3, v32 + 4, v32 + 5, v32 + 6, v32 + 7, &rtime, &wtime);
+    d.total.hddbytesr += b64a;
+    d.total.hddbytesw += b64b;
+    d.total.hddopr += v32[0];
+    d.total.hddopw += v32[1];
+    d.total.databytesr += v32[2];
+    d.total.databytesw += v32[3];
+    d.total.dataopr += v32[4];
+    d.total.dataopw += v32[5];
+    d.total.movels += v32[6];
+    d.total.movehs += v32[7];
+    d.total.datansecr += rtime;
+    d.total.datansecw += wtime;
+    hdd_op_stats(v32 + 0, v32 + 1, v32 + 2, v32 + 3, v32 + 4, v32 + 5, v32 + 6);
+    d.total.opcreate += v32[0];
+    d.total.opdelete += v32[1];
+    d.total.opversion += v32[2];
+    d.total.opduplicate += v32[3];
+    d.total.optruncate += v32[4];
+    d.total.opduptrunc += v32[5];
+    d.total.optest += v32[6];
+    mainserv_stats(&b64a, &b64b, v32 + 0, v32 + 1);
+    d.total.mainbytesin += b64a;
+    d.total.mainbytesout += b64b;
+    d.total.hlopr += v32[0];
+    d.total.hlopw += v32[1];
+    replicator_stats(&b64a, &b64b, v32 + 0, v32 + 1, v32 + 2, v32 + 3, &b64c);
+    d.total.replbytesin += b64a;
+    d.total.replbytesout += b64b;
+    d.total.repl += v32[0];
+    d.total.replok += v32[1];
+    d.total.replconnreused += v32[2];
+    d.total.replconnnew += v32[3];
+    d.total.replusec += b64c;
+    d.replbps = (prevcollected > 0) ? b64a * 1000000 / (monotonic_useconds() - prevcollected + 1) : 0;
+    replicator_window_stats(&d.replinflight, &d.replwaiting);
+    csserv_stats(&b64a, &b64b);
+    d.total.csservbytesin += b64a;
+    d.total.csservbytesout += b64b;
+    masterconn_stats(&b64a, &b64b);
+    d.total.masterbytesin += b64a;
+    d.total.masterbytesout += b64b;
+
+    job_get_load_and_hlstatus(&d.load, &d.hlstatus);
+    job_pool_stats(&d.workers, &d.workersidle, &d.queued, &d.queuewaitusec);
+    d.iosaturation = hdd_io_saturation();
+    blockcache_stats(&d.cachehits, &d.cachemisses, &d.cacheused, &d.cachesize);
+    hdd_get_space(&d.usedspace, &d.totalspace, &d.chunkcount, &tdused, &tdtotal, &tdchunks);
+    d.collected = monotonic_useconds();
+
+    zassert(pthread_mutex_lock(&statslock));
+    current = d;
+    zassert(pthread_mutex_unlock(&statslock));
+}
+
+int csstats_init(void)
+{
+    zassert(pthread_mutex_lock(&statslock));
+    memset(&current, 0, sizeof(current));
+    zassert(pthread_mutex_unlock(&statslock));
+    main_time_register(1, 0, csstats_collect);
+    return 0;
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _CSSTATS_H_
+#define _CSSTATS_H_
+
+#include <inttypes.h>
+
+/* counters accumulated since start (reset-on-read module stats are drained by main thread every second) */
+typedef struct csstats_counters {
+    uint64_t hddbytesr;
+    uint64_t hddbytesw;
+    uint64_t hddopr;
+    uint64_t hddopw;
+    uint64_t databytesr;
+    uint64_t databytesw;
+    uint64_t dataopr;
+    uint64_t dataopw;
+    uint64_t datansecr;
+    uint64_t datansecw; // writes and fsyncs
+    uint64_t movels;
+    uint64_t movehs;
+    uint64_t opcreate;
+    uint64_t opdelete;
+    uint64_t opversion;
+    uint64_t opduplicate;
+    uint64_t optruncate;
+    uint64_t opduptrunc;
+    uint64_t optest;
+    uint64_t mainbytesin;
+    uint64_t mainbytesout;
+    uint64_t hlopr;
+    uint64_t hlopw;
+    uint64_t replbytesin;
+    uint64_t replbytesout;
+    uint64_t repl;
+    uint64_t replok;
+    uint64_t replconnreused;
+    uint64_t replconnnew;
+    uint64_t replusec;
+    uint64_t csservbytesin;
+    uint64_t csservbytesout;
+    uint64_t masterbytesin;
+    uint64_t masterbytesout;
+} csstats_counters;
+
+typedef struct csstats_data {
+    uint64_t collected; // monotonic usec of last collection (0 - chunkserver is not running yet)
+    csstats_counters total;
+    uint32_t load;
+    uint8_t hlstatus;
+    uint32_t workers;
+    uint32_t workersidle;
+    uint32_t queued;
+    uint32_t queuewaitusec;
+    uint32_t iosaturation;
+    uint32_t replinflight;
+    uint32_t replwaiting;
+    uint64_t replbps; // replication bytes received per second in last collection period
+    uint64_t cachehits;
+    uint64_t cachemisses;
+    uint64_t cacheused;
+    uint64_t cachesize;
+    uint64_t usedspace;
+    uint64_t totalspace;
+    uint32_t chunkcount;
+} csstats_data;
+
+/* can be called from any thread */
+void csstats_get(csstats_data *d);
+
+int csstats_init(void);
+
+#endif
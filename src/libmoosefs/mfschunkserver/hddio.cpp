@@ -0,0 +1,671 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HDDIO_URING 1
+#endif
+#endif
+#endif
+
+#include "hddio.h"
+#include "massert.h"
+
+static uint64_t stats_submits = 0;
+static uint64_t stats_sqes = 0;
+static uint64_t stats_fallbacks = 0;
+
+static inline void hddio_stats_add(uint64_t* cnt, uint64_t v)
+{
+    __sync_fetch_and_add(cnt, v);
+}
+
+void hddio_stats(uint64_t* submits, uint64_t* sqes, uint64_t* fallbacks)
+{
+    *submits = __sync_fetch_and_add(&stats_submits, 0);
+    *sqes = __sync_fetch_and_add(&stats_sqes, 0);
+    *fallbacks = __sync_fetch_and_add(&stats_fallbacks, 0);
+}
+
+static inline int hddio_sync_fsync(int fd)
+{
+#ifdef F_FULLFSYNC
+    return fcntl(fd, F_FULLFSYNC);
+#else
+    return fsync(fd);
+#endif
+}
+
+/* synchronous path - also used to finish short transfers */
+static inline void hddio_sync_one(hddio_vec* v, uint32_t done)
+{
+    ssize_t r;
+    if (v->write == HDDIO_FSYNC) {
+        v->result = (hddio_sync_fsync(v->fd) < 0) ? -errno : 0;
+        return;
+    }
+    while (done < v->size) {
+        if (v->write) {
+            r = pwrite(v->fd, v->buf + done, v->size - done, v->offset + done);
+        } else {
+            r = pread(v->fd, v->buf + done, v->size - done, v->offset + done);
+        }
+        if (r < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (done == 0) {
+                v->result = -errno;
+                return;
+            }
+            break;
+        }
+        if (r == 0) { // EOF
+            break;
+        }
+        done += r;
+    }
+    v->result = done;
+}
+
+/* finishes vectored write after first 'done' bytes were already written - short transfers are rare, so piece by piece */
+static ssize_t hddio_sync_writev(int fd, const struct iovec* iov, int iovcnt, uint64_t offset, size_t done)
+{
+    hddio_vec v;
+    size_t pos;
+    int i;
+
+    pos = 0;
+    for (i = 0; i < iovcnt; i++) {
+        if (done < pos + iov[i].iov_len) {
+            v.fd = fd;
+            v.write = HDDIO_WRITE;
+            v.buf = (uint8_t*)(iov[i].iov_base);
+            v.size = iov[i].iov_len;
+            v.offset = offset + pos;
+            hddio_sync_one(&v, done - pos);
+            if (v.result < 0 && done == 0) {
+                errno = -v.result;
+                return -1;
+            }
+            if (v.result < 0 || (uint32_t)(v.result) < v.size) {
+                return (v.result < 0) ? done : pos + v.result;
+            }
+            done = pos + v.size;
+        }
+        pos += iov[i].iov_len;
+    }
+    return done;
+}
+
+#ifdef HDDIO_URING
+
+#define HDDIO_MAX_BATCH 64
+
+#define HDDIO_OP_INFLIGHT 0
+#define HDDIO_OP_DONE 1
+#define HDDIO_OP_NOTSUBMITTED 2
+
+typedef struct hddio_waiter {
+    pthread_cond_t cond;
+    uint32_t pending;
+    uint8_t stream; // wake up on every completion (not only on the last one)
+    struct hddio_waiter* next;
+} hddio_waiter;
+
+typedef struct hddio_op {
+    hddio_vec* v;
+    hddio_waiter* w;
+    struct iovec iov;
+    const struct iovec* iovp; // &iov or caller's gather list
+    uint32_t iovcnt;
+    uint8_t state;
+} hddio_op;
+
+/* there is no reaper thread - one of the threads waiting on the ring collects completions for all of them (io_uring_enter with IORING_ENTER_GETEVENTS) and hands this role over when its own operations are done */
+typedef struct hddio_ring {
+    int fd;
+    uint32_t entries;
+    uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+    uint32_t *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sqptr;
+    size_t sqsize;
+    void* cqptr;
+    size_t cqsize;
+    size_t sqesize;
+    uint32_t inflight;
+    uint32_t freewaiting;
+    uint8_t reaping;
+    hddio_waiter* waiters;
+    pthread_mutex_t lock;
+    pthread_cond_t freecond;
+} hddio_ring;
+
+static inline int hddio_uring_setup(uint32_t entries, struct io_uring_params* p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int hddio_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/* moves all available completions to their waiters (ring lock must be held) */
+static void hddio_reap(hddio_ring* r)
+{
+    uint32_t head, tail;
+    struct io_uring_cqe* cqe;
+    hddio_op* op;
+
+    head = *(r->cq_head);
+    tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        cqe = r->cqes + (head & *(r->cq_mask));
+        op = (hddio_op*)(uintptr_t)(cqe->user_data);
+        op->v->result = cqe->res;
+        op->state = HDDIO_OP_DONE;
+        op->w->pending--;
+        if (op->w->pending == 0 || op->w->stream) {
+            zassert(pthread_cond_signal(&(op->w->cond)));
+        }
+        r->inflight--;
+        head++;
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    if (r->freewaiting > 0) {
+        zassert(pthread_cond_broadcast(&(r->freecond)));
+    }
+}
+
+/* current reaper leaves - wake up another waiter that still has operations in flight, so it takes over (ring lock must be held) */
+static inline void hddio_reap_handoff(hddio_ring* r, hddio_waiter* self)
+{
+    hddio_waiter* w;
+
+    r->reaping = 0;
+    for (w = r->waiters; w != NULL; w = w->next) {
+        if (w != self && w->pending > 0) {
+            zassert(pthread_cond_signal(&(w->cond)));
+            return;
+        }
+    }
+}
+
+void* hddio_ring_new(uint32_t entries)
+{
+    hddio_ring* r;
+    struct io_uring_params p;
+    int fd;
+
+    memset(&p, 0, sizeof(p));
+    fd = hddio_uring_setup(entries, &p);
+    if (fd < 0) {
+        // ENOSYS (old kernel) or EPERM (seccomp/containers) - caller falls back to pread/pwrite
+        return NULL;
+    }
+    r = (hddio_ring*)malloc(sizeof(hddio_ring));
+    passert(r);
+    r->fd = fd;
+    r->entries = p.sq_entries;
+    r->sqsize = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    r->cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cqsize > r->sqsize) {
+            r->sqsize = r->cqsize;
+        }
+        r->cqsize = r->sqsize;
+    }
+    r->sqptr = mmap(NULL, r->sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (r->sqptr == MAP_FAILED) {
+        close(fd);
+        free(r);
+        return NULL;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cqptr = r->sqptr;
+    } else {
+        r->cqptr = mmap(NULL, r->cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (r->cqptr == MAP_FAILED) {
+            munmap(r->sqptr, r->sqsize);
+            close(fd);
+            free(r);
+            return NULL;
+        }
+    }
+    r->sqesize = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqesize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if ((void*)(r->sqes) == MAP_FAILED) {
+        if (r->cqptr != r->sqptr) {
+            munmap(r->cqptr, r->cqsize);
+        }
+        munmap(r->sqptr, r->sqsize);
+        close(fd);
+        free(r);
+        return NULL;
+    }
+    r->sq_head = (uint32_t*)((uint8_t*)r->sqptr + p.sq_off.head);
+    r->sq_tail = (uint32_t*)((uint8_t*)r->sqptr + p.sq_off.tail);
+    r->sq_mask = (uint32_t*)((uint8_t*)r->sqptr + p.sq_off.ring_mask);
+    r->sq_array = (uint32_t*)((uint8_t*)r->sqptr + p.sq_off.array);
+    r->cq_head = (uint32_t*)((uint8_t*)r->cqptr + p.cq_off.head);
+    r->cq_tail = (uint32_t*)((uint8_t*)r->cqptr + p.cq_off.tail);
+    r->cq_mask = (uint32_t*)((uint8_t*)r->cqptr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)((uint8_t*)r->cqptr + p.cq_off.cqes);
+    r->inflight = 0;
+    r->freewaiting = 0;
+    r->reaping = 0;
+    r->waiters = NULL;
+    zassert(pthread_mutex_init(&(r->lock), NULL));
+    zassert(pthread_cond_init(&(r->freecond), NULL));
+    return r;
+}
+
+static inline void hddio_fill_sqe(hddio_ring* r, uint8_t opcode, int fd, hddio_op* op, uint64_t offset)
+{
+    uint32_t tail, indx;
+    struct io_uring_sqe* sqe;
+
+    tail = *(r->sq_tail);
+    indx = tail & *(r->sq_mask);
+    sqe = r->sqes + indx;
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    if (op->iovcnt > 0) {
+        sqe->addr = (uint64_t)(uintptr_t)(op->iovp);
+        sqe->len = op->iovcnt;
+    }
+    sqe->off = offset;
+    sqe->user_data = (uint64_t)(uintptr_t)op;
+    r->sq_array[indx] = indx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* pushes 'cnt' prepared SQEs to the kernel - returns number accepted (ring lock must be held) */
+static inline uint32_t hddio_enter(hddio_ring* r, uint32_t cnt)
+{
+    uint32_t submitted;
+    int ret;
+
+    submitted = 0;
+    while (submitted < cnt) {
+        ret = hddio_uring_enter(r->fd, cnt - submitted, 0, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            break;
+        }
+        submitted += ret;
+    }
+    if (submitted < cnt) {
+        // without SQPOLL the kernel only consumes entries inside io_uring_enter, so unsubmitted ones can be withdrawn
+        __atomic_store_n(r->sq_tail, *(r->sq_tail) - (cnt - submitted), __ATOMIC_RELEASE);
+    }
+    return submitted;
+}
+
+static inline uint8_t hddio_opcode(const hddio_vec* v)
+{
+    switch (v->write) {
+    case HDDIO_WRITE:
+        return IORING_OP_WRITEV;
+    case HDDIO_FSYNC:
+        return IORING_OP_FSYNC;
+    }
+    return IORING_OP_READV;
+}
+
+/* submits prepared ops and waits for all of them - returns number of ops accepted by the kernel */
+/* when 'done' is given it is called (without ring lock) for every op in order as soon as it and all ops before it are finished (op->state tells if it was submitted at all) */
+static uint32_t hddio_run(hddio_ring* r, hddio_op* ops, uint32_t cnt, void (*done)(hddio_op* op, void* arg), void* arg)
+{
+    hddio_waiter w;
+    hddio_waiter** wp;
+    uint32_t i, submitted, next, upto;
+    uint8_t reaper;
+
+    zassert(pthread_cond_init(&(w.cond), NULL));
+    for (i = 0; i < cnt; i++) {
+        ops[i].w = &w;
+        ops[i].state = HDDIO_OP_INFLIGHT;
+    }
+    zassert(pthread_mutex_lock(&(r->lock)));
+    while (r->inflight + cnt > r->entries) {
+        r->freewaiting++;
+        zassert(pthread_cond_wait(&(r->freecond), &(r->lock)));
+        r->freewaiting--;
+    }
+    for (i = 0; i < cnt; i++) {
+        hddio_fill_sqe(r, hddio_opcode(ops[i].v), ops[i].v->fd, ops + i, ops[i].v->offset);
+    }
+    submitted = hddio_enter(r, cnt);
+    r->inflight += submitted;
+    for (i = submitted; i < cnt; i++) {
+        ops[i].state = HDDIO_OP_NOTSUBMITTED;
+    }
+    w.pending = submitted;
+    w.stream = (done != NULL);
+    w.next = r->waiters;
+    r->waiters = &w;
+    reaper = 0;
+    next = 0;
+    while (1) {
+        if (done != NULL) {
+            upto = next;
+            while (upto < cnt && ops[upto].state != HDDIO_OP_INFLIGHT) {
+                upto++;
+            }
+            if (upto > next) {
+                // callback may block (e.g. on a socket) - never keep the reaper role meanwhile
+                if (reaper) {
+                    reaper = 0;
+                    hddio_reap_handoff(r, &w);
+                }
+                zassert(pthread_mutex_unlock(&(r->lock)));
+                while (next < upto) {
+                    done(ops + next, arg);
+                    next++;
+                }
+                zassert(pthread_mutex_lock(&(r->lock)));
+                continue;
+            }
+        }
+        if (w.pending == 0) {
+            break;
+        }
+        if (reaper == 0 && r->reaping == 0) {
+            reaper = 1;
+            r->reaping = 1;
+        }
+        if (reaper) {
+            zassert(pthread_mutex_unlock(&(r->lock)));
+            if (hddio_uring_enter(r->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                syslog(LOG_WARNING, "hddio: io_uring_enter (getevents) error: %s", strerr(errno));
+                usleep(1000);
+            }
+            zassert(pthread_mutex_lock(&(r->lock)));
+            hddio_reap(r);
+        } else {
+            zassert(pthread_cond_wait(&(w.cond), &(r->lock)));
+        }
+    }
+    if (reaper) {
+        hddio_reap_handoff(r, &w);
+    }
+    for (wp = &(r->waiters); *wp != &w; wp = &((*wp)->next)) {
+    }
+    *wp = w.next;
+    zassert(pthread_mutex_unlock(&(r->lock)));
+    zassert(pthread_cond_destroy(&(w.cond)));
+
+    hddio_stats_add(&stats_submits, 1);
+    hddio_stats_add(&stats_sqes, submitted);
+    if (submitted < cnt) {
+        hddio_stats_add(&stats_fallbacks, cnt - submitted);
+    }
+    return submitted;
+}
+
+typedef struct hddio_batch {
+    hddio_vec* v;
+    hddio_ready_fn ready;
+    void* arg;
+    uint32_t base;
+    uint8_t stopped;
+} hddio_batch;
+
+/* finishes one vector of a batch (synchronous fallback, short transfer) and passes it to the caller */
+static void hddio_batch_done(hddio_op* op, void* arg)
+{
+    hddio_batch* b = (hddio_batch*)arg;
+    hddio_vec* v = op->v;
+
+    if (b->stopped) {
+        return;
+    }
+    if (op->state == HDDIO_OP_NOTSUBMITTED) {
+        hddio_sync_one(v, 0);
+    } else if (v->write != HDDIO_FSYNC && v->result > 0 && (uint32_t)(v->result) < v->size) {
+        hddio_sync_one(v, v->result);
+    }
+    if (b->ready != NULL && b->ready(b->arg, b->base + (v - b->v)) != 0) {
+        b->stopped = 1;
+    }
+}
+
+static uint8_t hddio_submit_batch(hddio_ring* r, hddio_vec* v, uint32_t cnt, hddio_batch* b)
+{
+    hddio_op ops[HDDIO_MAX_BATCH];
+    uint32_t i;
+
+    for (i = 0; i < cnt; i++) {
+        ops[i].v = v + i;
+        ops[i].iov.iov_base = v[i].buf;
+        ops[i].iov.iov_len = v[i].size;
+        ops[i].iovp = &(ops[i].iov);
+        ops[i].iovcnt = (v[i].write == HDDIO_FSYNC) ? 0 : 1;
+    }
+    // without a callback there is nothing to hand over early - wait for all and fix up afterwards
+    hddio_run(r, ops, cnt, (b->ready != NULL) ? hddio_batch_done : NULL, b);
+    if (b->ready == NULL) {
+        for (i = 0; i < cnt; i++) {
+            hddio_batch_done(ops + i, b);
+        }
+    }
+    return b->stopped;
+}
+
+void hddio_ring_free(void* ring)
+{
+    hddio_ring* r = (hddio_ring*)ring;
+
+    if (r == NULL) {
+        return;
+    }
+    // every op in flight has its submitter waiting for it (and reaping), so this ends as soon as they are done
+    zassert(pthread_mutex_lock(&(r->lock)));
+    while (r->inflight > 0) {
+        r->freewaiting++;
+        zassert(pthread_cond_wait(&(r->freecond), &(r->lock)));
+        r->freewaiting--;
+    }
+    zassert(pthread_mutex_unlock(&(r->lock)));
+    zassert(pthread_cond_destroy(&(r->freecond)));
+    zassert(pthread_mutex_destroy(&(r->lock)));
+    munmap(r->sqes, r->sqesize);
+    if (r->cqptr != r->sqptr) {
+        munmap(r->cqptr, r->cqsize);
+    }
+    munmap(r->sqptr, r->sqsize);
+    close(r->fd);
+    free(r);
+}
+
+static ssize_t hddio_ring_pwritev(hddio_ring* r, int fd, const struct iovec* iov, int iovcnt, uint64_t offset)
+{
+    hddio_op op;
+    hddio_vec v;
+    size_t size;
+    int i;
+
+    size = 0;
+    for (i = 0; i < iovcnt; i++) {
+        size += iov[i].iov_len;
+    }
+    v.fd = fd;
+    v.write = HDDIO_WRITE;
+    v.buf = NULL;
+    v.size = size;
+    v.offset = offset;
+    op.v = &v;
+    op.iovp = iov;
+    op.iovcnt = iovcnt;
+    if (hddio_run(r, &op, 1, NULL, NULL) == 0) {
+        return hddio_sync_writev(fd, iov, iovcnt, offset, 0);
+    }
+    if (v.result < 0) {
+        errno = -v.result;
+        return -1;
+    }
+    if ((size_t)(v.result) < size && v.result > 0) {
+        return hddio_sync_writev(fd, iov, iovcnt, offset, v.result);
+    }
+    return v.result;
+}
+
+void hddio_submit_ordered(void* ring, hddio_vec* v, uint32_t cnt, hddio_ready_fn ready, void* arg)
+{
+    hddio_ring* r = (hddio_ring*)ring;
+    hddio_batch b;
+    uint32_t i, batch;
+
+    if (r == NULL) {
+        for (i = 0; i < cnt; i++) {
+            hddio_sync_one(v + i, 0);
+            if (ready != NULL && ready(arg, i) != 0) {
+                return;
+            }
+        }
+        return;
+    }
+    b.v = v;
+    b.ready = ready;
+    b.arg = arg;
+    b.base = 0;
+    b.stopped = 0;
+    while (cnt > 0) {
+        batch = cnt;
+        if (batch > HDDIO_MAX_BATCH) {
+            batch = HDDIO_MAX_BATCH;
+        }
+        if (batch > r->entries) {
+            batch = r->entries;
+        }
+        if (hddio_submit_batch(r, v, batch, &b)) {
+            return;
+        }
+        v += batch;
+        b.v = v;
+        b.base += batch;
+        cnt -= batch;
+    }
+}
+
+#else /* HDDIO_URING */
+
+void* hddio_ring_new(uint32_t entries)
+{
+    (void)entries;
+    return NULL;
+}
+
+void hddio_ring_free(void* ring)
+{
+    (void)ring;
+}
+
+void hddio_submit_ordered(void* ring, hddio_vec* v, uint32_t cnt, hddio_ready_fn ready, void* arg)
+{
+    uint32_t i;
+    (void)ring;
+    for (i = 0; i < cnt; i++) {
+        hddio_sync_one(v + i, 0);
+        if (ready != NULL && ready(arg, i) != 0) {
+            return;
+        }
+    }
+}
+
+#endif /* HDDIO_URING */
+
+void hddio_submit(void* ring, hddio_vec* v, uint32_t cnt)
+{
+    hddio_submit_ordered(ring, v, cnt, NULL, NULL);
+}
+
+ssize_t hddio_pread(void* ring, int fd, void* buf, size_t size, uint64_t offset)
+{
+    hddio_vec v;
+
+    if (ring == NULL) {
+        return pread(fd, buf, size, offset);
+    }
+    v.fd = fd;
+    v.write = HDDIO_READ;
+    v.buf = (uint8_t*)buf;
+    v.size = size;
+    v.offset = offset;
+    hddio_submit(ring, &v, 1);
+    if (v.result < 0) {
+        errno = -v.result;
+        return -1;
+    }
+    return v.result;
+}
+
+ssize_t hddio_pwritev(void* ring, int fd, const struct iovec* iov, int iovcnt, uint64_t offset)
+{
+    ssize_t ret;
+    size_t size;
+    int i;
+
+#ifdef HDDIO_URING
+    if (ring != NULL) {
+        return hddio_ring_pwritev((hddio_ring*)ring, fd, iov, iovcnt, offset);
+    }
+#else
+    (void)ring;
+#endif
+    ret = pwritev(fd, iov, iovcnt, offset);
+    if (ret <= 0) {
+        return ret;
+    }
+    size = 0;
+    for (i = 0; i < iovcnt; i++) {
+        size += iov[i].iov_len;
+    }
+    if ((size_t)ret < size) {
+        return hddio_sync_writev(fd, iov, iovcnt, offset, ret);
+    }
+    return ret;
+}
+
+ssize_t hddio_pwrite(void* ring, int fd, const void* buf, size_t size, uint64_t offset)
+{
+    hddio_vec v;
+
+    if (ring == NULL) {
+        return pwrite(fd, buf, size, offset);
+    }
+    v.fd = fd;
+    v.write = HDDIO_WRITE;
+    v.buf = (uint8_t*)buf;
+    v.size = size;
+    v.offset = offset;
+    hddio_submit(ring, &v, 1);
+    if (v.result < 0) {
+        errno = -v.result;
+        return -1;
+    }
+    return v.result;
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _HDDIO_H_
+#define _HDDIO_H_
+
+#include <inttypes.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define HDDIO_READ 0
+#define HDDIO_WRITE 1
+#define HDDIO_FSYNC 2
+
+/* single positional read or write (or fsync of whole file - buf, size and offset are ignored); result is bytes transferred (0 for fsync) or -errno */
+typedef struct hddio_vec {
+    int fd;
+    uint8_t write; // HDDIO_READ, HDDIO_WRITE or HDDIO_FSYNC
+    uint8_t* buf;
+    uint32_t size;
+    uint64_t offset;
+    int32_t result;
+} hddio_vec;
+
+/* per folder submission ring - returns NULL when io_uring is not usable (caller then uses plain pread/pwrite) */
+void* hddio_ring_new(uint32_t entries);
+void hddio_ring_free(void* ring);
+
+/* submit all vectors at once and wait for all of them; ring==NULL -> synchronous fallback */
+void hddio_submit(void* ring, hddio_vec* v, uint32_t cnt);
+
+/* called for vector 'i' as soon as it and all vectors before it are complete - nonzero result stops further calls and submissions (vectors already in flight are still waited for) */
+typedef int (*hddio_ready_fn)(void* arg, uint32_t i);
+
+/* same as hddio_submit, but hands vectors over in order while later ones are still in flight (callbacks run in the calling thread) */
+void hddio_submit_ordered(void* ring, hddio_vec* v, uint32_t cnt, hddio_ready_fn ready, void* arg);
+
+/* pread/pwrite replacements (errno is set on error) */
+ssize_t hddio_pread(void* ring, int fd, void* buf, size_t size, uint64_t offset);
+ssize_t hddio_pwrite(void* ring, int fd, const void* buf, size_t size, uint64_t offset);
+
+/* gathers iovcnt buffers into one write at given offset (one sqe or one pwritev call) */
+ssize_t hddio_pwritev(void* ring, int fd, const struct iovec* iov, int iovcnt, uint64_t offset);
+
+void hddio_stats(uint64_t* submits, uint64_t* sqes, uint64_t* fallbacks);
+
+#endif
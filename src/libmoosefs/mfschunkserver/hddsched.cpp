@@ -0,0 +1,296 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MFSCommunication.h"
+#include "clocks.h"
+#include "hddsched.h"
+#include "massert.h"
+#include "portable.h"
+
+/*
+ * Every window client latency p99 is compared with the target - above it the background budget is halved,
+ * below it the budget grows back by 1/8 of maximum (AIMD). Budget is split between background classes that were
+ * active in last window according to their weights, and every class spends its share through a token bucket.
+ */
+
+#define HDDSCHED_WINDOW_USEC 1000000
+#define HDDSCHED_HISTBUCKETS 32
+#define HDDSCHED_BURST_USEC 100000
+#define HDDSCHED_MAXWAIT_USEC 1000000
+#define HDDSCHED_MINBUDGET (1024.0 * 1024.0)
+
+static const uint32_t class_weight[HDDSCHED_CLASSES] = { 0, 4, 2, 1 };
+
+static thread_local uint8_t thread_class = HDDSCHED_CLIENT;
+
+typedef struct _schedclass {
+    double tokens;
+    double rate;
+    uint64_t lastrefill;
+    uint32_t depth;
+    uint32_t maxdepth;
+    uint32_t windowmaxdepth;
+    uint32_t p99;
+    uint32_t windowops;
+    uint32_t hist[HDDSCHED_HISTBUCKETS];
+    uint8_t active;
+    uint8_t wasactive;
+    uint64_t ops;
+    uint64_t bytes;
+    uint64_t waitusec;
+    uint64_t latusec;
+} schedclass;
+
+typedef struct _hddsched {
+    pthread_mutex_t lock;
+    uint64_t windowstart;
+    double maxbudget;
+    double budget;
+    uint32_t targetusec;
+    schedclass cl[HDDSCHED_CLASSES];
+} hddsched;
+
+static inline uint32_t hddsched_bucket(uint64_t usec)
+{
+    uint32_t b = 0;
+    while (usec > 1 && b < HDDSCHED_HISTBUCKETS - 1) {
+        usec >>= 1;
+        b++;
+    }
+    return b;
+}
+
+/* upper bound of bucket containing 99th percentile */
+static inline uint32_t hddsched_p99(const schedclass* c)
+{
+    uint32_t b, cnt, limit;
+    if (c->windowops == 0) {
+        return 0;
+    }
+    limit = c->windowops - c->windowops / 100;
+    cnt = 0;
+    for (b = 0; b < HDDSCHED_HISTBUCKETS - 1; b++) {
+        cnt += c->hist[b];
+        if (cnt >= limit) {
+            break;
+        }
+    }
+    return UINT32_C(2) << b;
+}
+
+// lock:locked
+static void hddsched_window(hddsched* s, uint64_t now)
+{
+    schedclass* c;
+    uint32_t k, sumw;
+    double burst;
+
+    if (now < s->windowstart + HDDSCHED_WINDOW_USEC) {
+        return;
+    }
+    s->windowstart = now;
+    for (k = 0; k < HDDSCHED_CLASSES; k++) {
+        c = s->cl + k;
+        c->p99 = hddsched_p99(c);
+        c->maxdepth = c->windowmaxdepth;
+        c->windowmaxdepth = c->depth;
+        c->windowops = 0;
+        memset(c->hist, 0, sizeof(c->hist));
+        c->wasactive = c->active;
+        c->active = 0;
+    }
+    if (s->maxbudget == 0.0) {
+        return;
+    }
+    c = s->cl + HDDSCHED_CLIENT;
+    if (c->wasactive && c->p99 > s->targetusec) {
+        s->budget /= 2.0;
+        if (s->budget < HDDSCHED_MINBUDGET) {
+            s->budget = HDDSCHED_MINBUDGET;
+        }
+    } else {
+        s->budget += s->maxbudget / 8.0;
+        if (s->budget > s->maxbudget) {
+            s->budget = s->maxbudget;
+        }
+    }
+    sumw = 0;
+    for (k = 1; k < HDDSCHED_CLASSES; k++) {
+        if (s->cl[k].wasactive) {
+            sumw += class_weight[k];
+        }
+    }
+    for (k = 1; k < HDDSCHED_CLASSES; k++) {
+        c = s->cl + k;
+        // inactive class gets the share it would have when it joins others
+        c->rate = s->budget * class_weight[k] / (c->wasactive ? sumw : sumw + class_weight[k]);
+        burst = c->rate * HDDSCHED_BURST_USEC / 1000000.0;
+        if (burst < MFSBLOCKSIZE) {
+            burst = MFSBLOCKSIZE;
+        }
+        if (c->tokens > burst) {
+            c->tokens = burst;
+        }
+    }
+}
+
+void* hddsched_new(uint32_t maxbgmbps, uint32_t targetmsec)
+{
+    hddsched* s;
+    uint32_t k;
+
+    s = (hddsched*)malloc(sizeof(hddsched));
+    passert(s);
+    memset(s, 0, sizeof(hddsched));
+    zassert(pthread_mutex_init(&(s->lock), NULL));
+    s->windowstart = monotonic_useconds();
+    s->maxbudget = maxbgmbps * 1024.0 * 1024.0;
+    s->budget = s->maxbudget;
+    s->targetusec = targetmsec * 1000;
+    for (k = 1; k < HDDSCHED_CLASSES; k++) {
+        s->cl[k].rate = s->budget; // until first window every class can use whole budget
+        s->cl[k].lastrefill = s->windowstart;
+    }
+    return s;
+}
+
+void hddsched_free(void* sched)
+{
+    hddsched* s = (hddsched*)sched;
+    if (s == NULL) {
+        return;
+    }
+    zassert(pthread_mutex_destroy(&(s->lock)));
+    free(s);
+}
+
+uint8_t hddsched_set_class(uint8_t ioclass)
+{
+    uint8_t prev = thread_class;
+    if (ioclass < HDDSCHED_CLASSES) {
+        thread_class = ioclass;
+    }
+    return prev;
+}
+
+uint64_t hddsched_begin(void* sched, uint32_t bytes)
+{
+    hddsched* s = (hddsched*)sched;
+    schedclass* c;
+    uint64_t now, wait;
+    double burst;
+
+    now = monotonic_useconds();
+    if (s == NULL) {
+        return now;
+    }
+    wait = 0;
+    zassert(pthread_mutex_lock(&(s->lock)));
+    hddsched_window(s, now);
+    c = s->cl + thread_class;
+    c->depth++;
+    if (c->depth > c->windowmaxdepth) {
+        c->windowmaxdepth = c->depth;
+    }
+    c->active = 1;
+    c->ops++;
+    c->bytes += bytes;
+    if (thread_class != HDDSCHED_CLIENT && s->maxbudget > 0.0) {
+        burst = c->rate * HDDSCHED_BURST_USEC / 1000000.0;
+        if (burst < MFSBLOCKSIZE) {
+            burst = MFSBLOCKSIZE;
+        }
+        if (now > c->lastrefill) {
+            c->tokens += c->rate * (now - c->lastrefill) / 1000000.0;
+            if (c->tokens > burst) {
+                c->tokens = burst;
+            }
+            c->lastrefill = now;
+        }
+        // debt is allowed - next caller of this class waits for it
+        c->tokens -= bytes;
+        if (c->tokens < 0.0) {
+            wait = (uint64_t)(-c->tokens * 1000000.0 / c->rate);
+            if (wait > HDDSCHED_MAXWAIT_USEC) {
+                wait = HDDSCHED_MAXWAIT_USEC;
+            }
+            c->waitusec += wait;
+        }
+    }
+    zassert(pthread_mutex_unlock(&(s->lock)));
+    if (wait > 0) {
+        portable_usleep(wait);
+        now = monotonic_useconds();
+    }
+    return now;
+}
+
+void hddsched_end(void* sched, uint64_t start)
+{
+    hddsched* s = (hddsched*)sched;
+    schedclass* c;
+    uint64_t lat;
+    int err;
+
+    if (s == NULL) {
+        return;
+    }
+    err = errno;
+    lat = monotonic_useconds() - start;
+    zassert(pthread_mutex_lock(&(s->lock)));
+    c = s->cl + thread_class;
+    c->depth--;
+    c->latusec += lat;
+    c->windowops++;
+    c->hist[hddsched_bucket(lat)]++;
+    zassert(pthread_mutex_unlock(&(s->lock)));
+    errno = err;
+}
+
+void hddsched_stats(void* sched, hddsched_classstats stats[HDDSCHED_CLASSES])
+{
+    hddsched* s = (hddsched*)sched;
+    schedclass* c;
+    uint32_t k;
+
+    memset(stats, 0, sizeof(hddsched_classstats) * HDDSCHED_CLASSES);
+    if (s == NULL) {
+        return;
+    }
+    zassert(pthread_mutex_lock(&(s->lock)));
+    hddsched_window(s, monotonic_useconds());
+    for (k = 0; k < HDDSCHED_CLASSES; k++) {
+        c = s->cl + k;
+        stats[k].ops = c->ops;
+        stats[k].bytes = c->bytes;
+        stats[k].waitusec = c->waitusec;
+        stats[k].latusec = c->latusec;
+        stats[k].depth = c->depth;
+        stats[k].maxdepth = c->maxdepth;
+        stats[k].p99usec = c->p99;
+        stats[k].rate = (k == HDDSCHED_CLIENT || s->maxbudget == 0.0) ? 0 : (uint32_t)(c->rate);
+    }
+    zassert(pthread_mutex_unlock(&(s->lock)));
+}
+
+uint8_t hddsched_saturated(void* sched)
+{
+    hddsched* s = (hddsched*)sched;
+    uint8_t ret;
+
+    if (s == NULL) {
+        return 0;
+    }
+    zassert(pthread_mutex_lock(&(s->lock)));
+    hddsched_window(s, monotonic_useconds());
+    ret = (s->cl[HDDSCHED_CLIENT].wasactive && s->cl[HDDSCHED_CLIENT].p99 > s->targetusec) ? 1 : 0;
+    zassert(pthread_mutex_unlock(&(s->lock)));
+    return ret;
+}
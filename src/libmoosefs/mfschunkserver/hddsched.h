@@ -0,0 +1,44 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _HDDSCHED_H_
+#define _HDDSCHED_H_
+
+#include <inttypes.h>
+
+/* I/O classes - client traffic is never delayed, background classes share an adaptive per disk budget */
+#define HDDSCHED_CLIENT 0
+#define HDDSCHED_REPLICATION 1
+#define HDDSCHED_REBALANCE 2
+#define HDDSCHED_TEST 3
+#define HDDSCHED_CLASSES 4
+
+typedef struct hddsched_classstats {
+    uint64_t ops;
+    uint64_t bytes;
+    uint64_t waitusec; // total time spent waiting for budget
+    uint64_t latusec; // total time spent in I/O
+    uint32_t depth; // current queue depth (waiting + in progress)
+    uint32_t maxdepth; // max queue depth in last window
+    uint32_t p99usec; // I/O latency p99 in last window
+    uint32_t rate; // current budget in bytes/s (0 - unlimited)
+} hddsched_classstats;
+
+/* one scheduler per folder; maxbgmbps==0 - background traffic is not limited (only accounted) */
+void* hddsched_new(uint32_t maxbgmbps, uint32_t targetmsec);
+void hddsched_free(void* sched);
+
+/* class of I/O issued by calling thread (default: client); returns previous class */
+uint8_t hddsched_set_class(uint8_t ioclass);
+
+/* begin waits for budget of thread's class and returns start time to be passed to end */
+uint64_t hddsched_begin(void* sched, uint32_t bytes);
+void hddsched_end(void* sched, uint64_t start);
+
+void hddsched_stats(void* sched, hddsched_classstats stats[HDDSCHED_CLASSES]);
+
+/* returns 1 when client I/O latency p99 in last window was above target (disk is saturated) */
+uint8_t hddsched_saturated(void* sched);
+
+#endif
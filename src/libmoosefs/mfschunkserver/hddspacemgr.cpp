@@ -36,21 +36,24 @@
 #include <syslog.h>
 #include <time.h>
 #include <unistd.h>
-#ifdef MMAP_ALLOC
 #include <sys/mman.h>
-#endif
 
 #include "MFSCommunication.h"
 #include "bgjobs.h"
+#include "blockcache.h"
+#include "chunkdigest.h"
 #include "clocks.h"
 #include "crc.h"
 #include "datapack.h"
 #include "defaults.h"
+#include "hddio.h"
+#include "hddsched.h"
 #include "hddspacemgr.h"
 #include "massert.h"
 #include "masterconn.h"
 #include "portable.h"
 #include "mfscommon/random.h"
+#include "scrubdb.h"
 #include "slogger.h"
 
 #include "mfsnode/init.h"
@@ -84,6 +87,9 @@
 #define OPEN_DELAY 0.5
 #define CRC_DELAY 100
 
+/* max number of chunks synced in one delayed ops step (rest waits for next step) */
+#define FSYNC_GROUP_MAX 256
+
 #ifdef PRESERVE_BLOCK
 #define BLOCK_DELAY 10
 #endif
@@ -107,11 +113,19 @@
 
 #define RANDOM_CHUNK_RETRIES 50
 
-// HASHSIZE / (60 * 1000)
+#define CHUNKDB_ATTRS 1
+#define CHUNKDB_COUNTPOS 25
+#define CHUNKDB_HDRSIZE 31
+#define CHUNKDB_RECSIZE 18
+
+// hash buckets scanned per one (1ms) cycle
 #define KNOWNBLOCKS_HASH_PER_CYCLE 280
 
-#define HASHSIZE (0x1000000)
-#define HASHPOS(chunkid) ((chunkid)&0xFFFFFF)
+// chunk hash is split into independently locked shards - every shard has its own bucket table that grows with number of chunks
+#define HASHSHARDS 256
+#define HASHSHARD(chunkid) ((chunkid) & (HASHSHARDS - 1))
+#define HASHINITSIZE 1024
+#define HASHPOS(hs, chunkid) (((chunkid) >> 8) & ((hs)->size - 1))
 
 #define DHASHSIZE 64
 #define DHASHPOS(chunkid) ((chunkid)&0x3F)
@@ -186,6 +200,14 @@ typedef struct _cntcond {
     struct _cntcond* next;
 } cntcond;
 
+typedef struct hashshard {
+    pthread_mutex_t lock; // bucket table and state of all chunks in this shard
+    struct chunk** tab;
+    uint32_t size; // power of 2
+    uint32_t count;
+    cntcond* cclist; // conditions are used only with this shard's lock
+} __attribute__((aligned(64))) hashshard;
+
 typedef struct chunk {
     uint64_t chunkid;
     struct folder* owner;
@@ -214,7 +236,10 @@ typedef struct chunk {
     uint16_t blockno; // 0xFFFF == invalid
 #endif
     uint8_t validattr;
-    uint32_t testtime; // at start use max(atime,mtime) if possible then every operation set it to current time
+    uint32_t testtime; // last full verification (restored from '.scrubdb', for unknown chunks max(atime,mtime) if possible) - test chain is kept in this order
+    uint32_t atime; // last I/O
+    uint8_t digestvalid; // digest describes current crc table (cleared when crc changes)
+    uint8_t digest[CHUNKDIGEST_SIZE]; // merkle digest of block crcs computed at last verification (guarded by testlock)
     struct chunk *testnext, **testprev;
     struct chunk* next;
 } chunk;
@@ -271,6 +296,7 @@ typedef struct folder {
     uint8_t isro;
     hddstats cstat;
     hddstats monotonic;
+    uint64_t lathist[HDD_LATHIST_OPS][HDD_LATHIST_BUCKETS]; // since start - not moved with cstat
     hddstats stats[STATSHISTORY];
     uint32_t statspos;
     ioerror lasterrtab[LASTERRSIZE];
@@ -283,6 +309,13 @@ typedef struct folder {
     ino_t lockinode;
     int lfd;
     int dumpfd;
+    uint8_t* dumpbuff;
+    uint32_t dumpleng;
+    uint32_t dumpsize;
+    uint32_t dumpcount;
+    uint8_t dumpflags;
+    double nextdump;
+    double nextfsync; // next group fsync of chunks written on this folder
     double read_corr;
     double write_corr;
     uint32_t read_dist;
@@ -293,8 +326,12 @@ typedef struct folder {
     uint64_t rebalance_last_usec;
     //	double carry;
     pthread_t scanthread;
+    void* ioring; // io_uring ring (NULL -> synchronous pread/pwrite)
+    void* iosched;
     struct chunk *testhead, **testtail;
     uint64_t nexttest;
+    uint8_t scrubdirty; // chunks verified since last '.scrubdb' (guarded by testlock)
+    double nextscrubdump;
     uint32_t min_count;
     uint16_t min_pathid;
     uint16_t current_pathid;
@@ -311,6 +348,74 @@ typedef struct folder {
     struct folder* next;
 } folder;
 
+/* all chunk I/O of a folder goes through its scheduler (using I/O class of calling thread) */
+static inline ssize_t hdd_folder_pread(folder* f, int fd, void* buf, size_t size, uint64_t offset)
+{
+    uint64_t st;
+    ssize_t ret;
+    if (f == NULL) {
+        return hddio_pread(NULL, fd, buf, size, offset);
+    }
+    st = hddsched_begin(f->iosched, size);
+    ret = hddio_pread(f->ioring, fd, buf, size, offset);
+    hddsched_end(f->iosched, st);
+    return ret;
+}
+
+static inline ssize_t hdd_folder_pwrite(folder* f, int fd, const void* buf, size_t size, uint64_t offset)
+{
+    uint64_t st;
+    ssize_t ret;
+    if (f == NULL) {
+        return hddio_pwrite(NULL, fd, buf, size, offset);
+    }
+    st = hddsched_begin(f->iosched, size);
+    ret = hddio_pwrite(f->ioring, fd, buf, size, offset);
+    hddsched_end(f->iosched, st);
+    return ret;
+}
+
+static inline ssize_t hdd_folder_pwritev(folder* f, int fd, const struct iovec* iov, int iovcnt, uint64_t offset)
+{
+    uint64_t st;
+    ssize_t ret;
+    int i;
+    uint32_t bytes;
+    if (f == NULL) {
+        return hddio_pwritev(NULL, fd, iov, iovcnt, offset);
+    }
+    bytes = 0;
+    for (i = 0; i < iovcnt; i++) {
+        bytes += iov[i].iov_len;
+    }
+    st = hddsched_begin(f->iosched, bytes);
+    ret = hddio_pwritev(f->ioring, fd, iov, iovcnt, offset);
+    hddsched_end(f->iosched, st);
+    return ret;
+}
+
+static inline void hdd_folder_submit_ordered(folder* f, hddio_vec* v, uint32_t cnt, hddio_ready_fn ready, void* arg)
+{
+    uint64_t st;
+    uint32_t i, bytes;
+    if (f == NULL) {
+        hddio_submit_ordered(NULL, v, cnt, ready, arg);
+        return;
+    }
+    bytes = 0;
+    for (i = 0; i < cnt; i++) {
+        bytes += v[i].size;
+    }
+    st = hddsched_begin(f->iosched, bytes);
+    hddio_submit_ordered(f->ioring, v, cnt, ready, arg);
+    hddsched_end(f->iosched, st);
+}
+
+static inline void hdd_folder_submit(folder* f, hddio_vec* v, uint32_t cnt)
+{
+    hdd_folder_submit_ordered(f, v, cnt, NULL, NULL);
+}
+
 typedef struct cfgline {
     char* path;
     folder* f;
@@ -339,6 +444,7 @@ static uint32_t HDDRoundRobinChunkCount = 10000;
 static uint32_t HDDKeepDuplicatesHours = 7 * 24;
 static uint64_t LeaveFree;
 static uint8_t DoFsyncBeforeClose = 0;
+static uint32_t FsyncGroupInterval = 0;
 static uint32_t MinTimeBetweenTests = 86400;
 static int32_t MinFlushCacheTime = 86400;
 
@@ -349,7 +455,7 @@ static cfgline* cfglinehead = NULL;
 static folder* folderhead = NULL;
 
 /* chunk hash */
-static chunk* hashtab[HASHSIZE];
+static hashshard hashshards[HASHSHARDS];
 
 /* extra chunk info */
 static dopchunk* dophashtab[DHASHSIZE];
@@ -381,9 +487,9 @@ static pthread_mutex_t ndoplock = PTHREAD_MUTEX_INITIALIZER;
 // master reports = damaged chunks, lost chunks, errorcounter, hddspacechanged, hddspacerecalc, global_rebalance_is_on
 static pthread_mutex_t dclock = PTHREAD_MUTEX_INITIALIZER;
 
-// hashtab - only hash tab, chunks have their own separate locks
-static pthread_mutex_t hashlock = PTHREAD_MUTEX_INITIALIZER;
-static cntcond* cclist = NULL;
+// hashshards - each shard has its own lock (see hashshard), chunks have their own separate locks
+// hdd_get_chunks_* state
+static pthread_mutex_t getchunkslock = PTHREAD_MUTEX_INITIALIZER;
 
 // folderhead + all data in structures
 static pthread_mutex_t folderlock = PTHREAD_MUTEX_INITIALIZER;
@@ -817,6 +923,17 @@ static inline void hdd_stats_write(uint32_t size)
     zassert(pthread_mutex_unlock(&statslock));
 }
 
+static inline uint32_t hdd_lathist_bucket(int64_t nsec)
+{
+    uint64_t usec = nsec / 1000;
+    uint32_t b = 0;
+    while (usec > 1 && b < HDD_LATHIST_BUCKETS - 1) {
+        usec >>= 1;
+        b++;
+    }
+    return b;
+}
+
 static inline void hdd_stats_dataread(folder* f, uint32_t size, int64_t rtime)
 {
     if (rtime <= 0) {
@@ -832,6 +949,7 @@ static inline void hdd_stats_dataread(folder* f, uint32_t size, int64_t rtime)
     if (rtime > (int64_t)(f->cstat.nsecreadmax)) {
         f->cstat.nsecreadmax = rtime;
     }
+    f->lathist[HDD_LATHIST_READ][hdd_lathist_bucket(rtime)]++;
     zassert(pthread_mutex_unlock(&statslock));
 }
 
@@ -850,6 +968,7 @@ static inline void hdd_stats_datawrite(folder* f, uint32_t size, int64_t wtime)
     if (wtime > (int64_t)(f->cstat.nsecwritemax)) {
         f->cstat.nsecwritemax = wtime;
     }
+    f->lathist[HDD_LATHIST_WRITE][hdd_lathist_bucket(wtime)]++;
     zassert(pthread_mutex_unlock(&statslock));
 }
 
@@ -865,6 +984,7 @@ static inline void hdd_stats_datafsync(folder* f, int64_t fsynctime)
     if (fsynctime > (int64_t)(f->cstat.nsecfsyncmax)) {
         f->cstat.nsecfsyncmax = fsynctime;
     }
+    f->lathist[HDD_LATHIST_FSYNC][hdd_lathist_bucket(fsynctime)]++;
     zassert(pthread_mutex_unlock(&statslock));
 }
 
@@ -1218,14 +1338,81 @@ static inline void hdd_chunk_flush(chunk* c)
 #endif /* PRESERVE_BLOCK */
 }
 
-static inline int hdd_chunk_hash_remove(chunk* c)
+static void hdd_hash_init(void)
+{
+    uint32_t i;
+    hashshard* hs;
+    if (hashshards[0].tab != NULL) { // already initialized
+        return;
+    }
+    for (i = 0; i < HASHSHARDS; i++) {
+        hs = hashshards + i;
+        zassert(pthread_mutex_init(&(hs->lock), NULL));
+        hs->tab = (chunk**)calloc(HASHINITSIZE, sizeof(chunk*));
+        passert(hs->tab);
+        hs->size = HASHINITSIZE;
+        hs->count = 0;
+        hs->cclist = NULL;
+    }
+}
+
+static uint32_t hdd_get_chunks_active = 0;
+
+/* doubles bucket table of locked shard - postponed while chunk list is sent to master (its cursor points into the table) */
+static void hdd_hash_grow(hashshard* hs)
+{
+    chunk **newtab, *c, *cn;
+    uint32_t i, newsize, pos;
+#ifdef HAVE___SYNC_FETCH_AND_OP
+    if (__sync_fetch_and_or(&hdd_get_chunks_active, 0)) {
+        return;
+    }
+#else
+    zassert(pthread_mutex_lock(&getchunkslock));
+    i = hdd_get_chunks_active;
+    zassert(pthread_mutex_unlock(&getchunkslock));
+    if (i) {
+        return;
+    }
+#endif
+    newsize = hs->size * 2;
+    newtab = (chunk**)calloc(newsize, sizeof(chunk*));
+    if (newtab == NULL) { // not fatal - just longer chains
+        return;
+    }
+    for (i = 0; i < hs->size; i++) {
+        for (c = hs->tab[i]; c; c = cn) {
+            cn = c->next;
+            pos = ((c->chunkid) >> 8) & (newsize - 1);
+            c->next = newtab[pos];
+            newtab[pos] = c;
+        }
+    }
+    free(hs->tab);
+    hs->tab = newtab;
+    hs->size = newsize;
+}
+
+static inline void hdd_chunk_hash_add(hashshard* hs, chunk* c)
+{
+    uint32_t hashpos = HASHPOS(hs, c->chunkid);
+    c->next = hs->tab[hashpos];
+    hs->tab[hashpos] = c;
+    hs->count++;
+    if (hs->count > hs->size) {
+        hdd_hash_grow(hs);
+    }
+}
+
+static inline int hdd_chunk_hash_remove(hashshard* hs, chunk* c)
 {
     chunk **cptr, *cp;
-    uint32_t hashpos = HASHPOS(c->chunkid);
-    cptr = &(hashtab[hashpos]);
+    uint32_t hashpos = HASHPOS(hs, c->chunkid);
+    cptr = &(hs->tab[hashpos]);
     while ((cp = *cptr)) {
         if (c == cp) {
             *cptr = cp->next;
+            hs->count--;
             return 1;
         }
         cptr = &(cp->next);
@@ -1251,7 +1438,8 @@ static int hdd_timed_wait(pthread_cond_t* cond, pthread_mutex_t* mutex, uint32_t
 
 static void hdd_chunk_release(chunk* c)
 {
-    zassert(pthread_mutex_lock(&hashlock));
+    hashshard* hs = hashshards + HASHSHARD(c->chunkid);
+    zassert(pthread_mutex_lock(&(hs->lock)));
     // syslog(LOG_WARNING,"hdd_chunk_release got chunk: %016" PRIX64" (c->state:%u)",c->chunkid,c->state);
     if (c->state == CH_LOCKED) {
         c->state = CH_AVAIL;
@@ -1259,7 +1447,7 @@ static void hdd_chunk_release(chunk* c)
             zassert(pthread_cond_signal(&(c->ccond->cond)));
         }
     }
-    zassert(pthread_mutex_unlock(&hashlock));
+    zassert(pthread_mutex_unlock(&(hs->lock)));
 }
 
 static int hdd_chunk_getattr(chunk* c, uint8_t forceflag)
@@ -1348,10 +1536,10 @@ static int hdd_chunk_getattr(chunk* c, uint8_t forceflag)
 
 static chunk* hdd_chunk_tryfind(uint64_t chunkid)
 {
-    uint32_t hashpos = HASHPOS(chunkid);
+    hashshard* hs = hashshards + HASHSHARD(chunkid);
     chunk* c;
-    zassert(pthread_mutex_lock(&hashlock));
-    for (c = hashtab[hashpos]; c && c->chunkid != chunkid; c = c->next) { }
+    zassert(pthread_mutex_lock(&(hs->lock)));
+    for (c = hs->tab[HASHPOS(hs, chunkid)]; c && c->chunkid != chunkid; c = c->next) { }
     if (c != NULL) {
         if (c->state == CH_LOCKED) {
             c = (chunk*)CHUNKLOCKED;
@@ -1361,7 +1549,7 @@ static chunk* hdd_chunk_tryfind(uint64_t chunkid)
             c->state = CH_LOCKED;
         }
     }
-    zassert(pthread_mutex_unlock(&hashlock));
+    zassert(pthread_mutex_unlock(&(hs->lock)));
     return c;
 }
 
@@ -1369,14 +1557,14 @@ static void hdd_chunk_delete(chunk* c);
 
 static int hdd_chunk_get(uint64_t chunkid, chunk** cptr, uint8_t cflag)
 {
-    uint32_t hashpos = HASHPOS(chunkid);
+    hashshard* hs = hashshards + HASHSHARD(chunkid);
     chunk* c;
     cntcond* cc;
     int res;
 
     *cptr = NULL;
-    zassert(pthread_mutex_lock(&hashlock));
-    for (c = hashtab[hashpos]; c && c->chunkid != chunkid; c = c->next) { }
+    zassert(pthread_mutex_lock(&(hs->lock)));
+    for (c = hs->tab[HASHPOS(hs, chunkid)]; c && c->chunkid != chunkid; c = c->next) { }
     if (c == NULL) {
         if (cflag != CHMODE_EXISTING_ONLY && cflag != CHMODE_EXISTING_ONLY_WITH_ERRORS) { // create if not exists
             c = (chunk*)malloc(sizeof(chunk));
@@ -1397,6 +1585,9 @@ static int hdd_chunk_get(uint64_t chunkid, chunk** cptr, uint8_t cflag)
             c->crc = NULL;
             c->state = CH_LOCKED;
             c->ccond = NULL;
+            c->testtime = 0;
+            c->atime = 0;
+            c->digestvalid = 0;
 #ifdef PRESERVE_BLOCK
             c->blockto = 0.0;
             c->block = NULL;
@@ -1405,19 +1596,18 @@ static int hdd_chunk_get(uint64_t chunkid, chunk** cptr, uint8_t cflag)
             c->validattr = 0;
             c->testnext = NULL;
             c->testprev = NULL;
-            c->next = hashtab[hashpos];
-            hashtab[hashpos] = c;
+            hdd_chunk_hash_add(hs, c);
         } else {
             hdd_report_lost_chunk(chunkid);
         }
         // syslog(LOG_WARNING,"hdd_chunk_get returns chunk: %016" PRIX64" (c->state:%u)",c->chunkid,c->state);
-        zassert(pthread_mutex_unlock(&hashlock));
+        zassert(pthread_mutex_unlock(&(hs->lock)));
         *cptr = c;
         return 1;
     }
     if (cflag == CHMODE_NEW_ONLY) {
         if (c->state == CH_AVAIL || c->state == CH_LOCKED) {
-            zassert(pthread_mutex_unlock(&hashlock));
+            zassert(pthread_mutex_unlock(&(hs->lock)));
             return 0;
         }
     }
@@ -1426,7 +1616,7 @@ static int hdd_chunk_get(uint64_t chunkid, chunk** cptr, uint8_t cflag)
         case CH_AVAIL:
             c->state = CH_LOCKED;
             // syslog(LOG_WARNING,"hdd_chunk_get returns chunk: %016" PRIX64" (c->state:%u)",c->chunkid,c->state);
-            zassert(pthread_mutex_unlock(&hashlock));
+            zassert(pthread_mutex_unlock(&(hs->lock)));
             if (c->validattr == 0 && cflag != CHMODE_NEW_OR_EXISTING) {
                 if (hdd_chunk_getattr(c, (cflag == CHMODE_EXISTING_ONLY_WITH_ERRORS) ? 1 : 0) < 0) {
                     hdd_error_occured(c, 1);
@@ -1453,16 +1643,19 @@ static int hdd_chunk_get(uint64_t chunkid, chunk** cptr, uint8_t cflag)
                 c->blockno = 0xFFFF;
 #endif /* PRESERVE_BLOCK */
                 c->validattr = 0;
+                c->testtime = 0;
+                c->atime = 0;
+                c->digestvalid = 0;
                 c->state = CH_LOCKED;
                 // syslog(LOG_WARNING,"hdd_chunk_get returns chunk: %016" PRIX64" (c->state:%u)",c->chunkid,c->state);
-                zassert(pthread_mutex_unlock(&hashlock));
+                zassert(pthread_mutex_unlock(&(hs->lock)));
                 hdd_chunk_flush(c);
                 *cptr = c;
                 return 1;
             }
             if (c->ccond == NULL) { // no more waiting threads - remove
-                res = hdd_chunk_hash_remove(c);
-                zassert(pthread_mutex_unlock(&hashlock));
+                res = hdd_chunk_hash_remove(hs, c);
+                zassert(pthread_mutex_unlock(&(hs->lock)));
                 if (res) { // always true
                     hdd_chunk_flush(c);
                     free(c);
@@ -1471,30 +1664,30 @@ static int hdd_chunk_get(uint64_t chunkid, chunk** cptr, uint8_t cflag)
                 }
             } else { // there are waiting threads - wake them up
                 zassert(pthread_cond_signal(&(c->ccond->cond)));
-                zassert(pthread_mutex_unlock(&hashlock));
+                zassert(pthread_mutex_unlock(&(hs->lock)));
             }
             return 0;
         case CH_LOCKED:
             if (c->ccond == NULL) {
-                for (cc = cclist; cc && cc->wcnt; cc = cc->next) { }
+                for (cc = hs->cclist; cc && cc->wcnt; cc = cc->next) { }
                 if (cc == NULL) {
                     cc = (cntcond*)malloc(sizeof(cntcond));
                     passert(cc);
                     zassert(pthread_cond_init(&(cc->cond), NULL));
                     cc->wcnt = 0;
-                    cc->next = cclist;
-                    cclist = cc;
+                    cc->next = hs->cclist;
+                    hs->cclist = cc;
                 }
                 c->ccond = cc;
             }
             c->ccond->wcnt++;
-            if (hdd_timed_wait(&(c->ccond->cond), &hashlock, LOCKED_CHUNK_WAIT_USECS) != 0) { // do not wait for chunk too long
+            if (hdd_timed_wait(&(c->ccond->cond), &(hs->lock), LOCKED_CHUNK_WAIT_USECS) != 0) { // do not wait for chunk too long
                 syslog(LOG_WARNING, "hdd_chunk_get: chunk %016" PRIX64 " locked too long - giving up", chunkid);
                 c->ccond->wcnt--;
                 if (c->ccond->wcnt == 0) {
                     c->ccond = NULL;
                 }
-                zassert(pthread_mutex_unlock(&hashlock));
+                zassert(pthread_mutex_unlock(&(hs->lock)));
                 return 2;
             }
             c->ccond->wcnt--;
@@ -1508,8 +1701,10 @@ static int hdd_chunk_get(uint64_t chunkid, chunk** cptr, uint8_t cflag)
 static void hdd_chunk_delete(chunk* c)
 {
     folder* f;
+    hashshard* hs;
     int res;
 
+    blockcache_invalidate_chunk(c->chunkid);
     zassert(pthread_mutex_lock(&folderlock));
     f = c->owner;
     hdd_remove_chunk_from_folder(c, f);
@@ -1517,16 +1712,17 @@ static void hdd_chunk_delete(chunk* c)
     zassert(pthread_mutex_lock(&testlock));
     hdd_remove_chunk_from_test_chain(c, f);
     zassert(pthread_mutex_unlock(&testlock));
-    zassert(pthread_mutex_lock(&hashlock));
+    hs = hashshards + HASHSHARD(c->chunkid);
+    zassert(pthread_mutex_lock(&(hs->lock)));
     if (c->ccond) {
         c->state = CH_DELETED;
         //		printf("wake up one thread waiting for DELETED chunk: %016" PRIX64" ccond:%p\n",c->chunkid,c->ccond);
         //		printbacktrace();
         zassert(pthread_cond_signal(&(c->ccond->cond)));
-        zassert(pthread_mutex_unlock(&hashlock));
+        zassert(pthread_mutex_unlock(&(hs->lock)));
     } else {
-        res = hdd_chunk_hash_remove(c);
-        zassert(pthread_mutex_unlock(&hashlock));
+        res = hdd_chunk_hash_remove(hs, c);
+        zassert(pthread_mutex_unlock(&(hs->lock)));
         if (res) { // always true
             hdd_chunk_flush(c);
             free(c);
@@ -1550,6 +1746,8 @@ static chunk* hdd_chunk_create(folder* f, uint64_t chunkid, uint32_t version)
     c->blocks = 0;
     c->hdrsize = NEWHDRSIZE;
     c->validattr = 1;
+    c->testtime = main_time(); // new chunk goes to the end of the test chain
+    c->atime = c->testtime;
     f->needrefresh = 1;
     hdd_add_chunk_to_folder(c, f);
     zassert(pthread_mutex_lock(&testlock));
@@ -1563,7 +1761,7 @@ static chunk* hdd_chunk_create(folder* f, uint64_t chunkid, uint32_t version)
 
 #define hdd_chunk_force_find(chunkid, chunkptr) hdd_chunk_get(chunkid, chunkptr, CHMODE_EXISTING_ONLY_WITH_ERRORS)
 
-static inline void hdd_int_chunk_testmove(chunk* c)
+static inline void hdd_int_chunk_testtail(chunk* c)
 {
     if (c->testnext) {
         *(c->testprev) = c->testnext;
@@ -1573,13 +1771,19 @@ static inline void hdd_int_chunk_testmove(chunk* c)
         *(c->testprev) = c;
         c->owner->testtail = &(c->testnext);
     }
+}
+
+static inline void hdd_int_chunk_testmove(chunk* c)
+{
+    hdd_int_chunk_testtail(c);
     c->testtime = main_time();
 }
 
-static void hdd_chunk_testmove(chunk* c)
+/* chunk skipped by scrubber goes down the test chain, but keeps time of its last real verification */
+static void hdd_chunk_testskip(chunk* c)
 {
     zassert(pthread_mutex_lock(&testlock));
-    hdd_int_chunk_testmove(c);
+    hdd_int_chunk_testtail(c);
     zassert(pthread_mutex_unlock(&testlock));
 }
 
@@ -1838,22 +2042,31 @@ static inline void hdd_wfr_check(folder* f)
     }
 }
 
-static inline void hdd_folder_dump_chunkdb_begin(folder* f)
+/* '.chunkdb' snapshot:
+ * "MFS CHUNKDB3" ; flags:8 ; ctime_sec:64 ; ctime_nsec:32 ; count:32 ; pleng:16 ; path:pleng
+ * count * ( chunkid:64 ; version:32 ; blocks:16 ; hdrsize:16 ; pathid:16 )
+ * crc:32 (of all preceding bytes)
+ * ctime is taken from the temporary file itself (the same clock the filesystem uses for directories), so any
+ * chunk file created, renamed or removed after the snapshot has been started makes its subfolder newer than the
+ * snapshot. Blocks and hdrsize are stored only when chunks can't be modified anymore (CHUNKDB_ATTRS). */
+static inline void hdd_folder_dump_chunkdb_begin(folder* f, uint8_t flags)
 {
     uint32_t pleng;
     char* fname;
-    uint8_t hdr[14];
+    struct stat sb;
     uint8_t* wptr;
 
+    f->dumpfd = -1;
     if (f->damaged || f->markforremoval == MFR_READONLY || f->wfrcount > 0) { // do not store '.chunkdb'
-        if (f->damaged) {
-            syslog(LOG_WARNING, "disk %s is marked as 'damaged' - '.chunkdb' not written", f->path);
-        } else if (f->markforremoval == MFR_READONLY) {
-            syslog(LOG_WARNING, "disk %s is marked as 'read-only' - can't write '.chunkdb'", f->path);
-        } else {
-            syslog(LOG_WARNING, "disk %s has pending duplicates - can't use '.chunkdb' to avoid full scan", f->path);
+        if (flags & CHUNKDB_ATTRS) { // periodic snapshots are just silently skipped
+            if (f->damaged) {
+                syslog(LOG_WARNING, "disk %s is marked as 'damaged' - '.chunkdb' not written", f->path);
+            } else if (f->markforremoval == MFR_READONLY) {
+                syslog(LOG_WARNING, "disk %s is marked as 'read-only' - can't write '.chunkdb'", f->path);
+            } else {
+                syslog(LOG_WARNING, "disk %s has pending duplicates - can't use '.chunkdb' to avoid full scan", f->path);
+            }
         }
-        f->dumpfd = -1;
         return;
     }
     pleng = strlen(f->path);
@@ -1865,25 +2078,32 @@ static inline void hdd_folder_dump_chunkdb_begin(folder* f)
     f->dumpfd = open(fname, O_WRONLY | O_TRUNC | O_CREAT, 0666);
     if (f->dumpfd < 0) {
         mfs_arg_errlog(LOG_NOTICE, "%s: open error", fname);
+        free(fname);
+        return;
     }
-    if (f->dumpfd >= 0) {
-        memcpy(hdr, "MFS CHUNKDB2", 12);
-        wptr = hdr + 12;
-        put16bit(&wptr, pleng);
-        if (write(f->dumpfd, hdr, 14) != 14) {
-            mfs_arg_errlog(LOG_NOTICE, "%s: write error", fname);
-            close(f->dumpfd);
-            f->dumpfd = -1;
-            free(fname);
-            return;
-        }
-        if (write(f->dumpfd, f->path, pleng) != (int32_t)pleng) {
-            mfs_arg_errlog(LOG_NOTICE, "%s: write error", fname);
-            close(f->dumpfd);
-            f->dumpfd = -1;
-        }
+    if (fstat(f->dumpfd, &sb) < 0) {
+        mfs_arg_errlog(LOG_NOTICE, "%s: fstat error", fname);
+        close(f->dumpfd);
+        f->dumpfd = -1;
+        free(fname);
+        return;
     }
     free(fname);
+    f->dumpsize = CHUNKDB_HDRSIZE + pleng + 1024 * CHUNKDB_RECSIZE;
+    f->dumpbuff = (uint8_t*)malloc(f->dumpsize);
+    passert(f->dumpbuff);
+    wptr = f->dumpbuff;
+    memcpy(wptr, "MFS CHUNKDB3", 12);
+    wptr += 12;
+    put8bit(&wptr, flags);
+    put64bit(&wptr, sb.st_ctim.tv_sec);
+    put32bit(&wptr, sb.st_ctim.tv_nsec);
+    put32bit(&wptr, 0); // count - filled at the end
+    put16bit(&wptr, pleng);
+    memcpy(wptr, f->path, pleng);
+    f->dumpleng = CHUNKDB_HDRSIZE + pleng;
+    f->dumpcount = 0;
+    f->dumpflags = flags;
 }
 
 static inline void hdd_folder_dump_chunkdb_end(folder* f)
@@ -1891,7 +2111,9 @@ static inline void hdd_folder_dump_chunkdb_end(folder* f)
     if (f->dumpfd >= 0) {
         uint32_t pleng;
         char *fname_src, *fname_dst;
-        uint8_t buff[18];
+        uint8_t* wptr;
+        ssize_t ret;
+        uint32_t pos;
 
         pleng = strlen(f->path);
         fname_src = (char*)malloc(pleng + 13);
@@ -1905,22 +2127,37 @@ static inline void hdd_folder_dump_chunkdb_end(folder* f)
         memcpy(fname_dst + pleng, ".chunkdb", 8);
         fname_dst[pleng + 8] = 0;
 
-        memset(buff, 0, 18);
+        wptr = f->dumpbuff + CHUNKDB_COUNTPOS;
+        put32bit(&wptr, f->dumpcount);
+        wptr = f->dumpbuff + f->dumpleng; // there is always space for crc
+        put32bit(&wptr, mycrc32(0, f->dumpbuff, f->dumpleng));
+        f->dumpleng += 4;
+
+        for (pos = 0; pos < f->dumpleng; pos += ret) {
+            ret = write(f->dumpfd, f->dumpbuff + pos, f->dumpleng - pos);
+            if (ret <= 0) {
+                break;
+            }
+        }
+        free(f->dumpbuff);
+        f->dumpbuff = NULL;
 
-        if (write(f->dumpfd, buff, 18) != 18) {
+        if (pos < f->dumpleng || fsync(f->dumpfd) < 0) {
             mfs_arg_errlog(LOG_NOTICE, "%s: write error", fname_src);
-            free(fname_src);
-            free(fname_dst);
             close(f->dumpfd);
             f->dumpfd = -1;
+            unlink(fname_src);
+            free(fname_src);
+            free(fname_dst);
             return;
         }
 
         if (close(f->dumpfd) < 0) {
             mfs_arg_errlog(LOG_NOTICE, "%s: close error", fname_src);
+            f->dumpfd = -1;
+            unlink(fname_src);
             free(fname_src);
             free(fname_dst);
-            f->dumpfd = -1;
             return;
         }
 
@@ -1934,19 +2171,25 @@ static inline void hdd_folder_dump_chunkdb_end(folder* f)
         }
         free(fname_src);
         free(fname_dst);
-        syslog(LOG_NOTICE, "disk %s: '.chunkdb' has been written", f->path);
+        if (f->dumpflags & CHUNKDB_ATTRS) {
+            syslog(LOG_NOTICE, "disk %s: '.chunkdb' has been written (%" PRIu32 " chunks)", f->path, f->dumpcount);
+        }
     }
 }
 
 static inline void hdd_folder_dump_chunkdb_chunk(folder* f, chunk* c)
 {
     if (f->dumpfd >= 0) {
-        uint8_t buff[18];
         uint8_t* wptr;
-        wptr = buff;
+        if (f->dumpleng + CHUNKDB_RECSIZE + 4 > f->dumpsize) {
+            f->dumpsize *= 2;
+            f->dumpbuff = (uint8_t*)realloc(f->dumpbuff, f->dumpsize);
+            passert(f->dumpbuff);
+        }
+        wptr = f->dumpbuff + f->dumpleng;
         put64bit(&wptr, c->chunkid);
         put32bit(&wptr, c->version);
-        if (c->validattr) {
+        if (c->validattr && (f->dumpflags & CHUNKDB_ATTRS)) {
             put16bit(&wptr, c->blocks);
             put16bit(&wptr, c->hdrsize);
         } else {
@@ -1954,85 +2197,307 @@ static inline void hdd_folder_dump_chunkdb_chunk(folder* f, chunk* c)
             put16bit(&wptr, 0);
         }
         put16bit(&wptr, c->pathid);
-        if (write(f->dumpfd, buff, 18) != 18) {
-            uint32_t pleng;
-            char* fname;
-            pleng = strlen(f->path);
-            fname = (char*)malloc(pleng + 13);
-            passert(fname);
-            memcpy(fname, f->path, pleng);
-            memcpy(fname + pleng, ".tmp_chunkdb", 12);
-            fname[pleng + 12] = 0;
-            mfs_arg_errlog(LOG_NOTICE, "%s: write error", fname);
-            free(fname);
-            close(f->dumpfd);
-            f->dumpfd = -1;
+        f->dumpleng += CHUNKDB_RECSIZE;
+        f->dumpcount++;
+    }
+}
+
+/* snapshot of every working folder - used after crash (only chunk list, attributes are read on first use) */
+static void hdd_folders_dump_chunkdb(void)
+{
+    folder *f, *fhead;
+    chunk* c;
+    hashshard* hs;
+    uint32_t i, k;
+    uint8_t any;
+    double now;
+
+    if (HDD_CHUNKDB_DUMP_PERIOD == 0) {
+        return;
+    }
+    now = monotonic_seconds();
+    any = 0;
+    zassert(pthread_mutex_lock(&folderlock));
+    for (f = folderhead; f; f = f->next) {
+        if (f->toremove != REMOVING_NO) { // removed folder has its own (final) snapshot in progress
+            zassert(pthread_mutex_unlock(&folderlock));
             return;
         }
     }
+    if (folderactions) {
+        for (f = folderhead; f; f = f->next) {
+            if (f->scanstate == SCST_WORKING && f->toremove == REMOVING_NO && f->nextdump <= now) {
+                f->nextdump = now + HDD_CHUNKDB_DUMP_PERIOD;
+                hdd_folder_dump_chunkdb_begin(f, 0);
+                if (f->dumpfd >= 0) {
+                    any = 1;
+                }
+            }
+        }
+    }
+    fhead = folderhead;
+    zassert(pthread_mutex_unlock(&folderlock));
+    if (any == 0) {
+        return;
+    }
+    for (k = 0; k < HASHSHARDS; k++) {
+        hs = hashshards + k;
+        zassert(pthread_mutex_lock(&folderlock));
+        zassert(pthread_mutex_lock(&(hs->lock)));
+        for (i = 0; i < hs->size; i++) {
+            for (c = hs->tab[i]; c; c = c->next) {
+                if (c->owner != NULL && c->state != CH_DELETED && c->pathid != 0xFFFF) {
+                    hdd_folder_dump_chunkdb_chunk(c->owner, c);
+                }
+            }
+        }
+        zassert(pthread_mutex_unlock(&(hs->lock)));
+        zassert(pthread_mutex_unlock(&folderlock));
+    }
+    // folders are removed only by this thread and new ones are added at the head, so the list can be walked without lock here
+    for (f = fhead; f; f = f->next) {
+        hdd_folder_dump_chunkdb_end(f);
+    }
 }
 
-uint8_t hdd_senddata(folder* f, int rmflag)
+typedef struct scrubdump {
+    char* path;
+    scrubrec* recs;
+    uint32_t count;
+    struct scrubdump* next;
+} scrubdump;
+
+// folderlock:locked
+static scrubdump* hdd_folder_scrubdb_collect(folder* f)
 {
+    scrubdump* sd;
+    chunk* c;
     uint32_t i;
+
+    zassert(pthread_mutex_lock(&testlock));
+    if (f->scrubdirty == 0) {
+        zassert(pthread_mutex_unlock(&testlock));
+        return NULL;
+    }
+    f->scrubdirty = 0;
+    sd = (scrubdump*)malloc(sizeof(scrubdump));
+    passert(sd);
+    sd->count = 0;
+    for (c = f->testhead; c; c = c->testnext) {
+        if (c->testtime > 0) {
+            sd->count++;
+        }
+    }
+    sd->recs = (scrubrec*)malloc(sizeof(scrubrec) * (sd->count + 1));
+    passert(sd->recs);
+    i = 0;
+    for (c = f->testhead; c; c = c->testnext) {
+        if (c->testtime > 0) {
+            sd->recs[i].chunkid = c->chunkid;
+            sd->recs[i].version = c->version;
+            sd->recs[i].testtime = c->testtime;
+            sd->recs[i].digestvalid = c->digestvalid;
+            memcpy(sd->recs[i].digest, c->digest, CHUNKDIGEST_SIZE);
+            i++;
+        }
+    }
+    zassert(pthread_mutex_unlock(&testlock));
+    sd->path = strdup(f->path);
+    passert(sd->path);
+    sd->next = NULL;
+    return sd;
+}
+
+// no locks
+static void hdd_scrubdb_write(scrubdump* sd)
+{
+    uint32_t pleng;
+    uint64_t leng, pos;
+    char *fname_src, *fname_dst;
+    uint8_t* buff;
+    ssize_t ret;
+    int fd;
+
+    buff = scrubdb_encode(sd->recs, sd->count, &leng);
+
+    pleng = strlen(sd->path);
+    fname_src = (char*)malloc(pleng + 13);
+    fname_dst = (char*)malloc(pleng + 9);
+    passert(fname_src);
+    passert(fname_dst);
+    memcpy(fname_src, sd->path, pleng);
+    memcpy(fname_src + pleng, ".tmp_scrubdb", 13);
+    memcpy(fname_dst, sd->path, pleng);
+    memcpy(fname_dst + pleng, ".scrubdb", 9);
+
+    fd = open(fname_src, O_WRONLY | O_TRUNC | O_CREAT, 0666);
+    if (fd < 0) {
+        mfs_arg_errlog(LOG_NOTICE, "%s: open error", fname_src);
+    } else {
+        for (pos = 0; pos < leng; pos += ret) {
+            ret = write(fd, buff + pos, leng - pos);
+            if (ret <= 0) {
+                break;
+            }
+        }
+        if (pos < leng || fsync(fd) < 0) {
+            mfs_arg_errlog(LOG_NOTICE, "%s: write error", fname_src);
+            close(fd);
+            unlink(fname_src);
+        } else if (close(fd) < 0) {
+            mfs_arg_errlog(LOG_NOTICE, "%s: close error", fname_src);
+            unlink(fname_src);
+        } else if (rename(fname_src, fname_dst) < 0) {
+            mfs_arg_errlog(LOG_NOTICE, "%s->%s: rename error", fname_src, fname_dst);
+        }
+    }
+    free(fname_src);
+    free(fname_dst);
+    free(buff);
+}
+
+/* state of verified chunks is written periodically and at exit (force) - only for folders where anything has been verified */
+static void hdd_folders_dump_scrubdb(uint8_t force)
+{
+    folder* f;
+    scrubdump *sd, *sdhead;
+    double now;
+
+    if (HDD_SCRUBDB_DUMP_PERIOD == 0 && force == 0) {
+        return;
+    }
+    now = monotonic_seconds();
+    sdhead = NULL;
+    zassert(pthread_mutex_lock(&folderlock));
+    for (f = folderhead; f; f = f->next) {
+        if (f->scanstate == SCST_WORKING && f->toremove == REMOVING_NO && f->damaged == 0 && f->markforremoval != MFR_READONLY && (force || f->nextscrubdump <= now)) {
+            f->nextscrubdump = now + HDD_SCRUBDB_DUMP_PERIOD;
+            sd = hdd_folder_scrubdb_collect(f);
+            if (sd != NULL) {
+                sd->next = sdhead;
+                sdhead = sd;
+            }
+        }
+    }
+    zassert(pthread_mutex_unlock(&folderlock));
+    while (sdhead) {
+        sd = sdhead;
+        sdhead = sd->next;
+        hdd_scrubdb_write(sd);
+        free(sd->path);
+        free(sd->recs);
+        free(sd);
+    }
+}
+
+/* returns records sorted by chunkid (NULL and *count==0 when there is no valid '.scrubdb') */
+static scrubrec* hdd_folder_scrubdb_load(const char* path, uint32_t* count)
+{
+    uint32_t pleng;
+    char* fname;
+    uint8_t* buff;
+    scrubrec* recs;
+    struct stat sb;
+    int fd;
+
+    *count = 0;
+    pleng = strlen(path);
+    fname = (char*)malloc(pleng + 9);
+    passert(fname);
+    memcpy(fname, path, pleng);
+    memcpy(fname + pleng, ".scrubdb", 9);
+    fd = open(fname, O_RDONLY);
+    free(fname);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &sb) < 0 || sb.st_size <= 0) {
+        close(fd);
+        return NULL;
+    }
+    buff = (uint8_t*)malloc(sb.st_size);
+    passert(buff);
+    if (read(fd, buff, sb.st_size) != sb.st_size) {
+        close(fd);
+        free(buff);
+        return NULL;
+    }
+    close(fd);
+    recs = scrubdb_decode(buff, sb.st_size, count);
+    if (recs == NULL) {
+        syslog(LOG_NOTICE, "disk %s: '.scrubdb' is damaged - verification state is lost", path);
+    }
+    free(buff);
+    return recs;
+}
+
+uint8_t hdd_senddata(folder* f, int rmflag)
+{
+    uint32_t i, j;
+    hashshard* hs;
     uint8_t markforremoval;
     uint8_t canberemoved;
     chunk **cptr, *c;
 
     markforremoval = f->markforremoval != MFR_NO;
     canberemoved = 1;
-    zassert(pthread_mutex_lock(&hashlock));
-    zassert(pthread_mutex_lock(&testlock));
-    for (i = 0; i < HASHSIZE; i++) {
-        cptr = &(hashtab[i]);
-        while ((c = *cptr)) {
-            if (c->owner == f) {
-                if (rmflag) {
-                    if (c->state == CH_AVAIL) {
-                        hdd_report_lost_chunk(c->chunkid);
-                        hdd_folder_dump_chunkdb_chunk(f, c);
-                        *cptr = c->next;
-                        if (c->fd >= 0) {
-                            if (c->crcchanged) {
-                                syslog(LOG_WARNING, "hdd_senddata: CRC not flushed - writing now");
-                                chunk_writecrc(c, 1);
+    for (j = 0; j < HASHSHARDS; j++) {
+        hs = hashshards + j;
+        zassert(pthread_mutex_lock(&(hs->lock)));
+        zassert(pthread_mutex_lock(&testlock));
+        for (i = 0; i < hs->size; i++) {
+            cptr = &(hs->tab[i]);
+            while ((c = *cptr)) {
+                if (c->owner == f) {
+                    if (rmflag) {
+                        if (c->state == CH_AVAIL) {
+                            hdd_report_lost_chunk(c->chunkid);
+                            hdd_folder_dump_chunkdb_chunk(f, c);
+                            blockcache_invalidate_chunk(c->chunkid);
+                            *cptr = c->next;
+                            hs->count--;
+                            if (c->fd >= 0) {
+                                if (c->crcchanged) {
+                                    syslog(LOG_WARNING, "hdd_senddata: CRC not flushed - writing now");
+                                    chunk_writecrc(c, 1);
+                                }
+                                close(c->fd);
+                                hdd_open_files_handle(OF_AFTER_CLOSE);
                             }
-                            close(c->fd);
-                            hdd_open_files_handle(OF_AFTER_CLOSE);
-                        }
-                        if (c->crc != NULL) {
+                            if (c->crc != NULL) {
 #ifdef MMAP_ALLOC
-                            munmap((void*)(c->crc), CHUNKCRCSIZE);
+                                munmap((void*)(c->crc), CHUNKCRCSIZE);
 #else
-                            free(c->crc);
+                                free(c->crc);
 #endif
-                        }
+                            }
 #ifdef PRESERVE_BLOCK
-                        if (c->block != NULL) {
+                            if (c->block != NULL) {
 #ifdef MMAP_ALLOC
-                            munmap((void*)(c->block), MFSBLOCKSIZE);
+                                munmap((void*)(c->block), MFSBLOCKSIZE);
 #else
-                            free(c->block);
+                                free(c->block);
 #endif
-                        }
+                            }
 #endif /* PRESERVE_BLOCK */
-                        hdd_remove_chunk_from_test_chain(c, c->owner);
-                        free(c);
+                            hdd_remove_chunk_from_test_chain(c, c->owner);
+                            free(c);
+                        } else {
+                            canberemoved = 0;
+                            cptr = &(c->next);
+                        }
                     } else {
-                        canberemoved = 0;
+                        hdd_report_new_chunk(c->chunkid, c->version | (markforremoval ? 0x80000000 : 0));
                         cptr = &(c->next);
                     }
                 } else {
-                    hdd_report_new_chunk(c->chunkid, c->version | (markforremoval ? 0x80000000 : 0));
                     cptr = &(c->next);
                 }
-            } else {
-                cptr = &(c->next);
             }
         }
+        zassert(pthread_mutex_unlock(&testlock));
+        zassert(pthread_mutex_unlock(&(hs->lock)));
     }
-    zassert(pthread_mutex_unlock(&testlock));
-    zassert(pthread_mutex_unlock(&hashlock));
     return canberemoved;
 }
 
@@ -2120,7 +2585,7 @@ void hdd_check_folders(void)
                     f->scanstate = SCST_WORKING;
                 case SCST_WORKING:
                     if (f->toremove == REMOVING_START) {
-                        hdd_folder_dump_chunkdb_begin(f);
+                        hdd_folder_dump_chunkdb_begin(f, CHUNKDB_ATTRS);
                         f->toremove = REMOVING_INPROGRESS;
                     }
                     if (hdd_senddata(f, 1)) {
@@ -2162,6 +2627,8 @@ void hdd_check_folders(void)
                             }
                         }
                         syslog(LOG_NOTICE, "folder %s successfully removed", f->path);
+                        hddio_ring_free(f->ioring);
+                        hddsched_free(f->iosched);
                         free(f->path);
                         free(f);
                     }
@@ -2265,71 +2732,103 @@ void hdd_check_folders(void)
 
 /* interface */
 
+static uint32_t hdd_get_chunks_shard = 0;
 static uint32_t hdd_get_chunks_pos = 0;
 static pthread_cond_t hdd_get_chunks_cond = PTHREAD_COND_INITIALIZER;
 static uint8_t hdd_get_chunks_waiting = 0;
 static uint8_t hdd_get_chunks_partialmode = 0;
 
+/* non partial mode keeps all shards locked for the whole listing, partial mode locks one shard per list (between *_count and *_data) */
 void hdd_get_chunks_begin(uint8_t partialmode)
 {
-    zassert(pthread_mutex_lock(&hashlock));
-    hdd_get_chunks_pos = 0;
-    while (hdd_get_chunks_partialmode) {
+    uint32_t i;
+    zassert(pthread_mutex_lock(&getchunkslock));
+    while (hdd_get_chunks_active) {
         hdd_get_chunks_waiting++;
-        zassert(pthread_cond_wait(&hdd_get_chunks_cond, &hashlock));
+        zassert(pthread_cond_wait(&hdd_get_chunks_cond, &getchunkslock));
     }
+#ifdef HAVE___SYNC_FETCH_AND_OP
+    __sync_fetch_and_or(&hdd_get_chunks_active, 1);
+#else
+    hdd_get_chunks_active = 1;
+#endif
     hdd_get_chunks_partialmode = partialmode;
-    if (partialmode) {
-        zassert(pthread_mutex_unlock(&hashlock));
+    hdd_get_chunks_shard = 0;
+    hdd_get_chunks_pos = 0;
+    zassert(pthread_mutex_unlock(&getchunkslock));
+    if (partialmode == 0) {
+        for (i = 0; i < HASHSHARDS; i++) {
+            zassert(pthread_mutex_lock(&(hashshards[i].lock)));
+        }
     }
 }
 
 void hdd_get_chunks_end()
 {
-    if (hdd_get_chunks_partialmode) {
-        zassert(pthread_mutex_lock(&hashlock));
-        hdd_get_chunks_partialmode = 0;
-        if (hdd_get_chunks_waiting) {
-            zassert(pthread_cond_signal(&hdd_get_chunks_cond));
-            hdd_get_chunks_waiting--;
+    uint32_t i;
+    if (hdd_get_chunks_partialmode == 0) {
+        for (i = 0; i < HASHSHARDS; i++) {
+            zassert(pthread_mutex_unlock(&(hashshards[i].lock)));
         }
     }
-    zassert(pthread_mutex_unlock(&hashlock));
+    zassert(pthread_mutex_lock(&getchunkslock));
+    hdd_get_chunks_partialmode = 0;
+#ifdef HAVE___SYNC_FETCH_AND_OP
+    __sync_fetch_and_and(&hdd_get_chunks_active, 0);
+#else
+    hdd_get_chunks_active = 0;
+#endif
+    if (hdd_get_chunks_waiting) {
+        zassert(pthread_cond_signal(&hdd_get_chunks_cond));
+        hdd_get_chunks_waiting--;
+    }
+    zassert(pthread_mutex_unlock(&getchunkslock));
 }
 
+/* one list never crosses shard boundary - shard stays locked (in partial mode) until hdd_get_chunks_next_list_data */
 uint32_t hdd_get_chunks_next_list_count(uint32_t stopcount)
 {
     uint32_t res = 0;
-    uint32_t i = 0;
+    uint32_t i;
+    hashshard* hs;
     chunk* c;
     zassert(pthread_mutex_lock(&folderlock)); // c->owner !!!
-    if (hdd_get_chunks_partialmode) {
-        zassert(pthread_mutex_lock(&hashlock));
-    }
-    while (res < stopcount && hdd_get_chunks_pos + i < HASHSIZE) {
-        for (c = hashtab[hdd_get_chunks_pos + i]; c; c = c->next) {
-            if (c->owner != NULL) {
-                res++;
+    while (hdd_get_chunks_shard < HASHSHARDS) {
+        hs = hashshards + hdd_get_chunks_shard;
+        if (hdd_get_chunks_partialmode) {
+            zassert(pthread_mutex_lock(&(hs->lock)));
+        }
+        i = 0;
+        while (res < stopcount && hdd_get_chunks_pos + i < hs->size) {
+            for (c = hs->tab[hdd_get_chunks_pos + i]; c; c = c->next) {
+                if (c->owner != NULL) {
+                    res++;
+                }
             }
+            i++;
+        }
+        if (res > 0) {
+            return res;
         }
-        i++;
-    }
-    if (res == 0) {
         if (hdd_get_chunks_partialmode) {
-            zassert(pthread_mutex_unlock(&hashlock));
+            zassert(pthread_mutex_unlock(&(hs->lock)));
         }
-        zassert(pthread_mutex_unlock(&folderlock));
+        hdd_get_chunks_shard++;
+        hdd_get_chunks_pos = 0;
     }
-    return res;
+    zassert(pthread_mutex_unlock(&folderlock));
+    return 0;
 }
 
 void hdd_get_chunks_next_list_data(uint32_t stopcount, uint8_t* buff)
 {
     uint32_t res = 0;
     uint32_t v;
+    hashshard* hs;
     chunk* c;
-    while (res < stopcount && hdd_get_chunks_pos < HASHSIZE) {
-        for (c = hashtab[hdd_get_chunks_pos]; c; c = c->next) {
+    hs = hashshards + hdd_get_chunks_shard;
+    while (res < stopcount && hdd_get_chunks_pos < hs->size) {
+        for (c = hs->tab[hdd_get_chunks_pos]; c; c = c->next) {
             if (c->owner != NULL) {
                 put64bit(&buff, c->chunkid);
                 v = c->version;
@@ -2343,7 +2842,11 @@ void hdd_get_chunks_next_list_data(uint32_t stopcount, uint8_t* buff)
         hdd_get_chunks_pos++;
     }
     if (hdd_get_chunks_partialmode) {
-        zassert(pthread_mutex_unlock(&hashlock));
+        zassert(pthread_mutex_unlock(&(hs->lock)));
+    }
+    if (hdd_get_chunks_pos >= hs->size) {
+        hdd_get_chunks_shard++;
+        hdd_get_chunks_pos = 0;
     }
     zassert(pthread_mutex_unlock(&folderlock));
 }
@@ -2371,22 +2874,53 @@ static inline void chunk_emptycrc(chunk* c)
     memcpy(c->crc, emptychunkcrc, CHUNKCRCSIZE);
 }
 
-static inline int chunk_readcrc(chunk* c, int mode)
+static inline void chunk_freecrc(chunk* c)
 {
-    int ret;
-    uint8_t hdr[20];
-    const uint8_t* ptr;
-    uint64_t chunkid;
-    uint32_t version;
+#ifdef MMAP_ALLOC
+    munmap((void*)(c->crc), CHUNKCRCSIZE);
+#else
+    free(c->crc);
+#endif
+    c->crc = NULL;
+}
+
+static inline int chunk_readcrc(chunk* c, int mode)
+{
+    uint8_t hdr[20];
+    const uint8_t* ptr;
+    uint64_t chunkid;
+    uint32_t version;
     char fname[PATH_MAX];
-    if (mypread(c->fd, hdr, 20, 0) != 20) {
-        int errmem = errno;
-        hdd_generate_filename(fname, c); // preserves errno !!!
+    hddio_vec v[2];
+#ifdef MMAP_ALLOC
+    c->crc = (uint8_t*)mmap(NULL, CHUNKCRCSIZE, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+#else
+    c->crc = (uint8_t*)malloc(CHUNKCRCSIZE);
+#endif
+    passert(c->crc);
+    // header and crc table are read in one submission (hdrsize is already known from the scan)
+    v[0].fd = c->fd;
+    v[0].write = 0;
+    v[0].buf = hdr;
+    v[0].size = 20;
+    v[0].offset = 0;
+    v[1].fd = c->fd;
+    v[1].write = 0;
+    v[1].buf = c->crc;
+    v[1].size = CHUNKCRCSIZE;
+    v[1].offset = c->hdrsize;
+    hdd_folder_submit(c->owner, v, 2);
+    if (v[0].result != 20) {
+        int errmem = (v[0].result < 0) ? -v[0].result : 0;
+        chunk_freecrc(c);
+        hdd_generate_filename(fname, c);
+        errno = errmem;
         mfs_arg_errlog_silent(LOG_WARNING, "chunk_readcrc: file:%s - read error", fname);
         errno = errmem;
         return MFS_ERROR_IO;
     }
     if (memcmp(hdr, MFSSIGNATURE "C 1.", 7) != 0 || (hdr[7] != '0' && hdr[7] != '1')) { // accept chunks 1.1 (correct CRC for non existing blocks)
+        chunk_freecrc(c);
         hdd_generate_filename(fname, c);
         syslog(LOG_WARNING, "chunk_readcrc: file:%s - wrong header", fname);
         errno = 0;
@@ -2399,28 +2933,18 @@ static inline int chunk_readcrc(chunk* c, int mode)
         version = c->version;
     }
     if (c->chunkid != chunkid || c->version != version) {
+        chunk_freecrc(c);
         hdd_generate_filename(fname, c);
         syslog(LOG_WARNING, "chunk_readcrc: file:%s - wrong id/version in header (%016" PRIX64 "_%08" PRIX32 ")", fname, chunkid, version);
         errno = 0;
         return MFS_ERROR_IO;
     }
-#ifdef MMAP_ALLOC
-    c->crc = (uint8_t*)mmap(NULL, CHUNKCRCSIZE, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
-#else
-    c->crc = (uint8_t*)malloc(CHUNKCRCSIZE);
-#endif
-    passert(c->crc);
-    ret = mypread(c->fd, c->crc, CHUNKCRCSIZE, c->hdrsize);
-    if (ret != CHUNKCRCSIZE) {
-        int errmem = errno;
-        hdd_generate_filename(fname, c); // preserves errno !!!
+    if (v[1].result != CHUNKCRCSIZE) {
+        int errmem = (v[1].result < 0) ? -v[1].result : 0;
+        chunk_freecrc(c);
+        hdd_generate_filename(fname, c);
+        errno = errmem;
         mfs_arg_errlog_silent(LOG_WARNING, "chunk_readcrc: file:%s - read error", fname);
-#ifdef MMAP_ALLOC
-        munmap((void*)(c->crc), CHUNKCRCSIZE);
-#else
-        free(c->crc);
-#endif
-        c->crc = NULL;
         errno = errmem;
         return MFS_ERROR_IO;
     }
@@ -2429,16 +2953,6 @@ static inline int chunk_readcrc(chunk* c, int mode)
     return MFS_STATUS_OK;
 }
 
-static inline void chunk_freecrc(chunk* c)
-{
-#ifdef MMAP_ALLOC
-    munmap((void*)(c->crc), CHUNKCRCSIZE);
-#else
-    free(c->crc);
-#endif
-    c->crc = NULL;
-}
-
 static inline int chunk_writecrc(chunk* c, uint8_t emergency_mode)
 {
     int ret;
@@ -2448,7 +2962,7 @@ static inline int chunk_writecrc(chunk* c, uint8_t emergency_mode)
         c->owner->needrefresh = 1;
         zassert(pthread_mutex_unlock(&folderlock));
     }
-    ret = mypwrite(c->fd, c->crc, CHUNKCRCSIZE, c->hdrsize);
+    ret = hdd_folder_pwrite(c->owner, c->fd, c->crc, CHUNKCRCSIZE, c->hdrsize);
     if (ret != CHUNKCRCSIZE) {
         int errmem = errno;
         hdd_generate_filename(fname, c); // preserves errno !!!
@@ -2462,15 +2976,144 @@ static inline int chunk_writecrc(chunk* c, uint8_t emergency_mode)
 
 void hdd_test_show_chunks(void)
 {
-    uint32_t hashpos;
+    uint32_t i, hashpos;
+    hashshard* hs;
     chunk* c;
-    zassert(pthread_mutex_lock(&hashlock));
-    for (hashpos = 0; hashpos < HASHSIZE; hashpos++) {
-        for (c = hashtab[hashpos]; c; c = c->next) {
-            printf("chunk id:%" PRIu64 " version:%" PRIu32 " (%016" PRIX64 "_%08" PRIX32 ") state:%u\n", c->chunkid, c->version, c->chunkid, c->version, c->state);
+    for (i = 0; i < HASHSHARDS; i++) {
+        hs = hashshards + i;
+        zassert(pthread_mutex_lock(&(hs->lock)));
+        for (hashpos = 0; hashpos < hs->size; hashpos++) {
+            for (c = hs->tab[hashpos]; c; c = c->next) {
+                printf("chunk id:%" PRIu64 " version:%" PRIu32 " (%016" PRIX64 "_%08" PRIX32 ") state:%u\n", c->chunkid, c->version, c->chunkid, c->version, c->state);
+            }
+        }
+        zassert(pthread_mutex_unlock(&(hs->lock)));
+    }
+}
+
+/* memory only chunks (no owner, no file) - used to measure chunk hash performance */
+void hdd_test_hash_fill(uint64_t firstchunkid, uint32_t count)
+{
+    uint32_t i;
+    chunk* c;
+    hdd_hash_init(); // no-op after hdd_init
+    for (i = 0; i < count; i++) {
+        if (hdd_chunk_get(firstchunkid + i, &c, CHMODE_NEW_OR_EXISTING) == 1 && c != NULL) {
+            c->validattr = 1;
+            hdd_chunk_release(c);
+        }
+    }
+}
+
+int hdd_test_hash_lookup(uint64_t chunkid)
+{
+    chunk* c;
+    if (hdd_chunk_find(chunkid, &c) != 1 || c == NULL) {
+        return 0;
+    }
+    hdd_chunk_release(c);
+    return 1;
+}
+
+void hdd_test_hash_clear(void)
+{
+    uint32_t i, hashpos;
+    hashshard* hs;
+    chunk **cptr, *c;
+    for (i = 0; i < HASHSHARDS; i++) {
+        hs = hashshards + i;
+        if (hs->tab == NULL) {
+            continue;
+        }
+        zassert(pthread_mutex_lock(&(hs->lock)));
+        for (hashpos = 0; hashpos < hs->size; hashpos++) {
+            cptr = &(hs->tab[hashpos]);
+            while ((c = *cptr)) {
+                if (c->owner == NULL && c->state == CH_AVAIL && c->fd < 0) {
+                    *cptr = c->next;
+                    hs->count--;
+                    free(c);
+                } else {
+                    cptr = &(c->next);
+                }
+            }
+        }
+        zassert(pthread_mutex_unlock(&(hs->lock)));
+    }
+}
+
+static void hdd_chunk_fsync(chunk* c)
+{
+    uint64_t ts, te;
+    char fname[PATH_MAX];
+
+    ts = monotonic_nseconds();
+#ifdef F_FULLFSYNC
+    if (fcntl(c->fd, F_FULLFSYNC) < 0) {
+        hdd_error_occured(c, 1); // uses and preserves errno !!!
+        hdd_generate_filename(fname, c); // preserves errno !!!
+        mfs_arg_errlog_silent(LOG_WARNING, "hdd_delayed_ops: file:%s - fsync (via fcntl) error", fname);
+    }
+#else
+    if (fsync(c->fd) < 0) {
+        hdd_error_occured(c, 1); // uses and preserves errno !!!
+        hdd_generate_filename(fname, c); // preserves errno !!!
+        mfs_arg_errlog_silent(LOG_WARNING, "hdd_delayed_ops: file:%s - fsync (direct call) error", fname);
+    }
+#endif
+    te = monotonic_nseconds();
+    hdd_stats_datafsync(c->owner, te - ts);
+    c->fsyncneeded = 0;
+}
+
+/* syncs chunks collected by hdd_delayed_ops (all locked) - fsyncs of one folder are submitted together, so the
+ * file system can merge them into one journal commit; errors are still reported for every file separately */
+static void hdd_chunk_fsync_group(chunk** group, uint32_t cnt, double nextfsync)
+{
+    hddio_vec v[FSYNC_GROUP_MAX];
+    uint32_t gindx[FSYNC_GROUP_MAX];
+    uint32_t i, j, k;
+    uint64_t ts, te;
+    folder* f;
+    chunk* c;
+    char fname[PATH_MAX];
+
+    for (i = 0; i < cnt; i++) {
+        if (group[i] == NULL) {
+            continue;
+        }
+        f = group[i]->owner;
+        k = 0;
+        for (j = i; j < cnt; j++) {
+            if (group[j] != NULL && group[j]->owner == f) {
+                v[k].fd = group[j]->fd;
+                v[k].write = HDDIO_FSYNC;
+                v[k].buf = NULL;
+                v[k].size = 0;
+                v[k].offset = 0;
+                v[k].result = 0;
+                gindx[k] = j;
+                k++;
+            }
+        }
+        ts = monotonic_nseconds();
+        hddio_submit(f->ioring, v, k); // not through scheduler - fsync time is not latency seen by clients
+        te = monotonic_nseconds();
+        hdd_stats_datafsync(f, te - ts);
+        f->nextfsync = nextfsync;
+        for (j = 0; j < k; j++) {
+            c = group[gindx[j]];
+            if (v[j].result < 0) {
+                errno = -v[j].result;
+                hdd_error_occured(c, 1); // uses and preserves errno !!!
+                hdd_generate_filename(fname, c); // preserves errno !!!
+                mfs_arg_errlog_silent(LOG_WARNING, "hdd_delayed_ops: file:%s - fsync error", fname);
+            }
+            c->fsyncneeded = 0;
+            hdd_chunk_release(c);
+            group[gindx[j]] = NULL;
         }
     }
-    zassert(pthread_mutex_unlock(&hashlock));
 }
 
 void hdd_delayed_ops()
@@ -2478,15 +3121,22 @@ void hdd_delayed_ops()
     dopchunk **ccp, *cc, *tcc;
     uint32_t dhashpos;
     uint8_t dofsync;
+    uint32_t groupinterval;
+    chunk* fsyncgroup[FSYNC_GROUP_MAX];
+    uint32_t fsynccnt;
+    double steptime, nextfsync;
     chunk* c;
-    uint64_t ts, te;
     char fname[PATH_MAX];
     //	int status;
 
     //	printf("delayed ops: before lock\n");
     zassert(pthread_mutex_lock(&doplock));
     dofsync = DoFsyncBeforeClose;
+    groupinterval = FsyncGroupInterval;
     zassert(pthread_mutex_unlock(&doplock));
+    fsynccnt = 0;
+    steptime = monotonic_seconds();
+    nextfsync = steptime + groupinterval / 1000.0;
 
     zassert(pthread_mutex_lock(&ndoplock));
     //	printf("delayed ops: after lock\n");
@@ -2527,26 +3177,23 @@ void hdd_delayed_ops()
             } else if (c->crcrefcount > 0) { // io in progress - skip entry
                 hdd_chunk_release(c);
                 ccp = &(cc->next);
+            } else if (c->fd >= 0 && c->fsyncneeded && dofsync && groupinterval > 0 && c->owner != NULL) {
+                // descriptor stays open until chunk is synced together with other chunks of its folder
+                // (folder synced earlier in this step has nextfsync equal to this step's nextfsync - still due)
+                ccp = &(cc->next);
+                if (c->owner->nextfsync <= steptime || c->owner->nextfsync == nextfsync) {
+                    fsyncgroup[fsynccnt++] = c; // released after fsync
+                    if (fsynccnt == FSYNC_GROUP_MAX) {
+                        hdd_chunk_fsync_group(fsyncgroup, fsynccnt, nextfsync);
+                        fsynccnt = 0;
+                    }
+                } else {
+                    hdd_chunk_release(c);
+                }
             } else {
                 double now;
                 if (c->fd >= 0 && c->fsyncneeded && dofsync) {
-                    ts = monotonic_nseconds();
-#ifdef F_FULLFSYNC
-                    if (fcntl(c->fd, F_FULLFSYNC) < 0) {
-                        hdd_error_occured(c, 1); // uses and preserves errno !!!
-                        hdd_generate_filename(fname, c); // preserves errno !!!
-                        mfs_arg_errlog_silent(LOG_WARNING, "hdd_delayed_ops: file:%s - fsync (via fcntl) error", fname);
-                    }
-#else
-                    if (fsync(c->fd) < 0) {
-                        hdd_error_occured(c, 1); // uses and preserves errno !!!
-                        hdd_generate_filename(fname, c); // preserves errno !!!
-                        mfs_arg_errlog_silent(LOG_WARNING, "hdd_delayed_ops: file:%s - fsync (direct call) error", fname);
-                    }
-#endif
-                    te = monotonic_nseconds();
-                    hdd_stats_datafsync(c->owner, te - ts);
-                    c->fsyncneeded = 0;
+                    hdd_chunk_fsync(c);
                 }
                 now = monotonic_seconds();
 #ifdef PRESERVE_BLOCK
@@ -2605,6 +3252,9 @@ void hdd_delayed_ops()
             }
         }
     }
+    if (fsynccnt > 0) {
+        hdd_chunk_fsync_group(fsyncgroup, fsynccnt, nextfsync);
+    }
     //	printf("delayed ops: after loop , before unlock\n");
     //	printf("delayed ops: after unlock\n");
 }
@@ -2619,7 +3269,7 @@ static int hdd_io_begin(chunk* c, int mode)
     //	sassert(c->state==CH_LOCKED);
 
     // syslog(LOG_NOTICE,"chunk: %016" PRIX64" - before io",c->chunkid);
-    hdd_chunk_testmove(c);
+    c->atime = main_time();
     if (c->crcrefcount == 0) {
         hdd_generate_filename(fname, c);
 #ifdef PRESERVE_BLOCK
@@ -2930,6 +3580,18 @@ int hdd_read(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* buf
         hdd_chunk_release(c);
         return MFS_STATUS_OK;
     }
+    if (blockcache_read(c->chunkid, c->version, blocknum, buffer, offset, size)) {
+        // cached blocks were checked when stored - only crc of returned piece is needed
+        if (size == MFSBLOCKSIZE) {
+            rcrcptr = (c->crc) + (4 * blocknum);
+            crc = get32bit(&rcrcptr);
+        } else {
+            crc = mycrc32(0, buffer, size);
+        }
+        put32bit(&crcbuff, crc);
+        hdd_chunk_release(c);
+        return MFS_STATUS_OK;
+    }
     if (offset == 0 && size == MFSBLOCKSIZE) {
 #ifdef PRESERVE_BLOCK
         if (c->blockno == blocknum) {
@@ -2939,7 +3601,7 @@ int hdd_read(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* buf
         } else {
 #endif /* PRESERVE_BLOCK */
             ts = monotonic_nseconds();
-            ret = mypread(c->fd, buffer, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
+            ret = hdd_folder_pread(c->owner, c->fd, buffer, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
             error = errno;
             te = monotonic_nseconds();
             hdd_stats_dataread(c->owner, MFSBLOCKSIZE, te - ts);
@@ -2967,11 +3629,12 @@ int hdd_read(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* buf
             hdd_chunk_release(c);
             return MFS_ERROR_IO;
         }
+        blockcache_store(c->chunkid, c->version, blocknum, buffer);
     } else {
 #ifdef PRESERVE_BLOCK
         if (c->blockno != blocknum) {
             ts = monotonic_nseconds();
-            ret = mypread(c->fd, c->block, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
+            ret = hdd_folder_pread(c->owner, c->fd, c->block, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
             error = errno;
             te = monotonic_nseconds();
             hdd_stats_dataread(c->owner, MFSBLOCKSIZE, te - ts);
@@ -2985,7 +3648,7 @@ int hdd_read(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* buf
         postcrc = mycrc32(0, c->block + offset + size, MFSBLOCKSIZE - (offset + size));
 #else /* PRESERVE_BLOCK */
         ts = monotonic_nseconds();
-        ret = mypread(c->fd, blockbuffer, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
+        ret = hdd_folder_pread(c->owner, c->fd, blockbuffer, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
         error = errno;
         te = monotonic_nseconds();
         hdd_stats_dataread(c->owner, MFSBLOCKSIZE, te - ts);
@@ -3022,8 +3685,10 @@ int hdd_read(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* buf
             return MFS_ERROR_IO;
         }
 #ifdef PRESERVE_BLOCK
+        blockcache_store(c->chunkid, c->version, blocknum, c->block);
         memcpy(buffer, c->block + offset, size);
 #else /* PRESERVE_BLOCK */
+        blockcache_store(c->chunkid, c->version, blocknum, blockbuffer);
         memcpy(buffer, blockbuffer + offset, size);
 #endif /* PRESERVE_BLOCK */
     }
@@ -3032,6 +3697,251 @@ int hdd_read(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* buf
     return MFS_STATUS_OK;
 }
 
+typedef struct hdd_read_blocks_ctx {
+    chunk* c;
+    uint16_t blocknum;
+    uint16_t next; // first block not checked yet
+    uint8_t** buffers;
+    uint8_t** crcbuffs;
+    const uint8_t* cached;
+    const hddio_vec* v;
+    const uint16_t* vblock;
+    int status;
+} hdd_read_blocks_ctx;
+
+/* checks blocks up to 'upto' (exclusive) in order - returns nonzero when reading should stop */
+static int hdd_read_blocks_check(hdd_read_blocks_ctx* rb, uint16_t upto, uint16_t vindx)
+{
+    chunk* c = rb->c;
+    const uint8_t* rcrcptr;
+    uint32_t crc, bcrc;
+    uint16_t i;
+    char fname[PATH_MAX];
+
+    while (rb->status == MFS_STATUS_OK && rb->next < upto) {
+        i = rb->next;
+        if (rb->blocknum + i < c->blocks) {
+            rcrcptr = (c->crc) + (4 * (rb->blocknum + i));
+            bcrc = get32bit(&rcrcptr);
+            if (rb->cached[i]) {
+                put32bit(&(rb->crcbuffs[i]), bcrc);
+            } else {
+                if (vindx != 0xFFFF && rb->vblock[vindx] == i && rb->v[vindx].result != MFSBLOCKSIZE) {
+                    errno = (rb->v[vindx].result < 0) ? -rb->v[vindx].result : 0;
+                    hdd_error_occured(c, 1); // uses and preserves errno !!!
+                    hdd_generate_filename(fname, c); // preserves errno !!!
+                    mfs_arg_errlog_silent(LOG_WARNING, "read_block_from_chunk: file: %s ; block: %" PRIu16 " - read error", fname, (uint16_t)(rb->blocknum + i));
+                    rb->status = MFS_ERROR_IO;
+                    return 1;
+                }
+                crc = mycrc32(0, rb->buffers[i], MFSBLOCKSIZE);
+                if (bcrc != crc) {
+                    errno = 0;
+                    hdd_error_occured(c, 1); // uses and preserves errno !!!
+                    hdd_generate_filename(fname, c);
+                    syslog(LOG_WARNING, "read_block_from_chunk: file: %s ; block: %" PRIu16 " - crc error (data crc: %08" PRIX32 " ; check crc: %08" PRIX32 ")", fname, (uint16_t)(rb->blocknum + i), crc, bcrc);
+                    rb->status = MFS_ERROR_CRC;
+                    return 1;
+                }
+                put32bit(&(rb->crcbuffs[i]), crc);
+            }
+        }
+        rb->next++;
+    }
+    return (rb->status != MFS_STATUS_OK);
+}
+
+static int hdd_read_blocks_vready(void* arg, uint32_t vindx)
+{
+    hdd_read_blocks_ctx* rb = (hdd_read_blocks_ctx*)arg;
+    return hdd_read_blocks_check(rb, rb->vblock[vindx] + 1, vindx);
+}
+
+/* multi-block read - all full blocks are submitted at once and every block is checked against its crc as soon as it is read (reading stops at the first bad one) */
+/* with 'ready' given, checked blocks are handed over in order after the chunk is released, so the caller can send them to a socket without blocking other users of the chunk */
+int hdd_read_blocks(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint16_t blocks, uint8_t** buffers, uint8_t** crcbuffs, hdd_block_ready_fn ready, void* arg)
+{
+    chunk* c;
+    hddio_vec v[HDD_READ_MAX_BLOCKS];
+    uint16_t vblock[HDD_READ_MAX_BLOCKS];
+    uint8_t cached[HDD_READ_MAX_BLOCKS];
+    uint16_t i, cnt;
+    uint64_t ts, te;
+    hdd_read_blocks_ctx rb;
+
+    if (blocks == 0 || blocks > HDD_READ_MAX_BLOCKS) {
+        return MFS_ERROR_WRONGSIZE;
+    }
+    if (hdd_chunk_find(chunkid, &c) == 2) {
+        return MFS_ERROR_NOTDONE;
+    }
+    if (c == NULL) {
+        return MFS_ERROR_NOCHUNK;
+    }
+    if (c->version != version && version > 0) {
+        hdd_chunk_release(c);
+        return MFS_ERROR_WRONGVERSION;
+    }
+    if (blocknum >= MFSBLOCKSINCHUNK || blocknum + blocks > MFSBLOCKSINCHUNK) {
+        hdd_chunk_release(c);
+        return MFS_ERROR_BNUMTOOBIG;
+    }
+    cnt = 0;
+    for (i = 0; i < blocks; i++) {
+        cached[i] = 0;
+        if (blocknum + i >= c->blocks) {
+            memset(buffers[i], 0, MFSBLOCKSIZE);
+            put32bit(&(crcbuffs[i]), emptyblockcrc);
+        } else if (blockcache_read(c->chunkid, c->version, blocknum + i, buffers[i], 0, MFSBLOCKSIZE)) {
+            cached[i] = 1;
+        } else {
+#ifdef PRESERVE_BLOCK
+            if (c->blockno == blocknum + i) {
+                memcpy(buffers[i], c->block, MFSBLOCKSIZE);
+            } else {
+#endif /* PRESERVE_BLOCK */
+                v[cnt].fd = c->fd;
+                v[cnt].write = 0;
+                v[cnt].buf = buffers[i];
+                v[cnt].size = MFSBLOCKSIZE;
+                v[cnt].offset = c->hdrsize + CHUNKCRCSIZE + (((uint32_t)(blocknum + i)) << MFSBLOCKBITS);
+                v[cnt].result = MFSBLOCKSIZE;
+                vblock[cnt] = i;
+                cnt++;
+#ifdef PRESERVE_BLOCK
+            }
+#endif /* PRESERVE_BLOCK */
+        }
+    }
+    rb.c = c;
+    rb.blocknum = blocknum;
+    rb.next = 0;
+    rb.buffers = buffers;
+    rb.crcbuffs = crcbuffs;
+    rb.cached = cached;
+    rb.v = v;
+    rb.vblock = vblock;
+    rb.status = MFS_STATUS_OK;
+    if (cnt > 0) {
+        ts = monotonic_nseconds();
+        hdd_folder_submit_ordered(c->owner, v, cnt, hdd_read_blocks_vready, &rb);
+        te = monotonic_nseconds();
+        hdd_stats_dataread(c->owner, cnt * MFSBLOCKSIZE, te - ts);
+    }
+    // blocks after the last one read from disk (cached, sparse)
+    hdd_read_blocks_check(&rb, blocks, 0xFFFF);
+    hdd_chunk_release(c);
+    if (rb.status == MFS_STATUS_OK && ready != NULL) {
+        for (i = 0; i < blocks; i++) {
+            if (ready(arg, i) != 0) {
+                return MFS_ERROR_NOTDONE;
+            }
+        }
+    }
+    return rb.status;
+}
+
+/* sendfile variant of hdd_read_blocks - blocks are checked with the chunk locked: blocks found in blockcache were checked when stored, others are read, checked and stored there, so repeated reads of hot blocks touch no user memory */
+/* then a duplicate of the chunk descriptor pins the file, and the caller sends [*foffset,*foffset+blocks*MFSBLOCKSIZE) from *fd with sendfile after the chunk is released (and closes *fd) */
+/* a write that gets in between sendfile and the check is caught by the receiver, which checks every block against its crc */
+/* MFS_ERROR_NOTDONE means "use hdd_read_blocks" (sparse blocks etc.) */
+int hdd_read_sendfile(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint16_t blocks, uint8_t** crcbuffs, int* fd, uint64_t* foffset)
+{
+    chunk* c;
+    uint64_t boffset;
+    uint8_t* rbuffer;
+    uint16_t i;
+    const uint8_t* rcrcptr;
+    uint32_t crc, bcrc;
+    int ret;
+    uint64_t ts, te;
+    char fname[PATH_MAX];
+#ifndef PRESERVE_BLOCK
+    uint8_t* blockbuffer;
+    blockbuffer = pthread_getspecific(blockbufferkey);
+    if (blockbuffer == NULL) {
+#ifdef MMAP_ALLOC
+        blockbuffer = mmap(NULL, MFSBLOCKSIZE, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+#else
+        blockbuffer = malloc(MFSBLOCKSIZE);
+#endif
+        passert(blockbuffer);
+        zassert(pthread_setspecific(blockbufferkey, blockbuffer));
+    }
+#endif /* PRESERVE_BLOCK */
+
+    if (blocks == 0 || blocks > HDD_READ_MAX_BLOCKS) {
+        return MFS_ERROR_WRONGSIZE;
+    }
+    if (hdd_chunk_find(chunkid, &c) == 2) {
+        return MFS_ERROR_NOTDONE;
+    }
+    if (c == NULL) {
+        return MFS_ERROR_NOCHUNK;
+    }
+    if (c->version != version && version > 0) {
+        hdd_chunk_release(c);
+        return MFS_ERROR_WRONGVERSION;
+    }
+    if (blocknum >= MFSBLOCKSINCHUNK || blocknum + blocks > MFSBLOCKSINCHUNK) {
+        hdd_chunk_release(c);
+        return MFS_ERROR_BNUMTOOBIG;
+    }
+    if (c->fd < 0 || blocknum + blocks > c->blocks) {
+        hdd_chunk_release(c);
+        return MFS_ERROR_NOTDONE;
+    }
+    for (i = 0; i < blocks; i++) {
+        rcrcptr = (c->crc) + (4 * (blocknum + i));
+        bcrc = get32bit(&rcrcptr);
+        if (blockcache_read(c->chunkid, c->version, blocknum + i, NULL, 0, 0)) {
+            put32bit(&(crcbuffs[i]), bcrc);
+            continue;
+        }
+        boffset = c->hdrsize + CHUNKCRCSIZE + (((uint32_t)(blocknum + i)) << MFSBLOCKBITS);
+#ifdef PRESERVE_BLOCK
+        rbuffer = c->block;
+        if (c->blockno != blocknum + i) {
+            ts = monotonic_nseconds();
+            ret = hdd_folder_pread(c->owner, c->fd, c->block, MFSBLOCKSIZE, boffset);
+            te = monotonic_nseconds();
+            hdd_stats_dataread(c->owner, MFSBLOCKSIZE, te - ts);
+            c->blockno = blocknum + i;
+        } else {
+            ret = MFSBLOCKSIZE;
+        }
+#else /* PRESERVE_BLOCK */
+        rbuffer = blockbuffer;
+        ts = monotonic_nseconds();
+        ret = hdd_folder_pread(c->owner, c->fd, blockbuffer, MFSBLOCKSIZE, boffset);
+        te = monotonic_nseconds();
+        hdd_stats_dataread(c->owner, MFSBLOCKSIZE, te - ts);
+#endif /* PRESERVE_BLOCK */
+        if (ret != MFSBLOCKSIZE) {
+            hdd_error_occured(c, 1); // uses and preserves errno !!!
+            hdd_generate_filename(fname, c); // preserves errno !!!
+            mfs_arg_errlog_silent(LOG_WARNING, "read_block_from_chunk: file: %s ; block: %" PRIu16 " - read error", fname, (uint16_t)(blocknum + i));
+            hdd_chunk_release(c);
+            return MFS_ERROR_IO;
+        }
+        crc = mycrc32(0, rbuffer, MFSBLOCKSIZE);
+        if (bcrc != crc) {
+            errno = 0;
+            hdd_error_occured(c, 1); // uses and preserves errno !!!
+            hdd_generate_filename(fname, c);
+            syslog(LOG_WARNING, "read_block_from_chunk: file: %s ; block: %" PRIu16 " - crc error (data crc: %08" PRIX32 " ; check crc: %08" PRIX32 ")", fname, (uint16_t)(blocknum + i), crc, bcrc);
+            hdd_chunk_release(c);
+            return MFS_ERROR_CRC;
+        }
+        blockcache_store(c->chunkid, c->version, blocknum + i, rbuffer);
+        put32bit(&(crcbuffs[i]), crc);
+    }
+    *fd = dup(c->fd);
+    *foffset = c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS);
+    hdd_chunk_release(c);
+    return (*fd < 0) ? MFS_ERROR_NOTDONE : MFS_STATUS_OK;
+}
+
 int hdd_write(uint64_t chunkid, uint32_t version, uint16_t blocknum, const uint8_t* buffer, uint32_t offset, uint32_t size, const uint8_t* crcbuff)
 {
     chunk* c;
@@ -3079,6 +3989,7 @@ int hdd_write(uint64_t chunkid, uint32_t version, uint16_t blocknum, const uint8
         hdd_chunk_release(c);
         return MFS_ERROR_WRONGOFFSET;
     }
+    blockcache_invalidate_block(c->chunkid, blocknum);
     crc = get32bit(&crcbuff);
 #ifdef HAVE___SYNC_OP_AND_FETCH
     if (blocknum >= c->blocks && __sync_or_and_fetch(&Sparsification, 0)) { // new block - may be sparsified
@@ -3164,7 +4075,7 @@ int hdd_write(uint64_t chunkid, uint32_t version, uint16_t blocknum, const uint8
             c->blocks = blocknum + 1;
         }
         ts = monotonic_nseconds();
-        ret = mypwrite(c->fd, buffer, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
+        ret = hdd_folder_pwrite(c->owner, c->fd, buffer, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
         error = errno;
         te = monotonic_nseconds();
         hdd_stats_datawrite(c->owner, MFSBLOCKSIZE, te - ts);
@@ -3179,6 +4090,7 @@ int hdd_write(uint64_t chunkid, uint32_t version, uint16_t blocknum, const uint8
         wcrcptr = (c->crc) + (4 * blocknum);
         put32bit(&wcrcptr, crc);
         c->crcchanged = 1;
+        c->digestvalid = 0;
         if (ret != MFSBLOCKSIZE) {
             if (error == 0 || error == EAGAIN) {
                 error = ENOSPC;
@@ -3200,7 +4112,7 @@ int hdd_write(uint64_t chunkid, uint32_t version, uint16_t blocknum, const uint8
 #ifdef PRESERVE_BLOCK
             if (c->blockno != blocknum) {
                 ts = monotonic_nseconds();
-                ret = mypread(c->fd, c->block, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
+                ret = hdd_folder_pread(c->owner, c->fd, c->block, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
                 error = errno;
                 te = monotonic_nseconds();
                 hdd_stats_dataread(c->owner, MFSBLOCKSIZE, te - ts);
@@ -3211,7 +4123,7 @@ int hdd_write(uint64_t chunkid, uint32_t version, uint16_t blocknum, const uint8
             }
 #else /* PRESERVE_BLOCK */
             ts = monotonic_nseconds();
-            ret = mypread(c->fd, blockbuffer, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
+            ret = hdd_folder_pread(c->owner, c->fd, blockbuffer, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
             error = errno;
             te = monotonic_nseconds();
             hdd_stats_dataread(c->owner, MFSBLOCKSIZE, te - ts);
@@ -3274,7 +4186,7 @@ int hdd_write(uint64_t chunkid, uint32_t version, uint16_t blocknum, const uint8
 #ifdef PRESERVE_BLOCK
             memcpy(c->block + offset, buffer, size);
             ts = monotonic_nseconds();
-            ret = mypwrite(c->fd, c->block + offset, size, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS) + offset);
+            ret = hdd_folder_pwrite(c->owner, c->fd, c->block + offset, size, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS) + offset);
             error = errno;
             te = monotonic_nseconds();
             hdd_stats_datawrite(c->owner, size, te - ts);
@@ -3282,7 +4194,7 @@ int hdd_write(uint64_t chunkid, uint32_t version, uint16_t blocknum, const uint8
 #else /* PRESERVE_BLOCK */
             memcpy(blockbuffer + offset, buffer, size);
             ts = monotonic_nseconds();
-            ret = mypwrite(c->fd, blockbuffer + offset, size, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS) + offset);
+            ret = hdd_folder_pwrite(c->owner, c->fd, blockbuffer + offset, size, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS) + offset);
             error = errno;
             te = monotonic_nseconds();
             hdd_stats_datawrite(c->owner, size, te - ts);
@@ -3314,6 +4226,7 @@ int hdd_write(uint64_t chunkid, uint32_t version, uint16_t blocknum, const uint8
         //		put32bit(&wcrcptr,bcrc);
         put32bit(&wcrcptr, combinedcrc);
         c->crcchanged = 1;
+        c->digestvalid = 0;
         //		if (crc!=mycrc32(0,blockbuffer+offset,size)) {
         if (size > 0 && crc != chcrc) {
             hdd_error_occured(c, 1); // uses and preserves errno !!!
@@ -3333,16 +4246,128 @@ int hdd_write(uint64_t chunkid, uint32_t version, uint16_t blocknum, const uint8
             hdd_chunk_release(c);
             return MFS_ERROR_IO;
         }
-        if (truncneeded) {
-            if (ftruncate(c->fd, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)(blocknum + 1)) << MFSBLOCKBITS)) < 0) {
-                hdd_error_occured(c, 1); // uses and preserves errno !!!
-                hdd_generate_filename(fname, c); // preserves errno !!!
-                mfs_arg_errlog_silent(LOG_WARNING, "write_block_to_chunk: file: %s ; block: %" PRIu16 " - ftruncate error", fname, blocknum);
-                hdd_chunk_release(c);
-                return MFS_ERROR_IO;
-            }
+        if (truncneeded) {
+            if (ftruncate(c->fd, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)(blocknum + 1)) << MFSBLOCKBITS)) < 0) {
+                hdd_error_occured(c, 1); // uses and preserves errno !!!
+                hdd_generate_filename(fname, c); // preserves errno !!!
+                mfs_arg_errlog_silent(LOG_WARNING, "write_block_to_chunk: file: %s ; block: %" PRIu16 " - ftruncate error", fname, blocknum);
+                hdd_chunk_release(c);
+                return MFS_ERROR_IO;
+            }
+        }
+    }
+    hdd_chunk_release(c);
+    return MFS_STATUS_OK;
+}
+
+/* hdd_write shortens new block when its first or last 512 bytes are zeros - such blocks are left for hdd_write */
+static inline int hdd_block_sparsifiable(const uint8_t* buffer)
+{
+    uint32_t i;
+    for (i = 0; i < 512 && buffer[i] == 0; i++) { }
+    if (i == 512) {
+        return 1;
+    }
+    for (i = MFSBLOCKSIZE - 512; i < MFSBLOCKSIZE && buffer[i] == 0; i++) { }
+    return (i == MFSBLOCKSIZE) ? 1 : 0;
+}
+
+/* multi-block write - consecutive whole blocks are checked against their crcs and written with one vectored write */
+/* stops before first block that needs hdd_write (sparsification, crc mismatch) - *written==0 means "use hdd_write" */
+int hdd_write_blocks(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint16_t blocks, const uint8_t** buffers, const uint8_t** crcbuffs, uint16_t* written)
+{
+    chunk* c;
+    struct iovec iov[HDD_WRITE_MAX_BLOCKS];
+    uint32_t crc[HDD_WRITE_MAX_BLOCKS];
+    const uint8_t* rcrcptr;
+    uint8_t* wcrcptr;
+    uint16_t i, cnt;
+    uint32_t b;
+    uint8_t sp;
+    ssize_t ret;
+    int error;
+    uint64_t ts, te;
+    char fname[PATH_MAX];
+
+    *written = 0;
+    if (blocks == 0 || blocks > HDD_WRITE_MAX_BLOCKS) {
+        return MFS_ERROR_WRONGSIZE;
+    }
+    if (hdd_chunk_find(chunkid, &c) == 2) {
+        return MFS_ERROR_NOTDONE;
+    }
+    if (c == NULL) {
+        return MFS_ERROR_NOCHUNK;
+    }
+    if (c->version != version && version > 0) {
+        hdd_chunk_release(c);
+        return MFS_ERROR_WRONGVERSION;
+    }
+    if (blocknum >= MFSBLOCKSINCHUNK || blocknum + blocks > MFSBLOCKSINCHUNK) {
+        hdd_chunk_release(c);
+        return MFS_ERROR_BNUMTOOBIG;
+    }
+#ifdef HAVE___SYNC_OP_AND_FETCH
+    sp = __sync_or_and_fetch(&Sparsification, 0);
+#else
+    pthread_mutex_lock(&cfglock);
+    sp = Sparsification;
+    pthread_mutex_unlock(&cfglock);
+#endif
+    for (cnt = 0; cnt < blocks; cnt++) {
+        if (sp && blocknum + cnt >= c->blocks && hdd_block_sparsifiable(buffers[cnt])) {
+            break;
+        }
+        rcrcptr = crcbuffs[cnt];
+        crc[cnt] = get32bit(&rcrcptr);
+        if (crc[cnt] != mycrc32(0, buffers[cnt], MFSBLOCKSIZE)) {
+            break;
         }
+        iov[cnt].iov_base = (void*)(buffers[cnt]);
+        iov[cnt].iov_len = MFSBLOCKSIZE;
+    }
+    if (cnt == 0) {
+        hdd_chunk_release(c);
+        return MFS_STATUS_OK;
+    }
+    for (i = 0; i < cnt; i++) {
+        blockcache_invalidate_block(c->chunkid, blocknum + i);
+    }
+    if (blocknum + cnt > c->blocks) {
+        wcrcptr = (c->crc) + (4 * (c->blocks));
+        for (b = c->blocks; b < blocknum; b++) {
+            put32bit(&wcrcptr, emptyblockcrc);
+        }
+        c->blocks = blocknum + cnt;
+    }
+    ts = monotonic_nseconds();
+    ret = hdd_folder_pwritev(c->owner, c->fd, iov, cnt, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)blocknum) << MFSBLOCKBITS));
+    error = errno;
+    te = monotonic_nseconds();
+    hdd_stats_datawrite(c->owner, ((uint32_t)cnt) << MFSBLOCKBITS, te - ts);
+    // crc table is updated once for whole range and written to disk with the rest of changes in hdd_io_end
+    wcrcptr = (c->crc) + (4 * blocknum);
+    for (i = 0; i < cnt; i++) {
+        put32bit(&wcrcptr, crc[i]);
+    }
+    c->crcchanged = 1;
+    c->digestvalid = 0;
+    if (ret != (ssize_t)(((uint32_t)cnt) << MFSBLOCKBITS)) {
+        if (error == 0 || error == EAGAIN) {
+            error = ENOSPC;
+        }
+        errno = error;
+        hdd_error_occured(c, 1); // uses and preserves errno !!!
+        hdd_generate_filename(fname, c); // preserves errno !!!
+        mfs_arg_errlog_silent(LOG_WARNING, "write_block_to_chunk: file: %s ; blocks: %" PRIu16 "-%" PRIu16 " - write error", fname, blocknum, (uint16_t)(blocknum + cnt - 1));
+        hdd_chunk_release(c);
+        return MFS_ERROR_IO;
     }
+#ifdef PRESERVE_BLOCK
+    memcpy(c->block, buffers[cnt - 1], MFSBLOCKSIZE);
+    c->blockno = blocknum + cnt - 1;
+#endif /* PRESERVE_BLOCK */
+    *written = cnt;
     hdd_chunk_release(c);
     return MFS_STATUS_OK;
 }
@@ -3507,13 +4532,17 @@ static int hdd_int_create(uint64_t chunkid, uint32_t version)
     return MFS_STATUS_OK;
 }
 
-static int hdd_int_test(uint64_t chunkid, uint32_t version, uint16_t* blocks)
+/* scrub - called by tester: damaged chunks are only moved to the end of the test chain */
+static int hdd_int_test(uint64_t chunkid, uint32_t version, uint16_t* blocks, uint8_t scrub)
 {
     const uint8_t* ptr;
     uint16_t block;
     uint32_t bcrc;
     int32_t retsize;
-    uint32_t lasttesttime, now;
+    uint32_t lasttesttime, lastatime, now;
+    uint8_t digest[CHUNKDIGEST_SIZE];
+    uint8_t digestchanged;
+    struct stat sb;
     int status;
     chunk* c;
     char fname[PATH_MAX];
@@ -3543,7 +4572,13 @@ static int hdd_int_test(uint64_t chunkid, uint32_t version, uint16_t* blocks)
         hdd_chunk_release(c);
         return MFS_ERROR_WRONGVERSION;
     }
+    if (scrub && c->damaged) {
+        hdd_chunk_testskip(c);
+        hdd_chunk_release(c);
+        return MFS_ERROR_NOTDONE;
+    }
     lasttesttime = c->testtime;
+    lastatime = c->atime;
     status = hdd_io_begin(c, MODE_EXISTING);
     if (status != MFS_STATUS_OK) {
         hdd_error_occured(c, 1); // uses and preserves errno !!!
@@ -3588,7 +4623,34 @@ static int hdd_int_test(uint64_t chunkid, uint32_t version, uint16_t* blocks)
                 return MFS_ERROR_CRC;
             }
         }
-        if (MinFlushCacheTime >= 0 && lasttesttime + MinFlushCacheTime <= now) {
+        // blocks match crcs - now check that crc table itself is the one verified last time
+        chunkdigest_blocks(c->crc, c->blocks, digest);
+        zassert(pthread_mutex_lock(&testlock));
+        digestchanged = (c->digestvalid && memcmp(c->digest, digest, CHUNKDIGEST_SIZE) != 0) ? 1 : 0;
+        zassert(pthread_mutex_unlock(&testlock));
+        // digest may come from '.scrubdb' - file modified after that verification (e.g. while chunkserver was down) is not an error
+        if (digestchanged && fstat(c->fd, &sb) == 0 && (uint64_t)sb.st_mtime > lasttesttime) {
+            hdd_generate_filename(fname, c);
+            syslog(LOG_NOTICE, "test_chunk: file:%s - modified after last verification - crc table digest renewed", fname);
+            digestchanged = 0;
+        }
+        zassert(pthread_mutex_lock(&testlock));
+        if (digestchanged) {
+            zassert(pthread_mutex_unlock(&testlock));
+            errno = 0; // set anything to errno
+            hdd_error_occured(c, 1); // uses and preserves errno !!!
+            hdd_generate_filename(fname, c); // preserves errno !!!
+            syslog(LOG_WARNING, "test_chunk: file:%s - crc table differs from last verification", fname);
+            hdd_io_end(c);
+            hdd_chunk_release(c);
+            return MFS_ERROR_CRC;
+        }
+        memcpy(c->digest, digest, CHUNKDIGEST_SIZE);
+        c->digestvalid = 1;
+        hdd_int_chunk_testmove(c);
+        c->owner->scrubdirty = 1;
+        zassert(pthread_mutex_unlock(&testlock));
+        if (MinFlushCacheTime >= 0 && lastatime + MinFlushCacheTime <= now) {
             hdd_drop_caches_int(c);
         }
     }
@@ -3700,7 +4762,7 @@ static int hdd_int_duplicate(uint64_t chunkid, uint32_t version, uint32_t newver
         }
         ptr = vbuff;
         put32bit(&ptr, newversion);
-        if (mypwrite(oc->fd, vbuff, 4, 16) != 4) {
+        if (hdd_folder_pwrite(oc->owner, oc->fd, vbuff, 4, 16) != 4) {
             hdd_error_occured(oc, 1); // uses and preserves errno !!!
             mfs_arg_errlog_silent(LOG_WARNING, "duplicate_chunk: file:%s - write error", fname);
             hdd_chunk_delete(c);
@@ -3762,7 +4824,7 @@ static int hdd_int_duplicate(uint64_t chunkid, uint32_t version, uint32_t newver
             memcpy(c->block, oc->block, MFSBLOCKSIZE);
             retsize = MFSBLOCKSIZE;
         } else {
-            retsize = mypread(oc->fd, c->block, MFSBLOCKSIZE, oc->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS));
+            retsize = hdd_folder_pread(oc->owner, oc->fd, c->block, MFSBLOCKSIZE, oc->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS));
         }
 #else /* PRESERVE_BLOCK */
         retsize = read(oc->fd, blockbuffer, MFSBLOCKSIZE);
@@ -3816,7 +4878,7 @@ static int hdd_int_duplicate(uint64_t chunkid, uint32_t version, uint32_t newver
             retsize = 0;
             nzstart = nzend = 0;
         } else {
-            retsize = mypwrite(c->fd, writeptr + nzstart, nzend - nzstart, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS) + nzstart);
+            retsize = hdd_folder_pwrite(c->owner, c->fd, writeptr + nzstart, nzend - nzstart, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS) + nzstart);
         }
         if (retsize != (int32_t)(nzend - nzstart)) {
             hdd_error_occured(c, 0); // uses and preserves errno !!!
@@ -3921,7 +4983,7 @@ static int hdd_int_version(uint64_t chunkid, uint32_t version, uint32_t newversi
     }
     ptr = vbuff;
     put32bit(&ptr, newversion);
-    if (mypwrite(c->fd, vbuff, 4, 16) != 4) {
+    if (hdd_folder_pwrite(c->owner, c->fd, vbuff, 4, 16) != 4) {
         hdd_error_occured(c, 1); // uses and preserves errno !!!
         mfs_arg_errlog_silent(LOG_WARNING, "set_chunk_version: file:%s - write error", fname);
         hdd_io_end(c);
@@ -3998,7 +5060,7 @@ static int hdd_int_truncate(uint64_t chunkid, uint32_t version, uint32_t newvers
     }
     ptr = vbuff;
     put32bit(&ptr, newversion);
-    if (mypwrite(c->fd, vbuff, 4, 16) != 4) {
+    if (hdd_folder_pwrite(c->owner, c->fd, vbuff, 4, 16) != 4) {
         hdd_error_occured(c, 1); // uses and preserves errno !!!
         mfs_arg_errlog_silent(LOG_WARNING, "truncate_chunk: file:%s - write error", fname);
         hdd_io_end(c);
@@ -4024,6 +5086,7 @@ static int hdd_int_truncate(uint64_t chunkid, uint32_t version, uint32_t newvers
             put32bit(&ptr, emptyblockcrc);
         }
         c->crcchanged = 1;
+        c->digestvalid = 0;
     } else {
         uint32_t blocknum = length >> MFSBLOCKBITS;
         uint32_t blockpos = length & MFSCHUNKBLOCKMASK;
@@ -4051,9 +5114,9 @@ static int hdd_int_truncate(uint64_t chunkid, uint32_t version, uint32_t newvers
 #ifdef PRESERVE_BLOCK
             if (c->blockno != blocknum) {
 
-                if (mypread(c->fd, c->block, blocksize, c->hdrsize + CHUNKCRCSIZE + blockpos) != (signed)blocksize) {
+                if (hdd_folder_pread(c->owner, c->fd, c->block, blocksize, c->hdrsize + CHUNKCRCSIZE + blockpos) != (signed)blocksize) {
 #else /* PRESERVE_BLOCK */
-            if (mypread(c->fd, blockbuffer, blocksize, c->hdrsize + CHUNKCRCSIZE + blockpos) != (signed)blocksize) {
+            if (hdd_folder_pread(c->owner, c->fd, blockbuffer, blocksize, c->hdrsize + CHUNKCRCSIZE + blockpos) != (signed)blocksize) {
 #endif /* PRESERVE_BLOCK */
                     hdd_error_occured(c, 1); // uses and preserves errno !!!
                     mfs_arg_errlog_silent(LOG_WARNING, "truncate_chunk: file:%s - read error", fname);
@@ -4074,6 +5137,7 @@ static int hdd_int_truncate(uint64_t chunkid, uint32_t version, uint32_t newvers
             put32bit(&ptr, i);
             blocknum++;
             c->crcchanged = 1;
+            c->digestvalid = 0;
         } else {
             ptr = (c->crc) + (4 * blocknum);
         }
@@ -4082,6 +5146,7 @@ static int hdd_int_truncate(uint64_t chunkid, uint32_t version, uint32_t newvers
                 put32bit(&ptr, emptyblockcrc);
             }
             c->crcchanged = 1;
+            c->digestvalid = 0;
         }
     }
     if (c->blocks != blocks && c->owner != NULL) {
@@ -4198,7 +5263,7 @@ static int hdd_int_duptrunc(uint64_t chunkid, uint32_t version, uint32_t newvers
         }
         ptr = vbuff;
         put32bit(&ptr, newversion);
-        if (mypwrite(oc->fd, vbuff, 4, 16) != 4) {
+        if (hdd_folder_pwrite(oc->owner, oc->fd, vbuff, 4, 16) != 4) {
             hdd_error_occured(oc, 1); // uses and preserves errno !!!
             mfs_arg_errlog_silent(LOG_WARNING, "duptrunc_chunk: file:%s - write error", fname);
             hdd_chunk_delete(c);
@@ -4259,7 +5324,7 @@ static int hdd_int_duptrunc(uint64_t chunkid, uint32_t version, uint32_t newvers
                 memcpy(c->block, oc->block, MFSBLOCKSIZE);
                 retsize = MFSBLOCKSIZE;
             } else {
-                retsize = mypread(oc->fd, c->block, MFSBLOCKSIZE, oc->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS));
+                retsize = hdd_folder_pread(oc->owner, oc->fd, c->block, MFSBLOCKSIZE, oc->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS));
             }
 #else /* PRESERVE_BLOCK */
             retsize = read(oc->fd, blockbuffer, MFSBLOCKSIZE);
@@ -4313,7 +5378,7 @@ static int hdd_int_duptrunc(uint64_t chunkid, uint32_t version, uint32_t newvers
                 retsize = 0;
                 nzstart = nzend = 0;
             } else {
-                retsize = mypwrite(c->fd, writeptr + nzstart, nzend - nzstart, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS) + nzstart);
+                retsize = hdd_folder_pwrite(c->owner, c->fd, writeptr + nzstart, nzend - nzstart, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS) + nzstart);
             }
             if (retsize != (int32_t)(nzend - nzstart)) {
                 hdd_error_occured(c, 0); // uses and preserves errno !!!
@@ -4361,7 +5426,7 @@ static int hdd_int_duptrunc(uint64_t chunkid, uint32_t version, uint32_t newvers
                     memcpy(c->block, oc->block, MFSBLOCKSIZE);
                     retsize = MFSBLOCKSIZE;
                 } else {
-                    retsize = mypread(oc->fd, c->block, MFSBLOCKSIZE, oc->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS));
+                    retsize = hdd_folder_pread(oc->owner, oc->fd, c->block, MFSBLOCKSIZE, oc->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS));
                 }
 #else /* PRESERVE_BLOCK */
                 retsize = read(oc->fd, blockbuffer, MFSBLOCKSIZE);
@@ -4415,7 +5480,7 @@ static int hdd_int_duptrunc(uint64_t chunkid, uint32_t version, uint32_t newvers
                     retsize = 0;
                     nzstart = nzend = 0;
                 } else {
-                    retsize = mypwrite(c->fd, writeptr + nzstart, nzend - nzstart, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS) + nzstart);
+                    retsize = hdd_folder_pwrite(c->owner, c->fd, writeptr + nzstart, nzend - nzstart, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS) + nzstart);
                 }
                 if (retsize != (int32_t)(nzend - nzstart)) {
                     hdd_error_occured(c, 0); // uses and preserves errno !!!
@@ -4462,7 +5527,7 @@ static int hdd_int_duptrunc(uint64_t chunkid, uint32_t version, uint32_t newvers
                     memcpy(c->block, oc->block, MFSBLOCKSIZE);
                     retsize = MFSBLOCKSIZE;
                 } else {
-                    retsize = mypread(oc->fd, c->block, MFSBLOCKSIZE, oc->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS));
+                    retsize = hdd_folder_pread(oc->owner, oc->fd, c->block, MFSBLOCKSIZE, oc->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS));
                 }
 #else /* PRESERVE_BLOCK */
                 retsize = read(oc->fd, blockbuffer, MFSBLOCKSIZE);
@@ -4516,7 +5581,7 @@ static int hdd_int_duptrunc(uint64_t chunkid, uint32_t version, uint32_t newvers
                     retsize = 0;
                     nzstart = nzend = 0;
                 } else {
-                    retsize = mypwrite(c->fd, writeptr + nzstart, nzend - nzstart, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS) + nzstart);
+                    retsize = hdd_folder_pwrite(c->owner, c->fd, writeptr + nzstart, nzend - nzstart, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS) + nzstart);
                 }
                 if (retsize != (int32_t)(nzend - nzstart)) {
                     hdd_error_occured(c, 0); // uses and preserves errno !!!
@@ -4542,7 +5607,7 @@ static int hdd_int_duptrunc(uint64_t chunkid, uint32_t version, uint32_t newvers
                 memcpy(c->block, oc->block, blocksize);
                 retsize = blocksize;
             } else {
-                retsize = mypread(oc->fd, c->block, blocksize, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS));
+                retsize = hdd_folder_pread(oc->owner, oc->fd, c->block, blocksize, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS));
             }
 #else /* PRESERVE_BLOCK */
             retsize = read(oc->fd, blockbuffer, blocksize);
@@ -4601,7 +5666,7 @@ static int hdd_int_duptrunc(uint64_t chunkid, uint32_t version, uint32_t newvers
                 retsize = 0;
                 nzstart = nzend = 0;
             } else {
-                retsize = mypwrite(c->fd, writeptr + nzstart, nzend - nzstart, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS) + nzstart);
+                retsize = hdd_folder_pwrite(c->owner, c->fd, writeptr + nzstart, nzend - nzstart, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS) + nzstart);
             }
             if (retsize != (int32_t)(nzend - nzstart)) {
                 hdd_error_occured(c, 0); // uses and preserves errno !!!
@@ -4739,6 +5804,8 @@ static int hdd_int_delete(uint64_t chunkid, uint32_t version)
 // newversion==0 && length==2                                -> check chunk contents
 int hdd_chunkop(uint64_t chunkid, uint32_t version, uint32_t newversion, uint64_t copychunkid, uint32_t copyversion, uint32_t length)
 {
+    int status;
+
     zassert(pthread_mutex_lock(&statslock));
     if (newversion > 0) {
         if (length == 0xFFFFFFFF) {
@@ -4767,47 +5834,57 @@ int hdd_chunkop(uint64_t chunkid, uint32_t version, uint32_t newversion, uint64_
     if (newversion > 0) {
         if (length == 0xFFFFFFFF) {
             if (copychunkid == 0) {
-                return hdd_int_version(chunkid, version, newversion);
+                status = hdd_int_version(chunkid, version, newversion);
             } else {
-                return hdd_int_duplicate(chunkid, version, newversion, copychunkid, copyversion);
+                status = hdd_int_duplicate(chunkid, version, newversion, copychunkid, copyversion);
             }
         } else if (length <= MFSCHUNKSIZE) {
             if (copychunkid == 0) {
-                return hdd_int_truncate(chunkid, version, newversion, length);
+                status = hdd_int_truncate(chunkid, version, newversion, length);
             } else {
-                return hdd_int_duptrunc(chunkid, version, newversion, copychunkid, copyversion, length);
+                status = hdd_int_duptrunc(chunkid, version, newversion, copychunkid, copyversion, length);
             }
         } else {
-            return MFS_ERROR_EINVAL;
+            status = MFS_ERROR_EINVAL;
         }
     } else {
         if (length == 0) {
-            return hdd_int_delete(chunkid, version);
+            status = hdd_int_delete(chunkid, version);
         } else if (length == 1) {
-            return hdd_int_create(chunkid, version);
+            status = hdd_int_create(chunkid, version);
         } else if (length == 2) {
-            return hdd_int_test(chunkid, version, NULL);
+            status = hdd_int_test(chunkid, version, NULL, 0);
         } else {
-            return MFS_ERROR_EINVAL;
+            status = MFS_ERROR_EINVAL;
         }
     }
+    // also after failed operations - chunk could be partially modified
+    if (newversion > 0) {
+        blockcache_invalidate_chunk(chunkid);
+        if (copychunkid > 0) {
+            blockcache_invalidate_chunk(copychunkid);
+        }
+    }
+    return status;
 }
 
 chunk* hdd_random_chunk(folder* f)
 {
     uint32_t otry;
     uint32_t pos;
+    hashshard* hs;
     chunk* c;
 
     zassert(pthread_mutex_lock(&folderlock));
-    zassert(pthread_mutex_lock(&hashlock));
     if (f->chunkcount > 0) {
         for (otry = 0; otry < RANDOM_CHUNK_RETRIES; otry++) {
             pos = rndu32_ranged(f->chunkcount);
             c = f->chunktab[pos];
+            hs = hashshards + HASHSHARD(c->chunkid);
+            zassert(pthread_mutex_lock(&(hs->lock)));
             if (c->state == CH_AVAIL && c->damaged == 0) {
                 c->state = CH_LOCKED;
-                zassert(pthread_mutex_unlock(&hashlock));
+                zassert(pthread_mutex_unlock(&(hs->lock)));
                 zassert(pthread_mutex_unlock(&folderlock));
                 if (c->validattr == 0) {
                     if (hdd_chunk_getattr(c, 0) < 0) {
@@ -4820,11 +5897,14 @@ chunk* hdd_random_chunk(folder* f)
                     return c;
                 }
                 zassert(pthread_mutex_lock(&folderlock));
-                zassert(pthread_mutex_lock(&hashlock));
+                if (f->chunkcount == 0) {
+                    break;
+                }
+            } else {
+                zassert(pthread_mutex_unlock(&(hs->lock)));
             }
         }
     }
-    zassert(pthread_mutex_unlock(&hashlock));
     zassert(pthread_mutex_unlock(&folderlock));
     return NULL;
 }
@@ -4945,15 +6025,14 @@ static int hdd_int_move(folder* fsrc, folder* fdst)
         return MFS_ERROR_IO;
     }
     hdd_stats_write(new_hdrsize + CHUNKCRCSIZE);
-    lseek(c->fd, c->hdrsize + CHUNKCRCSIZE, SEEK_SET);
     rptr = c->crc;
     truncneeded = 0;
     for (block = 0; block < c->blocks; block++) {
         ts = monotonic_nseconds();
 #ifdef PRESERVE_BLOCK
-        retsize = read(c->fd, c->block, MFSBLOCKSIZE);
+        retsize = hdd_folder_pread(fsrc, c->fd, c->block, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS));
 #else /* PRESERVE_BLOCK */
-        retsize = read(c->fd, blockbuffer, MFSBLOCKSIZE);
+        retsize = hdd_folder_pread(fsrc, c->fd, blockbuffer, MFSBLOCKSIZE, c->hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS));
 #endif /* PRESERVE_BLOCK */
         error = errno;
         te = monotonic_nseconds();
@@ -5025,7 +6104,7 @@ static int hdd_int_move(folder* fsrc, folder* fdst)
             retsize = 0;
             nzstart = nzend = 0;
         } else {
-            retsize = mypwrite(new_fd, writeptr + nzstart, nzend - nzstart, new_hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS) + nzstart);
+            retsize = hdd_folder_pwrite(fdst, new_fd, writeptr + nzstart, nzend - nzstart, new_hdrsize + CHUNKCRCSIZE + (((uint32_t)block) << MFSBLOCKBITS) + nzstart);
         }
         te = monotonic_nseconds();
         if (retsize != (int32_t)(nzend - nzstart)) {
@@ -5384,6 +6463,7 @@ void* hdd_highspeed_rebalance_thread(void* arg)
     double rebalance_finished;
     double monotonic_time;
 
+    hddsched_set_class(HDDSCHED_REBALANCE);
     rebalance_is_on = 0;
     rebalance_finished = 0;
     for (;;) {
@@ -5496,6 +6576,7 @@ void* hdd_rebalance_thread(void* arg)
     uint32_t perc;
     uint64_t st, en;
 
+    hddsched_set_class(HDDSCHED_REBALANCE);
     rebalance_is_on = 0;
     rebalance_finished = 0;
     for (;;) {
@@ -5606,13 +6687,22 @@ void* hdd_rebalance_thread(void* arg)
     return arg;
 }
 
+/*
+ * Scrubber - every folder is tested at HDDTestMBPS on its own schedule. Test chain of a folder is ordered by time of
+ * last verification (kept across restarts in '.scrubdb'), so the head is always the chunk not verified for the longest
+ * time and scrubbing continues where it stopped. When the head has been verified within MinTimeBetweenTests then the
+ * whole folder is up to date and it is not visited until the head becomes due. Damaged chunks are skipped - they go to
+ * the tail of the chain without being marked as verified.
+ */
+#define HDD_TESTER_MAX_IDLE 60
+
 void* hdd_tester_thread(void* arg)
 {
     folder *f, *tf;
     chunk* c;
     uint64_t chunkid;
-    uint32_t version;
     uint64_t testbps;
+    uint32_t now, idledelay;
     uint16_t blocks;
     uint8_t idlemode;
     uint64_t st, en, nextdelay, nextevent;
@@ -5624,6 +6714,7 @@ void* hdd_tester_thread(void* arg)
     global_st = monotonic_useconds();
     global_bytes = 0;
 #endif
+    hddsched_set_class(HDDSCHED_TEST);
     for (;;) {
         st = monotonic_useconds();
 #ifdef HDD_TESTER_DEBUG
@@ -5632,10 +6723,9 @@ void* hdd_tester_thread(void* arg)
         }
 #endif
         chunkid = 0;
-        version = 0;
+        idledelay = 0;
         idlemode = 1;
         zassert(pthread_mutex_lock(&folderlock));
-        zassert(pthread_mutex_lock(&hashlock));
         zassert(pthread_mutex_lock(&testlock));
         testbps = HDDTestMBPS * 1024 * 1024;
 
@@ -5667,14 +6757,18 @@ void* hdd_tester_thread(void* arg)
                     fprintf(fd, "chosen path: %s\n", tf->path);
                 }
 #endif
+                // only chunk id is taken here - chunk state (damaged, version) is checked by hdd_int_test under chunk lock
                 c = tf->testhead;
-                if (c && c->state == CH_AVAIL) {
-                    if (c->damaged) {
-                        hdd_int_chunk_testmove(c);
-                    } else {
-                        chunkid = c->chunkid;
-                        version = c->version;
+                now = main_time();
+                if (c == NULL) {
+                    idledelay = HDD_TESTER_MAX_IDLE;
+                } else if (c->testtime + MinTimeBetweenTests > now) {
+                    idledelay = c->testtime + MinTimeBetweenTests - now;
+                    if (idledelay > HDD_TESTER_MAX_IDLE) {
+                        idledelay = HDD_TESTER_MAX_IDLE;
                     }
+                } else {
+                    chunkid = c->chunkid;
                 }
 #ifdef HDD_TESTER_DEBUG
             } else if (fd) {
@@ -5684,14 +6778,14 @@ void* hdd_tester_thread(void* arg)
         }
 
         zassert(pthread_mutex_unlock(&testlock));
-        zassert(pthread_mutex_unlock(&hashlock));
         zassert(pthread_mutex_unlock(&folderlock));
 
         blocks = 0;
         if (chunkid > 0) {
-            // syslog(LOG_NOTICE,"testing chunk: %s",path);
-            (void)hdd_int_test(chunkid, version, &blocks); // ignore status here - hdd_int_test on error does everything itself
-            // free(path);
+            // hdd_int_test on error does everything itself - status matters only for skipped chunks
+            if (hdd_int_test(chunkid, 0, &blocks, 1) == MFS_ERROR_NOTDONE) {
+                blocks = 1; // skipped chunks keep their old testtime - charge one block, so folder with damaged chunks is not spun over
+            }
         }
 
         zassert(pthread_mutex_lock(&termlock));
@@ -5711,7 +6805,9 @@ void* hdd_tester_thread(void* arg)
 #endif
         if (idlemode == 0) {
             zassert(pthread_mutex_lock(&folderlock));
-            if (testbps > 0) {
+            if (idledelay > 0) {
+                nextdelay = idledelay * UINT64_C(1000000);
+            } else if (testbps > 0) {
                 nextdelay = blocks;
                 nextdelay *= UINT64_C(65536000000);
                 nextdelay /= testbps;
@@ -5793,7 +6889,8 @@ void* hdd_knownblocks_thread(void* arg)
 {
     folder* f;
     chunk* c;
-    uint32_t i, j;
+    hashshard* hs;
+    uint32_t i, j, k;
 
     for (;;) {
         zassert(pthread_mutex_lock(&folderlock));
@@ -5804,20 +6901,29 @@ void* hdd_knownblocks_thread(void* arg)
             f->knownblocks_next = 0;
         }
         zassert(pthread_mutex_unlock(&folderlock));
-        for (i = 0; i < HASHSIZE; i += KNOWNBLOCKS_HASH_PER_CYCLE) {
+        // shard can grow between cycles - these are only statistics, so a chunk counted twice (or missed) doesn't matter
+        k = 0;
+        i = 0;
+        while (k < HASHSHARDS) {
+            hs = hashshards + k;
             zassert(pthread_mutex_lock(&folderlock));
-            zassert(pthread_mutex_lock(&hashlock));
+            zassert(pthread_mutex_lock(&(hs->lock)));
             //			zassert(pthread_mutex_lock(&testlock));
-            for (j = i; j < i + KNOWNBLOCKS_HASH_PER_CYCLE && j < HASHSIZE; j++) {
-                for (c = hashtab[j]; c; c = c->next) {
+            for (j = i; j < i + KNOWNBLOCKS_HASH_PER_CYCLE && j < hs->size; j++) {
+                for (c = hs->tab[j]; c; c = c->next) {
                     if (c->state == CH_AVAIL && c->validattr == 1 && c->owner != NULL) {
                         c->owner->knowncount_next++;
                         c->owner->knownblocks_next += c->blocks;
                     }
                 }
             }
+            i = j;
+            if (i >= hs->size) {
+                k++;
+                i = 0;
+            }
             //			zassert(pthread_mutex_unlock(&testlock));
-            zassert(pthread_mutex_unlock(&hashlock));
+            zassert(pthread_mutex_unlock(&(hs->lock)));
             zassert(pthread_mutex_unlock(&folderlock));
 
             portable_usleep(1000);
@@ -5832,32 +6938,56 @@ void* hdd_knownblocks_thread(void* arg)
     }
 }
 
-void hdd_testshuffle(folder* f)
+typedef struct testsortrec {
+    chunk* c;
+    uint32_t testtime;
+    uint32_t rnd;
+} testsortrec;
+
+static int hdd_testsortrec_cmp(const void* a, const void* b)
+{
+    const testsortrec* ra = (const testsortrec*)a;
+    const testsortrec* rb = (const testsortrec*)b;
+    if (ra->testtime != rb->testtime) {
+        return (ra->testtime < rb->testtime) ? -1 : 1;
+    }
+    return (ra->rnd < rb->rnd) ? -1 : (ra->rnd > rb->rnd) ? 1 : 0;
+}
+
+/* restores verification state from '.scrubdb' (recs sorted by chunkid) and orders test chain by time of last
+ * verification - chunks never verified (or with equal times) are shuffled ; restored digest is not trusted for chunk
+ * files modified after that verification (hdd_int_test compares mtime with testtime) */
+static void hdd_testsort(folder* f, const scrubrec* recs, uint32_t reccnt)
 {
-    uint32_t i, j, chunksno;
-    chunk **csorttab, *c;
+    uint32_t i, chunksno;
+    testsortrec* csorttab;
+    const scrubrec* r;
+    chunk* c;
+
     zassert(pthread_mutex_lock(&testlock));
     chunksno = 0;
     for (c = f->testhead; c; c = c->testnext) {
         chunksno++;
     }
     if (chunksno > 0) {
-        csorttab = (chunk**)malloc(sizeof(chunk*) * chunksno);
+        csorttab = (testsortrec*)malloc(sizeof(testsortrec) * chunksno);
         passert(csorttab);
         chunksno = 0;
         for (c = f->testhead; c; c = c->testnext) {
-            csorttab[chunksno++] = c;
-        }
-        if (chunksno > 1) {
-            for (i = 0; i < chunksno - 1; i++) {
-                j = i + rndu32_ranged(chunksno - i);
-                if (j != i) {
-                    c = csorttab[i];
-                    csorttab[i] = csorttab[j];
-                    csorttab[j] = c;
+            r = scrubdb_find(recs, reccnt, c->chunkid);
+            if (r != NULL && r->version == c->version) {
+                c->testtime = r->testtime;
+                if (r->digestvalid) {
+                    memcpy(c->digest, r->digest, CHUNKDIGEST_SIZE);
+                    c->digestvalid = 1;
                 }
             }
+            csorttab[chunksno].c = c;
+            csorttab[chunksno].testtime = c->testtime;
+            csorttab[chunksno].rnd = rndu32();
+            chunksno++;
         }
+        qsort(csorttab, chunksno, sizeof(testsortrec), hdd_testsortrec_cmp);
     } else {
         csorttab = NULL;
     }
@@ -5865,16 +6995,16 @@ void hdd_testshuffle(folder* f)
     f->testtail = &(f->testhead);
     f->nexttest = 0;
     for (i = 0; i < chunksno; i++) {
-        c = csorttab[i];
+        c = csorttab[i].c;
         c->testnext = NULL;
         c->testprev = f->testtail;
         *(c->testprev) = c;
         f->testtail = &(c->testnext);
     }
+    zassert(pthread_mutex_unlock(&testlock));
     if (csorttab) {
         free(csorttab);
     }
-    zassert(pthread_mutex_unlock(&testlock));
 }
 
 /* initialization */
@@ -6035,42 +7165,67 @@ static inline void hdd_add_chunk(folder* f, uint16_t pathid, uint64_t chunkid, u
     hdd_chunk_release(c);
 }
 
-static inline int hdd_folder_fastscan(folder* f, char* fullname, uint16_t plen)
+/* v3 snapshot is stale when any data subfolder changed (ctime) after the snapshot had been started */
+static inline int hdd_folder_chunkdb_stale(char* fullname, uint16_t plen, int64_t snapsec, uint32_t snapnsec)
+{
+    struct stat sb;
+    uint16_t subf;
+
+    for (subf = 0; subf < 256; subf++) {
+        fullname[plen] = "0123456789ABCDEF"[(subf >> 4) & 0xF];
+        fullname[plen + 1] = "0123456789ABCDEF"[subf & 0xF];
+        fullname[plen + 2] = '\0';
+        if (lstat(fullname, &sb) < 0) {
+            return 1;
+        }
+        if (sb.st_ctim.tv_sec > snapsec || (sb.st_ctim.tv_sec == snapsec && (uint32_t)(sb.st_ctim.tv_nsec) >= snapnsec)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* old (v1/v2) snapshots have no checksum nor timestamp - file mtime is compared with atime/mtime of subfolders */
+static inline int hdd_folder_chunkdb_stale_legacy(char* fullname, uint16_t plen, time_t dbmtime)
 {
     struct stat sb;
-    int fd;
-    uint8_t* chunkbuff;
-    const uint8_t *rptr, *rptrmem, *endbuff;
-    uint16_t pleng;
-    uint64_t chunkid;
-    uint32_t version;
-    uint16_t blocks;
-    uint16_t pathid;
-    uint16_t hdrsize;
     uint16_t subf;
-    uint8_t mode;
-    uint8_t rsize;
-    time_t foldersmaxtime;
 
     fullname[plen] = '\0';
-    if (lstat(fullname, &sb) < 0) {
-        return -1;
+    if (lstat(fullname, &sb) < 0 || sb.st_mtime > dbmtime) {
+        return 1;
     }
-    foldersmaxtime = sb.st_mtime;
     for (subf = 0; subf < 256; subf++) {
         fullname[plen] = "0123456789ABCDEF"[(subf >> 4) & 0xF];
         fullname[plen + 1] = "0123456789ABCDEF"[subf & 0xF];
         fullname[plen + 2] = '\0';
         if (lstat(fullname, &sb) < 0) {
-            return -1;
-        }
-        if (sb.st_atime > foldersmaxtime) {
-            foldersmaxtime = sb.st_atime;
+            return 1;
         }
-        if (sb.st_mtime > foldersmaxtime) {
-            foldersmaxtime = sb.st_mtime;
+        if (sb.st_atime > dbmtime || sb.st_mtime > dbmtime) {
+            return 1;
         }
     }
+    return 0;
+}
+
+static inline int hdd_folder_fastscan(folder* f, char* fullname, uint16_t plen)
+{
+    struct stat sb;
+    int fd;
+    uint8_t* chunkbuff;
+    const uint8_t *rptr, *rptrmem, *recptr, *endbuff;
+    uint16_t pleng;
+    uint64_t chunkid;
+    uint32_t version;
+    uint16_t blocks;
+    uint16_t pathid;
+    uint16_t hdrsize;
+    uint8_t mode;
+    uint8_t rsize;
+    uint32_t count, crc, snapnsec;
+    int64_t snapsec;
+    const char* reason;
 
     memcpy(fullname + plen, ".chunkdb", 8);
     fullname[plen + 8] = '\0';
@@ -6079,102 +7234,103 @@ static inline int hdd_folder_fastscan(folder* f, char* fullname, uint16_t plen)
     if (fd < 0) {
         return -1;
     }
-    if (fstat(fd, &sb) < 0) {
-        close(fd);
-        return -1;
-    }
-    if (sb.st_mtime < foldersmaxtime) { // somebody touched data subfolders, so '.chunkdb' might be not valid
-        syslog(LOG_NOTICE, "scanning folder %s: at least one of data subfolders has more recent atime/mtime than '.chunkdb' - fallback to standard scan", f->path);
-        close(fd);
-        return -1;
-    }
-    //	if (sb.st_size<12 || (sb.st_size-12)%6!=0) {
-    //		close(fd);
-    //		return -1;
-    //	}
-    chunkbuff = (uint8_t*)malloc(sb.st_size);
-    if (chunkbuff == NULL) {
+    if (fstat(fd, &sb) < 0 || sb.st_size < CHUNKDB_HDRSIZE + 4) {
         close(fd);
         return -1;
     }
-    if (read(fd, chunkbuff, sb.st_size) != sb.st_size) {
-        free(chunkbuff);
-        close(fd);
+    chunkbuff = (uint8_t*)mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (chunkbuff == MAP_FAILED) {
         return -1;
     }
-    close(fd);
+#ifdef MADV_SEQUENTIAL
+    madvise(chunkbuff, sb.st_size, MADV_SEQUENTIAL);
+#endif
+    // snapshot is used only once - after start chunks can be modified without touching their subfolders
     if (unlink(fullname) < 0) {
-        free(chunkbuff);
+        munmap(chunkbuff, sb.st_size);
         return -1;
     }
 
     rptr = chunkbuff;
     endbuff = rptr + sb.st_size;
-
-    if (memcmp(rptr, "MFS CHUNKDB", 11) != 0 && rptr[11] != '1' && rptr[11] != '2') {
-        syslog(LOG_NOTICE, "scanning folder %s: wrong header in .chunkdb - fallback to standard scan", f->path);
-        free(chunkbuff);
-        return -1;
-    }
-    if (rptr[11] == '1') {
-        mode = 1;
-        rsize = 16;
+    reason = NULL;
+    count = 0;
+    mode = 0;
+    rsize = CHUNKDB_RECSIZE;
+
+    if (memcmp(rptr, "MFS CHUNKDB", 11) != 0 || (rptr[11] != '1' && rptr[11] != '2' && rptr[11] != '3')) {
+        reason = "wrong header";
+    } else if (rptr[11] == '3') {
+        mode = 3;
+        rptr += 12;
+        rptr++; // flags
+        snapsec = get64bit(&rptr);
+        snapnsec = get32bit(&rptr);
+        count = get32bit(&rptr);
+        pleng = get16bit(&rptr);
+        rptrmem = endbuff - 4;
+        crc = get32bit(&rptrmem);
+        if ((uint64_t)CHUNKDB_HDRSIZE + pleng + (uint64_t)count * CHUNKDB_RECSIZE + 4 != (uint64_t)sb.st_size || crc != mycrc32(0, chunkbuff, sb.st_size - 4)) {
+            reason = "checksum error";
+        } else if (pleng != plen || memcmp(rptr, fullname, pleng) != 0) {
+            reason = "wrong path";
+        } else if (hdd_folder_chunkdb_stale(fullname, plen, snapsec, snapnsec)) {
+            reason = "data subfolders changed after snapshot";
+        }
+        rptr += pleng;
     } else {
-        mode = 2;
-        rsize = 18;
-    }
-    rptr += 12;
-
-    pleng = get16bit(&rptr);
-    if (rptr + pleng > endbuff || pleng != plen || memcmp(rptr, fullname, pleng) != 0) {
-        syslog(LOG_NOTICE, "scanning folder %s: wrong path in .chunkdb - fallback to standard scan", f->path);
-        free(chunkbuff);
-        return -1;
-    }
-    rptr += pleng;
-    rptrmem = rptr;
-    chunkid = 0;
-    version = 0;
-    blocks = 0;
-    hdrsize = OLDHDRSIZE;
-    pathid = 0xFFFF;
-
-    while (rptr + rsize <= endbuff) {
-        chunkid = get64bit(&rptr);
-        version = get32bit(&rptr);
-        blocks = get16bit(&rptr);
-        if (mode == 2) {
-            hdrsize = get16bit(&rptr);
-        }
-        pathid = get16bit(&rptr);
-        if (chunkid == 0) {
-            break;
+        if (rptr[11] == '1') {
+            mode = 1;
+            rsize = 16;
+        } else {
+            mode = 2;
+        }
+        rptr += 12;
+        pleng = get16bit(&rptr);
+        if (rptr + pleng > endbuff || pleng != plen || memcmp(rptr, fullname, pleng) != 0) {
+            reason = "wrong path";
+        } else if (hdd_folder_chunkdb_stale_legacy(fullname, plen, sb.st_mtime)) {
+            reason = "data subfolders changed after snapshot";
+        } else {
+            rptr += pleng;
+            // records are terminated by an empty one
+            count = 0;
+            chunkid = 1;
+            for (rptrmem = rptr; rptrmem + rsize <= endbuff; rptrmem += rsize) {
+                recptr = rptrmem;
+                chunkid = get64bit(&recptr);
+                if (chunkid == 0) {
+                    break;
+                }
+                count++;
+            }
+            if (chunkid != 0 || rptrmem + rsize != endbuff) {
+                reason = "data malformed";
+            }
         }
     }
-    if (rptr != endbuff || chunkid != 0 || version != 0 || blocks != 0 || pathid != 0) {
-        syslog(LOG_NOTICE, "scanning folder %s: data malformed in .chunkdb - fallback to standard scan", f->path);
-        free(chunkbuff);
+    if (reason != NULL) {
+        syslog(LOG_NOTICE, "scanning folder %s: %s in .chunkdb - fallback to standard scan", f->path, reason);
+        munmap(chunkbuff, sb.st_size);
         return -1;
     }
 
-    rptr = rptrmem;
-
-    while (1) {
+    hdrsize = OLDHDRSIZE;
+    while (count > 0) {
         chunkid = get64bit(&rptr);
         version = get32bit(&rptr);
         blocks = get16bit(&rptr);
-        if (mode == 2) {
+        if (mode >= 2) {
             hdrsize = get16bit(&rptr);
         }
         pathid = get16bit(&rptr);
-        if (chunkid == 0 && version == 0 && blocks == 0 && pathid == 0) {
-            break;
-        }
         hdd_add_chunk(f, pathid, chunkid, version, blocks, hdrsize);
+        count--;
     }
 
-    syslog(LOG_NOTICE, "scanning folder %s: .chunkdb used - full scan not needed", f->path);
-    free(chunkbuff);
+    syslog(LOG_NOTICE, "scanning folder %s: .chunkdb (v%u) used - full scan not needed", f->path, mode);
+    munmap(chunkbuff, sb.st_size);
     return 0;
 }
 
@@ -6196,6 +7352,8 @@ void* hdd_folder_scan(void* arg)
     //	uint8_t progressreportmode;
     uint8_t lastperc, currentperc;
     uint32_t lasttime, currenttime, begintime;
+    scrubrec* scrubrecs;
+    uint32_t scrubcnt;
 
     begintime = time(NULL);
 
@@ -6346,8 +7504,12 @@ void* hdd_folder_scan(void* arg)
     free(fullname);
     //	fprintf(stderr,"hdd space manager: %s: %" PRIu32" chunks found\n",f->path,f->chunkcount);
 
+    scrubrecs = hdd_folder_scrubdb_load(f->path, &scrubcnt);
     zassert(pthread_mutex_lock(&folderlock));
-    hdd_testshuffle(f);
+    hdd_testsort(f, scrubrecs, scrubcnt);
+    if (scrubrecs) {
+        free(scrubrecs);
+    }
     if (f->scanstate == SCST_SCANTERMINATE) {
         syslog(LOG_NOTICE, "scanning folder %s: interrupted", f->path);
     } else {
@@ -6395,6 +7557,8 @@ void* hdd_folders_thread(void* arg)
 {
     for (;;) {
         hdd_check_folders();
+        hdd_folders_dump_chunkdb();
+        hdd_folders_dump_scrubdb(0);
         zassert(pthread_mutex_lock(&termlock));
         if (term) {
             zassert(pthread_mutex_unlock(&termlock));
@@ -6443,7 +7607,7 @@ void hdd_clear_cfglines(void)
 
 void hdd_term(void)
 {
-    uint32_t i, m, l;
+    uint32_t i, k, m, l;
     folder *f, *fn;
     chunk *c, *cn;
     dopchunk *dc, *dcn;
@@ -6467,6 +7631,7 @@ void hdd_term(void)
         zassert(pthread_join(rebalancethread, NULL));
         zassert(pthread_join(delayedthread, NULL));
     }
+    hdd_folders_dump_scrubdb(1);
     zassert(pthread_mutex_lock(&folderlock));
     i = 0;
     m = 0;
@@ -6481,7 +7646,7 @@ void hdd_term(void)
             m++;
         }
         if (f->scanstate == SCST_WORKING && f->toremove == REMOVING_NO) {
-            hdd_folder_dump_chunkdb_begin(f);
+            hdd_folder_dump_chunkdb_begin(f, CHUNKDB_ATTRS);
         }
     }
     zassert(pthread_mutex_unlock(&folderlock));
@@ -6519,40 +7684,45 @@ void hdd_term(void)
         syslog(LOG_WARNING, "can't wait longer for rebalance jobs (%" PRIu32 ")", m);
     }
     syslog(LOG_NOTICE, "closing chunks");
-    for (i = 0; i < HASHSIZE; i++) {
-        for (c = hashtab[i]; c; c = cn) {
-            cn = c->next;
-            if (c->owner != NULL && c->state != CH_DELETED) {
-                hdd_folder_dump_chunkdb_chunk(c->owner, c);
-            }
-            if (c->state == CH_AVAIL && c->owner != NULL) {
-                if (c->fd >= 0) {
-                    if (c->crcchanged) {
-                        syslog(LOG_WARNING, "hdd_term: CRC not flushed - writing now");
-                        chunk_writecrc(c, 0);
-                    }
-                    close(c->fd);
-                    hdd_open_files_handle(OF_AFTER_CLOSE);
+    for (k = 0; k < HASHSHARDS; k++) {
+        for (i = 0; i < hashshards[k].size; i++) {
+            for (c = hashshards[k].tab[i]; c; c = cn) {
+                cn = c->next;
+                if (c->owner != NULL && c->state != CH_DELETED) {
+                    hdd_folder_dump_chunkdb_chunk(c->owner, c);
                 }
-                if (c->crc != NULL) {
+                if (c->state == CH_AVAIL && c->owner != NULL) {
+                    if (c->fd >= 0) {
+                        if (c->crcchanged) {
+                            syslog(LOG_WARNING, "hdd_term: CRC not flushed - writing now");
+                            chunk_writecrc(c, 0);
+                        }
+                        if (c->fsyncneeded && DoFsyncBeforeClose) { // still waiting for its group fsync
+                            hdd_chunk_fsync(c);
+                        }
+                        close(c->fd);
+                        hdd_open_files_handle(OF_AFTER_CLOSE);
+                    }
+                    if (c->crc != NULL) {
 #ifdef MMAP_ALLOC
-                    munmap((void*)(c->crc), CHUNKCRCSIZE);
+                        munmap((void*)(c->crc), CHUNKCRCSIZE);
 #else
-                    free(c->crc);
+                        free(c->crc);
 #endif
-                }
+                    }
 #ifdef PRESERVE_BLOCK
-                if (c->block != NULL) {
+                    if (c->block != NULL) {
 #ifdef MMAP_ALLOC
-                    munmap((void*)(c->block), MFSBLOCKSIZE);
+                        munmap((void*)(c->block), MFSBLOCKSIZE);
 #else
-                    free(c->block);
+                        free(c->block);
 #endif
-                }
+                    }
 #endif /* PRESERVE_BLOCK */
-                free(c);
-            } else {
-                syslog(LOG_WARNING, "hdd_term: locked chunk !!!");
+                    free(c);
+                } else {
+                    syslog(LOG_WARNING, "hdd_term: locked chunk !!!");
+                }
             }
         }
     }
@@ -6569,6 +7739,8 @@ void hdd_term(void)
         if (f->chunktab) {
             free(f->chunktab);
         }
+        hddio_ring_free(f->ioring);
+        hddsched_free(f->iosched);
         free(f->path);
         while (f->wfrchunks) {
             wfr = f->wfrchunks;
@@ -6591,14 +7763,19 @@ void hdd_term(void)
         dcn = dc->next;
         free(dc);
     }
-    for (cc = cclist; cc; cc = ccn) {
-        ccn = cc->next;
-        if (cc->wcnt) {
-            syslog(LOG_WARNING, "hddspacemgr (atexit): used cond !!!");
-        } else {
-            zassert(pthread_cond_destroy(&(cc->cond)));
+    for (k = 0; k < HASHSHARDS; k++) {
+        for (cc = hashshards[k].cclist; cc; cc = ccn) {
+            ccn = cc->next;
+            if (cc->wcnt) {
+                syslog(LOG_WARNING, "hddspacemgr (atexit): used cond !!!");
+            } else {
+                zassert(pthread_cond_destroy(&(cc->cond)));
+            }
+            free(cc);
         }
-        free(cc);
+        hashshards[k].cclist = NULL;
+        free(hashshards[k].tab);
+        hashshards[k].tab = NULL;
     }
     for (xc = chgchunks; xc; xc = xcn) {
         xcn = xc->next;
@@ -6616,6 +7793,7 @@ void hdd_term(void)
         dmcn = dmc->next;
         free(dmc);
     }
+    blockcache_term();
     syslog(LOG_NOTICE, "hddspacemgr: terminating done");
 }
 
@@ -7074,6 +8252,7 @@ int hdd_parseline(char* hddcfgline)
     f->chunktab = NULL;
     hdd_stats_clear(&(f->cstat));
     hdd_stats_clear(&(f->monotonic));
+    memset(f->lathist, 0, sizeof(f->lathist));
     for (l = 0; l < STATSHISTORY; l++) {
         hdd_stats_clear(&(f->stats[l]));
     }
@@ -7091,6 +8270,19 @@ int hdd_parseline(char* hddcfgline)
     f->lockinode = sb.st_ino;
     f->lfd = lfd;
     f->dumpfd = -1;
+    f->dumpbuff = NULL;
+    f->nextdump = 0.0;
+    f->nextscrubdump = 0.0;
+    f->scrubdirty = 0;
+    f->nextfsync = 0.0;
+    f->ioring = NULL;
+    if (HDD_USE_IO_URING) {
+        f->ioring = hddio_ring_new(HDD_IO_URING_ENTRIES);
+        if (f->ioring == NULL) {
+            syslog(LOG_NOTICE, "hdd space manager: io_uring not available for folder %s - using pread/pwrite", f->path);
+        }
+    }
+    f->iosched = hddsched_new(HDD_SCHED_BACKGROUND_MBPS, HDD_SCHED_CLIENT_LATENCY_TARGET);
     f->testhead = NULL;
     f->testtail = &(f->testhead);
     f->nexttest = 0;
@@ -7173,7 +8365,112 @@ void hdd_wantexit(void)
 
 void hdd_info(void)
 {
+    static const char* classname[HDDSCHED_CLASSES] = { "client", "replication", "rebalance", "test" };
+    hddsched_classstats st[HDDSCHED_CLASSES];
+    uint64_t hits, misses, used, size;
+    uint32_t k;
+    folder* f;
+
     hdd_open_files_handle(OF_INFO);
+    zassert(pthread_mutex_lock(&folderlock));
+    for (f = folderhead; f; f = f->next) {
+        hddsched_stats(f->iosched, st);
+        for (k = 0; k < HDDSCHED_CLASSES; k++) {
+            if (st[k].ops > 0) {
+                syslog(LOG_NOTICE, "hdd space manager: %s: %s I/O: ops: %" PRIu64 " ; bytes: %" PRIu64 " ; queue depth: %" PRIu32 " (max: %" PRIu32 ") ; avg wait: %" PRIu64 "us ; avg latency: %" PRIu64 "us ; p99 latency: %" PRIu32 "us ; budget: %" PRIu32 " B/s", f->path, classname[k], st[k].ops, st[k].bytes, st[k].depth, st[k].maxdepth, st[k].waitusec / st[k].ops, st[k].latusec / st[k].ops, st[k].p99usec, st[k].rate);
+            }
+        }
+    }
+    zassert(pthread_mutex_unlock(&folderlock));
+    blockcache_stats(&hits, &misses, &used, &size);
+    if (size > 0) {
+        syslog(LOG_NOTICE, "hdd space manager: block cache: %" PRIu64 "/%" PRIu64 " MiB used ; hits: %" PRIu64 " ; misses: %" PRIu64 " ; hit ratio: %.2lf%%", used >> 20, size >> 20, hits, misses, (hits + misses) ? (100.0 * hits) / (hits + misses) : 0.0);
+    }
+}
+
+uint32_t hdd_folder_metrics(hdd_foldermetrics** fmtab)
+{
+    hdd_foldermetrics* fm;
+    uint32_t cnt, i, now;
+    folder* f;
+
+    zassert(pthread_mutex_lock(&folderlock));
+    cnt = 0;
+    for (f = folderhead; f; f = f->next) {
+        cnt++;
+    }
+    *fmtab = NULL;
+    if (cnt == 0) {
+        zassert(pthread_mutex_unlock(&folderlock));
+        return 0;
+    }
+    fm = (hdd_foldermetrics*)malloc(sizeof(hdd_foldermetrics) * cnt);
+    passert(fm);
+    memset(fm, 0, sizeof(hdd_foldermetrics) * cnt);
+    zassert(pthread_mutex_lock(&statslock));
+    for (f = folderhead, i = 0; f; f = f->next, i++) {
+        fm[i].path = strdup(f->path);
+        passert(fm[i].path);
+        fm[i].damaged = f->damaged;
+        fm[i].toremove = f->toremove;
+        fm[i].avail = f->avail;
+        fm[i].total = f->total;
+        fm[i].chunkcount = f->chunkcount;
+        fm[i].ops[HDD_LATHIST_READ] = f->monotonic.rops + f->cstat.rops;
+        fm[i].ops[HDD_LATHIST_WRITE] = f->monotonic.wops + f->cstat.wops;
+        fm[i].ops[HDD_LATHIST_FSYNC] = f->monotonic.fsyncops + f->cstat.fsyncops;
+        fm[i].bytes[HDD_LATHIST_READ] = f->monotonic.rbytes + f->cstat.rbytes;
+        fm[i].bytes[HDD_LATHIST_WRITE] = f->monotonic.wbytes + f->cstat.wbytes;
+        fm[i].nsecsum[HDD_LATHIST_READ] = f->monotonic.nsecreadsum + f->cstat.nsecreadsum;
+        fm[i].nsecsum[HDD_LATHIST_WRITE] = f->monotonic.nsecwritesum + f->cstat.nsecwritesum;
+        fm[i].nsecsum[HDD_LATHIST_FSYNC] = f->monotonic.nsecfsyncsum + f->cstat.nsecfsyncsum;
+        memcpy(fm[i].hist, f->lathist, sizeof(fm[i].hist));
+    }
+    zassert(pthread_mutex_unlock(&statslock));
+    for (f = folderhead, i = 0; f; f = f->next, i++) {
+        hddsched_stats(f->iosched, fm[i].sched);
+    }
+    now = main_time();
+    zassert(pthread_mutex_lock(&testlock));
+    for (f = folderhead, i = 0; f; f = f->next, i++) {
+        if (f->testhead != NULL && f->testhead->testtime < now) {
+            fm[i].scrubage = now - f->testhead->testtime;
+        }
+    }
+    zassert(pthread_mutex_unlock(&testlock));
+    zassert(pthread_mutex_unlock(&folderlock));
+    *fmtab = fm;
+    return cnt;
+}
+
+void hdd_folder_metrics_free(hdd_foldermetrics* fmtab, uint32_t cnt)
+{
+    uint32_t i;
+    for (i = 0; i < cnt; i++) {
+        free(fmtab[i].path);
+    }
+    free(fmtab);
+}
+
+uint32_t hdd_io_saturation(void)
+{
+    uint32_t all, saturated;
+    folder* f;
+
+    all = 0;
+    saturated = 0;
+    zassert(pthread_mutex_lock(&folderlock));
+    for (f = folderhead; f; f = f->next) {
+        if (f->damaged || f->toremove) {
+            continue;
+        }
+        all++;
+        if (hddsched_saturated(f->iosched)) {
+            saturated++;
+        }
+    }
+    zassert(pthread_mutex_unlock(&folderlock));
+    return (all > 0) ? (saturated * 100) / all : 0;
 }
 
 static inline void hdd_options_common(uint8_t initflag)
@@ -7205,6 +8502,7 @@ static inline void hdd_options_common(uint8_t initflag)
     zassert(pthread_mutex_unlock(&testlock));
     zassert(pthread_mutex_lock(&doplock));
     DoFsyncBeforeClose = HDD_FSYNC_BEFORE_CLOSE;
+    FsyncGroupInterval = HDD_FSYNC_GROUP_INTERVAL;
     zassert(pthread_mutex_unlock(&doplock));
     LeaveFree = HDD_LEAVE_SPACE_DEFAULT;
     sp = HDD_SPARSIFY_ON_WRITE;
@@ -7257,9 +8555,7 @@ int hdd_init(void)
     folder* f;
 
     // this routine is called at the beginning from the main thread so no locks are necessary here
-    for (hp = 0; hp < HASHSIZE; hp++) {
-        hashtab[hp] = NULL;
-    }
+    hdd_hash_init();
     for (hp = 0; hp < DHASHSIZE; hp++) {
         dophashtab[hp] = NULL;
     }
@@ -7314,6 +8610,7 @@ int hdd_init(void)
     }
 
     hdd_options_common(1);
+    blockcache_init(HDD_BLOCK_CACHE_SIZE);
 
     if (hdd_folders_reinit() < 0) {
         return -1;
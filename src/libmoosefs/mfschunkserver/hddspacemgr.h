@@ -24,6 +24,7 @@
 #include <inttypes.h>
 
 #include "MFSCommunication.h"
+#include "hddsched.h"
 
 class TargetDisk {
 private:
@@ -79,6 +80,36 @@ void hdd_get_space(uint64_t *usedspace,uint64_t *totalspace,uint32_t *chunkcount
 
 uint8_t hdd_is_rebalance_on(void);
 
+/* percent of working folders where client I/O latency is above scheduler target */
+uint32_t hdd_io_saturation(void);
+
+/* per folder I/O latency histograms (since start) - bucket b counts operations that took [2^b,2^(b+1)) us, first bucket also shorter ones, last bucket also longer ones */
+#define HDD_LATHIST_BUCKETS 24
+#define HDD_LATHIST_READ 0
+#define HDD_LATHIST_WRITE 1
+#define HDD_LATHIST_FSYNC 2
+#define HDD_LATHIST_OPS 3
+
+typedef struct hdd_foldermetrics {
+    char *path;
+    uint8_t damaged;
+    uint8_t toremove;
+    uint64_t avail;
+    uint64_t total;
+    uint32_t chunkcount;
+    uint32_t scrubage; // seconds since verification of the least recently verified chunk
+    uint64_t ops[HDD_LATHIST_OPS];
+    uint64_t bytes[HDD_LATHIST_OPS];
+    uint64_t nsecsum[HDD_LATHIST_OPS];
+    uint64_t hist[HDD_LATHIST_OPS][HDD_LATHIST_BUCKETS];
+    hddsched_classstats sched[HDDSCHED_CLASSES]; // queue depths and scheduler latency per I/O class
+} hdd_foldermetrics;
+
+/* snapshot of all folders - *fmtab has to be released with hdd_folder_metrics_free */
+uint32_t hdd_folder_metrics(hdd_foldermetrics **fmtab);
+void hdd_folder_metrics_free(hdd_foldermetrics *fmtab,uint32_t cnt);
+
+
 /* emergency chunk read - ignore errors, do retries */
 int hdd_emergency_read(uint64_t chunkid,uint32_t *version,uint16_t blocknum,uint8_t buffer[MFSBLOCKSIZE],uint8_t retries,uint8_t *errorflags);
 
@@ -90,6 +121,16 @@ int hdd_open(uint64_t chunkid,uint32_t version);
 int hdd_close(uint64_t chunkid);
 int hdd_read(uint64_t chunkid,uint32_t version,uint16_t blocknum,uint8_t *buffer,uint32_t offset,uint32_t size,uint8_t *crcbuff);
 int hdd_write(uint64_t chunkid,uint32_t version,uint16_t blocknum,const uint8_t *buffer,uint32_t offset,uint32_t size,const uint8_t *crcbuff);
+/* write up to HDD_WRITE_MAX_BLOCKS consecutive whole blocks with one vectored write; *written - number of blocks written (0 -> use hdd_write) */
+#define HDD_WRITE_MAX_BLOCKS 16
+int hdd_write_blocks(uint64_t chunkid,uint32_t version,uint16_t blocknum,uint16_t blocks,const uint8_t **buffers,const uint8_t **crcbuffs,uint16_t *written);
+/* read up to HDD_READ_MAX_BLOCKS whole blocks in one submission (one buffer/crc pointer per block) */
+#define HDD_READ_MAX_BLOCKS 8
+/* called in order for every block 'b' (index within request) once all of them are read and checked and the chunk is released - nonzero result stops (MFS_ERROR_NOTDONE is returned) */
+typedef int (*hdd_block_ready_fn)(void *arg,uint16_t b);
+int hdd_read_blocks(uint64_t chunkid,uint32_t version,uint16_t blocknum,uint16_t blocks,uint8_t **buffers,uint8_t **crcbuffs,hdd_block_ready_fn ready,void *arg);
+/* same as hdd_read_blocks, but only verifies crcs and returns a duplicated descriptor (to be closed by caller) and file offset of the checked blocks for sendfile outside the chunk lock */
+int hdd_read_sendfile(uint64_t chunkid,uint32_t version,uint16_t blocknum,uint16_t blocks,uint8_t **crcbuffs,int *fd,uint64_t *foffset);
 
 /* chunk info */
 // int hdd_check_version(uint64_t chunkid,uint32_t version);
@@ -132,4 +173,9 @@ int hdd_init(void);
 /* debug only */
 void hdd_test_show_chunks(void);
 void hdd_test_show_openedchunks(void);
+
+/* benchmarks only - memory only chunks in hash table */
+void hdd_test_hash_fill(uint64_t firstchunkid, uint32_t count);
+int hdd_test_hash_lookup(uint64_t chunkid);
+void hdd_test_hash_clear(void);
 #endif
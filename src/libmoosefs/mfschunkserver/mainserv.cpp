@@ -31,6 +31,7 @@
 #include <sys/poll.h>
 #endif
 #include <pthread.h>
+#include <sys/socket.h>
 
 #include "clocks.h"
 #include "conncache.h"
@@ -54,6 +55,13 @@
 
 #define SMALL_PACKET_SIZE 12
 
+// buffers at least this big (up to a full CSTOCL_READ_DATA packet or write job with a whole block) are taken from the pool
+#define PACKET_POOL_MINSIZE 4096
+#define PACKET_POOL_BUFFSIZE (128 + 8 + 8 + 4 + 2 + 2 + 4 + 4 + MFSBLOCKSIZE)
+#define PACKET_POOL_MAXCOUNT 256
+
+#define READ_DATA_HDRSIZE (8 + 8 + 2 + 2 + 4 + 4)
+
 #define CONNECT_RETRIES 10
 #define CONNECT_TIMEOUT(cnt) (((cnt) % 2) ? (300 * (1 << ((cnt) >> 1))) : (200 * (1 << ((cnt) >> 1))))
 
@@ -147,22 +155,110 @@ static inline int32_t mainserv_toforward(int sock1, int sock2, uint8_t* ptr, uin
     return r;
 }
 
+static inline int32_t mainserv_tosendfile(int sock, const uint8_t* hdr, uint32_t hleng, int fd, uint64_t offset, uint32_t leng, uint32_t timeout)
+{
+    int32_t r;
+#ifdef MSG_MORE
+    r = send(sock, hdr, hleng, MSG_MORE); // let header go out in the same segment as data
+    if (r < 0) {
+        if (ERRNO_ERROR) {
+            return -1;
+        }
+        r = 0;
+    }
+#else
+    r = 0;
+#endif
+    if ((uint32_t)r < hleng) {
+        if (tcptowrite(sock, hdr + r, hleng - r, timeout) != (int32_t)(hleng - r)) {
+            return -1;
+        }
+    }
+    mainserv_bytesout(hleng);
+    r = tcptosendfile(sock, fd, offset, leng, timeout);
+    if (r > 0) {
+        mainserv_bytesout(r);
+    }
+    return r;
+}
+
+/* packet pool - every read data packet and write job used to be malloc'ed (or mmap'ed) and freed */
+typedef struct packet_buff {
+    struct packet_buff* next;
+    uint64_t pooled; // also keeps packet data 16-byte aligned
+} packet_buff;
+
+static packet_buff* packet_pool_head = NULL;
+static uint32_t packet_pool_count = 0;
+static pthread_mutex_t packet_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void* mainserv_pool_alloc(uint32_t size)
+{
+    packet_buff* pb;
+    pb = NULL;
+    if (size >= PACKET_POOL_MINSIZE && size <= PACKET_POOL_BUFFSIZE) {
+        zassert(pthread_mutex_lock(&packet_pool_lock));
+        pb = packet_pool_head;
+        if (pb != NULL) {
+            packet_pool_head = pb->next;
+            packet_pool_count--;
+        }
+        zassert(pthread_mutex_unlock(&packet_pool_lock));
+        if (pb == NULL) {
+            pb = (packet_buff*)malloc(sizeof(packet_buff) + PACKET_POOL_BUFFSIZE);
+            passert(pb);
+        }
+        pb->pooled = 1;
+    } else {
+        pb = (packet_buff*)malloc(sizeof(packet_buff) + size);
+        passert(pb);
+        pb->pooled = 0;
+    }
+    return pb + 1;
+}
+
+static void mainserv_pool_free(void* ptr)
+{
+    packet_buff* pb;
+    if (ptr == NULL) {
+        return;
+    }
+    pb = ((packet_buff*)ptr) - 1;
+    if (pb->pooled) {
+        zassert(pthread_mutex_lock(&packet_pool_lock));
+        if (packet_pool_count < PACKET_POOL_MAXCOUNT) {
+            pb->next = packet_pool_head;
+            packet_pool_head = pb;
+            packet_pool_count++;
+            pb = NULL;
+        }
+        zassert(pthread_mutex_unlock(&packet_pool_lock));
+    }
+    if (pb != NULL) {
+        free(pb);
+    }
+}
+
 uint8_t* mainserv_create_packet(uint8_t** wptr, uint32_t cmd, uint32_t leng)
 {
     uint8_t* ptr;
-    ptr = (uint8_t*)malloc(leng + 8);
-    passert(ptr);
+    ptr = (uint8_t*)mainserv_pool_alloc(leng + 8);
     *wptr = ptr;
     put32bit(wptr, cmd);
     put32bit(wptr, leng);
     return ptr;
 }
 
+void mainserv_free_packet(uint8_t* ptr)
+{
+    mainserv_pool_free(ptr);
+}
+
 uint8_t mainserv_send_and_free(int sock, uint8_t* ptr, uint32_t pleng)
 {
     uint8_t r;
     r = (mainserv_towrite(sock, ptr, pleng + 8, SERV_TIMEOUT) != (int32_t)(pleng + 8)) ? 0 : 1;
-    free(ptr);
+    mainserv_free_packet(ptr);
     return r;
 }
 
@@ -289,6 +385,69 @@ static inline void mainserv_read_nop_del(read_nops* rn)
     zassert(pthread_mutex_unlock(&read_nops_lock));
 }
 
+typedef struct read_stream {
+    int sock;
+    uint8_t protover;
+    uint8_t error;
+    read_nops* rn;
+    uint8_t** bpackets;
+    uint8_t (*hdrs)[READ_DATA_HDRSIZE];
+} read_stream;
+
+/* blocks are sent while later ones are still being read - nop sender is paused meanwhile, so nops never get in the middle of a data packet */
+static inline void mainserv_read_stream_pause(read_stream* rs)
+{
+    if (rs->protover) {
+        mainserv_read_nop_del(rs->rn);
+        if (rs->rn->error) {
+            rs->error = 1;
+        } else if (rs->rn->bytesleft > 0) {
+            if (mainserv_towrite(rs->sock, read_nop_buff + (8 - rs->rn->bytesleft), rs->rn->bytesleft, SERV_TIMEOUT) != (int32_t)(rs->rn->bytesleft)) {
+                rs->error = 1;
+            }
+            rs->rn->bytesleft = 0;
+        }
+    }
+}
+
+static inline void mainserv_read_stream_resume(read_stream* rs)
+{
+    if (rs->protover) {
+        mainserv_read_nop_add(rs->rn);
+    }
+}
+
+/* hdd_read_blocks callback - sends the packet with a checked block (chunk is not locked here) */
+static int mainserv_read_send_block(void* arg, uint16_t b)
+{
+    read_stream* rs = (read_stream*)arg;
+    uint8_t* packet;
+
+    mainserv_read_stream_pause(rs);
+    if (rs->error == 0) {
+        packet = rs->bpackets[b];
+        rs->bpackets[b] = NULL;
+        if (mainserv_send_and_free(rs->sock, packet, 8 + 2 + 2 + 4 + 4 + MFSBLOCKSIZE) == 0) {
+            rs->error = 1;
+        }
+    }
+    mainserv_read_stream_resume(rs);
+    return rs->error;
+}
+
+/* sends block checked by hdd_read_sendfile - header from rs->hdrs, data straight from the page cache (fd is the pinned descriptor, chunk is not locked here) */
+static int mainserv_read_sendfile_block(read_stream* rs, uint16_t b, int fd, uint64_t offset)
+{
+    mainserv_read_stream_pause(rs);
+    if (rs->error == 0) {
+        if (mainserv_tosendfile(rs->sock, rs->hdrs[b], READ_DATA_HDRSIZE, fd, offset, MFSBLOCKSIZE, SERV_TIMEOUT) != MFSBLOCKSIZE) {
+            rs->error = 1;
+        }
+    }
+    mainserv_read_stream_resume(rs);
+    return rs->error;
+}
+
 uint8_t mainserv_read(int sock, const uint8_t* data, uint32_t length)
 {
     uint64_t chunkid;
@@ -308,6 +467,14 @@ uint8_t mainserv_read(int sock, const uint8_t* data, uint32_t length)
     uint8_t hdr[8];
     uint32_t cmd, leng;
     read_nops rn;
+    uint8_t* bpackets[HDD_READ_MAX_BLOCKS];
+    uint8_t* bdata[HDD_READ_MAX_BLOCKS];
+    uint8_t* bcrcs[HDD_READ_MAX_BLOCKS];
+    uint8_t zchdr[HDD_READ_MAX_BLOCKS][READ_DATA_HDRSIZE];
+    read_stream rs;
+    uint16_t b, bcnt;
+    int sfd;
+    uint64_t soffset;
 
     if (length != 20 && length != 21) {
         syslog(LOG_NOTICE, "CLTOCS_READ - wrong size (%" PRIu32 "/20|21)", length);
@@ -375,39 +542,104 @@ uint8_t mainserv_read(int sock, const uint8_t* data, uint32_t length)
     }
     hdd_precache_data(chunkid, offset, size);
     rcvd = 0;
+    rs.sock = sock;
+    rs.protover = protover;
+    rs.error = 0;
+    rs.rn = &rn;
+    rs.bpackets = bpackets;
+    rs.hdrs = zchdr;
     while (size > 0) {
         blocknum = (offset) >> MFSBLOCKBITS;
         blockoffset = (offset)&MFSBLOCKMASK;
-        if (((offset + size - 1) >> MFSBLOCKBITS) == blocknum) { // last block
-            blocksize = size;
+        if (blockoffset == 0 && size >= 2 * MFSBLOCKSIZE) { // whole blocks - read several of them in one submission
+            bcnt = size >> MFSBLOCKBITS;
+            if (bcnt > HDD_READ_MAX_BLOCKS) {
+                bcnt = HDD_READ_MAX_BLOCKS;
+            }
+            // headers only - data goes straight from the page cache to the socket when possible
+            for (b = 0; b < bcnt; b++) {
+                bpackets[b] = NULL;
+                wptr = zchdr[b];
+                put32bit(&wptr, CSTOCL_READ_DATA);
+                put32bit(&wptr, 8 + 2 + 2 + 4 + 4 + MFSBLOCKSIZE);
+                put64bit(&wptr, chunkid);
+                put16bit(&wptr, blocknum + b);
+                put16bit(&wptr, 0);
+                put32bit(&wptr, MFSBLOCKSIZE);
+                bcrcs[b] = wptr;
+            }
+            blocksize = ((uint32_t)bcnt) << MFSBLOCKBITS;
+            packet = NULL;
         } else {
-            blocksize = MFSBLOCKSIZE - blockoffset;
+            bcnt = 0;
+            if (((offset + size - 1) >> MFSBLOCKBITS) == blocknum) { // last block
+                blocksize = size;
+            } else {
+                blocksize = MFSBLOCKSIZE - blockoffset;
+            }
+            packet = mainserv_create_packet(&wptr, CSTOCL_READ_DATA, 8 + 2 + 2 + 4 + 4 + blocksize);
+            put64bit(&wptr, chunkid);
+            put16bit(&wptr, blocknum);
+            put16bit(&wptr, blockoffset);
+            put32bit(&wptr, blocksize);
         }
-        packet = mainserv_create_packet(&wptr, CSTOCL_READ_DATA, 8 + 2 + 2 + 4 + 4 + blocksize);
-        put64bit(&wptr, chunkid);
-        put16bit(&wptr, blocknum);
-        put16bit(&wptr, blockoffset);
-        put32bit(&wptr, blocksize);
         if (protover) {
             mainserv_read_nop_add(&rn);
         }
-        status = hdd_read(chunkid, version, blocknum, wptr + 4, blockoffset, blocksize, wptr);
+        if (bcnt > 0) {
+            status = hdd_read_sendfile(chunkid, version, blocknum, bcnt, bcrcs, &sfd, &soffset);
+            if (status == MFS_STATUS_OK) {
+                for (b = 0; b < bcnt && rs.error == 0; b++) {
+                    mainserv_read_sendfile_block(&rs, b, sfd, soffset + (((uint64_t)b) << MFSBLOCKBITS));
+                }
+                close(sfd);
+            } else if (status == MFS_ERROR_NOTDONE) {
+                for (b = 0; b < bcnt; b++) {
+                    bpackets[b] = mainserv_create_packet(&wptr, CSTOCL_READ_DATA, 8 + 2 + 2 + 4 + 4 + MFSBLOCKSIZE);
+                    memcpy(wptr, zchdr[b] + 8, READ_DATA_HDRSIZE - 8 - 4);
+                    bcrcs[b] = wptr + READ_DATA_HDRSIZE - 8 - 4;
+                    bdata[b] = wptr + READ_DATA_HDRSIZE - 8;
+                }
+                // blocks go out once the whole batch is read and checked and the chunk is released
+                status = hdd_read_blocks(chunkid, version, blocknum, bcnt, bdata, bcrcs, mainserv_read_send_block, &rs);
+            }
+        } else {
+            status = hdd_read(chunkid, version, blocknum, wptr + 4, blockoffset, blocksize, wptr);
+        }
         if (protover) {
             mainserv_read_nop_del(&rn);
             if (rn.error) {
+                mainserv_free_packet(packet);
+                for (b = 0; b < bcnt; b++) {
+                    mainserv_free_packet(bpackets[b]);
+                }
                 hdd_close(chunkid);
                 return 0;
             }
             if (rn.bytesleft > 0) {
                 if (mainserv_towrite(sock, read_nop_buff + (8 - rn.bytesleft), rn.bytesleft, SERV_TIMEOUT) != (int32_t)rn.bytesleft) {
+                    mainserv_free_packet(packet);
+                    for (b = 0; b < bcnt; b++) {
+                        mainserv_free_packet(bpackets[b]);
+                    }
                     hdd_close(chunkid);
                     return 0;
                 }
             }
             rn.bytesleft = 0;
         }
+        if (rs.error) {
+            for (b = 0; b < bcnt; b++) {
+                mainserv_free_packet(bpackets[b]);
+            }
+            hdd_close(chunkid);
+            return 0;
+        }
         if (status != MFS_STATUS_OK) {
-            free(packet);
+            mainserv_free_packet(packet);
+            for (b = 0; b < bcnt; b++) {
+                mainserv_free_packet(bpackets[b]);
+            }
             hdd_close(chunkid);
             packet = mainserv_create_packet(&wptr, CSTOCL_READ_STATUS, 8 + 1);
             put64bit(&wptr, chunkid);
@@ -422,7 +654,8 @@ uint8_t mainserv_read(int sock, const uint8_t* data, uint32_t length)
 #endif
             return ret;
         }
-        if (mainserv_send_and_free(sock, packet, 8 + 2 + 2 + 4 + 4 + blocksize) == 0) {
+        // whole blocks were already sent (sendfile or hdd_read_blocks callback)
+        if (bcnt == 0 && mainserv_send_and_free(sock, packet, 8 + 2 + 2 + 4 + 4 + blocksize) == 0) {
             hdd_close(chunkid);
             return 0;
         }
@@ -479,7 +712,6 @@ typedef struct write_job {
     uint8_t netstatus;
     uint8_t ack;
     struct write_job* next;
-    uint32_t structsize;
     uint8_t data[1];
 } write_job;
 
@@ -494,12 +726,22 @@ typedef struct write_xchg {
     uint8_t term;
 } write_xchg;
 
+static inline int mainserv_write_wholeblock(const write_job* wrjob)
+{
+    return (wrjob->offset == 0 && wrjob->size == MFSBLOCKSIZE) ? 1 : 0;
+}
+
+/* jobs queued while disk was busy are written together - runs of consecutive whole blocks go to hdd_write_blocks */
 void* mainserv_write_thread(void* arg)
 {
     write_xchg* wrdata = (write_xchg*)arg;
     write_job* wrjob;
+    write_job* jobs[HDD_WRITE_MAX_BLOCKS];
+    const uint8_t* buffs[HDD_WRITE_MAX_BLOCKS];
+    const uint8_t* crcs[HDD_WRITE_MAX_BLOCKS];
     uint64_t gchunkid;
     uint32_t gversion;
+    uint16_t i, cnt, written;
     uint8_t status;
     while (1) {
         pthread_mutex_lock(&(wrdata->lock));
@@ -512,14 +754,39 @@ void* mainserv_write_thread(void* arg)
             return NULL;
         }
         wrjob = wrdata->hddhead;
+        cnt = 0;
+        if (mainserv_write_wholeblock(wrjob)) {
+            while (wrjob != NULL && cnt < HDD_WRITE_MAX_BLOCKS && mainserv_write_wholeblock(wrjob) && (cnt == 0 || wrjob->blocknum == jobs[cnt - 1]->blocknum + 1)) {
+                jobs[cnt] = wrjob;
+                buffs[cnt] = wrjob->buff;
+                crcs[cnt] = wrjob->crcptr;
+                cnt++;
+                wrjob = wrjob->next;
+            }
+        }
+        wrjob = wrdata->hddhead;
         gchunkid = wrdata->chunkid;
         gversion = wrdata->version;
         pthread_mutex_unlock(&(wrdata->lock));
-        status = hdd_write(gchunkid, gversion, wrjob->blocknum, wrjob->buff, wrjob->offset, wrjob->size, wrjob->crcptr);
+        written = 0;
+        status = MFS_STATUS_OK;
+        if (cnt > 1) {
+            status = hdd_write_blocks(gchunkid, gversion, wrjob->blocknum, cnt, buffs, crcs, &written);
+        }
+        if (status == MFS_STATUS_OK && written == 0) {
+            status = hdd_write(gchunkid, gversion, wrjob->blocknum, wrjob->buff, wrjob->offset, wrjob->size, wrjob->crcptr);
+            written = 1;
+        }
         pthread_mutex_lock(&(wrdata->lock));
-        wrjob->hddstatus = status;
-        wrjob->ack |= 1;
-        wrdata->hddhead = wrjob->next;
+        if (status != MFS_STATUS_OK) { // error belongs to first job - rest of them is never acknowledged
+            written = 1;
+        }
+        for (i = 0; i < written; i++) {
+            wrjob->hddstatus = status;
+            wrjob->ack |= 1;
+            wrjob = wrjob->next;
+        }
+        wrdata->hddhead = wrjob;
         pthread_mutex_unlock(&(wrdata->lock));
         if (write(wrdata->pipe[1], "*", 1) != 1) {
             mfs_errlog(LOG_WARNING, "pipe write error");
@@ -603,20 +870,11 @@ uint8_t mainserv_write_middle(int sock, int fwdsock, uint64_t gchunkid, uint32_t
                         syslog(LOG_WARNING, "packet too long (%" PRIu32 "/%u) ; command:%" PRIu32, leng, MaxPacketSize, cmd);
                         break;
                     }
-#ifdef MMAP_ALLOC
-                    wrjob = (write_job*)mmap(NULL, offsetof(write_job, data) + leng + 8, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
-#else
-                    wrjob = malloc(offsetof(write_job, data) + leng + 8);
-#endif
+                    wrjob = (write_job*)mainserv_pool_alloc(offsetof(write_job, data) + leng + 8);
                     passert(wrjob);
-                    wrjob->structsize = offsetof(write_job, data) + leng + 8;
                     memcpy(wrjob->data, hdr, 8);
                     if (mainserv_toforward(sock, fwdsock, wrjob->data, leng + 8, 8, 0, SERV_TIMEOUT) != (int32_t)(leng + 8)) {
-#ifdef MMAP_ALLOC
-                        munmap(wrjob, wrjob->structsize);
-#else
-                        free(wrjob);
-#endif
+                        mainserv_pool_free(wrjob);
                         break;
                     }
                 } else {
@@ -674,11 +932,7 @@ uint8_t mainserv_write_middle(int sock, int fwdsock, uint64_t gchunkid, uint32_t
                 const uint8_t* crcptr;
                 if (leng < 8 + 4 + 2 + 2 + 4 + 4) {
                     syslog(LOG_NOTICE, "CLTOCS_WRITE_DATA - wrong size (%" PRIu32 "/24+size)", leng);
-#ifdef MMAP_ALLOC
-                    munmap(wrjob, wrjob->structsize);
-#else
-                    free(wrjob);
-#endif
+                    mainserv_pool_free(wrjob);
                     break;
                 }
                 rptr = wrjob->data + 8;
@@ -691,11 +945,7 @@ uint8_t mainserv_write_middle(int sock, int fwdsock, uint64_t gchunkid, uint32_t
                 crc = get32bit(&crcptr);
                 if (leng != 8 + 4 + 2 + 2 + 4 + 4 + wrjob->size) {
                     syslog(LOG_NOTICE, "CLTOCS_WRITE_DATA - wrong size (%" PRIu32 "/24+%" PRIu32 ")", leng, wrjob->size);
-#ifdef MMAP_ALLOC
-                    munmap(wrjob, wrjob->structsize);
-#else
-                    free(wrjob);
-#endif
+                    mainserv_pool_free(wrjob);
                     break;
                 }
                 if (gchunkid != wrjob->chunkid) {
@@ -704,11 +954,7 @@ uint8_t mainserv_write_middle(int sock, int fwdsock, uint64_t gchunkid, uint32_t
                     put32bit(&wptr, 0);
                     put8bit(&wptr, MFS_ERROR_WRONGCHUNKID);
                     mainserv_send_and_free(sock, packet, 8 + 4 + 1);
-#ifdef MMAP_ALLOC
-                    munmap(wrjob, wrjob->structsize);
-#else
-                    free(wrjob);
-#endif
+                    mainserv_pool_free(wrjob);
                     break;
                 }
                 syslog(LOG_NOTICE, "chunkid: %016" PRIX64 ", version: %08" PRIX32 ", blocknum: %" PRIu16 ", offset: %" PRIu16 ", size: %" PRIu32 ", crc: %08" PRIX32 ":%08" PRIX32, gchunkid, gversion, wrjob->blocknum, wrjob->offset, wrjob->size, crc, mycrc32(0, rptr + 4, wrjob->size));
@@ -781,15 +1027,10 @@ uint8_t mainserv_write_middle(int sock, int fwdsock, uint64_t gchunkid, uint32_t
                 pthread_mutex_lock(&(wrdata.lock));
                 if (writeid == 0) {
                     // add new element to wrdata.head
-#ifdef MMAP_ALLOC
-                    wrjob = (write_job*)mmap(NULL, offsetof(write_job, data), PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
-#else
-                    wrjob = malloc(offsetof(write_job, data));
-#endif
+                    wrjob = (write_job*)mainserv_pool_alloc(offsetof(write_job, data));
                     passert(wrjob);
                     wrjob->chunkid = chunkid;
                     wrjob->writeid = 0;
-                    wrjob->structsize = offsetof(write_job, data);
                     wrjob->ack = 3;
                     wrjob->hddstatus = MFS_STATUS_OK;
                     wrjob->netstatus = status;
@@ -852,11 +1093,7 @@ uint8_t mainserv_write_middle(int sock, int fwdsock, uint64_t gchunkid, uint32_t
             if (wrdata.head == NULL) {
                 wrdata.tail = &(wrdata.head);
             }
-#ifdef MMAP_ALLOC
-            munmap(wrjob, wrjob->structsize);
-#else
-            free(wrjob);
-#endif
+            mainserv_pool_free(wrjob);
             pthread_mutex_unlock(&(wrdata.lock));
             packet = mainserv_create_packet(&wptr, CSTOCL_WRITE_STATUS, 8 + 4 + 1);
             put64bit(&wptr, chunkid);
@@ -896,11 +1133,7 @@ uint8_t mainserv_write_middle(int sock, int fwdsock, uint64_t gchunkid, uint32_t
 //		if (wrdata.head==NULL) {
 //			wrdata.tail = &(wrdata.head);
 //		}
-#ifdef MMAP_ALLOC
-        munmap(wrjob, wrjob->structsize);
-#else
-        free(wrjob);
-#endif
+        mainserv_pool_free(wrjob);
     }
     if (pdata) {
 #ifdef MMAP_ALLOC
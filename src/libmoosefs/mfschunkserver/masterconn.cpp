@@ -18,6 +18,10 @@
  * or visit http://www.gnu.org/licenses/gpl-2.0.html
  */
 
+#if defined(HAVE_CONFIG_H)
+#include <config/dash-config.h>
+#endif
+
 #include <fcntl.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -55,6 +59,13 @@
 // has to be less than MaxPacketSize on master side divided by 12
 #define CHANGEDCHUNKLIMIT 25000
 
+// master on a loopback address is refused, except in builds for the load generator (--enable-moosefs-loadgen)
+#ifdef ENABLE_MOOSEFS_LOADGEN
+#define MASTERCONN_ALLOW_LOOPBACK 1
+#else
+#define MASTERCONN_ALLOW_LOOPBACK 0
+#endif
+
 #define REPORT_LOAD_FREQ 5
 #define REPORT_SPACE_FREQ 1
 
@@ -876,6 +887,31 @@ void masterconn_replicate(masterconn* eptr, const uint8_t* data, uint32_t length
     }
 }
 
+void masterconn_replicate_ec(masterconn* eptr, const uint8_t* data, uint32_t length)
+{
+    uint64_t chunkid;
+    uint32_t version;
+    uint8_t k, m, part;
+    uint8_t* ptr;
+    void* packet;
+
+    if (length < 15 + 19 || (length - 15) % 19 != 0 || (length - 15) / 19 > MFS_EC_MAX_DATA_PARTS + MFS_EC_MAX_PARITY_PARTS) {
+        syslog(LOG_NOTICE, "MATOCS_REPLICATE_EC - wrong size (%" PRIu32 "/15+n*19[n:1..%u])", length, MFS_EC_MAX_DATA_PARTS + MFS_EC_MAX_PARITY_PARTS);
+        eptr->mode = KILL;
+        return;
+    }
+    chunkid = get64bit(&data);
+    version = get32bit(&data);
+    k = get8bit(&data);
+    m = get8bit(&data);
+    part = get8bit(&data);
+    packet = masterconn_create_detached_packet(eptr, CSTOMA_REPLICATE, 8 + 4 + 1);
+    ptr = masterconn_get_packet_data(packet);
+    put64bit(&ptr, chunkid);
+    put32bit(&ptr, version);
+    job_replicate_ec(masterconn_replicationfinished, packet, chunkid, version, k, m, part, (length - 15) / 19, data);
+}
+
 void masterconn_idlejob_finished(uint8_t status, void* ijp)
 {
     idlejob* ij = (idlejob*)ijp;
@@ -1020,6 +1056,9 @@ void masterconn_gotpacket(masterconn* eptr, uint32_t type, const uint8_t* data,
     case MATOCS_REPLICATE:
         masterconn_replicate(eptr, data, length);
         break;
+    case MATOCS_REPLICATE_EC:
+        masterconn_replicate_ec(eptr, data, length);
+        break;
     case MATOCS_CHUNKOP:
         masterconn_chunkop(eptr, data, length);
         break;
@@ -1090,7 +1129,7 @@ int masterconn_initconnect(masterconn* eptr)
         }
         eptr->bindip = bip;
         if (tcpresolve(MasterHost, MasterPort, &mip, &mport, 0) >= 0) {
-            if ((mip & 0xFF000000) != 0x7F000000) {
+            if ((mip & 0xFF000000) != 0x7F000000 || MASTERCONN_ALLOW_LOOPBACK) {
                 //				eptr->new_register_mode = 3;
                 eptr->masterip = mip;
                 eptr->masterport = mport;
@@ -26,17 +26,30 @@
 #include <unistd.h>
 
 #include "clocks.h"
+#include "conncache.h"
 #include "crc.h"
 #include "datapack.h"
+#include "defaults.h"
+#include "gf256.h"
+#include "hashfn.h"
 #include "hddspacemgr.h"
 #include "massert.h"
 #include "mfsstrerr.h"
+#include "portable.h"
 #include "slogger.h"
 #include "sockets.h"
+#include "xorblock.h"
 
 #define CONNMSECTO 5000
 #define SENDMSECTO 5000
 #define RECVMSECTO 5000
+#define WINDOWMSECTO 30000
+
+#define REP_PEER_HASHSIZE 256
+#define REP_PEER_HASH(ip, port) (hash32((ip) ^ ((port) << 16)) % (REP_PEER_HASHSIZE))
+
+/* bytes received above the bandwidth limit without waiting (as time at the limit) */
+#define REP_BW_BURST_USEC 100000
 
 #define MAX_RECV_PACKET_SIZE (20 + MFSBLOCKSIZE)
 
@@ -45,8 +58,17 @@ typedef enum { IDLE,
     HEADER,
     DATA } modetype;
 
+typedef struct _reppeer {
+    uint32_t ip;
+    uint16_t port;
+    uint32_t inflight;
+    uint32_t waiting;
+    struct _reppeer* next;
+} reppeer;
+
 typedef struct _repsrc {
     int sock;
+    uint8_t pooled;
     modetype mode;
     uint8_t hdrbuff[8];
     uint8_t* packet;
@@ -59,6 +81,7 @@ typedef struct _repsrc {
 
     uint32_t ip;
     uint16_t port;
+    reppeer* peer; // window slot held by this source (NULL - peer listed earlier or slot not taken yet)
 
     uint32_t crcsums[4];
 } repsrc;
@@ -68,30 +91,114 @@ typedef struct _replication {
     uint32_t version;
 
     uint8_t* xorbuff;
+    const uint8_t** xorsrcs;
+    uint8_t* ecbuff;
 
-    uint8_t created, opened;
+    uint8_t created, opened, finished;
+    uint8_t keepconns, pooled;
     uint8_t srccnt;
+    uint64_t startusec;
     struct pollfd* fds;
     repsrc* repsources;
 } replication;
 
 static uint32_t stats_repl = 0;
+static uint32_t stats_replok = 0;
+static uint32_t stats_connreused = 0;
+static uint32_t stats_connnew = 0;
+static uint64_t stats_replusec = 0;
 static uint64_t stats_bytesin = 0;
 static uint64_t stats_bytesout = 0;
 static pthread_mutex_t statslock = PTHREAD_MUTEX_INITIALIZER;
 
-void replicator_stats(uint64_t* bin, uint64_t* bout, uint32_t* repl)
+/*
+ * When a chunkserver rejoins, master sends it thousands of replications - usually many chunks from the same few
+ * peers, run concurrently by bgjobs workers. Connections of successful replications are handed to conncache (which
+ * keeps them alive with nops) and picked up by next replications from the same peer, so consecutive chunks skip
+ * connection setup. The window limits replications streaming from one peer at a time (others wait for a slot),
+ * and all replications share one bandwidth limit.
+ */
+static reppeer* peerhash[REP_PEER_HASHSIZE];
+static uint32_t rep_window = REPLICATION_WINDOW;
+static uint32_t peers_inflight = 0;
+static uint32_t peers_waiting = 0;
+static pthread_mutex_t peerlock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t peercond = PTHREAD_COND_INITIALIZER;
+
+static uint32_t bw_mbps = REPLICATION_BANDWIDTH_MBPS; // 0 - unlimited
+static uint64_t bw_next = 0; // monotonic usec when bytes received so far are paid off
+static pthread_mutex_t bwlock = PTHREAD_MUTEX_INITIALIZER;
+
+void replicator_stats(uint64_t* bin, uint64_t* bout, uint32_t* repl, uint32_t* replok, uint32_t* connreused, uint32_t* connnew, uint64_t* replusec)
 {
     pthread_mutex_lock(&statslock);
     *bin = stats_bytesin;
     *bout = stats_bytesout;
     *repl = stats_repl;
+    *replok = stats_replok;
+    *connreused = stats_connreused;
+    *connnew = stats_connnew;
+    *replusec = stats_replusec;
     stats_repl = 0;
+    stats_replok = 0;
+    stats_connreused = 0;
+    stats_connnew = 0;
+    stats_replusec = 0;
     stats_bytesin = 0;
     stats_bytesout = 0;
     pthread_mutex_unlock(&statslock);
 }
 
+void replicator_window_stats(uint32_t* inflight, uint32_t* waiting)
+{
+    zassert(pthread_mutex_lock(&peerlock));
+    *inflight = peers_inflight;
+    *waiting = peers_waiting;
+    zassert(pthread_mutex_unlock(&peerlock));
+}
+
+void replicator_set_limits(uint32_t window, uint32_t mbps)
+{
+    zassert(pthread_mutex_lock(&peerlock));
+    rep_window = (window > 0) ? window : 1;
+    zassert(pthread_cond_broadcast(&peercond));
+    zassert(pthread_mutex_unlock(&peerlock));
+    zassert(pthread_mutex_lock(&bwlock));
+    bw_mbps = mbps;
+    zassert(pthread_mutex_unlock(&bwlock));
+}
+
+void replicator_get_limits(uint32_t* window, uint32_t* mbps)
+{
+    zassert(pthread_mutex_lock(&peerlock));
+    *window = rep_window;
+    zassert(pthread_mutex_unlock(&peerlock));
+    zassert(pthread_mutex_lock(&bwlock));
+    *mbps = bw_mbps;
+    zassert(pthread_mutex_unlock(&bwlock));
+}
+
+/* accounts received bytes against the bandwidth limit - returns time (usec) the receiver has to wait */
+static uint64_t rep_bw_delay(uint32_t bytes)
+{
+    uint64_t now, delay;
+
+    delay = 0;
+    zassert(pthread_mutex_lock(&bwlock));
+    if (bw_mbps > 0 && bytes > 0) {
+        now = monotonic_useconds();
+        if (bw_next < now) {
+            bw_next = now;
+        }
+        bw_next += (uint64_t)bytes * 1000000 / ((uint64_t)bw_mbps * 1024 * 1024);
+        if (bw_next > now + REP_BW_BURST_USEC) {
+            delay = bw_next - now - REP_BW_BURST_USEC;
+        }
+    }
+    zassert(pthread_mutex_unlock(&bwlock));
+    return delay;
+}
+
 static inline void replicator_bytesin(uint64_t bytes)
 {
     zassert(pthread_mutex_lock(&statslock));
@@ -106,65 +213,14 @@ static inline void replicator_bytesout(uint64_t bytes)
     zassert(pthread_mutex_unlock(&statslock));
 }
 
-static void xordata(uint8_t* dst, const uint8_t* src, uint32_t leng)
-{
-    uint32_t* dst4;
-    const uint32_t* src4;
-#define XOR_ONE_BYTE (*dst++) ^= (*src++)
-#define XOR_FOUR_BYTES (*dst4++) ^= (*src4++)
-    if (((unsigned long)dst & 3) == ((unsigned long)src & 3)) {
-        while (leng && ((unsigned long)src & 3)) {
-            XOR_ONE_BYTE;
-            leng--;
-        }
-        dst4 = (uint32_t*)dst;
-        src4 = (const uint32_t*)src;
-        while (leng >= 32) {
-            XOR_FOUR_BYTES;
-            XOR_FOUR_BYTES;
-            XOR_FOUR_BYTES;
-            XOR_FOUR_BYTES;
-            XOR_FOUR_BYTES;
-            XOR_FOUR_BYTES;
-            XOR_FOUR_BYTES;
-            XOR_FOUR_BYTES;
-            leng -= 32;
-        }
-        while (leng >= 4) {
-            XOR_FOUR_BYTES;
-            leng -= 4;
-        }
-        src = (const uint8_t*)src4;
-        dst = (uint8_t*)dst4;
-        if (leng)
-            do {
-                XOR_ONE_BYTE;
-            } while (--leng);
-    } else {
-        while (leng >= 8) {
-            XOR_ONE_BYTE;
-            XOR_ONE_BYTE;
-            XOR_ONE_BYTE;
-            XOR_ONE_BYTE;
-            XOR_ONE_BYTE;
-            XOR_ONE_BYTE;
-            XOR_ONE_BYTE;
-            XOR_ONE_BYTE;
-            leng -= 8;
-        }
-        if (leng > 0)
-            do {
-                XOR_ONE_BYTE;
-            } while (--leng);
-    }
-}
-
-static int rep_read(repsrc* rs)
+/* returns number of bytes received or -1 on error */
+static int32_t rep_read(repsrc* rs)
 {
-    int32_t i;
+    int32_t i, total;
     uint32_t type;
     uint32_t size;
     const uint8_t* ptr;
+    total = 0;
     while (rs->bytesleft > 0) {
         i = read(rs->sock, rs->startptr, rs->bytesleft);
         if (i == 0) {
@@ -176,15 +232,16 @@ static int rep_read(repsrc* rs)
                 mfs_errlog_silent(LOG_NOTICE, "replicator: read error");
                 return -1;
             }
-            return 0;
+            return total;
         }
         replicator_bytesin(i);
         //		stats_bytesin+=i;
+        total += i;
         rs->startptr += i;
         rs->bytesleft -= i;
 
         if (rs->bytesleft > 0) {
-            return 0;
+            return total;
         }
 
         if (rs->mode == HEADER) {
@@ -194,7 +251,7 @@ static int rep_read(repsrc* rs)
             if (type == ANTOAN_NOP && size == 0) { // NOP
                 rs->startptr = rs->hdrbuff;
                 rs->bytesleft = 8;
-                return 0;
+                return total;
             }
 
             if (rs->packet) {
@@ -215,14 +272,15 @@ static int rep_read(repsrc* rs)
             rs->mode = DATA;
         }
     }
-    return 0;
+    return total;
 }
 
 static int rep_receive_all_packets(replication* r, uint32_t msecto)
 {
     uint8_t i, l;
-    uint64_t st;
-    uint32_t msec;
+    uint64_t st, delay;
+    uint32_t msec, rcvd;
+    int32_t n;
     st = monotonic_useconds();
     for (;;) {
         l = 1;
@@ -249,17 +307,26 @@ static int rep_receive_all_packets(replication* r, uint32_t msecto)
             }
             continue;
         }
+        rcvd = 0;
         for (i = 0; i < r->srccnt; i++) {
             if (r->fds[i].revents & POLLHUP) {
                 syslog(LOG_NOTICE, "replicator: connection lost");
                 return -1;
             }
             if (r->fds[i].revents & POLLIN) {
-                if (rep_read(r->repsources + i) < 0) {
+                n = rep_read(r->repsources + i);
+                if (n < 0) {
                     return -1;
                 }
+                rcvd += n;
             }
         }
+        // throttled time doesn't count as waiting for peers
+        delay = rep_bw_delay(rcvd);
+        if (delay > 0) {
+            portable_usleep(delay);
+            st += delay;
+        }
     }
 }
 
@@ -403,9 +470,168 @@ static int rep_wait_for_connection(replication* r, uint32_t msecto)
     }
 }
 
+static reppeer* rep_peer_get(uint32_t ip, uint16_t port)
+{
+    uint32_t hash;
+    reppeer* p;
+
+    hash = REP_PEER_HASH(ip, port);
+    for (p = peerhash[hash]; p != NULL; p = p->next) {
+        if (p->ip == ip && p->port == port) {
+            return p;
+        }
+    }
+    p = (reppeer*)malloc(sizeof(reppeer));
+    passert(p);
+    p->ip = ip;
+    p->port = port;
+    p->inflight = 0;
+    p->waiting = 0;
+    p->next = peerhash[hash];
+    peerhash[hash] = p;
+    return p;
+}
+
+static void rep_peer_put(reppeer* p)
+{
+    reppeer** pp;
+
+    if (p->inflight > 0 || p->waiting > 0) {
+        return;
+    }
+    pp = peerhash + REP_PEER_HASH(p->ip, p->port);
+    while (*pp != p) {
+        pp = &((*pp)->next);
+    }
+    *pp = p->next;
+    free(p);
+}
+
+static int rep_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, uint64_t usecs)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += usecs / 1000000;
+    ts.tv_nsec += (usecs % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return pthread_cond_timedwait(cond, mutex, &ts);
+}
+
+/* gives back window slots of all sources (peerlock has to be locked) */
+static void rep_peers_release_locked(replication* r)
+{
+    uint8_t i;
+    reppeer* p;
+
+    for (i = 0; i < r->srccnt; i++) {
+        p = r->repsources[i].peer;
+        if (p != NULL) {
+            p->inflight--;
+            peers_inflight--;
+            rep_peer_put(p);
+            r->repsources[i].peer = NULL;
+        }
+    }
+    zassert(pthread_cond_broadcast(&peercond));
+}
+
+/*
+ * takes a window slot at every distinct source peer - peers are taken in ip:port order, so replications waiting for
+ * each other's slots can't deadlock
+ */
+static uint8_t rep_peers_acquire(replication* r)
+{
+    uint8_t order[256];
+    uint8_t i, j, n, t;
+    uint64_t deadline, now;
+    repsrc *rs, *prs;
+    reppeer* p;
+
+    for (i = 0; i < r->srccnt; i++) {
+        order[i] = i;
+        r->repsources[i].peer = NULL;
+    }
+    for (i = 1; i < r->srccnt; i++) {
+        t = order[i];
+        rs = r->repsources + t;
+        for (j = i; j > 0; j--) {
+            prs = r->repsources + order[j - 1];
+            if (prs->ip < rs->ip || (prs->ip == rs->ip && prs->port <= rs->port)) {
+                break;
+            }
+            order[j] = order[j - 1];
+        }
+        order[j] = t;
+    }
+    deadline = monotonic_useconds() + WINDOWMSECTO * 1000ULL;
+    zassert(pthread_mutex_lock(&peerlock));
+    for (n = 0; n < r->srccnt; n++) {
+        rs = r->repsources + order[n];
+        if (n > 0) {
+            prs = r->repsources + order[n - 1];
+            if (prs->ip == rs->ip && prs->port == rs->port) {
+                continue;
+            }
+        }
+        p = rep_peer_get(rs->ip, rs->port);
+        p->waiting++;
+        peers_waiting++;
+        while (p->inflight >= rep_window) {
+            now = monotonic_useconds();
+            if (now >= deadline) {
+                break;
+            }
+            rep_cond_timedwait(&peercond, &peerlock, deadline - now);
+        }
+        p->waiting--;
+        peers_waiting--;
+        if (p->inflight >= rep_window) {
+            rep_peer_put(p);
+            rep_peers_release_locked(r);
+            zassert(pthread_mutex_unlock(&peerlock));
+            syslog(LOG_NOTICE, "replicator: replication window of (%u.%u.%u.%u:%u) is full", (rs->ip >> 24) & 0xFF, (rs->ip >> 16) & 0xFF, (rs->ip >> 8) & 0xFF, rs->ip & 0xFF, rs->port);
+            return MFS_ERROR_NOTDONE;
+        }
+        p->inflight++;
+        peers_inflight++;
+        rs->peer = p;
+    }
+    zassert(pthread_mutex_unlock(&peerlock));
+    return MFS_STATUS_OK;
+}
+
+/* closes all source connections (sources stay initialized, so they can be connected again) */
+static void rep_disconnect(replication* r)
+{
+    uint8_t i;
+    for (i = 0; i < r->srccnt; i++) {
+        if (r->repsources[i].sock >= 0) {
+            tcpclose(r->repsources[i].sock);
+            r->repsources[i].sock = -1;
+        }
+        rep_no_packet(r->repsources + i);
+        r->repsources[i].mode = IDLE;
+        r->repsources[i].pooled = 0;
+    }
+    r->pooled = 0;
+}
+
 static void rep_cleanup(replication* r)
 {
     int i;
+    if (r->finished) {
+        zassert(pthread_mutex_lock(&statslock));
+        stats_replok++;
+        stats_replusec += monotonic_useconds() - r->startusec;
+        zassert(pthread_mutex_unlock(&statslock));
+    }
+    zassert(pthread_mutex_lock(&peerlock));
+    rep_peers_release_locked(r);
+    zassert(pthread_mutex_unlock(&peerlock));
     if (r->opened) {
         hdd_close(r->chunkid);
     }
@@ -414,7 +640,12 @@ static void rep_cleanup(replication* r)
     }
     for (i = 0; i < r->srccnt; i++) {
         if (r->repsources[i].sock >= 0) {
-            tcpclose(r->repsources[i].sock);
+            // all streams ended with read status - connection can be used by next replication from this peer
+            if (r->keepconns) {
+                conncache_insert(r->repsources[i].ip, r->repsources[i].port, r->repsources[i].sock);
+            } else {
+                tcpclose(r->repsources[i].sock);
+            }
         }
         if (r->repsources[i].packet) {
             free(r->repsources[i].packet);
@@ -429,200 +660,441 @@ static void rep_cleanup(replication* r)
     if (r->xorbuff) {
         free(r->xorbuff);
     }
+    if (r->xorsrcs) {
+        free(r->xorsrcs);
+    }
+    if (r->ecbuff) {
+        free(r->ecbuff);
+    }
 }
 
-/* srcs: srccnt * (chunkid:64 version:32 ip:32 port:16) */
-uint8_t replicate(uint64_t chunkid, uint32_t version, const uint32_t xormasks[4], uint8_t srccnt, const uint8_t* srcs)
+#define REP_IPFMT "(%u.%u.%u.%u:%u)"
+#define REP_IPARGS(rs) ((rs)->ip >> 24) & 0xFF, ((rs)->ip >> 16) & 0xFF, ((rs)->ip >> 8) & 0xFF, (rs)->ip & 0xFF, (rs)->port
+
+/* connects to all sources (r->srccnt has to be set and sources initialized) - usepool: take idle connections from conncache first */
+static uint8_t rep_connect(replication* r, uint8_t usepool)
 {
-    replication r;
-    uint8_t status, i, j, vbuffs, first;
-    uint16_t b, blocks;
-    uint32_t xcrc[4], crc;
-    uint32_t codeindex, codeword;
-    uint8_t* wptr;
-    const uint8_t* rptr;
+    uint8_t i, fresh;
     int s;
 
-    if (srccnt == 0) {
-        return MFS_ERROR_EINVAL;
-    }
-
-    syslog(LOG_NOTICE, "replication begin (chunkid:%08" PRIX64 ",version:%04" PRIX32 ",srccnt:%" PRIu8 ")", chunkid, version, srccnt);
-
-    pthread_mutex_lock(&statslock);
-    stats_repl++;
-    pthread_mutex_unlock(&statslock);
-
-    // init replication structure
-    r.chunkid = chunkid;
-    r.version = version;
-    r.srccnt = 0;
-    r.created = 0;
-    r.opened = 0;
-    r.fds = (pollfd*)malloc(sizeof(struct pollfd) * srccnt);
-    passert(r.fds);
-    r.repsources = (repsrc*)malloc(sizeof(repsrc) * srccnt);
-    passert(r.repsources);
-    if (srccnt > 1) {
-        r.xorbuff = (uint8_t*)malloc(MFSBLOCKSIZE + 4);
-        passert(r.xorbuff);
-    } else {
-        r.xorbuff = NULL;
-    }
-    // create chunk
-    status = hdd_create(chunkid, 0);
-    if (status != MFS_STATUS_OK) {
-        syslog(LOG_NOTICE, "replicator: hdd_create status: %s", mfsstrerr(status));
-        rep_cleanup(&r);
-        return status;
-    }
-    r.created = 1;
-    // init sources
-    r.srccnt = srccnt;
-    for (i = 0; i < srccnt; i++) {
-        r.repsources[i].chunkid = get64bit(&srcs);
-        r.repsources[i].version = get32bit(&srcs);
-        r.repsources[i].ip = get32bit(&srcs);
-        r.repsources[i].port = get16bit(&srcs);
-        r.repsources[i].sock = -1;
-        r.repsources[i].packet = NULL;
-    }
-    // connect
-    for (i = 0; i < srccnt; i++) {
+    r->pooled = 0;
+    fresh = 0;
+    for (i = 0; i < r->srccnt; i++) {
+        r->repsources[i].pooled = 0;
+        if (usepool) {
+            s = conncache_get(r->repsources[i].ip, r->repsources[i].port);
+            if (s >= 0) {
+                r->repsources[i].sock = s;
+                r->repsources[i].pooled = 1;
+                r->repsources[i].mode = IDLE;
+                r->fds[i].fd = s;
+                r->pooled++;
+                continue;
+            }
+        }
+        fresh++;
         s = tcpsocket();
         if (s < 0) {
             mfs_errlog_silent(LOG_NOTICE, "replicator: socket error");
-            rep_cleanup(&r);
             return MFS_ERROR_CANTCONNECT;
         }
-        r.repsources[i].sock = s;
-        r.fds[i].fd = s;
+        r->repsources[i].sock = s;
+        r->fds[i].fd = s;
         if (tcpnonblock(s) < 0) {
             mfs_errlog_silent(LOG_NOTICE, "replicator: nonblock error");
-            rep_cleanup(&r);
             return MFS_ERROR_CANTCONNECT;
         }
-        s = tcpnumconnect(s, r.repsources[i].ip, r.repsources[i].port);
+        s = tcpnumconnect(s, r->repsources[i].ip, r->repsources[i].port);
         if (s < 0) {
             mfs_errlog_silent(LOG_NOTICE, "replicator: connect error");
-            rep_cleanup(&r);
             return MFS_ERROR_CANTCONNECT;
         }
         if (s == 0) {
-            r.repsources[i].mode = IDLE;
+            r->repsources[i].mode = IDLE;
         } else {
-            r.repsources[i].mode = CONNECTING;
+            r->repsources[i].mode = CONNECTING;
         }
     }
-    if (rep_wait_for_connection(&r, CONNMSECTO) < 0) {
-        rep_cleanup(&r);
+    zassert(pthread_mutex_lock(&statslock));
+    stats_connreused += r->pooled;
+    stats_connnew += fresh;
+    zassert(pthread_mutex_unlock(&statslock));
+    if (rep_wait_for_connection(r, CONNMSECTO) < 0) {
         return MFS_ERROR_CANTCONNECT;
     }
     // disable Nagle
-    for (i = 0; i < srccnt; i++) {
-        tcpnodelay(r.repsources[i].sock);
-    }
-    // open chunk
-    status = hdd_open(chunkid, 0);
-    if (status != MFS_STATUS_OK) {
-        syslog(LOG_NOTICE, "replicator: hdd_open status: %s", mfsstrerr(status));
-        rep_cleanup(&r);
-        return status;
+    for (i = 0; i < r->srccnt; i++) {
+        if (r->repsources[i].pooled == 0) {
+            tcpnodelay(r->repsources[i].sock);
+        }
     }
-    r.opened = 1;
-    // get block numbers
-    for (i = 0; i < srccnt; i++) {
-        wptr = rep_create_packet(r.repsources + i, ANTOCS_GET_CHUNK_BLOCKS, 8 + 4);
+    return MFS_STATUS_OK;
+}
+
+/* asks every source for number of blocks (stored in repsources[i].blocks) ; *blocks - max of them */
+static uint8_t rep_get_blocks(replication* r, uint16_t* blocks)
+{
+    uint8_t i;
+    uint8_t* wptr;
+    const uint8_t* rptr;
+
+    for (i = 0; i < r->srccnt; i++) {
+        wptr = rep_create_packet(r->repsources + i, ANTOCS_GET_CHUNK_BLOCKS, 8 + 4);
         if (wptr == NULL) {
             syslog(LOG_NOTICE, "replicator: out of memory");
-            rep_cleanup(&r);
             return MFS_ERROR_OUTOFMEMORY;
         }
-        put64bit(&wptr, r.repsources[i].chunkid);
-        put32bit(&wptr, r.repsources[i].version);
+        put64bit(&wptr, r->repsources[i].chunkid);
+        put32bit(&wptr, r->repsources[i].version);
     }
     // send packet
-    if (rep_send_all_packets(&r, SENDMSECTO) < 0) {
-        rep_cleanup(&r);
+    if (rep_send_all_packets(r, SENDMSECTO) < 0) {
         return MFS_ERROR_DISCONNECTED;
     }
     // receive answers
-    for (i = 0; i < srccnt; i++) {
-        r.repsources[i].mode = HEADER;
-        r.repsources[i].startptr = r.repsources[i].hdrbuff;
-        r.repsources[i].bytesleft = 8;
+    for (i = 0; i < r->srccnt; i++) {
+        r->repsources[i].mode = HEADER;
+        r->repsources[i].startptr = r->repsources[i].hdrbuff;
+        r->repsources[i].bytesleft = 8;
     }
-    if (rep_receive_all_packets(&r, RECVMSECTO) < 0) {
-        rep_cleanup(&r);
+    if (rep_receive_all_packets(r, RECVMSECTO) < 0) {
         return MFS_ERROR_DISCONNECTED;
     }
     // get # of blocks
-    blocks = 0;
-    for (i = 0; i < srccnt; i++) {
+    *blocks = 0;
+    for (i = 0; i < r->srccnt; i++) {
         uint32_t type, size;
         uint64_t pchid;
         uint32_t pver;
         uint16_t pblocks;
         uint8_t pstatus;
-        uint32_t ip;
-        rptr = r.repsources[i].hdrbuff;
+        repsrc* rs = r->repsources + i;
+        rptr = rs->hdrbuff;
         type = get32bit(&rptr);
         size = get32bit(&rptr);
-        rptr = r.repsources[i].packet;
-        ip = r.repsources[i].ip;
+        rptr = rs->packet;
         if (rptr == NULL || type != CSTOAN_CHUNK_BLOCKS || size != 15) {
-            syslog(LOG_WARNING, "replicator,get # of blocks: got wrong answer (type:0x%08" PRIX32 "/size:0x%08" PRIX32 ") from (%u.%u.%u.%u:%u)", type, size, (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-            rep_cleanup(&r);
+            syslog(LOG_WARNING, "replicator,get # of blocks: got wrong answer (type:0x%08" PRIX32 "/size:0x%08" PRIX32 ") from " REP_IPFMT, type, size, REP_IPARGS(rs));
             return MFS_ERROR_DISCONNECTED;
         }
         pchid = get64bit(&rptr);
         pver = get32bit(&rptr);
         pblocks = get16bit(&rptr);
         pstatus = get8bit(&rptr);
-        if (pchid != r.repsources[i].chunkid) {
-            syslog(LOG_WARNING, "replicator,get # of blocks: got wrong answer (chunk_status:chunkid:%" PRIX64 "/%" PRIX64 ") from (%u.%u.%u.%u:%u)", pchid, r.repsources[i].chunkid, (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-            rep_cleanup(&r);
+        if (pchid != rs->chunkid) {
+            syslog(LOG_WARNING, "replicator,get # of blocks: got wrong answer (chunk_status:chunkid:%" PRIX64 "/%" PRIX64 ") from " REP_IPFMT, pchid, rs->chunkid, REP_IPARGS(rs));
             return MFS_ERROR_WRONGCHUNKID;
         }
-        if (pver != r.repsources[i].version) {
-            syslog(LOG_WARNING, "replicator,get # of blocks: got wrong answer (chunk_status:version:%" PRIX32 "/%" PRIX32 ") from (%u.%u.%u.%u:%u)", pver, r.repsources[i].version, (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-            rep_cleanup(&r);
+        if (pver != rs->version) {
+            syslog(LOG_WARNING, "replicator,get # of blocks: got wrong answer (chunk_status:version:%" PRIX32 "/%" PRIX32 ") from " REP_IPFMT, pver, rs->version, REP_IPARGS(rs));
             return MFS_ERROR_WRONGVERSION;
         }
         if (pstatus != MFS_STATUS_OK) {
-            syslog(LOG_NOTICE, "replicator,get # of blocks: got status: %s from (%u.%u.%u.%u:%u)", mfsstrerr(pstatus), (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-            rep_cleanup(&r);
+            syslog(LOG_NOTICE, "replicator,get # of blocks: got status: %s from " REP_IPFMT, mfsstrerr(pstatus), REP_IPARGS(rs));
             return pstatus;
         }
-        r.repsources[i].blocks = pblocks;
-        if (pblocks > blocks) {
-            blocks = pblocks;
+        rs->blocks = pblocks;
+        if (pblocks > *blocks) {
+            *blocks = pblocks;
         }
     }
-    // create read request
-    for (i = 0; i < srccnt; i++) {
-        if (r.repsources[i].blocks > 0) {
+    return MFS_STATUS_OK;
+}
+
+/* asks every source with data for all its blocks */
+static uint8_t rep_send_read(replication* r)
+{
+    uint8_t i;
+    uint8_t* wptr;
+
+    for (i = 0; i < r->srccnt; i++) {
+        if (r->repsources[i].blocks > 0) {
             uint32_t leng;
-            wptr = rep_create_packet(r.repsources + i, CLTOCS_READ, 8 + 4 + 4 + 4);
+            wptr = rep_create_packet(r->repsources + i, CLTOCS_READ, 8 + 4 + 4 + 4);
             if (wptr == NULL) {
                 syslog(LOG_NOTICE, "replicator: out of memory");
-                rep_cleanup(&r);
                 return MFS_ERROR_OUTOFMEMORY;
             }
-            leng = r.repsources[i].blocks * MFSBLOCKSIZE;
-            put64bit(&wptr, r.repsources[i].chunkid);
-            put32bit(&wptr, r.repsources[i].version);
+            leng = r->repsources[i].blocks * MFSBLOCKSIZE;
+            put64bit(&wptr, r->repsources[i].chunkid);
+            put32bit(&wptr, r->repsources[i].version);
             put32bit(&wptr, 0);
             put32bit(&wptr, leng);
         } else {
-            rep_no_packet(r.repsources + i);
+            rep_no_packet(r->repsources + i);
         }
     }
     // send read request
-    if (rep_send_all_packets(&r, SENDMSECTO) < 0) {
-        rep_cleanup(&r);
+    if (rep_send_all_packets(r, SENDMSECTO) < 0) {
+        return MFS_ERROR_DISCONNECTED;
+    }
+    return MFS_STATUS_OK;
+}
+
+/* checks received packet of source - it has to be whole block b (data at packet+20, crc at packet+16) */
+static uint8_t rep_check_data(repsrc* rs, uint16_t b)
+{
+    uint32_t type, size;
+    uint64_t pchid;
+    uint16_t pblocknum;
+    uint16_t poffset;
+    uint32_t psize;
+    uint8_t pstatus;
+    const uint8_t* rptr;
+
+    rptr = rs->hdrbuff;
+    type = get32bit(&rptr);
+    size = get32bit(&rptr);
+    rptr = rs->packet;
+    if (rptr == NULL) {
         return MFS_ERROR_DISCONNECTED;
     }
+    if (type == CSTOCL_READ_STATUS && size == 9) {
+        pchid = get64bit(&rptr);
+        pstatus = get8bit(&rptr);
+        if (pchid != rs->chunkid) {
+            syslog(LOG_WARNING, "replicator,read chunks: got wrong answer (read_status:chunkid:%" PRIX64 "/%" PRIX64 ") from " REP_IPFMT, pchid, rs->chunkid, REP_IPARGS(rs));
+            return MFS_ERROR_WRONGCHUNKID;
+        }
+        if (pstatus == MFS_STATUS_OK) { // got status too early or got incorrect packet
+            syslog(LOG_WARNING, "replicator,read chunks: got unexpected ok status from " REP_IPFMT, REP_IPARGS(rs));
+            return MFS_ERROR_DISCONNECTED;
+        }
+        syslog(LOG_NOTICE, "replicator,read chunks: got status: %s from " REP_IPFMT, mfsstrerr(pstatus), REP_IPARGS(rs));
+        return pstatus;
+    } else if (type == CSTOCL_READ_DATA && size == 20 + MFSBLOCKSIZE) {
+        pchid = get64bit(&rptr);
+        pblocknum = get16bit(&rptr);
+        poffset = get16bit(&rptr);
+        psize = get32bit(&rptr);
+        if (pchid != rs->chunkid) {
+            syslog(LOG_WARNING, "replicator,read chunks: got wrong answer (read_data:chunkid:%" PRIX64 "/%" PRIX64 ") from " REP_IPFMT, pchid, rs->chunkid, REP_IPARGS(rs));
+            return MFS_ERROR_WRONGCHUNKID;
+        }
+        if (pblocknum != b) {
+            syslog(LOG_WARNING, "replicator,read chunks: got wrong answer (read_data:blocknum:%" PRIu16 "/%" PRIu16 ") from " REP_IPFMT, pblocknum, b, REP_IPARGS(rs));
+            return MFS_ERROR_DISCONNECTED;
+        }
+        if (poffset != 0) {
+            syslog(LOG_WARNING, "replicator,read chunks: got wrong answer (read_data:offset:%" PRIu16 ") from " REP_IPFMT, poffset, REP_IPARGS(rs));
+            return MFS_ERROR_WRONGOFFSET;
+        }
+        if (psize != MFSBLOCKSIZE) {
+            syslog(LOG_WARNING, "replicator,read chunks: got wrong answer (read_data:size:%" PRIu32 ") from " REP_IPFMT, psize, REP_IPARGS(rs));
+            return MFS_ERROR_WRONGSIZE;
+        }
+    } else {
+        syslog(LOG_WARNING, "replicator,read chunks: got wrong answer (type:0x%08" PRIX32 "/size:0x%08" PRIX32 ") from " REP_IPFMT, type, size, REP_IPARGS(rs));
+        return MFS_ERROR_DISCONNECTED;
+    }
+    return MFS_STATUS_OK;
+}
+
+/* checks crc of whole block received from source */
+static uint8_t rep_check_crc(repsrc* rs)
+{
+    const uint8_t* rptr;
+    uint32_t crc;
+
+    rptr = rs->packet + 16;
+    crc = get32bit(&rptr);
+    if (crc != mycrc32(0, rptr, MFSBLOCKSIZE)) {
+        syslog(LOG_WARNING, "replicator: received data with wrong checksum from " REP_IPFMT, REP_IPARGS(rs));
+        return MFS_ERROR_CRC;
+    }
+    return MFS_STATUS_OK;
+}
+
+/* receives final read status from every source that sent data */
+static uint8_t rep_check_status(replication* r)
+{
+    uint8_t i;
+    const uint8_t* rptr;
+
+    for (i = 0; i < r->srccnt; i++) {
+        if (r->repsources[i].blocks > 0) {
+            r->repsources[i].mode = HEADER;
+            r->repsources[i].startptr = r->repsources[i].hdrbuff;
+            r->repsources[i].bytesleft = 8;
+        } else {
+            r->repsources[i].mode = IDLE;
+            r->repsources[i].bytesleft = 0;
+        }
+    }
+    if (rep_receive_all_packets(r, RECVMSECTO) < 0) {
+        return MFS_ERROR_DISCONNECTED;
+    }
+    for (i = 0; i < r->srccnt; i++) {
+        if (r->repsources[i].blocks > 0) {
+            uint32_t type, size;
+            uint64_t pchid;
+            uint8_t pstatus;
+            repsrc* rs = r->repsources + i;
+            rptr = rs->hdrbuff;
+            type = get32bit(&rptr);
+            size = get32bit(&rptr);
+            rptr = rs->packet;
+            if (rptr == NULL || type != CSTOCL_READ_STATUS || size != 9) {
+                syslog(LOG_WARNING, "replicator,check status: got wrong answer (type:0x%08" PRIX32 "/size:0x%08" PRIX32 ") from " REP_IPFMT, type, size, REP_IPARGS(rs));
+                return MFS_ERROR_DISCONNECTED;
+            }
+            pchid = get64bit(&rptr);
+            pstatus = get8bit(&rptr);
+            if (pchid != rs->chunkid) {
+                syslog(LOG_WARNING, "replicator,check status: got wrong answer (read_status:chunkid:%" PRIX64 "/%" PRIX64 ") from " REP_IPFMT, pchid, rs->chunkid, REP_IPARGS(rs));
+                return MFS_ERROR_WRONGCHUNKID;
+            }
+            if (pstatus != MFS_STATUS_OK) {
+                syslog(LOG_NOTICE, "replicator,check status: got status: %s from " REP_IPFMT, mfsstrerr(pstatus), REP_IPARGS(rs));
+                return pstatus;
+            }
+        }
+    }
+    r->keepconns = 1;
+    return MFS_STATUS_OK;
+}
+
+/* close chunk and change version */
+static uint8_t rep_finish(replication* r)
+{
+    uint8_t status;
+
+    status = hdd_close(r->chunkid);
+    if (status != MFS_STATUS_OK) {
+        syslog(LOG_NOTICE, "replicator: hdd_close status: %s", mfsstrerr(status));
+        return status;
+    }
+    r->opened = 0;
+    status = hdd_version(r->chunkid, 0, r->version);
+    if (status != MFS_STATUS_OK) {
+        syslog(LOG_NOTICE, "replicator: hdd_version status: %s", mfsstrerr(status));
+        return status;
+    }
+    r->created = 0;
+    r->finished = 1;
+    return MFS_STATUS_OK;
+}
+
+/*
+ * takes window slots, creates and opens new chunk, connects to sources and asks them for number of blocks
+ * (r->srccnt and sources have to be set)
+ */
+static uint8_t rep_start(replication* r, uint16_t* blocks)
+{
+    uint8_t status;
+
+    status = rep_peers_acquire(r);
+    if (status != MFS_STATUS_OK) {
+        return status;
+    }
+    // create chunk
+    status = hdd_create(r->chunkid, 0);
+    if (status != MFS_STATUS_OK) {
+        syslog(LOG_NOTICE, "replicator: hdd_create status: %s", mfsstrerr(status));
+        return status;
+    }
+    r->created = 1;
+    // connect
+    status = rep_connect(r, 1);
+    if (status == MFS_STATUS_OK) {
+        status = rep_get_blocks(r, blocks);
+    }
+    if (status == MFS_ERROR_DISCONNECTED && r->pooled > 0) {
+        // pooled connection could have been closed by peer in the meantime - try once more with new connections
+        syslog(LOG_NOTICE, "replicator: pooled connection failed - reconnecting");
+        rep_disconnect(r);
+        status = rep_connect(r, 0);
+        if (status == MFS_STATUS_OK) {
+            status = rep_get_blocks(r, blocks);
+        }
+    }
+    if (status != MFS_STATUS_OK) {
+        return status;
+    }
+    // open chunk
+    status = hdd_open(r->chunkid, 0);
+    if (status != MFS_STATUS_OK) {
+        syslog(LOG_NOTICE, "replicator: hdd_open status: %s", mfsstrerr(status));
+        return status;
+    }
+    r->opened = 1;
+    return MFS_STATUS_OK;
+}
+
+static void rep_init(replication* r, uint64_t chunkid, uint32_t version, uint8_t srccnt)
+{
+    uint8_t i;
+
+    pthread_mutex_lock(&statslock);
+    stats_repl++;
+    pthread_mutex_unlock(&statslock);
+
+    r->chunkid = chunkid;
+    r->version = version;
+    r->srccnt = 0;
+    r->created = 0;
+    r->opened = 0;
+    r->finished = 0;
+    r->keepconns = 0;
+    r->pooled = 0;
+    r->startusec = monotonic_useconds();
+    r->xorbuff = NULL;
+    r->xorsrcs = NULL;
+    r->ecbuff = NULL;
+    r->fds = (pollfd*)malloc(sizeof(struct pollfd) * srccnt);
+    passert(r->fds);
+    r->repsources = (repsrc*)malloc(sizeof(repsrc) * srccnt);
+    passert(r->repsources);
+    for (i = 0; i < srccnt; i++) {
+        r->repsources[i].sock = -1;
+        r->repsources[i].packet = NULL;
+        r->repsources[i].peer = NULL;
+        r->repsources[i].pooled = 0;
+    }
+}
+
+/* srcs: srccnt * (chunkid:64 version:32 ip:32 port:16) */
+uint8_t replicate(uint64_t chunkid, uint32_t version, const uint32_t xormasks[4], uint8_t srccnt, const uint8_t* srcs)
+{
+    replication r;
+    uint8_t status, i, j, vbuffs;
+    uint32_t xcnt;
+    uint16_t b, blocks;
+    uint32_t xcrc[4], crc;
+    uint32_t codeindex, codeword;
+    uint8_t* wptr;
+    const uint8_t* rptr;
+
+    if (srccnt == 0) {
+        return MFS_ERROR_EINVAL;
+    }
+
+    syslog(LOG_NOTICE, "replication begin (chunkid:%08" PRIX64 ",version:%04" PRIX32 ",srccnt:%" PRIu8 ")", chunkid, version, srccnt);
+
+    // init replication structure
+    rep_init(&r, chunkid, version, srccnt);
+    if (srccnt > 1) {
+        r.xorbuff = (uint8_t*)malloc(MFSBLOCKSIZE + 4);
+        passert(r.xorbuff);
+        r.xorsrcs = (const uint8_t**)malloc(sizeof(const uint8_t*) * srccnt * 4);
+        passert(r.xorsrcs);
+    }
+    // init sources
+    r.srccnt = srccnt;
+    for (i = 0; i < srccnt; i++) {
+        r.repsources[i].chunkid = get64bit(&srcs);
+        r.repsources[i].version = get32bit(&srcs);
+        r.repsources[i].ip = get32bit(&srcs);
+        r.repsources[i].port = get16bit(&srcs);
+    }
+    status = rep_start(&r, &blocks);
+    if (status == MFS_STATUS_OK) {
+        status = rep_send_read(&r);
+    }
+    if (status != MFS_STATUS_OK) {
+        rep_cleanup(&r);
+        return status;
+    }
     // receive data and write to hdd
     for (b = 0; b < blocks; b++) {
         // prepare receive
@@ -645,67 +1117,10 @@ uint8_t replicate(uint64_t chunkid, uint32_t version, const uint32_t xormasks[4]
         vbuffs = 0;
         for (i = 0; i < srccnt; i++) {
             if (r.repsources[i].mode != IDLE) {
-                uint32_t type, size;
-                uint64_t pchid;
-                uint16_t pblocknum;
-                uint16_t poffset;
-                uint32_t psize;
-                uint8_t pstatus;
-                uint32_t ip;
-                rptr = r.repsources[i].hdrbuff;
-                type = get32bit(&rptr);
-                size = get32bit(&rptr);
-                rptr = r.repsources[i].packet;
-                ip = r.repsources[i].ip;
-                if (rptr == NULL) {
+                status = rep_check_data(r.repsources + i, b);
+                if (status != MFS_STATUS_OK) {
                     rep_cleanup(&r);
-                    return MFS_ERROR_DISCONNECTED;
-                }
-                if (type == CSTOCL_READ_STATUS && size == 9) {
-                    pchid = get64bit(&rptr);
-                    pstatus = get8bit(&rptr);
-                    if (pchid != r.repsources[i].chunkid) {
-                        syslog(LOG_WARNING, "replicator,read chunks: got wrong answer (read_status:chunkid:%" PRIX64 "/%" PRIX64 ") from (%u.%u.%u.%u:%u)", pchid, r.repsources[i].chunkid, (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-                        rep_cleanup(&r);
-                        return MFS_ERROR_WRONGCHUNKID;
-                    }
-                    if (pstatus == MFS_STATUS_OK) { // got status too early or got incorrect packet
-                        syslog(LOG_WARNING, "replicator,read chunks: got unexpected ok status from (%u.%u.%u.%u:%u)", (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-                        rep_cleanup(&r);
-                        return MFS_ERROR_DISCONNECTED;
-                    }
-                    syslog(LOG_NOTICE, "replicator,read chunks: got status: %s from (%u.%u.%u.%u:%u)", mfsstrerr(pstatus), (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-                    rep_cleanup(&r);
-                    return pstatus;
-                } else if (type == CSTOCL_READ_DATA && size == 20 + MFSBLOCKSIZE) {
-                    pchid = get64bit(&rptr);
-                    pblocknum = get16bit(&rptr);
-                    poffset = get16bit(&rptr);
-                    psize = get32bit(&rptr);
-                    if (pchid != r.repsources[i].chunkid) {
-                        syslog(LOG_WARNING, "replicator,read chunks: got wrong answer (read_data:chunkid:%" PRIX64 "/%" PRIX64 ") from (%u.%u.%u.%u:%u)", pchid, r.repsources[i].chunkid, (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-                        rep_cleanup(&r);
-                        return MFS_ERROR_WRONGCHUNKID;
-                    }
-                    if (pblocknum != b) {
-                        syslog(LOG_WARNING, "replicator,read chunks: got wrong answer (read_data:blocknum:%" PRIu16 "/%" PRIu16 ") from (%u.%u.%u.%u:%u)", pblocknum, b, (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-                        rep_cleanup(&r);
-                        return MFS_ERROR_DISCONNECTED;
-                    }
-                    if (poffset != 0) {
-                        syslog(LOG_WARNING, "replicator,read chunks: got wrong answer (read_data:offset:%" PRIu16 ") from (%u.%u.%u.%u:%u)", poffset, (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-                        rep_cleanup(&r);
-                        return MFS_ERROR_WRONGOFFSET;
-                    }
-                    if (psize != MFSBLOCKSIZE) {
-                        syslog(LOG_WARNING, "replicator,read chunks: got wrong answer (read_data:size:%" PRIu32 ") from (%u.%u.%u.%u:%u)", psize, (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-                        rep_cleanup(&r);
-                        return MFS_ERROR_WRONGSIZE;
-                    }
-                } else {
-                    syslog(LOG_WARNING, "replicator,read chunks: got wrong answer (type:0x%08" PRIX32 "/size:0x%08" PRIX32 ") from (%u.%u.%u.%u:%u)", type, size, (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-                    rep_cleanup(&r);
-                    return MFS_ERROR_DISCONNECTED;
+                    return status;
                 }
                 vbuffs++;
             }
@@ -737,9 +1152,7 @@ uint8_t replicate(uint64_t chunkid, uint32_t version, const uint32_t xormasks[4]
                         r.repsources[i].crcsums[j] = mycrc32(0, rptr + j * MFSBLOCKSIZE / 4, MFSBLOCKSIZE / 4);
                     }
                     if (crc != mycrc32_combine(mycrc32_combine(r.repsources[i].crcsums[0], r.repsources[i].crcsums[1], MFSBLOCKSIZE / 4), mycrc32_combine(r.repsources[i].crcsums[2], r.repsources[i].crcsums[3], MFSBLOCKSIZE / 4), MFSBLOCKSIZE / 2)) {
-                        uint32_t ip;
-                        ip = r.repsources[i].ip;
-                        syslog(LOG_WARNING, "replicator: received data with wrong checksum from (%u.%u.%u.%u:%u)", (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
+                        syslog(LOG_WARNING, "replicator: received data with wrong checksum from " REP_IPFMT, REP_IPARGS(r.repsources + i));
                         rep_cleanup(&r);
                         return MFS_ERROR_CRC;
                     }
@@ -748,24 +1161,27 @@ uint8_t replicate(uint64_t chunkid, uint32_t version, const uint32_t xormasks[4]
             crc = mycrc32_zeroblock(0, MFSBLOCKSIZE / 4);
             for (codeindex = 0; codeindex < 4; codeindex++) {
                 codeword = xormasks[codeindex];
-                first = 1;
+                xcnt = 0;
                 for (i = 0; i < srccnt; i++) {
                     for (j = 0; j < 4; j++) {
                         if (r.repsources[i].mode != IDLE && (codeword & UINT32_C(0x80000000))) {
                             rptr = r.repsources[i].packet;
                             rptr += 16;
-                            if (first) {
-                                memcpy(r.xorbuff + 4 + codeindex * MFSBLOCKSIZE / 4, rptr + 4 + j * MFSBLOCKSIZE / 4, MFSBLOCKSIZE / 4);
-                                first = 0;
+                            r.xorsrcs[xcnt] = rptr + 4 + j * MFSBLOCKSIZE / 4;
+                            if (xcnt == 0) {
                                 xcrc[codeindex] = r.repsources[i].crcsums[j];
                             } else {
-                                xordata(r.xorbuff + 4 + codeindex * MFSBLOCKSIZE / 4, rptr + 4 + j * MFSBLOCKSIZE / 4, MFSBLOCKSIZE / 4);
                                 xcrc[codeindex] ^= r.repsources[i].crcsums[j] ^ crc;
                             }
+                            xcnt++;
                         }
                         codeword >>= 1;
                     }
                 }
+                // all parts of this quarter in one pass (instead of copy + one pass per part)
+                if (xcnt > 0) {
+                    xorblock(r.xorbuff + 4 + codeindex * MFSBLOCKSIZE / 4, r.xorsrcs, xcnt, MFSBLOCKSIZE / 4);
+                }
             }
             crc = mycrc32_combine(mycrc32_combine(xcrc[0], xcrc[1], MFSBLOCKSIZE / 4), mycrc32_combine(xcrc[2], xcrc[3], MFSBLOCKSIZE / 4), MFSBLOCKSIZE / 2);
             wptr = r.xorbuff;
@@ -778,66 +1194,174 @@ uint8_t replicate(uint64_t chunkid, uint32_t version, const uint32_t xormasks[4]
             }
         }
     }
-    // receive status
+    status = rep_check_status(&r);
+    if (status == MFS_STATUS_OK) {
+        status = rep_finish(&r);
+    }
+    rep_cleanup(&r);
+    return status;
+}
+
+/*
+ * Builds Reed-Solomon part 'part' from k other parts (one block of every source per row) or from one full copy
+ * (k consecutive blocks per row). Every source block is crc checked before use and every written block gets its own
+ * crc, so the new part is verified the same way as any other chunk. Blocks that come out all zero are not written
+ * (chunk reads them as zeros anyway), so data parts built from a short chunk stay short.
+ * srcs: srccnt * (chunkid:64 version:32 ip:32 port:16 part:8)
+ */
+uint8_t replicate_ec(uint64_t chunkid, uint32_t version, uint8_t k, uint8_t m, uint8_t part, uint8_t srccnt, const uint8_t* srcs)
+{
+    replication r;
+    uint8_t srcpart[MFS_EC_MAX_DATA_PARTS + MFS_EC_MAX_PARITY_PARTS];
+    uint8_t avail[MFS_EC_MAX_DATA_PARTS];
+    uint8_t coefs[MFS_EC_MAX_DATA_PARTS];
+    const uint8_t* cols[MFS_EC_MAX_DATA_PARTS];
+    uint8_t status, i, q, pk, full, used;
+    uint16_t b, row, rows, blocks;
+    uint8_t *zeroblock, *wptr;
+    repsrc* rs;
+
+    if (k == 0 || k > MFS_EC_MAX_DATA_PARTS || m > MFS_EC_MAX_PARITY_PARTS || part >= k + m || srccnt == 0 || srccnt > k + m) {
+        return MFS_ERROR_EINVAL;
+    }
+    // choose sources
+    full = 0;
+    used = 0;
     for (i = 0; i < srccnt; i++) {
-        if (r.repsources[i].blocks > 0) {
-            r.repsources[i].mode = HEADER;
-            r.repsources[i].startptr = r.repsources[i].hdrbuff;
-            r.repsources[i].bytesleft = 8;
-        } else {
-            r.repsources[i].mode = IDLE;
-            r.repsources[i].bytesleft = 0;
+        srcpart[i] = srcs[i * 19 + 18];
+        if (srcpart[i] == MFS_EC_PART_FULL) {
+            full = 1;
+            used = 1;
+            srcs += i * 19;
+            break;
+        }
+    }
+    if (full) {
+        for (q = 0; q < k; q++) {
+            avail[q] = q;
+        }
+    } else {
+        if (srccnt < k) {
+            return MFS_ERROR_EINVAL;
         }
+        used = k; // any k parts are enough
+        for (i = 0; i < used; i++) {
+            if (srcpart[i] >= k + m || srcpart[i] == part) {
+                return MFS_ERROR_EINVAL;
+            }
+            avail[i] = srcpart[i];
+        }
+    }
+    if (gf256_rs_coefs(k, m, avail, part, coefs) < 0) { // some part is listed twice
+        return MFS_ERROR_EINVAL;
+    }
+
+    syslog(LOG_NOTICE, "replication begin (chunkid:%08" PRIX64 ",version:%04" PRIX32 ",ec:%" PRIu8 "+%" PRIu8 ",part:%" PRIu8 ",srccnt:%" PRIu8 "%s)", chunkid, version, k, m, part, used, full ? ",full copy" : "");
+
+    // init replication structure
+    rep_init(&r, chunkid, version, used);
+    r.xorbuff = (uint8_t*)malloc(MFSBLOCKSIZE + 4);
+    passert(r.xorbuff);
+    // full copy: k received blocks of a row ; always: one zero block for missing blocks
+    r.ecbuff = (uint8_t*)calloc((full ? k : 0) + 1, MFSBLOCKSIZE);
+    passert(r.ecbuff);
+    zeroblock = r.ecbuff + (full ? k : 0) * MFSBLOCKSIZE;
+    // init sources
+    r.srccnt = used;
+    for (i = 0; i < used; i++) {
+        r.repsources[i].chunkid = get64bit(&srcs);
+        r.repsources[i].version = get32bit(&srcs);
+        r.repsources[i].ip = get32bit(&srcs);
+        r.repsources[i].port = get16bit(&srcs);
+        srcs++; // part
     }
-    if (rep_receive_all_packets(&r, RECVMSECTO) < 0) {
+    status = rep_start(&r, &blocks);
+    if (status == MFS_STATUS_OK) {
+        status = rep_send_read(&r);
+    }
+    if (status != MFS_STATUS_OK) {
         rep_cleanup(&r);
-        return MFS_ERROR_DISCONNECTED;
+        return status;
     }
-    for (i = 0; i < srccnt; i++) {
-        if (r.repsources[i].blocks > 0) {
-            uint32_t type, size;
-            uint64_t pchid;
-            uint8_t pstatus;
-            uint32_t ip;
-            rptr = r.repsources[i].hdrbuff;
-            type = get32bit(&rptr);
-            size = get32bit(&rptr);
-            rptr = r.repsources[i].packet;
-            ip = r.repsources[i].ip;
-            if (rptr == NULL || type != CSTOCL_READ_STATUS || size != 9) {
-                syslog(LOG_WARNING, "replicator,check status: got wrong answer (type:0x%08" PRIX32 "/size:0x%08" PRIX32 ") from (%u.%u.%u.%u:%u)", type, size, (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-                rep_cleanup(&r);
-                return MFS_ERROR_DISCONNECTED;
+    rows = full ? gf256_rs_stripe_rows(k, blocks) : blocks;
+    for (row = 0; row < rows; row++) {
+        if (full) {
+            rs = r.repsources;
+            b = gf256_rs_stripe_block(k, 0, row); // first block of this row
+            pk = (rs->blocks - b < k) ? rs->blocks - b : k;
+            for (q = 0; q < k; q++) {
+                cols[q] = zeroblock;
             }
-            pchid = get64bit(&rptr);
-            pstatus = get8bit(&rptr);
-            if (pchid != r.repsources[i].chunkid) {
-                syslog(LOG_WARNING, "replicator,check status: got wrong answer (read_status:chunkid:%" PRIX64 "/%" PRIX64 ") from (%u.%u.%u.%u:%u)", pchid, r.repsources[i].chunkid, (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
-                rep_cleanup(&r);
-                return MFS_ERROR_WRONGCHUNKID;
+            for (q = 0; q < pk; q++) {
+                b = gf256_rs_stripe_block(k, q, row);
+                rs->mode = HEADER;
+                rs->startptr = rs->hdrbuff;
+                rs->bytesleft = 8;
+                if (rep_receive_all_packets(&r, RECVMSECTO) < 0) {
+                    rep_cleanup(&r);
+                    return MFS_ERROR_DISCONNECTED;
+                }
+                status = rep_check_data(rs, b);
+                if (status == MFS_STATUS_OK) {
+                    status = rep_check_crc(rs);
+                }
+                if (status != MFS_STATUS_OK) {
+                    rep_cleanup(&r);
+                    return status;
+                }
+                // packet buffer is reused for next block
+                memcpy(r.ecbuff + q * MFSBLOCKSIZE, rs->packet + 20, MFSBLOCKSIZE);
+                cols[q] = r.ecbuff + q * MFSBLOCKSIZE;
             }
-            if (pstatus != MFS_STATUS_OK) {
-                syslog(LOG_NOTICE, "replicator,check status: got status: %s from (%u.%u.%u.%u:%u)", mfsstrerr(pstatus), (ip >> 24) & 0xFF, (ip >> 16) & 0xFF, (ip >> 8) & 0xFF, ip & 0xFF, r.repsources[i].port);
+        } else {
+            for (i = 0; i < used; i++) {
+                rs = r.repsources + i;
+                if (row < rs->blocks) {
+                    rs->mode = HEADER;
+                    rs->startptr = rs->hdrbuff;
+                    rs->bytesleft = 8;
+                } else {
+                    rs->mode = IDLE;
+                    rs->bytesleft = 0;
+                }
+            }
+            if (rep_receive_all_packets(&r, RECVMSECTO) < 0) {
                 rep_cleanup(&r);
-                return pstatus;
+                return MFS_ERROR_DISCONNECTED;
+            }
+            for (i = 0; i < used; i++) {
+                rs = r.repsources + i;
+                cols[i] = zeroblock;
+                if (rs->mode != IDLE) {
+                    status = rep_check_data(rs, row);
+                    if (status == MFS_STATUS_OK) {
+                        status = rep_check_crc(rs);
+                    }
+                    if (status != MFS_STATUS_OK) {
+                        rep_cleanup(&r);
+                        return status;
+                    }
+                    cols[i] = rs->packet + 20;
+                }
             }
         }
+        gf256_region(r.xorbuff + 4, cols, coefs, k, MFSBLOCKSIZE);
+        if (r.xorbuff[4] == 0 && memcmp(r.xorbuff + 4, zeroblock, MFSBLOCKSIZE) == 0) {
+            continue;
+        }
+        wptr = r.xorbuff;
+        put32bit(&wptr, mycrc32(0, r.xorbuff + 4, MFSBLOCKSIZE));
+        status = hdd_write(chunkid, 0, row, r.xorbuff + 4, 0, MFSBLOCKSIZE, r.xorbuff);
+        if (status != MFS_STATUS_OK) {
+            syslog(LOG_WARNING, "replicator: ec write status: %s", mfsstrerr(status));
+            rep_cleanup(&r);
+            return status;
+        }
     }
-    // close chunk and change version
-    status = hdd_close(chunkid);
-    if (status != MFS_STATUS_OK) {
-        syslog(LOG_NOTICE, "replicator: hdd_close status: %s", mfsstrerr(status));
-        rep_cleanup(&r);
-        return status;
-    }
-    r.opened = 0;
-    status = hdd_version(chunkid, 0, version);
-    if (status != MFS_STATUS_OK) {
-        syslog(LOG_NOTICE, "replicator: hdd_version status: %s", mfsstrerr(status));
-        rep_cleanup(&r);
-        return status;
+    status = rep_check_status(&r);
+    if (status == MFS_STATUS_OK) {
+        status = rep_finish(&r);
     }
-    r.created = 0;
     rep_cleanup(&r);
-    return MFS_STATUS_OK;
+    return status;
 }
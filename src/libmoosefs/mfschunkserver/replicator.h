@@ -23,8 +23,15 @@
 
 #include <inttypes.h>
 
-void replicator_stats(uint64_t *bin,uint64_t *bout,uint32_t *repl);
+void replicator_stats(uint64_t *bin,uint64_t *bout,uint32_t *repl,uint32_t *replok,uint32_t *connreused,uint32_t *connnew,uint64_t *replusec);
+/* replications streaming from peers and replications waiting for a window slot */
+void replicator_window_stats(uint32_t *inflight,uint32_t *waiting);
+/* window: replications streaming from one peer at a time ; mbps: bandwidth limit of all replications (0 - unlimited) */
+void replicator_set_limits(uint32_t window,uint32_t mbps);
+void replicator_get_limits(uint32_t *window,uint32_t *mbps);
 /* srcs: srccnt * (chunkid:64 version:32 ip:32 port:16) */
 uint8_t replicate(uint64_t chunkid,uint32_t version,const uint32_t xormasks[4],uint8_t srccnt,const uint8_t *srcs);
+/* Reed-Solomon k+m part ; srcs: srccnt * (chunkid:64 version:32 ip:32 port:16 part:8) */
+uint8_t replicate_ec(uint64_t chunkid,uint32_t version,uint8_t k,uint8_t m,uint8_t part,uint8_t srccnt,const uint8_t *srcs);
 
 #endif
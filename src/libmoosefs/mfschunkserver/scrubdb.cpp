@@ -0,0 +1,100 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc.h"
+#include "datapack.h"
+#include "massert.h"
+#include "scrubdb.h"
+
+/* '.scrubdb' - verification state of chunks (scrubbing resumes from it after restart):
+ * "MFS SCRUBDB2" ; count:32
+ * count * ( chunkid:64 ; version:32 ; testtime:32 ; digestvalid:8 ; digest:256 ) - sorted by chunkid
+ * crc:32 (of all preceding bytes)
+ * version 1 had 128-bit (md5) digests - such files are treated as damaged */
+#define SCRUBDB_SIGNATURE "MFS SCRUBDB2"
+#define SCRUBDB_HDRSIZE (12 + 4)
+#define SCRUBDB_RECSIZE (8 + 4 + 4 + 1 + CHUNKDIGEST_SIZE)
+
+static int scrubdb_rec_cmp(const void* a, const void* b)
+{
+    const scrubrec* ra = (const scrubrec*)a;
+    const scrubrec* rb = (const scrubrec*)b;
+    return (ra->chunkid < rb->chunkid) ? -1 : (ra->chunkid > rb->chunkid) ? 1 : 0;
+}
+
+uint8_t* scrubdb_encode(scrubrec* recs, uint32_t count, uint64_t* leng)
+{
+    uint8_t *buff, *wptr;
+    uint32_t i;
+
+    qsort(recs, count, sizeof(scrubrec), scrubdb_rec_cmp);
+    *leng = SCRUBDB_HDRSIZE + (uint64_t)count * SCRUBDB_RECSIZE + 4;
+    buff = (uint8_t*)malloc(*leng);
+    passert(buff);
+    wptr = buff;
+    memcpy(wptr, SCRUBDB_SIGNATURE, 12);
+    wptr += 12;
+    put32bit(&wptr, count);
+    for (i = 0; i < count; i++) {
+        put64bit(&wptr, recs[i].chunkid);
+        put32bit(&wptr, recs[i].version);
+        put32bit(&wptr, recs[i].testtime);
+        put8bit(&wptr, recs[i].digestvalid);
+        memcpy(wptr, recs[i].digest, CHUNKDIGEST_SIZE);
+        wptr += CHUNKDIGEST_SIZE;
+    }
+    put32bit(&wptr, mycrc32(0, buff, *leng - 4));
+    return buff;
+}
+
+scrubrec* scrubdb_decode(const uint8_t* buff, uint64_t leng, uint32_t* count)
+{
+    const uint8_t* rptr;
+    scrubrec* recs;
+    uint32_t i, cnt, crc;
+
+    *count = 0;
+    if (leng < SCRUBDB_HDRSIZE + 4 || memcmp(buff, SCRUBDB_SIGNATURE, 12) != 0) {
+        return NULL;
+    }
+    rptr = buff + 12;
+    cnt = get32bit(&rptr);
+    rptr = buff + leng - 4;
+    crc = get32bit(&rptr);
+    if (SCRUBDB_HDRSIZE + (uint64_t)cnt * SCRUBDB_RECSIZE + 4 != leng || crc != mycrc32(0, buff, leng - 4)) {
+        return NULL;
+    }
+    recs = (scrubrec*)malloc(sizeof(scrubrec) * (cnt + 1));
+    passert(recs);
+    rptr = buff + SCRUBDB_HDRSIZE;
+    for (i = 0; i < cnt; i++) {
+        recs[i].chunkid = get64bit(&rptr);
+        recs[i].version = get32bit(&rptr);
+        recs[i].testtime = get32bit(&rptr);
+        recs[i].digestvalid = get8bit(&rptr);
+        memcpy(recs[i].digest, rptr, CHUNKDIGEST_SIZE);
+        rptr += CHUNKDIGEST_SIZE;
+        if (i > 0 && recs[i - 1].chunkid >= recs[i].chunkid) { // not sorted - lookups would fail
+            free(recs);
+            return NULL;
+        }
+    }
+    *count = cnt;
+    return recs;
+}
+
+const scrubrec* scrubdb_find(const scrubrec* recs, uint32_t count, uint64_t chunkid)
+{
+    scrubrec key;
+
+    if (count == 0) {
+        return NULL;
+    }
+    key.chunkid = chunkid;
+    return (const scrubrec*)bsearch(&key, recs, count, sizeof(scrubrec), scrubdb_rec_cmp);
+}
@@ -0,0 +1,30 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _SCRUBDB_H_
+#define _SCRUBDB_H_
+
+#include <inttypes.h>
+
+#include "chunkdigest.h"
+
+/* verification state of one chunk, kept in '.scrubdb' of its folder */
+typedef struct scrubrec {
+    uint64_t chunkid;
+    uint32_t version;
+    uint32_t testtime;
+    uint8_t digestvalid;
+    uint8_t digest[CHUNKDIGEST_SIZE];
+} scrubrec;
+
+/* sorts recs by chunkid and returns malloc'ed '.scrubdb' image (its size in *leng) */
+uint8_t* scrubdb_encode(scrubrec* recs, uint32_t count, uint64_t* leng);
+
+/* returns malloc'ed records sorted by chunkid - NULL and *count==0 when image is damaged (or has old format) */
+scrubrec* scrubdb_decode(const uint8_t* buff, uint64_t leng, uint32_t* count);
+
+/* record of given chunk in decoded (sorted) records or NULL */
+const scrubrec* scrubdb_find(const scrubrec* recs, uint32_t count, uint64_t chunkid);
+
+#endif
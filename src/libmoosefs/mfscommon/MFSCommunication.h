@@ -824,6 +824,16 @@
 #define CSTOMA_CHUNKOP (PROTO_BASE+153)
 // chunkid:64 version:32 newversion:32 copychunkid:64 copyversion:32 length:32 status:8
 
+// 0x009A
+#define MATOCS_REPLICATE_EC (PROTO_BASE+154)
+// build Reed-Solomon part 'part' (k data parts, m parity parts) of chunk from any k other parts (or one full copy)
+// data part i holds chunk blocks i, i+k, i+2k, ... ; parity parts are combinations of data part blocks with the same index
+// chunkid:64 version:32 k:8 m:8 part:8 N * [ chunkid:64 version:32 ip:32 port:16 part:8 ] (part==MFS_EC_PART_FULL - full copy)
+// answer: CSTOMA_REPLICATE
+#define MFS_EC_MAX_DATA_PARTS 32
+#define MFS_EC_MAX_PARITY_PARTS 32
+#define MFS_EC_PART_FULL 0xFF
+
 
 // 0x00A0
 #define MATOCS_TRUNCATE (PROTO_BASE+160)
@@ -18,9 +18,26 @@
  * or visit http://www.gnu.org/licenses/gpl-2.0.html
  */
 
+#if defined(HAVE_CONFIG_H)
+#include <config/dash-config.h>
+#endif
+
 #include "MFSCommunication.h"
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(ENABLE_ARM_CRC) && defined(__aarch64__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "crc.h"
+#include "massert.h"
 
 #define FASTCRC 1
 
@@ -76,7 +93,17 @@ void crc_generate_main_tables(void)
 #endif
 }
 
-uint32_t mycrc32(uint32_t crc, const uint8_t* block, uint32_t leng)
+/* hardware folding kernels - they take the raw (inverted) crc register */
+uint32_t mycrc32_fold_clmul(uint32_t crc, const uint8_t* block, uint32_t leng);
+uint32_t mycrc32_fold_vpclmul(uint32_t crc, const uint8_t* block, uint32_t leng);
+uint32_t mycrc32_fold_arm(uint32_t crc, const uint8_t* block, uint32_t leng);
+
+static uint32_t (*crc_fold)(uint32_t crc, const uint8_t* block, uint32_t leng) = NULL;
+static uint32_t crc_fold_minleng = 0; // kernel is used only for at least this many bytes
+static uint32_t crc_fold_mask = 0; // and only for a multiple of (mask+1) bytes
+static const char* crc_impl_name = "standard";
+
+uint32_t mycrc32_generic(uint32_t crc, const uint8_t* block, uint32_t leng)
 {
 #ifdef FASTCRC
     const uint32_t* block4;
@@ -157,6 +184,112 @@ uint32_t mycrc32(uint32_t crc, const uint8_t* block, uint32_t leng)
 #endif
 }
 
+uint32_t mycrc32(uint32_t crc, const uint8_t* block, uint32_t leng)
+{
+    uint32_t fleng;
+    if (crc_fold != NULL && leng >= crc_fold_minleng) {
+        fleng = leng & ~crc_fold_mask;
+        crc = crc_fold(crc ^ 0xFFFFFFFF, block, fleng) ^ 0xFFFFFFFF;
+        if (fleng == leng) {
+            return crc;
+        }
+        block += fleng;
+        leng -= fleng;
+    }
+    return mycrc32_generic(crc, block, leng);
+}
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+static inline void crc_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d)
+{
+    __cpuid_count(leaf, subleaf, *a, *b, *c, *d);
+}
+
+/* OS saves ZMM/YMM/XMM state (XCR0 bits 1,2,5,6,7) */
+static inline int crc_avx512_enabled(void)
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 0xE6) == 0xE6;
+}
+#endif
+
+static int crc_selftest(void)
+{
+    uint8_t buff[1024 + 13];
+    uint32_t i, leng;
+    for (i = 0; i < sizeof(buff); i++) {
+        buff[i] = (uint8_t)(i * 131 + (i >> 7));
+    }
+    for (leng = 0; leng <= sizeof(buff) - 13; leng += 61) {
+        for (i = 0; i < 13; i += 4) {
+            if (mycrc32(0x12345678, buff + i, leng) != mycrc32_generic(0x12345678, buff + i, leng)) {
+                return 0;
+            }
+        }
+    }
+    /* "123456789" check value */
+    return mycrc32(0, (const uint8_t*)"123456789", 9) == 0xCBF43926;
+}
+
+const char* mycrc32_autodetect(void)
+{
+    crc_fold = NULL;
+    crc_impl_name = "standard";
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    int have_clmul, have_sse41, have_vpclmul;
+
+    crc_cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    have_clmul = (ecx >> 1) & 1;
+    have_sse41 = (ecx >> 19) & 1;
+    have_vpclmul = 0;
+    if (((ecx >> 27) & 1) && crc_avx512_enabled()) { // osxsave
+        crc_cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+        // vpclmulqdq + avx512f + avx512vl
+        have_vpclmul = ((ecx >> 10) & 1) && ((ebx >> 16) & 1) && ((ebx >> 31) & 1);
+    }
+    (void)have_clmul;
+    (void)have_sse41;
+    (void)have_vpclmul;
+#if defined(ENABLE_CLMUL)
+    if (have_clmul && have_sse41) {
+        crc_fold = mycrc32_fold_clmul;
+        crc_fold_minleng = 64;
+        crc_fold_mask = 15;
+        crc_impl_name = "pclmulqdq";
+    }
+#endif
+#if defined(ENABLE_VPCLMUL)
+    if (have_clmul && have_sse41 && have_vpclmul) {
+        crc_fold = mycrc32_fold_vpclmul;
+        crc_fold_minleng = 256;
+        crc_fold_mask = 15;
+        crc_impl_name = "vpclmulqdq";
+    }
+#endif
+#endif
+#if defined(__linux__) && defined(ENABLE_ARM_CRC) && defined(__aarch64__)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+        crc_fold = mycrc32_fold_arm;
+        crc_fold_minleng = 0;
+        crc_fold_mask = 0;
+        crc_impl_name = "armv8-crc32";
+    }
+#endif
+    if (crc_fold != NULL && crc_selftest() == 0) {
+        syslog(LOG_WARNING, "crc32: %s implementation failed self test - using standard one", crc_impl_name);
+        crc_fold = NULL;
+        crc_impl_name = "standard";
+    }
+    return crc_impl_name;
+}
+
+const char* mycrc32_implementation(void)
+{
+    return crc_impl_name;
+}
+
 /* crc_combine */
 
 static uint32_t crc_combine_table[32][4][256];
@@ -237,4 +370,5 @@ void mycrc32_init(void)
 {
     crc_generate_main_tables();
     crc_generate_combine_tables();
+    mycrc32_autodetect();
 }
@@ -23,11 +23,15 @@
 #include <inttypes.h>
 
 uint32_t mycrc32(uint32_t crc,const uint8_t *block,uint32_t leng);
+uint32_t mycrc32_generic(uint32_t crc,const uint8_t *block,uint32_t leng);
 uint32_t mycrc32_combine(uint32_t crc1, uint32_t crc2, uint32_t leng2);
 #define mycrc32_zeroblock(crc,zeros) mycrc32_combine((crc)^0xFFFFFFFF,0xFFFFFFFF,(zeros))
 #define mycrc32_zeroexpanded(crc,block,leng,zeros) mycrc32_zeroblock(mycrc32((crc),(block),(leng)),(zeros))
 #define mycrc32_xorblocks(crc,crcblock1,crcblock2,leng) ((crcblock1)^(crcblock2)^mycrc32_zeroblock(crc,leng))
 
 void mycrc32_init(void);
+/* select the fastest available implementation (called by mycrc32_init) - returns its name */
+const char* mycrc32_autodetect(void);
+const char* mycrc32_implementation(void);
 
 #endif
@@ -0,0 +1,47 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// CRC-32 (bit-reflected 0xEDB88320) with the ARMv8 CRC32 instructions.
+
+#ifdef ENABLE_ARM_CRC
+
+#include <arm_acle.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* 'crc' is the raw (pre-inverted) register; any length */
+uint32_t mycrc32_fold_arm(uint32_t crc, const uint8_t* block, uint32_t leng)
+{
+    uint64_t d0, d1, d2, d3;
+
+    while (leng && ((uintptr_t)block & 7)) {
+        crc = __crc32b(crc, *block++);
+        leng--;
+    }
+    while (leng >= 32) {
+        memcpy(&d0, block, 8);
+        memcpy(&d1, block + 8, 8);
+        memcpy(&d2, block + 16, 8);
+        memcpy(&d3, block + 24, 8);
+        crc = __crc32d(crc, d0);
+        crc = __crc32d(crc, d1);
+        crc = __crc32d(crc, d2);
+        crc = __crc32d(crc, d3);
+        block += 32;
+        leng -= 32;
+    }
+    while (leng >= 8) {
+        memcpy(&d0, block, 8);
+        crc = __crc32d(crc, d0);
+        block += 8;
+        leng -= 8;
+    }
+    while (leng) {
+        crc = __crc32b(crc, *block++);
+        leng--;
+    }
+    return crc;
+}
+
+#endif
@@ -0,0 +1,89 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Folding CRC-32 (bit-reflected 0xEDB88320) with VPCLMULQDQ on 512-bit registers.
+// Four ZMM accumulators fold 256 bytes per iteration, then the state is narrowed
+// to 128 bits and finished exactly like the PCLMULQDQ variant.
+
+#ifdef ENABLE_VPCLMUL
+
+#include <inttypes.h>
+#include <immintrin.h>
+
+/* 'crc' is the raw (pre-inverted) register; leng >= 256 and a multiple of 16 */
+uint32_t mycrc32_fold_vpclmul(uint32_t crc, const uint8_t* block, uint32_t leng)
+{
+    /* x^(2048+32), x^(2048-32) - fold distance of four ZMM registers */
+    const __m512i k2048 = _mm512_broadcast_i32x4(_mm_set_epi64x(0x01322d1430, 0x011542778a));
+    /* x^(512+32), x^(512-32) - fold distance of one ZMM register */
+    const __m512i k512 = _mm512_broadcast_i32x4(_mm_set_epi64x(0x01c6e41596, 0x0154442bd4));
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m512i z0, z1, z2, z3;
+    __m128i x1, x2, x5;
+
+    z0 = _mm512_loadu_si512((const void*)(block + 0x00));
+    z1 = _mm512_loadu_si512((const void*)(block + 0x40));
+    z2 = _mm512_loadu_si512((const void*)(block + 0x80));
+    z3 = _mm512_loadu_si512((const void*)(block + 0xC0));
+    z0 = _mm512_xor_si512(z0, _mm512_zextsi128_si512(_mm_cvtsi32_si128(crc)));
+    block += 256;
+    leng -= 256;
+
+    while (leng >= 256) {
+        z0 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z0, k2048, 0x00), _mm512_clmulepi64_epi128(z0, k2048, 0x11), _mm512_loadu_si512((const void*)(block + 0x00)), 0x96);
+        z1 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z1, k2048, 0x00), _mm512_clmulepi64_epi128(z1, k2048, 0x11), _mm512_loadu_si512((const void*)(block + 0x40)), 0x96);
+        z2 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z2, k2048, 0x00), _mm512_clmulepi64_epi128(z2, k2048, 0x11), _mm512_loadu_si512((const void*)(block + 0x80)), 0x96);
+        z3 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z3, k2048, 0x00), _mm512_clmulepi64_epi128(z3, k2048, 0x11), _mm512_loadu_si512((const void*)(block + 0xC0)), 0x96);
+        block += 256;
+        leng -= 256;
+    }
+
+    /* 4x512 -> 512 bits */
+    z0 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z0, k512, 0x00), _mm512_clmulepi64_epi128(z0, k512, 0x11), z1, 0x96);
+    z0 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z0, k512, 0x00), _mm512_clmulepi64_epi128(z0, k512, 0x11), z2, 0x96);
+    z0 = _mm512_ternarylogic_epi64(_mm512_clmulepi64_epi128(z0, k512, 0x00), _mm512_clmulepi64_epi128(z0, k512, 0x11), z3, 0x96);
+
+    /* 512 -> 128 bits (lanes in memory order) */
+    x1 = _mm512_extracti32x4_epi32(z0, 0);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_ternarylogic_epi64(x1, x5, _mm512_extracti32x4_epi32(z0, 1), 0x96);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_ternarylogic_epi64(x1, x5, _mm512_extracti32x4_epi32(z0, 2), 0x96);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_ternarylogic_epi64(x1, x5, _mm512_extracti32x4_epi32(z0, 3), 0x96);
+
+    /* remaining 16 byte blocks */
+    while (leng >= 16) {
+        x2 = _mm_loadu_si128((const __m128i*)block);
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        block += 16;
+        leng -= 16;
+    }
+
+    /* 128 -> 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x2 = _mm_and_si128(x1, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+    x2 = _mm_and_si128(x2, mask32);
+    x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return _mm_extract_epi32(x1, 1);
+}
+
+#endif
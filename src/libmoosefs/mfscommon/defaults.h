@@ -17,18 +17,30 @@ const int32_t HDD_RR_CHUNK_COUNT = 10000;
 const int32_t NICE_LEVEL = -19;
 const uint32_t CHUNKS_PER_REGISTER_PACKET = 10000;
 const uint32_t FILE_UMASK = 0x027;
+const uint32_t HDD_CHUNKDB_DUMP_PERIOD = 600;
 const uint32_t HDD_ERROR_TOLERANCE_COUNT = 2;
 const uint32_t HDD_ERROR_TOLERANCE_PERIOD = 600;
+const uint32_t HDD_FSYNC_GROUP_INTERVAL = 500;
 const uint32_t HDD_HIGH_SPEED_REBALANCE_LIMIT = 0;
+const uint32_t HDD_IO_URING_ENTRIES = 256;
 const uint32_t HDD_LEAVE_SPACE_DEFAULT = 0x40000000;
 const uint32_t HDD_MIN_TEST_INTERVAL = 86400;
 const uint32_t HDD_REBALANCE_UTILIZATION = 20;
+const uint32_t HDD_SCHED_BACKGROUND_MBPS = 256;
+const uint32_t HDD_SCHED_CLIENT_LATENCY_TARGET = 50;
+const uint32_t HDD_SCRUBDB_DUMP_PERIOD = 300;
+const uint32_t JOB_QUEUE_WAIT_TARGET = 20;
 const uint32_t MASTER_RECONNECTION_DELAY = 2;
 const uint32_t MASTER_TIMEOUT = 0;
+const uint32_t REPLICATION_BANDWIDTH_MBPS = 0;
+const uint32_t REPLICATION_WINDOW = 8;
 const uint32_t WORKERS_MAX = 250;
 const uint32_t WORKERS_MAX_IDLE = 40;
+const uint32_t WORKERS_MIN = 16;
+const uint64_t HDD_BLOCK_CACHE_SIZE = 0x10000000;
 const uint8_t HDD_FSYNC_BEFORE_CLOSE = 0;
 const uint8_t HDD_SPARSIFY_ON_WRITE = 1;
+const uint8_t HDD_USE_IO_URING = 1;
 const uint8_t LIMIT_GLIBC_MALLOC_ARENAS = 4;
 
 #endif // MFSCOMMON_DEFAULTS_H
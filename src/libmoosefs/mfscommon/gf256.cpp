@@ -0,0 +1,355 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// GF(2^8) arithmetic (polynomial 0x11D) used by Reed-Solomon chunk parts.
+// SIMD kernels multiply 16/32 bytes at once with two 16-entry lookups
+// (low and high nibble of every byte), so a product costs two shuffles
+// and a xor instead of a table load per byte.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/dash-config.h>
+#endif
+
+#include <inttypes.h>
+#include <string.h>
+#include <syslog.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "gf256.h"
+
+#if defined(ENABLE_AVX2)
+void gf256_region_avx2(uint8_t* dst, const uint8_t* const* srcs, const uint8_t (*tabs)[32], uint32_t cnt, uint32_t leng);
+#endif
+
+typedef void (*gf256_fn)(uint8_t* dst, const uint8_t* const* srcs, const uint8_t* coefs, uint32_t cnt, uint32_t leng);
+
+static uint8_t gf_exp[512];
+static uint8_t gf_log[256];
+static uint8_t gf_multab[256][256];
+
+static gf256_fn gf_impl = gf256_region_generic;
+static const char* gf_impl_name = "standard";
+
+uint8_t gf256_mul(uint8_t a, uint8_t b)
+{
+    return gf_multab[a][b];
+}
+
+uint8_t gf256_inv(uint8_t a)
+{
+    if (a == 0) {
+        return 0;
+    }
+    return gf_exp[255 - gf_log[a]];
+}
+
+/* tabs[i][0..15] = coefs[i]*x, tabs[i][16..31] = coefs[i]*(x<<4) */
+static inline void gf256_nibble_tables(uint8_t (*tabs)[32], const uint8_t* coefs, uint32_t cnt)
+{
+    uint32_t i, x;
+    for (i = 0; i < cnt; i++) {
+        for (x = 0; x < 16; x++) {
+            tabs[i][x] = gf_multab[coefs[i]][x];
+            tabs[i][16 + x] = gf_multab[coefs[i]][x << 4];
+        }
+    }
+}
+
+void gf256_region_generic(uint8_t* dst, const uint8_t* const* srcs, const uint8_t* coefs, uint32_t cnt, uint32_t leng)
+{
+    uint8_t acc[64];
+    const uint8_t* row;
+    const uint8_t* s;
+    uint32_t off, i, j, l;
+
+    off = 0;
+    while (off < leng) {
+        l = (leng - off < 64) ? leng - off : 64;
+        row = gf_multab[coefs[0]];
+        s = srcs[0] + off;
+        for (j = 0; j < l; j++) {
+            acc[j] = row[s[j]];
+        }
+        for (i = 1; i < cnt; i++) {
+            row = gf_multab[coefs[i]];
+            s = srcs[i] + off;
+            for (j = 0; j < l; j++) {
+                acc[j] ^= row[s[j]];
+            }
+        }
+        memcpy(dst + off, acc, l);
+        off += l;
+    }
+}
+
+#if defined(__aarch64__)
+/* NEON is part of the base ARMv8-A instruction set - no runtime check needed */
+static void gf256_region_neon(uint8_t* dst, const uint8_t* const* srcs, const uint8_t* coefs, uint32_t cnt, uint32_t leng)
+{
+    uint8_t tabs[GF256_MAX_SOURCES][32];
+    uint8x16_t lo, hi, a0, a1, v, mask;
+    uint32_t off, i;
+    const uint8_t* s;
+    uint8_t b;
+
+    gf256_nibble_tables(tabs, coefs, cnt);
+    mask = vdupq_n_u8(0x0F);
+    off = 0;
+    while (off + 32 <= leng) {
+        a0 = vdupq_n_u8(0);
+        a1 = vdupq_n_u8(0);
+        for (i = 0; i < cnt; i++) {
+            s = srcs[i] + off;
+            lo = vld1q_u8(tabs[i]);
+            hi = vld1q_u8(tabs[i] + 16);
+            v = vld1q_u8(s);
+            a0 = veorq_u8(a0, veorq_u8(vqtbl1q_u8(lo, vandq_u8(v, mask)), vqtbl1q_u8(hi, vshrq_n_u8(v, 4))));
+            v = vld1q_u8(s + 16);
+            a1 = veorq_u8(a1, veorq_u8(vqtbl1q_u8(lo, vandq_u8(v, mask)), vqtbl1q_u8(hi, vshrq_n_u8(v, 4))));
+        }
+        vst1q_u8(dst + off, a0);
+        vst1q_u8(dst + off + 16, a1);
+        off += 32;
+    }
+    while (off < leng) {
+        b = 0;
+        for (i = 0; i < cnt; i++) {
+            b ^= tabs[i][srcs[i][off] & 0x0F] ^ tabs[i][16 + (srcs[i][off] >> 4)];
+        }
+        dst[off] = b;
+        off++;
+    }
+}
+#endif
+
+#if defined(ENABLE_AVX2)
+static void gf256_region_avx2_tabs(uint8_t* dst, const uint8_t* const* srcs, const uint8_t* coefs, uint32_t cnt, uint32_t leng)
+{
+    uint8_t tabs[GF256_MAX_SOURCES][32];
+    gf256_nibble_tables(tabs, coefs, cnt);
+    gf256_region_avx2(dst, srcs, tabs, cnt, leng);
+}
+#endif
+
+void gf256_region(uint8_t* dst, const uint8_t* const* srcs, const uint8_t* coefs, uint32_t cnt, uint32_t leng)
+{
+    if (cnt == 0) {
+        memset(dst, 0, leng);
+        return;
+    }
+    if (cnt == 1 && coefs[0] == 1) {
+        if (dst != srcs[0]) {
+            memcpy(dst, srcs[0], leng);
+        }
+        return;
+    }
+    gf_impl(dst, srcs, coefs, cnt, leng);
+}
+
+/* inverts k x k matrix in place (Gauss-Jordan) - returns -1 when matrix is singular */
+static int gf256_invert(uint8_t* mat, uint8_t* inv, uint32_t k)
+{
+    uint32_t r, c, p;
+    uint8_t t, f;
+
+    memset(inv, 0, k * k);
+    for (r = 0; r < k; r++) {
+        inv[r * k + r] = 1;
+    }
+    for (c = 0; c < k; c++) {
+        for (p = c; p < k && mat[p * k + c] == 0; p++) { }
+        if (p == k) {
+            return -1;
+        }
+        if (p != c) {
+            for (r = 0; r < k; r++) {
+                t = mat[p * k + r];
+                mat[p * k + r] = mat[c * k + r];
+                mat[c * k + r] = t;
+                t = inv[p * k + r];
+                inv[p * k + r] = inv[c * k + r];
+                inv[c * k + r] = t;
+            }
+        }
+        f = gf256_inv(mat[c * k + c]);
+        for (r = 0; r < k; r++) {
+            mat[c * k + r] = gf_multab[f][mat[c * k + r]];
+            inv[c * k + r] = gf_multab[f][inv[c * k + r]];
+        }
+        for (p = 0; p < k; p++) {
+            if (p != c && mat[p * k + c] != 0) {
+                f = mat[p * k + c];
+                for (r = 0; r < k; r++) {
+                    mat[p * k + r] ^= gf_multab[f][mat[c * k + r]];
+                    inv[p * k + r] ^= gf_multab[f][inv[c * k + r]];
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+/* row of encoding matrix for given part: identity for data parts, Cauchy 1/(x_p+y_i) with x_p=k+p, y_i=i for parity */
+static inline void gf256_rs_row(uint8_t k, uint8_t part, uint8_t* row)
+{
+    uint32_t i;
+    if (part < k) {
+        memset(row, 0, k);
+        row[part] = 1;
+    } else {
+        for (i = 0; i < k; i++) {
+            row[i] = gf256_inv(part ^ i);
+        }
+    }
+}
+
+int gf256_rs_coefs(uint8_t k, uint8_t m, const uint8_t* avail, uint8_t target, uint8_t* coefs)
+{
+    uint8_t mat[GF256_MAX_SOURCES * GF256_MAX_SOURCES];
+    uint8_t inv[GF256_MAX_SOURCES * GF256_MAX_SOURCES];
+    uint8_t row[GF256_MAX_SOURCES];
+    uint32_t i, j;
+    uint8_t c;
+
+    if (k == 0 || k > GF256_MAX_SOURCES || m > GF256_MAX_SOURCES || target >= k + m) {
+        return -1;
+    }
+    for (i = 0; i < k; i++) {
+        if (avail[i] >= k + m) {
+            return -1;
+        }
+        if (avail[i] == target) { // part is available - just copy it
+            memset(coefs, 0, k);
+            coefs[i] = 1;
+            return 0;
+        }
+        gf256_rs_row(k, avail[i], mat + i * k);
+    }
+    // data = inv(A) * avail ; target = row(target) * data
+    if (gf256_invert(mat, inv, k) < 0) { // only when some part is listed twice
+        return -1;
+    }
+    gf256_rs_row(k, target, row);
+    for (j = 0; j < k; j++) {
+        c = 0;
+        for (i = 0; i < k; i++) {
+            c ^= gf_multab[row[i]][inv[i * k + j]];
+        }
+        coefs[j] = c;
+    }
+    return 0;
+}
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+/* XCR0 - OS saves state for all requested register sets */
+static inline int gf_xsave_enabled(uint32_t mask)
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & mask) == mask;
+}
+#endif
+
+static int gf_selftest(void)
+{
+    uint8_t src[5][333 + 7];
+    uint8_t d1[333], d2[333];
+    const uint8_t* srcs[5];
+    uint8_t coefs[5];
+    uint32_t i, j, cnt, leng;
+
+    for (i = 0; i < 5; i++) {
+        for (j = 0; j < sizeof(src[i]); j++) {
+            src[i][j] = (uint8_t)(j * 131 + i * 17 + (j >> 5));
+        }
+    }
+    for (cnt = 1; cnt <= 5; cnt++) {
+        for (leng = 1; leng <= sizeof(d1); leng += 37) {
+            for (i = 0; i < cnt; i++) {
+                srcs[i] = src[i] + ((i + leng) % 7); // misaligned on purpose
+                coefs[i] = (uint8_t)(leng * 7 + i * 71 + 2);
+            }
+            gf256_region_generic(d1, srcs, coefs, cnt, leng);
+            gf_impl(d2, srcs, coefs, cnt, leng);
+            if (memcmp(d1, d2, leng) != 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+const char* gf256_autodetect(void)
+{
+    gf_impl = gf256_region_generic;
+    gf_impl_name = "standard";
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    int have_avx2;
+
+    have_avx2 = 0;
+    __cpuid_count(1, 0, eax, ebx, ecx, edx);
+    if ((ecx >> 27) & 1) { // osxsave
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = ((ebx >> 5) & 1) && gf_xsave_enabled(0x06);
+    }
+    (void)have_avx2;
+#if defined(ENABLE_AVX2)
+    if (have_avx2) {
+        gf_impl = gf256_region_avx2_tabs;
+        gf_impl_name = "avx2";
+    }
+#endif
+#endif
+#if defined(__aarch64__)
+    gf_impl = gf256_region_neon;
+    gf_impl_name = "neon";
+#endif
+    if (gf_impl != gf256_region_generic && gf_selftest() == 0) {
+        syslog(LOG_WARNING, "gf256: %s implementation failed self test - using standard one", gf_impl_name);
+        gf_impl = gf256_region_generic;
+        gf_impl_name = "standard";
+    }
+    return gf_impl_name;
+}
+
+const char* gf256_implementation(void)
+{
+    return gf_impl_name;
+}
+
+void gf256_init(void)
+{
+    uint32_t i, j, x;
+
+    x = 1;
+    for (i = 0; i < 255; i++) {
+        gf_exp[i] = x;
+        gf_log[x] = i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= 0x11D;
+        }
+    }
+    for (i = 255; i < 512; i++) {
+        gf_exp[i] = gf_exp[i - 255];
+    }
+    gf_log[0] = 0;
+    for (i = 0; i < 256; i++) {
+        gf_multab[i][0] = 0;
+        gf_multab[0][i] = 0;
+    }
+    for (i = 1; i < 256; i++) {
+        for (j = 1; j < 256; j++) {
+            gf_multab[i][j] = gf_exp[gf_log[i] + gf_log[j]];
+        }
+    }
+    gf256_autodetect();
+}
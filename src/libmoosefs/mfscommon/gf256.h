@@ -0,0 +1,41 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _GF256_H_
+#define _GF256_H_
+#include <inttypes.h>
+
+/* max number of sources combined by gf256_region (max k of Reed-Solomon k+m) */
+#define GF256_MAX_SOURCES 32
+
+uint8_t gf256_mul(uint8_t a, uint8_t b);
+uint8_t gf256_inv(uint8_t a);
+
+/* dst = coefs[0]*srcs[0] + coefs[1]*srcs[1] + ... (GF(2^8), cnt<=GF256_MAX_SOURCES) - every source is read once */
+void gf256_region(uint8_t *dst,const uint8_t * const *srcs,const uint8_t *coefs,uint32_t cnt,uint32_t leng);
+void gf256_region_generic(uint8_t *dst,const uint8_t * const *srcs,const uint8_t *coefs,uint32_t cnt,uint32_t leng);
+
+/*
+ * Systematic Reed-Solomon k+m: parts 0..k-1 are data, parts k..k+m-1 are parity (Cauchy matrix).
+ * Finds coefficients expressing part 'target' as combination of the k parts listed in 'avail'.
+ * Returns 0 on success, -1 when arguments are invalid.
+ */
+int gf256_rs_coefs(uint8_t k,uint8_t m,const uint8_t *avail,uint8_t target,uint8_t *coefs);
+
+/* full chunk copy is striped over data parts: block 'row' of data part q is block row*k+q of the chunk */
+static inline uint32_t gf256_rs_stripe_block(uint8_t k,uint8_t q,uint32_t row) {
+	return row*k+q;
+}
+
+/* number of rows (blocks of every part) needed for 'blocks' blocks of a full chunk */
+static inline uint32_t gf256_rs_stripe_rows(uint8_t k,uint32_t blocks) {
+	return (blocks+k-1)/k;
+}
+
+void gf256_init(void);
+/* select the fastest available implementation (called by gf256_init) - returns its name */
+const char* gf256_autodetect(void);
+const char* gf256_implementation(void);
+
+#endif
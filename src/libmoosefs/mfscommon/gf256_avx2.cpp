@@ -0,0 +1,50 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <inttypes.h>
+#include <immintrin.h>
+
+/* two YMM accumulators - 64 bytes of every source per iteration; tabs[i] holds low/high nibble products of coefficient i */
+void gf256_region_avx2(uint8_t* dst, const uint8_t* const* srcs, const uint8_t (*tabs)[32], uint32_t cnt, uint32_t leng)
+{
+    __m256i lo, hi, a0, a1, v, mask;
+    __m128i t;
+    uint32_t off, i;
+    const uint8_t* s;
+    uint8_t b;
+
+    mask = _mm256_set1_epi8(0x0F);
+    off = 0;
+    while (off + 64 <= leng) {
+        a0 = _mm256_setzero_si256();
+        a1 = _mm256_setzero_si256();
+        for (i = 0; i < cnt; i++) {
+            s = srcs[i] + off;
+            t = _mm_loadu_si128((const __m128i*)(tabs[i]));
+            lo = _mm256_broadcastsi128_si256(t);
+            t = _mm_loadu_si128((const __m128i*)(tabs[i] + 16));
+            hi = _mm256_broadcastsi128_si256(t);
+            v = _mm256_loadu_si256((const __m256i*)(s));
+            a0 = _mm256_xor_si256(a0, _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(v, mask)), _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(v, 4), mask))));
+            v = _mm256_loadu_si256((const __m256i*)(s + 32));
+            a1 = _mm256_xor_si256(a1, _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(v, mask)), _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(v, 4), mask))));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + off), a0);
+        _mm256_storeu_si256((__m256i*)(dst + off + 32), a1);
+        off += 64;
+    }
+    while (off < leng) {
+        b = 0;
+        for (i = 0; i < cnt; i++) {
+            b ^= tabs[i][srcs[i][off] & 0x0F] ^ tabs[i][16 + (srcs[i][off] >> 4)];
+        }
+        dst[off] = b;
+        off++;
+    }
+    _mm256_zeroupper();
+}
+
+#endif
@@ -26,6 +26,17 @@
 #define MFSMAXFILES 4096
 #endif
 
+// upper limit for one main loop sleep (each-loop entries are not driven by any descriptor)
+#ifndef MFSMAXWAIT
+#define MFSMAXWAIT 100
+#endif
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#define MFS_USE_EPOLL 1
+#define EPOLL_BATCH 256
+#endif
+
 #if defined(HAVE_MLOCKALL)
 #if defined(HAVE_SYS_MMAN_H)
 #include <sys/mman.h>
@@ -83,14 +94,17 @@
 #include "clocks.h"
 #include "crc.h"
 #include "defaults.h"
+#include "gf256.h"
 #include "massert.h"
 #include "portable.h"
 #include "slogger.h"
 #include "sockets.h"
+#include "xorblock.h"
 
 // included for threadfn definitions
 #include "bgjobs.h"
 #include "csserv.h"
+#include "csstats.h"
 #include "hddspacemgr.h"
 #include "mainserv.h"
 #include "masterconn.h"
@@ -164,6 +178,22 @@ typedef struct pollentry {
 
 static pollentry* pollhead = NULL;
 
+typedef struct fdentry {
+    int fd; // -1 - unregistered (freed at the end of the loop)
+    short events; // POLLIN/POLLOUT - 0 means not watched
+    int32_t pdescpos;
+    void (*fun)(void*, short);
+    void* arg;
+    char* fname;
+    struct fdentry* next;
+} fdentry;
+
+static fdentry* fdhead = NULL;
+static uint32_t fdremoved = 0;
+#ifdef MFS_USE_EPOLL
+static int epfd = -1;
+#endif
+
 typedef struct eloopentry {
     void (*fun)(void);
     char* fname;
@@ -275,6 +305,108 @@ void main_poll_register_fname(void (*desc)(struct pollfd*, uint32_t*), void (*se
     pollhead = aux;
 }
 
+#ifdef MFS_USE_EPOLL
+static void main_fd_epoll_ctl(fdentry* aux, short oldevents)
+{
+    struct epoll_event ev;
+    int op;
+
+    if (epfd < 0) {
+        return;
+    }
+    if (aux->events == 0) {
+        op = EPOLL_CTL_DEL;
+    } else if (oldevents == 0) {
+        op = EPOLL_CTL_ADD;
+    } else {
+        op = EPOLL_CTL_MOD;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = ((aux->events & POLLIN) ? (uint32_t)EPOLLIN : 0) | ((aux->events & POLLOUT) ? (uint32_t)EPOLLOUT : 0);
+    ev.data.ptr = aux;
+    if (epoll_ctl(epfd, op, aux->fd, &ev) < 0) {
+        // descriptor number was reused - closing the old one dropped its registration (ENOENT) or the new owner is already in the set (EEXIST)
+        if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+            op = EPOLL_CTL_ADD;
+        } else if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+            op = EPOLL_CTL_MOD;
+        } else if (op == EPOLL_CTL_DEL) {
+            return; // already gone
+        } else {
+            op = -1;
+        }
+        if (op >= 0 && epoll_ctl(epfd, op, aux->fd, &ev) == 0) {
+            return;
+        }
+        mfs_arg_errlog(LOG_WARNING, "epoll_ctl error (fd:%d) - falling back to poll", aux->fd);
+        close(epfd);
+        epfd = -1;
+    }
+}
+#endif
+
+/* persistent descriptor registration - 'fun' is called only for descriptors with pending events */
+void* main_fd_register_fname(int fd, short events, void (*fun)(void*, short), void* arg, const char* fname)
+{
+    fdentry *aux, *fdit;
+#ifdef MFS_USE_EPOLL
+    if (epfd < 0 && fdhead == NULL) {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) {
+            mfs_errlog(LOG_WARNING, "can't create epoll descriptor - using poll");
+        }
+    }
+#endif
+    aux = (fdentry*)malloc(sizeof(fdentry));
+    passert(aux);
+    aux->fd = fd;
+    aux->events = 0;
+    aux->pdescpos = -1;
+    aux->fun = fun;
+    aux->arg = arg;
+    aux->fname = strdup(fname);
+    aux->next = fdhead;
+    fdhead = aux;
+    // previous owner of this descriptor number was closed without unregistering
+    for (fdit = aux->next; fdit; fdit = fdit->next) {
+        if (fdit->fd == fd) {
+            fdit->fd = -1;
+            fdit->events = 0;
+            fdremoved++;
+        }
+    }
+    main_fd_change(aux, events);
+    return aux;
+}
+
+void main_fd_change(void* x, short events)
+{
+    fdentry* aux = (fdentry*)x;
+    short oldevents;
+
+    events &= (POLLIN | POLLOUT);
+    if (aux->fd < 0 || aux->events == events) {
+        return;
+    }
+    oldevents = aux->events;
+    aux->events = events;
+#ifdef MFS_USE_EPOLL
+    main_fd_epoll_ctl(aux, oldevents);
+#else
+    (void)oldevents;
+#endif
+}
+
+/* has to be called before closing the descriptor */
+void main_fd_unregister(void* x)
+{
+    fdentry* aux = (fdentry*)x;
+
+    main_fd_change(aux, 0);
+    aux->fd = -1;
+    fdremoved++;
+}
+
 void main_eachloop_register_fname(void (*fun)(void), const char* fname)
 {
     eloopentry* aux = (eloopentry*)malloc(sizeof(eloopentry));
@@ -356,6 +488,7 @@ void free_all_registered_entries(void)
     rlentry *re, *ren;
     inentry *ie, *ien;
     pollentry *pe, *pen;
+    fdentry *fe, *fen;
     eloopentry *ee, *een;
     timeentry *te, *ten;
 
@@ -396,6 +529,19 @@ void free_all_registered_entries(void)
         free(pe);
     }
 
+    for (fe = fdhead; fe; fe = fen) {
+        fen = fe->next;
+        free(fe->fname);
+        free(fe);
+    }
+    fdhead = NULL;
+#ifdef MFS_USE_EPOLL
+    if (epfd >= 0) {
+        close(epfd);
+        epfd = -1;
+    }
+#endif
+
     for (ee = eloophead; ee; ee = een) {
         een = ee->next;
         free(ee->fname);
@@ -527,10 +673,18 @@ void mainloop()
     weentry* weit;
     rlentry* rlit;
     inentry* init;
+    fdentry *fdit, **fdptr;
     struct pollfd pdesc[MFSMAXFILES];
     uint32_t ndesc;
     int i;
     int t, r;
+    int waitms;
+#ifdef MFS_USE_EPOLL
+    struct epoll_event epev[EPOLL_BATCH];
+    int32_t eppdescpos;
+    int n, j;
+    short revents;
+#endif
 
     t = 0;
     r = 0;
@@ -539,12 +693,49 @@ void mainloop()
         pdesc[0].fd = signalpipe[0];
         pdesc[0].events = POLLIN;
         pdesc[0].revents = 0;
+#ifdef MFS_USE_EPOLL
+        // all persistent descriptors are represented by one pollable epoll descriptor
+        eppdescpos = -1;
+        if (epfd >= 0) {
+            pdesc[ndesc].fd = epfd;
+            pdesc[ndesc].events = POLLIN;
+            pdesc[ndesc].revents = 0;
+            eppdescpos = ndesc;
+            ndesc++;
+        } else
+#endif
+        {
+            for (fdit = fdhead; fdit != NULL; fdit = fdit->next) {
+                fdit->pdescpos = -1;
+                if (fdit->events && ndesc < MFSMAXFILES) {
+                    pdesc[ndesc].fd = fdit->fd;
+                    pdesc[ndesc].events = fdit->events;
+                    pdesc[ndesc].revents = 0;
+                    fdit->pdescpos = ndesc;
+                    ndesc++;
+                }
+            }
+        }
         for (pollit = pollhead; pollit != NULL; pollit = pollit->next) {
             LOOP_START;
             pollit->desc(pdesc, &ndesc);
             LOOP_END(pollit->dname);
         }
-        i = poll(pdesc, ndesc, 10);
+        // sleep until the nearest timed event instead of waking up every 10ms
+        // (msectime entries need no timerfds - the loop blocks in this single poll, so its timeout wakes it up just as well)
+        if (t != 0) {
+            waitms = 10; // exiting - keep asking 'canexit' entries
+        } else {
+            waitms = MFSMAXWAIT;
+            for (timeit = timehead; timeit != NULL && waitms > 0; timeit = timeit->next) {
+                if (timeit->nextevent <= usecnow) {
+                    waitms = 0;
+                } else if (timeit->nextevent - usecnow < UINT64_C(1000) * waitms) {
+                    waitms = (timeit->nextevent - usecnow + 999) / 1000;
+                }
+            }
+        }
+        i = poll(pdesc, ndesc, waitms);
         gettimeofday(&tv, NULL);
         useclast = usecnow;
         usecnow = tv.tv_sec;
@@ -600,12 +791,59 @@ void mainloop()
                     }
                 }
             }
+#ifdef MFS_USE_EPOLL
+            if (eppdescpos >= 0 && (pdesc[eppdescpos].revents & POLLIN)) {
+                n = epoll_wait(epfd, epev, EPOLL_BATCH, 0);
+                for (j = 0; j < n; j++) {
+                    fdit = (fdentry*)(epev[j].data.ptr);
+                    if (fdit->fd < 0 || fdit->events == 0) { // unregistered or disabled by one of previous callbacks
+                        continue;
+                    }
+                    revents = 0;
+                    if (epev[j].events & EPOLLIN) {
+                        revents |= POLLIN;
+                    }
+                    if (epev[j].events & EPOLLOUT) {
+                        revents |= POLLOUT;
+                    }
+                    if (epev[j].events & EPOLLERR) {
+                        revents |= POLLERR;
+                    }
+                    if (epev[j].events & EPOLLHUP) {
+                        revents |= POLLHUP;
+                    }
+                    LOOP_START;
+                    fdit->fun(fdit->arg, revents);
+                    LOOP_END(fdit->fname);
+                }
+            }
+#endif
+            for (fdit = fdhead; fdit != NULL; fdit = fdit->next) {
+                if (fdit->pdescpos >= 0 && fdit->fd >= 0 && fdit->events && pdesc[fdit->pdescpos].revents) {
+                    LOOP_START;
+                    fdit->fun(fdit->arg, pdesc[fdit->pdescpos].revents);
+                    LOOP_END(fdit->fname);
+                }
+            }
             for (pollit = pollhead; pollit != NULL; pollit = pollit->next) {
                 LOOP_START;
                 pollit->serve(pdesc);
                 LOOP_END(pollit->sname);
             }
         }
+        if (fdremoved) {
+            fdptr = &fdhead;
+            while ((fdit = *fdptr)) {
+                if (fdit->fd < 0) {
+                    *fdptr = fdit->next;
+                    free(fdit->fname);
+                    free(fdit);
+                } else {
+                    fdptr = &(fdit->next);
+                }
+            }
+            fdremoved = 0;
+        }
         for (eloopit = eloophead; eloopit != NULL; eloopit = eloopit->next) {
             LOOP_START;
             eloopit->fun();
@@ -722,6 +960,7 @@ struct {
     { job_init, "jobs manager" },
     { csserv_init, "main server acceptor" }, /* it has to be before "masterconn" */
     { masterconn_init, "master connection module" },
+    { csstats_init, "statistics collector" },
     { (runfn)0, "****" }
 },
   LateRunTab[] = { { hdd_late_init, "hdd space manager - threads" }, { (runfn)0, "****" } }, RestoreRunTab[] = { { hdd_restore, "hdd space restore" }, { (runfn)0, "****" } };
@@ -1164,6 +1403,8 @@ void mfschunkserver(void)
 #endif
     strerr_init();
     mycrc32_init();
+    xorblock_init();
+    gf256_init();
     set_signal_handlers(0);
     // processname_init(0, NULL);
     char* logappname = strdup(localnode.syslogident);
@@ -57,6 +57,7 @@
 #define main_chld_register(p,x) main_chld_register_fname(p,x,STR(x))
 #define main_keepalive_register(x) main_keepalive_register_fname(x,STR(x))
 #define main_poll_register(x,y) main_poll_register_fname(x,y,STR(x),STR(y))
+#define main_fd_register(fd,e,x,a) main_fd_register_fname(fd,e,x,a,STR(x))
 #define main_eachloop_register(x) main_eachloop_register_fname(x,STR(x))
 #define main_msectime_register(m,o,x) main_msectime_register_fname(m,o,x,STR(x))
 #define main_time_register(s,o,x) main_time_register_fname(s,o,x,STR(x))
@@ -69,10 +70,13 @@ void main_info_register_fname (void (*fun)(void),const char *fname);
 void main_chld_register_fname (pid_t pid,void (*fun)(int),const char *fname);
 void main_keepalive_register_fname (void (*fun)(void),const char *fname);
 void main_poll_register_fname (void (*desc)(struct pollfd *,uint32_t *),void (*serve)(struct pollfd *),const char *dname,const char *sname);
+void* main_fd_register_fname (int fd,short events,void (*fun)(void *,short),void *arg,const char *fname);
 void main_eachloop_register_fname (void (*fun)(void),const char *fname);
 void* main_msectime_register_fname (uint32_t mseconds,uint32_t offset,void (*fun)(void),const char *fname);
 void* main_time_register_fname (uint32_t seconds,uint32_t offset,void (*fun)(void),const char *fname);
 
+void main_fd_change(void *x,short events);
+void main_fd_unregister(void *x);
 int main_msectime_change(void* x,uint32_t mseconds,uint32_t offset);
 int main_time_change(void *x,uint32_t seconds,uint32_t offset);
 void main_exit(void);
@@ -18,11 +18,30 @@
  * or visit http://www.gnu.org/licenses/gpl-2.0.html
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 
 #include "massert.h"
+#include "pcqueue.h"
+
+/*
+ * Bounded MPMC ring (sequence number per cell) - put/get don't allocate and don't lock.
+ * When the ring is full elements go to a locked overflow list, so unbounded queues (size==0)
+ * never block producers. Sleeping threads are woken through an eventfd (pipe on other systems),
+ * which is written only when somebody actually waits.
+ */
+
+#define QUEUE_RING_SIZE 4096
+#define QUEUE_SPIN 64
 
 typedef struct _qentry {
     uint32_t id;
@@ -32,56 +51,282 @@ typedef struct _qentry {
     struct _qentry* next;
 } qentry;
 
+typedef struct _qcell {
+    uint64_t seq;
+    uint32_t id;
+    uint32_t op;
+    uint8_t* data;
+    uint32_t leng;
+} qcell;
+
 typedef struct _queue {
-    qentry *head, **tail;
-    uint32_t elements;
+    uint64_t head __attribute__((aligned(64)));
+    uint64_t tail __attribute__((aligned(64)));
+    uint32_t elements __attribute__((aligned(64)));
     uint32_t size;
     uint32_t maxsize;
     uint32_t freewaiting;
     uint32_t fullwaiting;
     uint32_t closed;
-    pthread_cond_t waitfree, waitfull;
-    pthread_mutex_t lock;
+    uint32_t overflowcnt;
+    int freefd[2]; // element available
+    int fullfd[2]; // space available
+    qentry *ovhead, **ovtail;
+    pthread_mutex_t ovlock;
+    qcell ring[QUEUE_RING_SIZE];
 } queue;
 
+static void queue_wakefd_new(int fd[2])
+{
+#ifdef __linux__
+    fd[0] = fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC | EFD_SEMAPHORE);
+    eassert(fd[0] >= 0);
+#else
+    eassert(pipe(fd) == 0);
+    eassert(fcntl(fd[0], F_SETFL, O_NONBLOCK) >= 0);
+    eassert(fcntl(fd[1], F_SETFL, O_NONBLOCK) >= 0);
+#endif
+}
+
+static void queue_wakefd_delete(int fd[2])
+{
+    close(fd[0]);
+    if (fd[1] != fd[0]) {
+        close(fd[1]);
+    }
+}
+
+/* semaphore like - every signal wakes (at most) one waiter; extra tokens only cause spurious wakeups */
+static inline void queue_wakefd_signal(int fd[2], uint32_t cnt)
+{
+#ifdef __linux__
+    uint64_t val = cnt;
+    if (write(fd[1], &val, sizeof(val)) < 0) { // EAGAIN - counter is already huge
+        return;
+    }
+#else
+    uint8_t one = 1;
+    while (cnt > 0) {
+        if (write(fd[1], &one, 1) < 0) { // EAGAIN - pipe is already full
+            return;
+        }
+        cnt--;
+    }
+#endif
+}
+
+static inline void queue_wakefd_wait(int fd[2])
+{
+    struct pollfd pfd;
+    pfd.fd = fd[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, -1) > 0) {
+#ifdef __linux__
+        uint64_t val;
+        if (read(fd[0], &val, sizeof(val)) < 0) { // other waiter took the token
+            return;
+        }
+#else
+        uint8_t val;
+        if (read(fd[0], &val, 1) < 0) { // other waiter took the token
+            return;
+        }
+#endif
+    }
+}
+
+static inline int queue_ring_put(queue* q, uint32_t id, uint32_t op, uint8_t* data, uint32_t leng)
+{
+    qcell* c;
+    uint64_t pos, seq;
+    int64_t dif;
+
+    pos = __atomic_load_n(&(q->tail), __ATOMIC_RELAXED);
+    for (;;) {
+        c = q->ring + (pos & (QUEUE_RING_SIZE - 1));
+        seq = __atomic_load_n(&(c->seq), __ATOMIC_ACQUIRE);
+        dif = (int64_t)seq - (int64_t)pos;
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&(q->tail), &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return 0; // full
+        } else {
+            pos = __atomic_load_n(&(q->tail), __ATOMIC_RELAXED);
+        }
+    }
+    c->id = id;
+    c->op = op;
+    c->data = data;
+    c->leng = leng;
+    __atomic_store_n(&(c->seq), pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static inline int queue_ring_get(queue* q, uint32_t* id, uint32_t* op, uint8_t** data, uint32_t* leng)
+{
+    qcell* c;
+    uint64_t pos, seq;
+    int64_t dif;
+
+    pos = __atomic_load_n(&(q->head), __ATOMIC_RELAXED);
+    for (;;) {
+        c = q->ring + (pos & (QUEUE_RING_SIZE - 1));
+        seq = __atomic_load_n(&(c->seq), __ATOMIC_ACQUIRE);
+        dif = (int64_t)seq - (int64_t)(pos + 1);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&(q->head), &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            return 0; // empty
+        } else {
+            pos = __atomic_load_n(&(q->head), __ATOMIC_RELAXED);
+        }
+    }
+    *id = c->id;
+    *op = c->op;
+    *data = c->data;
+    *leng = c->leng;
+    __atomic_store_n(&(c->seq), pos + QUEUE_RING_SIZE, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static inline void queue_push(queue* q, uint32_t id, uint32_t op, uint8_t* data, uint32_t leng)
+{
+    qentry* qe;
+    // count first, so 'elements' is never lower than number of elements that can be taken
+    __atomic_add_fetch(&(q->elements), 1, __ATOMIC_RELAXED);
+    // once overflow is used keep adding there, so ring (older elements) is drained first
+    if (__atomic_load_n(&(q->overflowcnt), __ATOMIC_ACQUIRE) > 0 || queue_ring_put(q, id, op, data, leng) == 0) {
+        qe = (qentry*)malloc(sizeof(qentry));
+        passert(qe);
+        qe->id = id;
+        qe->op = op;
+        qe->data = data;
+        qe->leng = leng;
+        qe->next = NULL;
+        zassert(pthread_mutex_lock(&(q->ovlock)));
+        *(q->ovtail) = qe;
+        q->ovtail = &(qe->next);
+        __atomic_add_fetch(&(q->overflowcnt), 1, __ATOMIC_RELEASE);
+        zassert(pthread_mutex_unlock(&(q->ovlock)));
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // pairs with fence in waiting consumer
+    if (__atomic_load_n(&(q->freewaiting), __ATOMIC_RELAXED) > 0) {
+        queue_wakefd_signal(q->freefd, 1);
+    }
+}
+
+static inline int queue_pop(queue* q, uint32_t* id, uint32_t* op, uint8_t** data, uint32_t* leng)
+{
+    qentry* qe;
+    if (queue_ring_get(q, id, op, data, leng) == 0) {
+        if (__atomic_load_n(&(q->overflowcnt), __ATOMIC_ACQUIRE) == 0) {
+            return 0;
+        }
+        zassert(pthread_mutex_lock(&(q->ovlock)));
+        qe = q->ovhead;
+        if (qe == NULL) {
+            zassert(pthread_mutex_unlock(&(q->ovlock)));
+            return 0;
+        }
+        q->ovhead = qe->next;
+        if (q->ovhead == NULL) {
+            q->ovtail = &(q->ovhead);
+        }
+        __atomic_sub_fetch(&(q->overflowcnt), 1, __ATOMIC_RELEASE);
+        zassert(pthread_mutex_unlock(&(q->ovlock)));
+        *id = qe->id;
+        *op = qe->op;
+        *data = qe->data;
+        *leng = qe->leng;
+        free(qe);
+    }
+    __atomic_sub_fetch(&(q->elements), 1, __ATOMIC_RELAXED);
+    if (q->maxsize) {
+        __atomic_sub_fetch(&(q->size), *leng, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&(q->fullwaiting), __ATOMIC_SEQ_CST) > 0) {
+            queue_wakefd_signal(q->fullfd, 1);
+        }
+    } else {
+        __atomic_sub_fetch(&(q->size), *leng, __ATOMIC_RELAXED);
+    }
+    return 1;
+}
+
+/* reserve 'leng' in bounded queue: 1 - ok, 0 - no space */
+static inline int queue_reserve(queue* q, uint32_t leng)
+{
+    uint32_t s = __atomic_load_n(&(q->size), __ATOMIC_SEQ_CST);
+    do {
+        if (q->maxsize && s + leng > q->maxsize) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&(q->size), &s, s + leng, 1, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+    return 1;
+}
+
+static inline void queue_clear_result(uint32_t* id, uint32_t* op, uint8_t** data, uint32_t* leng)
+{
+    if (id) {
+        *id = 0;
+    }
+    if (op) {
+        *op = 0;
+    }
+    if (data) {
+        *data = NULL;
+    }
+    if (leng) {
+        *leng = 0;
+    }
+}
+
 void* queue_new(uint32_t size)
 {
     queue* q;
+    uint32_t i;
     q = (queue*)malloc(sizeof(queue));
     passert(q);
-    q->head = NULL;
-    q->tail = &(q->head);
+    q->head = 0;
+    q->tail = 0;
     q->elements = 0;
     q->size = 0;
     q->maxsize = size;
     q->freewaiting = 0;
     q->fullwaiting = 0;
     q->closed = 0;
+    q->overflowcnt = 0;
+    q->ovhead = NULL;
+    q->ovtail = &(q->ovhead);
+    for (i = 0; i < QUEUE_RING_SIZE; i++) {
+        q->ring[i].seq = i;
+    }
+    queue_wakefd_new(q->freefd);
     if (size) {
-        zassert(pthread_cond_init(&(q->waitfull), NULL));
+        queue_wakefd_new(q->fullfd);
     }
-    zassert(pthread_cond_init(&(q->waitfree), NULL));
-    zassert(pthread_mutex_init(&(q->lock), NULL));
+    zassert(pthread_mutex_init(&(q->ovlock), NULL));
     return q;
 }
 
 void queue_delete(void* que)
 {
     queue* q = (queue*)que;
-    qentry *qe, *qen;
-    zassert(pthread_mutex_lock(&(q->lock)));
+    uint32_t id, op, leng;
+    uint8_t* data;
     sassert(q->freewaiting == 0);
     sassert(q->fullwaiting == 0);
-    for (qe = q->head; qe; qe = qen) {
-        qen = qe->next;
-        free(qe->data);
-        free(qe);
+    while (queue_pop(q, &id, &op, &data, &leng)) {
+        free(data);
     }
-    zassert(pthread_mutex_unlock(&(q->lock)));
-    zassert(pthread_mutex_destroy(&(q->lock)));
-    zassert(pthread_cond_destroy(&(q->waitfree)));
+    zassert(pthread_mutex_destroy(&(q->ovlock)));
+    queue_wakefd_delete(q->freefd);
     if (q->maxsize) {
-        zassert(pthread_cond_destroy(&(q->waitfull)));
+        queue_wakefd_delete(q->fullfd);
     }
     free(q);
 }
@@ -89,241 +334,169 @@ void queue_delete(void* que)
 void queue_close(void* que)
 {
     queue* q = (queue*)que;
-    zassert(pthread_mutex_lock(&(q->lock)));
-    q->closed = 1;
-    if (q->freewaiting > 0) {
-        zassert(pthread_cond_broadcast(&(q->waitfree)));
-        q->freewaiting = 0;
-    }
-    if (q->fullwaiting > 0) {
-        zassert(pthread_cond_broadcast(&(q->waitfull)));
-        q->fullwaiting = 0;
+    __atomic_store_n(&(q->closed), 1, __ATOMIC_SEQ_CST);
+    // wake up everybody (also threads that are just going to sleep)
+    queue_wakefd_signal(q->freefd, 0x10000);
+    if (q->maxsize) {
+        queue_wakefd_signal(q->fullfd, 0x10000);
     }
-    zassert(pthread_mutex_unlock(&(q->lock)));
 }
 
 int queue_isempty(void* que)
 {
     queue* q = (queue*)que;
-    int r;
-    zassert(pthread_mutex_lock(&(q->lock)));
-    r = (q->elements == 0) ? 1 : 0;
-    zassert(pthread_mutex_unlock(&(q->lock)));
-    return r;
+    return (__atomic_load_n(&(q->elements), __ATOMIC_SEQ_CST) == 0) ? 1 : 0;
 }
 
 uint32_t queue_elements(void* que)
 {
     queue* q = (queue*)que;
-    uint32_t r;
-    zassert(pthread_mutex_lock(&(q->lock)));
-    r = q->elements;
-    zassert(pthread_mutex_unlock(&(q->lock)));
-    return r;
+    return __atomic_load_n(&(q->elements), __ATOMIC_SEQ_CST);
 }
 
 int queue_isfull(void* que)
 {
     queue* q = (queue*)que;
-    int r;
-    zassert(pthread_mutex_lock(&(q->lock)));
-    r = (q->maxsize > 0 && q->maxsize <= q->size) ? 1 : 0;
-    zassert(pthread_mutex_unlock(&(q->lock)));
-    return r;
+    return (q->maxsize > 0 && q->maxsize <= __atomic_load_n(&(q->size), __ATOMIC_SEQ_CST)) ? 1 : 0;
 }
 
 uint32_t queue_sizeleft(void* que)
 {
     queue* q = (queue*)que;
-    uint32_t r;
-    zassert(pthread_mutex_lock(&(q->lock)));
     if (q->maxsize > 0) {
-        r = q->maxsize - q->size;
+        return q->maxsize - __atomic_load_n(&(q->size), __ATOMIC_SEQ_CST);
     } else {
-        r = 0xFFFFFFFF;
+        return 0xFFFFFFFF;
     }
-    zassert(pthread_mutex_unlock(&(q->lock)));
-    return r;
 }
 
 int queue_put(void* que, uint32_t id, uint32_t op, uint8_t* data, uint32_t leng)
 {
     queue* q = (queue*)que;
-    qentry* qe;
-    qe = (qentry*)malloc(sizeof(qentry));
-    passert(qe);
-    qe->id = id;
-    qe->op = op;
-    qe->data = data;
-    qe->leng = leng;
-    qe->next = NULL;
-    zassert(pthread_mutex_lock(&(q->lock)));
     if (q->maxsize) {
         if (leng > q->maxsize) {
-            zassert(pthread_mutex_unlock(&(q->lock)));
-            free(qe);
             errno = EDEADLK;
             return -1;
         }
-        while (q->size + leng > q->maxsize && q->closed == 0) {
-            q->fullwaiting++;
-            zassert(pthread_cond_wait(&(q->waitfull), &(q->lock)));
+        while (queue_reserve(q, leng) == 0) {
+            if (__atomic_load_n(&(q->closed), __ATOMIC_SEQ_CST)) {
+                errno = EIO;
+                return -1;
+            }
+            __atomic_add_fetch(&(q->fullwaiting), 1, __ATOMIC_SEQ_CST);
+            // check again after announcing ourselves - consumer might have freed space in the meantime
+            if (queue_reserve(q, leng)) {
+                __atomic_sub_fetch(&(q->fullwaiting), 1, __ATOMIC_SEQ_CST);
+                break;
+            }
+            if (__atomic_load_n(&(q->closed), __ATOMIC_SEQ_CST) == 0) {
+                queue_wakefd_wait(q->fullfd);
+            }
+            __atomic_sub_fetch(&(q->fullwaiting), 1, __ATOMIC_SEQ_CST);
         }
-        if (q->closed) {
-            zassert(pthread_mutex_unlock(&(q->lock)));
-            free(qe);
+        if (__atomic_load_n(&(q->closed), __ATOMIC_SEQ_CST)) {
+            __atomic_sub_fetch(&(q->size), leng, __ATOMIC_SEQ_CST);
             errno = EIO;
             return -1;
         }
+    } else {
+        __atomic_add_fetch(&(q->size), leng, __ATOMIC_RELAXED);
     }
-    q->elements++;
-    q->size += leng;
-    *(q->tail) = qe;
-    q->tail = &(qe->next);
-    if (q->freewaiting > 0) {
-        zassert(pthread_cond_signal(&(q->waitfree)));
-        q->freewaiting--;
-    }
-    zassert(pthread_mutex_unlock(&(q->lock)));
+    queue_push(q, id, op, data, leng);
     return 0;
 }
 
 int queue_tryput(void* que, uint32_t id, uint32_t op, uint8_t* data, uint32_t leng)
 {
     queue* q = (queue*)que;
-    qentry* qe;
-    zassert(pthread_mutex_lock(&(q->lock)));
     if (q->maxsize) {
         if (leng > q->maxsize) {
-            zassert(pthread_mutex_unlock(&(q->lock)));
             errno = EDEADLK;
             return -1;
         }
-        if (q->size + leng > q->maxsize) {
-            zassert(pthread_mutex_unlock(&(q->lock)));
+        if (queue_reserve(q, leng) == 0) {
             errno = EBUSY;
             return -1;
         }
+    } else {
+        __atomic_add_fetch(&(q->size), leng, __ATOMIC_RELAXED);
     }
-    qe = (qentry*)malloc(sizeof(qentry));
-    passert(qe);
-    qe->id = id;
-    qe->op = op;
-    qe->data = data;
-    qe->leng = leng;
-    qe->next = NULL;
-    q->elements++;
-    q->size += leng;
-    *(q->tail) = qe;
-    q->tail = &(qe->next);
-    if (q->freewaiting > 0) {
-        zassert(pthread_cond_signal(&(q->waitfree)));
-        q->freewaiting--;
-    }
-    zassert(pthread_mutex_unlock(&(q->lock)));
+    queue_push(q, id, op, data, leng);
     return 0;
 }
 
 int queue_get(void* que, uint32_t* id, uint32_t* op, uint8_t** data, uint32_t* leng)
 {
     queue* q = (queue*)que;
-    qentry* qe;
-    zassert(pthread_mutex_lock(&(q->lock)));
-    while (q->elements == 0 && q->closed == 0) {
-        q->freewaiting++;
-        zassert(pthread_cond_wait(&(q->waitfree), &(q->lock)));
-    }
-    if (q->closed) {
-        zassert(pthread_mutex_unlock(&(q->lock)));
-        if (id) {
-            *id = 0;
+    uint32_t qid, qop, qleng, spin;
+    uint8_t* qdata;
+
+    spin = 0;
+    for (;;) {
+        if (__atomic_load_n(&(q->closed), __ATOMIC_SEQ_CST)) {
+            queue_clear_result(id, op, data, leng);
+            errno = EIO;
+            return -1;
         }
-        if (op) {
-            *op = 0;
+        if (queue_pop(q, &qid, &qop, &qdata, &qleng)) {
+            break;
         }
-        if (data) {
-            *data = NULL;
+        if (spin < QUEUE_SPIN) { // short bursts are cheaper to wait for than to sleep on
+            spin++;
+            if (spin > QUEUE_SPIN / 2) { // let producer run when cores are oversubscribed
+                sched_yield();
+            }
+            continue;
         }
-        if (leng) {
-            *leng = 0;
+        __atomic_add_fetch(&(q->freewaiting), 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST); // pairs with fence in queue_push
+        // check again after announcing ourselves - producer might have missed our counter
+        if (queue_pop(q, &qid, &qop, &qdata, &qleng)) {
+            __atomic_sub_fetch(&(q->freewaiting), 1, __ATOMIC_SEQ_CST);
+            break;
         }
-        errno = EIO;
-        return -1;
-    }
-    qe = q->head;
-    q->head = qe->next;
-    if (q->head == NULL) {
-        q->tail = &(q->head);
-    }
-    q->elements--;
-    q->size -= qe->leng;
-    if (q->fullwaiting > 0) {
-        zassert(pthread_cond_signal(&(q->waitfull)));
-        q->fullwaiting--;
+        if (__atomic_load_n(&(q->closed), __ATOMIC_SEQ_CST) == 0) {
+            queue_wakefd_wait(q->freefd);
+        }
+        __atomic_sub_fetch(&(q->freewaiting), 1, __ATOMIC_SEQ_CST);
     }
-    zassert(pthread_mutex_unlock(&(q->lock)));
     if (id) {
-        *id = qe->id;
+        *id = qid;
     }
     if (op) {
-        *op = qe->op;
+        *op = qop;
     }
     if (data) {
-        *data = qe->data;
+        *data = qdata;
     }
     if (leng) {
-        *leng = qe->leng;
+        *leng = qleng;
     }
-    free(qe);
     return 0;
 }
 
 int queue_tryget(void* que, uint32_t* id, uint32_t* op, uint8_t** data, uint32_t* leng)
 {
     queue* q = (queue*)que;
-    qentry* qe;
-    zassert(pthread_mutex_lock(&(q->lock)));
-    if (q->elements == 0) {
-        zassert(pthread_mutex_unlock(&(q->lock)));
-        if (id) {
-            *id = 0;
-        }
-        if (op) {
-            *op = 0;
-        }
-        if (data) {
-            *data = NULL;
-        }
-        if (leng) {
-            *leng = 0;
-        }
+    uint32_t qid, qop, qleng;
+    uint8_t* qdata;
+
+    if (queue_pop(q, &qid, &qop, &qdata, &qleng) == 0) {
+        queue_clear_result(id, op, data, leng);
         errno = EBUSY;
         return -1;
     }
-    qe = q->head;
-    q->head = qe->next;
-    if (q->head == NULL) {
-        q->tail = &(q->head);
-    }
-    q->elements--;
-    q->size -= qe->leng;
-    if (q->fullwaiting > 0) {
-        zassert(pthread_cond_signal(&(q->waitfull)));
-        q->fullwaiting--;
-    }
-    zassert(pthread_mutex_unlock(&(q->lock)));
     if (id) {
-        *id = qe->id;
+        *id = qid;
     }
     if (op) {
-        *op = qe->op;
+        *op = qop;
     }
     if (data) {
-        *data = qe->data;
+        *data = qdata;
     }
     if (leng) {
-        *leng = qe->leng;
+        *leng = qleng;
     }
-    free(qe);
     return 0;
 }
@@ -30,9 +30,9 @@ int queue_isempty(void *que);
 uint32_t queue_elements(void *que);
 int queue_isfull(void *que);
 uint32_t queue_sizeleft(void *que);
-void queue_put(void *que,uint32_t id,uint32_t op,uint8_t *data,uint32_t leng);
+int queue_put(void *que,uint32_t id,uint32_t op,uint8_t *data,uint32_t leng);
 int queue_tryput(void *que,uint32_t id,uint32_t op,uint8_t *data,uint32_t leng);
-void queue_get(void *que,uint32_t *id,uint32_t *op,uint8_t **data,uint32_t *leng);
+int queue_get(void *que,uint32_t *id,uint32_t *op,uint8_t **data,uint32_t *leng);
 int queue_tryget(void *que,uint32_t *id,uint32_t *op,uint8_t **data,uint32_t *leng);
 
 #endif
@@ -44,6 +44,9 @@
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
 #include "clocks.h"
 #include "sockets.h"
@@ -884,6 +887,74 @@ int32_t tcptoforward(int srcsock, int dstsock, void* buff, uint32_t leng, uint32
     return streamtoforward(srcsock, dstsock, buff, leng, rcvd, sent, msecto);
 }
 
+/* sends leng bytes from file descriptor fd (starting at offset) without copying them through user space */
+int32_t tcptosendfile(int sock, int fd, uint64_t offset, uint32_t leng, uint32_t msecto)
+{
+#ifdef __linux__
+    uint32_t sent = 0;
+    ssize_t i;
+    off_t foff;
+    struct pollfd pfd;
+    double s, c;
+    uint32_t msecpassed;
+
+    s = 0.0;
+    foff = offset;
+    pfd.fd = sock;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    while (1) {
+        i = sendfile(sock, fd, &foff, leng - sent);
+        if (i == 0) { // end of file
+            return sent;
+        }
+        if (i > 0) {
+            sent += i;
+        } else if (ERRNO_ERROR) {
+            return -1;
+        }
+        if (sent >= leng) {
+            break;
+        }
+        if (s == 0.0) {
+            s = monotonic_seconds();
+            msecpassed = 0;
+        } else {
+            c = monotonic_seconds();
+            msecpassed = (c - s) * 1000.0;
+            if (msecpassed >= msecto) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+        }
+        pfd.revents = 0;
+        if (poll(&pfd, 1, msecto - msecpassed) < 0) {
+            if (errno != EINTR) {
+                return -1;
+            } else {
+                continue;
+            }
+        }
+        if (pfd.revents & (POLLHUP | POLLERR)) {
+            return -1;
+        }
+        if ((pfd.revents & POLLOUT) == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+    }
+    return sent;
+#else
+    (void)sock;
+    (void)fd;
+    (void)offset;
+    (void)leng;
+    (void)msecto;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 int tcptoaccept(int lsock, uint32_t msecto)
 {
     return streamtoaccept(lsock, msecto);
@@ -0,0 +1,246 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Multi-source XOR used to rebuild chunk parts. All sources are combined in a
+// single pass over the destination, so the cost is one read of every source
+// and one write of the result regardless of the number of sources.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/dash-config.h>
+#endif
+
+#include <inttypes.h>
+#include <string.h>
+#include <syslog.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "xorblock.h"
+
+#if defined(ENABLE_AVX2)
+void xorblock_avx2(uint8_t* dst, const uint8_t* const* srcs, uint32_t cnt, uint32_t leng);
+#endif
+#if defined(ENABLE_AVX512F)
+void xorblock_avx512(uint8_t* dst, const uint8_t* const* srcs, uint32_t cnt, uint32_t leng);
+#endif
+
+typedef void (*xorblock_fn)(uint8_t* dst, const uint8_t* const* srcs, uint32_t cnt, uint32_t leng);
+
+static xorblock_fn xor_impl = xorblock_generic;
+static const char* xor_impl_name = "standard";
+
+void xorblock_generic(uint8_t* dst, const uint8_t* const* srcs, uint32_t cnt, uint32_t leng)
+{
+    uint64_t a0, a1, a2, a3, w;
+    uint32_t off, i;
+
+    off = 0;
+    while (off + 32 <= leng) {
+        memcpy(&a0, srcs[0] + off, 8);
+        memcpy(&a1, srcs[0] + off + 8, 8);
+        memcpy(&a2, srcs[0] + off + 16, 8);
+        memcpy(&a3, srcs[0] + off + 24, 8);
+        for (i = 1; i < cnt; i++) {
+            memcpy(&w, srcs[i] + off, 8);
+            a0 ^= w;
+            memcpy(&w, srcs[i] + off + 8, 8);
+            a1 ^= w;
+            memcpy(&w, srcs[i] + off + 16, 8);
+            a2 ^= w;
+            memcpy(&w, srcs[i] + off + 24, 8);
+            a3 ^= w;
+        }
+        memcpy(dst + off, &a0, 8);
+        memcpy(dst + off + 8, &a1, 8);
+        memcpy(dst + off + 16, &a2, 8);
+        memcpy(dst + off + 24, &a3, 8);
+        off += 32;
+    }
+    while (off < leng) {
+        uint8_t b = srcs[0][off];
+        for (i = 1; i < cnt; i++) {
+            b ^= srcs[i][off];
+        }
+        dst[off] = b;
+        off++;
+    }
+}
+
+#if defined(__aarch64__)
+/* NEON is part of the base ARMv8-A instruction set - no runtime check needed */
+static void xorblock_neon(uint8_t* dst, const uint8_t* const* srcs, uint32_t cnt, uint32_t leng)
+{
+    uint8x16_t a0, a1, a2, a3;
+    uint32_t off, i;
+    const uint8_t* s;
+
+    off = 0;
+    while (off + 64 <= leng) {
+        s = srcs[0] + off;
+        a0 = vld1q_u8(s);
+        a1 = vld1q_u8(s + 16);
+        a2 = vld1q_u8(s + 32);
+        a3 = vld1q_u8(s + 48);
+        for (i = 1; i < cnt; i++) {
+            s = srcs[i] + off;
+            a0 = veorq_u8(a0, vld1q_u8(s));
+            a1 = veorq_u8(a1, vld1q_u8(s + 16));
+            a2 = veorq_u8(a2, vld1q_u8(s + 32));
+            a3 = veorq_u8(a3, vld1q_u8(s + 48));
+        }
+        vst1q_u8(dst + off, a0);
+        vst1q_u8(dst + off + 16, a1);
+        vst1q_u8(dst + off + 32, a2);
+        vst1q_u8(dst + off + 48, a3);
+        off += 64;
+    }
+    while (off < leng) {
+        uint8_t b = srcs[0][off];
+        for (i = 1; i < cnt; i++) {
+            b ^= srcs[i][off];
+        }
+        dst[off] = b;
+        off++;
+    }
+}
+#endif
+
+void xorblock(uint8_t* dst, const uint8_t* const* srcs, uint32_t cnt, uint32_t leng)
+{
+    if (cnt == 0) {
+        memset(dst, 0, leng);
+        return;
+    }
+    if (cnt == 1) {
+        if (dst != srcs[0]) {
+            memcpy(dst, srcs[0], leng);
+        }
+        return;
+    }
+    xor_impl(dst, srcs, cnt, leng);
+}
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+/* XCR0 - OS saves state for all requested register sets */
+static inline int xor_xsave_enabled(uint32_t mask)
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & mask) == mask;
+}
+#endif
+
+static int xor_selftest(void)
+{
+    uint8_t src[5][333 + 7];
+    uint8_t d1[333], d2[333];
+    const uint8_t* srcs[5];
+    uint32_t i, j, cnt, leng;
+
+    for (i = 0; i < 5; i++) {
+        for (j = 0; j < sizeof(src[i]); j++) {
+            src[i][j] = (uint8_t)(j * 131 + i * 17 + (j >> 5));
+        }
+    }
+    for (cnt = 2; cnt <= 5; cnt++) {
+        for (leng = 1; leng <= sizeof(d1); leng += 37) {
+            for (i = 0; i < cnt; i++) {
+                srcs[i] = src[i] + ((i + leng) % 7); // misaligned on purpose
+            }
+            xorblock_generic(d1, srcs, cnt, leng);
+            xor_impl(d2, srcs, cnt, leng);
+            if (memcmp(d1, d2, leng) != 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* implementation with given name if this machine can run it, NULL otherwise */
+static xorblock_fn xor_lookup(const char* name)
+{
+    if (strcmp(name, "standard") == 0) {
+        return xorblock_generic;
+    }
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+    uint32_t eax, ebx, ecx, edx;
+    int have_avx2, have_avx512;
+
+    have_avx2 = 0;
+    have_avx512 = 0;
+    __cpuid_count(1, 0, eax, ebx, ecx, edx);
+    if ((ecx >> 27) & 1) { // osxsave
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = ((ebx >> 5) & 1) && xor_xsave_enabled(0x06);
+        have_avx512 = ((ebx >> 16) & 1) && xor_xsave_enabled(0xE6);
+    }
+    (void)have_avx2;
+    (void)have_avx512;
+#if defined(ENABLE_AVX2)
+    if (have_avx2 && strcmp(name, "avx2") == 0) {
+        return xorblock_avx2;
+    }
+#endif
+#if defined(ENABLE_AVX512F)
+    if (have_avx512 && strcmp(name, "avx512f") == 0) {
+        return xorblock_avx512;
+    }
+#endif
+#endif
+#if defined(__aarch64__)
+    if (strcmp(name, "neon") == 0) {
+        return xorblock_neon;
+    }
+#endif
+    return NULL;
+}
+
+int xorblock_select(const char* name)
+{
+    xorblock_fn fn;
+
+    fn = xor_lookup(name);
+    if (fn == NULL) {
+        return 0;
+    }
+    xor_impl = fn;
+    xor_impl_name = (fn == xorblock_generic) ? "standard" : name;
+    return 1;
+}
+
+const char* xorblock_autodetect(void)
+{
+    static const char* const preferred[] = {"avx512f", "avx2", "neon"};
+    uint32_t i;
+
+    xor_impl = xorblock_generic;
+    xor_impl_name = "standard";
+    for (i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+        if (xorblock_select(preferred[i])) {
+            break;
+        }
+    }
+    if (xor_impl != xorblock_generic && xor_selftest() == 0) {
+        syslog(LOG_WARNING, "xorblock: %s implementation failed self test - using standard one", xor_impl_name);
+        xor_impl = xorblock_generic;
+        xor_impl_name = "standard";
+    }
+    return xor_impl_name;
+}
+
+const char* xorblock_implementation(void)
+{
+    return xor_impl_name;
+}
+
+void xorblock_init(void)
+{
+    xorblock_autodetect();
+}
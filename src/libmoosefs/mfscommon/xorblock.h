@@ -0,0 +1,20 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef _XORBLOCK_H_
+#define _XORBLOCK_H_
+#include <inttypes.h>
+
+/* dst = srcs[0] ^ srcs[1] ^ ... ^ srcs[cnt-1] - every source is read once (dst may be the same buffer as one of the sources) */
+void xorblock(uint8_t *dst,const uint8_t * const *srcs,uint32_t cnt,uint32_t leng);
+void xorblock_generic(uint8_t *dst,const uint8_t * const *srcs,uint32_t cnt,uint32_t leng);
+
+void xorblock_init(void);
+/* select the fastest available implementation (called by xorblock_init) - returns its name */
+const char* xorblock_autodetect(void);
+const char* xorblock_implementation(void);
+/* use the named implementation ("standard", "avx2", "avx512f", "neon") without self test - returns 0 (and changes nothing) when this machine can not run it */
+int xorblock_select(const char* name);
+
+#endif
@@ -0,0 +1,56 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <inttypes.h>
+#include <immintrin.h>
+
+/* four YMM accumulators - 128 bytes of every source per iteration */
+void xorblock_avx2(uint8_t* dst, const uint8_t* const* srcs, uint32_t cnt, uint32_t leng)
+{
+    __m256i a0, a1, a2, a3;
+    uint32_t off, i;
+    const uint8_t* s;
+
+    off = 0;
+    while (off + 128 <= leng) {
+        s = srcs[0] + off;
+        a0 = _mm256_loadu_si256((const __m256i*)(s));
+        a1 = _mm256_loadu_si256((const __m256i*)(s + 32));
+        a2 = _mm256_loadu_si256((const __m256i*)(s + 64));
+        a3 = _mm256_loadu_si256((const __m256i*)(s + 96));
+        for (i = 1; i < cnt; i++) {
+            s = srcs[i] + off;
+            a0 = _mm256_xor_si256(a0, _mm256_loadu_si256((const __m256i*)(s)));
+            a1 = _mm256_xor_si256(a1, _mm256_loadu_si256((const __m256i*)(s + 32)));
+            a2 = _mm256_xor_si256(a2, _mm256_loadu_si256((const __m256i*)(s + 64)));
+            a3 = _mm256_xor_si256(a3, _mm256_loadu_si256((const __m256i*)(s + 96)));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + off), a0);
+        _mm256_storeu_si256((__m256i*)(dst + off + 32), a1);
+        _mm256_storeu_si256((__m256i*)(dst + off + 64), a2);
+        _mm256_storeu_si256((__m256i*)(dst + off + 96), a3);
+        off += 128;
+    }
+    while (off + 32 <= leng) {
+        a0 = _mm256_loadu_si256((const __m256i*)(srcs[0] + off));
+        for (i = 1; i < cnt; i++) {
+            a0 = _mm256_xor_si256(a0, _mm256_loadu_si256((const __m256i*)(srcs[i] + off)));
+        }
+        _mm256_storeu_si256((__m256i*)(dst + off), a0);
+        off += 32;
+    }
+    while (off < leng) {
+        uint8_t b = srcs[0][off];
+        for (i = 1; i < cnt; i++) {
+            b ^= srcs[i][off];
+        }
+        dst[off] = b;
+        off++;
+    }
+    _mm256_zeroupper();
+}
+
+#endif
@@ -0,0 +1,64 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX512F
+
+#include <inttypes.h>
+#include <immintrin.h>
+
+/* four ZMM accumulators - 256 bytes of every source per iteration, two sources folded per vpternlogq */
+void xorblock_avx512(uint8_t* dst, const uint8_t* const* srcs, uint32_t cnt, uint32_t leng)
+{
+    __m512i a0, a1, a2, a3;
+    uint32_t off, i;
+    const uint8_t *s, *t;
+
+    off = 0;
+    while (off + 256 <= leng) {
+        s = srcs[0] + off;
+        a0 = _mm512_loadu_si512((const void*)(s));
+        a1 = _mm512_loadu_si512((const void*)(s + 64));
+        a2 = _mm512_loadu_si512((const void*)(s + 128));
+        a3 = _mm512_loadu_si512((const void*)(s + 192));
+        for (i = 1; i + 1 < cnt; i += 2) {
+            s = srcs[i] + off;
+            t = srcs[i + 1] + off;
+            a0 = _mm512_ternarylogic_epi64(a0, _mm512_loadu_si512((const void*)(s)), _mm512_loadu_si512((const void*)(t)), 0x96);
+            a1 = _mm512_ternarylogic_epi64(a1, _mm512_loadu_si512((const void*)(s + 64)), _mm512_loadu_si512((const void*)(t + 64)), 0x96);
+            a2 = _mm512_ternarylogic_epi64(a2, _mm512_loadu_si512((const void*)(s + 128)), _mm512_loadu_si512((const void*)(t + 128)), 0x96);
+            a3 = _mm512_ternarylogic_epi64(a3, _mm512_loadu_si512((const void*)(s + 192)), _mm512_loadu_si512((const void*)(t + 192)), 0x96);
+        }
+        if (i < cnt) {
+            s = srcs[i] + off;
+            a0 = _mm512_xor_si512(a0, _mm512_loadu_si512((const void*)(s)));
+            a1 = _mm512_xor_si512(a1, _mm512_loadu_si512((const void*)(s + 64)));
+            a2 = _mm512_xor_si512(a2, _mm512_loadu_si512((const void*)(s + 128)));
+            a3 = _mm512_xor_si512(a3, _mm512_loadu_si512((const void*)(s + 192)));
+        }
+        _mm512_storeu_si512((void*)(dst + off), a0);
+        _mm512_storeu_si512((void*)(dst + off + 64), a1);
+        _mm512_storeu_si512((void*)(dst + off + 128), a2);
+        _mm512_storeu_si512((void*)(dst + off + 192), a3);
+        off += 256;
+    }
+    while (off + 64 <= leng) {
+        a0 = _mm512_loadu_si512((const void*)(srcs[0] + off));
+        for (i = 1; i < cnt; i++) {
+            a0 = _mm512_xor_si512(a0, _mm512_loadu_si512((const void*)(srcs[i] + off)));
+        }
+        _mm512_storeu_si512((void*)(dst + off), a0);
+        off += 64;
+    }
+    while (off < leng) {
+        uint8_t b = srcs[0][off];
+        for (i = 1; i < cnt; i++) {
+            b ^= srcs[i][off];
+        }
+        dst[off] = b;
+        off++;
+    }
+    _mm256_zeroupper();
+}
+
+#endif
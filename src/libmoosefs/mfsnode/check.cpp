@@ -79,6 +79,15 @@ static inline int hdd_check_filename(const char* fname, uint64_t* chunkid, uint3
     return 0;
 }
 
+int chunk_parse_filename(const char* fname, uint64_t* chunkid, uint32_t* version)
+{
+    uint32_t i = strlen(fname);
+    if (i < 35) {
+        return -1;
+    }
+    return hdd_check_filename(fname + (i - 35), chunkid, version);
+}
+
 int chunk_repair(const char* fname, uint8_t mode, uint8_t showok)
 {
     uint64_t namechunkid;
@@ -11,5 +11,7 @@
 #define MODE_REPAIR 8
 
 int chunk_repair(const char *fname, uint8_t mode, uint8_t showok);
+/* chunkid and version from ..../chunk_XXXXXXXXXXXXXXXX_YYYYYYYY.mfs - returns -1 for other names */
+int chunk_parse_filename(const char *fname, uint64_t *chunkid, uint32_t *version);
 
 #endif // MFSNODE_CHECK_H
@@ -4,42 +4,7 @@
 
 #include "mfsnode/node.h"
 
-bool read_chunkfolder(char* chunkfolder)
-{
-    mycrc32_init();
-    DIR* dr = opendir(chunkfolder);
-    // chunkfolder must exist
-    if (dr) {
-        for (unsigned int i = 0; i < 256; i++) {
-            char chunkpath[256];
-            memset(chunkpath, 0, sizeof(chunkpath));
-            sprintf(chunkpath, "%s/%02hhX", chunkfolder, i);
-            // subfolders might exist
-            struct dirent* en;
-            DIR* subdir = opendir(chunkpath);
-            if (subdir) {
-                // iterate chunk files
-                while ((en = readdir(subdir)) != NULL) {
-                    if (!strcmp(en->d_name, ".") || !strcmp(en->d_name, ".."))
-                        continue;
-                    // build chunkfile
-                    int file_result;
-                    char chunkfile[256];
-                    memset(chunkfile, 0, sizeof(chunkfile));
-                    sprintf(chunkfile, "%s/%s", chunkpath, en->d_name);
-                    file_result = chunk_repair(chunkfile, MODE_FAST, true);
-                    if (file_result != 0)
-                        return false;
-                }
-                closedir(subdir);
-            }
-        }
-        return true;
-    }
-    return false;
-}
-
-void launch_chunkserver(int space_mode, bool net_type)
+void launch_chunkserver(int space_mode, bool net_type, unsigned int check_threads, bool check_background)
 {
     if (!set_local_node(net_type)) {
         printf("error provisioning storage node..\n");
@@ -53,8 +18,10 @@ void launch_chunkserver(int space_mode, bool net_type)
     printf("datapath:   %s\n", node_info.datapath);
     printf("chunkspath: %s\n", node_info.chunkpath);
 
-    // halt chunkserver thread
-    if (!read_chunkfolder(node_info.chunkpath)) {
+    // halt chunkserver thread (unless chunks are verified in background)
+    char journalfile[PATH_MAX];
+    snprintf(journalfile, sizeof(journalfile), "%s/%s", node_info.datapath, VERIFY_JOURNAL_NAME);
+    if (!chunk_verify_start(node_info.chunkpath, journalfile, check_threads, check_background)) {
         printf("error found whilst checking chunk files..\n");
         return;
     }
@@ -66,6 +33,8 @@ void launch_chunkserver(int space_mode, bool net_type)
         if (get_quit_signal()) break;
     }
 
+    chunk_verify_stop();
+
     if (chunk_thread.joinable()) chunk_thread.join();
 
     return;
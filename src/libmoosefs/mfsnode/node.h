@@ -8,6 +8,7 @@
 #include "mfscommon/crc.h"
 #include "mfsnode/init.h"
 #include "mfsnode/check.h"
+#include "mfsnode/verify.h"
 #include "mfschunkserver/hddspacemgr.h"
 
 #include <dirent.h>
@@ -17,6 +18,6 @@
 
 extern std::thread chunk_thread;
 
-void launch_chunkserver(int space_mode, bool net_type);
+void launch_chunkserver(int space_mode, bool net_type, unsigned int check_threads, bool check_background);
 
 #endif // MFSNODE_NODE_H
@@ -0,0 +1,289 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "crc.h"
+#include "datapack.h"
+
+#include "mfsnode/check.h"
+#include "mfsnode/verify.h"
+
+#define JOURNAL_SIGNATURE "MFSVJ 1\n"
+#define JOURNAL_SIGNATURE_SIZE 8
+#define JOURNAL_RECORD_SIZE (8 + 4 + 1 + 8 + 8 + 4)
+
+typedef struct verifyrec {
+    uint64_t chunkid;
+    uint32_t version;
+    uint8_t pathid;
+    uint64_t size;
+    int64_t mtime_sec;
+    uint32_t mtime_nsec;
+} verifyrec;
+
+// previous run (read only while workers are running)
+static std::unordered_map<uint64_t, verifyrec> journal;
+// this run - guarded by verifylock
+static std::vector<verifyrec> verified;
+static bool pathdone[256];
+static std::mutex verifylock;
+
+static std::string verifyfolder;
+static std::string verifyjournal;
+static bool verifybackground;
+static unsigned int verifythreads;
+static std::thread verifythread;
+
+static std::atomic<unsigned int> nextpath;
+static std::atomic<bool> verifystop;
+static std::atomic<bool> verifyfailed;
+static std::atomic<uint64_t> stats_checked;
+static std::atomic<uint64_t> stats_skipped;
+static std::atomic<uint64_t> stats_damaged;
+
+static void journal_load(void)
+{
+    uint8_t rbuff[JOURNAL_RECORD_SIZE];
+    const uint8_t* rptr;
+    verifyrec rec;
+    FILE* fd;
+
+    journal.clear();
+    fd = fopen(verifyjournal.c_str(), "rb");
+    if (fd == NULL) {
+        return;
+    }
+    if (fread(rbuff, 1, JOURNAL_SIGNATURE_SIZE, fd) != JOURNAL_SIGNATURE_SIZE || memcmp(rbuff, JOURNAL_SIGNATURE, JOURNAL_SIGNATURE_SIZE) != 0) {
+        printf("%s: wrong journal header - verifying all chunks\n", verifyjournal.c_str());
+        fclose(fd);
+        return;
+    }
+    // truncated tail (crash while writing) just drops last record
+    while (fread(rbuff, 1, JOURNAL_RECORD_SIZE, fd) == JOURNAL_RECORD_SIZE) {
+        rptr = rbuff;
+        rec.chunkid = get64bit(&rptr);
+        rec.version = get32bit(&rptr);
+        rec.pathid = get8bit(&rptr);
+        rec.size = get64bit(&rptr);
+        rec.mtime_sec = (int64_t)get64bit(&rptr);
+        rec.mtime_nsec = get32bit(&rptr);
+        journal[rec.chunkid] = rec;
+    }
+    fclose(fd);
+}
+
+static void journal_store_record(FILE* fd, const verifyrec& rec)
+{
+    uint8_t wbuff[JOURNAL_RECORD_SIZE];
+    uint8_t* wptr = wbuff;
+    put64bit(&wptr, rec.chunkid);
+    put32bit(&wptr, rec.version);
+    put8bit(&wptr, rec.pathid);
+    put64bit(&wptr, rec.size);
+    put64bit(&wptr, (uint64_t)rec.mtime_sec);
+    put32bit(&wptr, rec.mtime_nsec);
+    fwrite(wbuff, 1, JOURNAL_RECORD_SIZE, fd);
+}
+
+/* verified chunks + previous entries from subfolders that were not finished (interrupted run) */
+static void journal_store(void)
+{
+    std::string tmpname = verifyjournal + ".tmp";
+    FILE* fd;
+    bool ok;
+
+    fd = fopen(tmpname.c_str(), "wb");
+    if (fd == NULL) {
+        printf("%s: can't create journal\n", tmpname.c_str());
+        return;
+    }
+    fwrite(JOURNAL_SIGNATURE, 1, JOURNAL_SIGNATURE_SIZE, fd);
+    {
+        std::lock_guard<std::mutex> lock(verifylock);
+        for (const auto& rec : verified) {
+            journal_store_record(fd, rec);
+        }
+        for (const auto& it : journal) {
+            if (!pathdone[it.second.pathid]) {
+                journal_store_record(fd, it.second);
+            }
+        }
+    }
+    ok = (fflush(fd) == 0 && fsync(fileno(fd)) == 0 && !ferror(fd));
+    fclose(fd);
+    if (!ok || rename(tmpname.c_str(), verifyjournal.c_str()) < 0) {
+        printf("%s: error writing journal\n", verifyjournal.c_str());
+        unlink(tmpname.c_str());
+    }
+}
+
+static bool chunk_stat(const char* chunkfile, uint8_t pathid, verifyrec* rec)
+{
+    struct stat sb;
+    if (chunk_parse_filename(chunkfile, &(rec->chunkid), &(rec->version)) < 0) {
+        return false;
+    }
+    if (stat(chunkfile, &sb) < 0) {
+        return false;
+    }
+    rec->pathid = pathid;
+    rec->size = sb.st_size;
+    rec->mtime_sec = sb.st_mtim.tv_sec;
+    rec->mtime_nsec = sb.st_mtim.tv_nsec;
+    return true;
+}
+
+static bool chunk_unchanged(const verifyrec& rec)
+{
+    auto it = journal.find(rec.chunkid);
+    if (it == journal.end()) {
+        return false;
+    }
+    return it->second.version == rec.version && it->second.size == rec.size && it->second.mtime_sec == rec.mtime_sec && it->second.mtime_nsec == rec.mtime_nsec;
+}
+
+/* each worker takes whole subfolders, so the disk sees a few sequential streams */
+static void verify_worker(void)
+{
+    std::vector<verifyrec> local;
+    char chunkpath[PATH_MAX];
+    char chunkfile[PATH_MAX];
+    struct dirent* en;
+    verifyrec rec;
+    unsigned int pathid;
+    bool known, complete;
+    DIR* subdir;
+
+    while (!verifystop && !verifyfailed) {
+        pathid = nextpath++;
+        if (pathid >= 256) {
+            break;
+        }
+        snprintf(chunkpath, sizeof(chunkpath), "%s/%02X", verifyfolder.c_str(), pathid);
+        complete = true;
+        subdir = opendir(chunkpath);
+        if (subdir) {
+            while ((en = readdir(subdir)) != NULL) {
+                if (verifystop || verifyfailed) {
+                    complete = false;
+                    break;
+                }
+                if (!strcmp(en->d_name, ".") || !strcmp(en->d_name, "..")) {
+                    continue;
+                }
+                snprintf(chunkfile, sizeof(chunkfile), "%s/%s", chunkpath, en->d_name);
+                known = chunk_stat(chunkfile, pathid, &rec);
+                if (known && chunk_unchanged(rec)) {
+                    local.push_back(rec);
+                    stats_skipped++;
+                    continue;
+                }
+                if (chunk_repair(chunkfile, MODE_FAST, 0) != 0) {
+                    stats_damaged++;
+                    if (!verifybackground) {
+                        verifyfailed = true;
+                        complete = false;
+                        break;
+                    }
+                    // chunk may be modified by running chunkserver - don't record it, it will be checked again on next start
+                    continue;
+                }
+                stats_checked++;
+                if (known) {
+                    local.push_back(rec);
+                }
+            }
+            closedir(subdir);
+        }
+        std::lock_guard<std::mutex> lock(verifylock);
+        verified.insert(verified.end(), local.begin(), local.end());
+        pathdone[pathid] = complete;
+        local.clear();
+    }
+}
+
+static bool verify_run(void)
+{
+    std::vector<std::thread> workers;
+    unsigned int i;
+
+    for (i = 0; i < verifythreads; i++) {
+        workers.emplace_back(verify_worker);
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (!verifyfailed) {
+        journal_store();
+    }
+    printf("chunk verification %s: %llu checked, %llu unchanged, %llu damaged\n",
+        verifystop ? "interrupted" : "finished",
+        (unsigned long long)stats_checked, (unsigned long long)stats_skipped, (unsigned long long)stats_damaged);
+    return !verifyfailed;
+}
+
+bool chunk_verify_start(const char* chunkfolder, const char* journalfile, unsigned int threads, bool background)
+{
+    DIR* dr;
+
+    mycrc32_init();
+    // chunkfolder must exist
+    dr = opendir(chunkfolder);
+    if (dr == NULL) {
+        return false;
+    }
+    closedir(dr);
+
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+    if (threads > VERIFY_MAX_THREADS) {
+        threads = VERIFY_MAX_THREADS;
+    }
+
+    verifyfolder = chunkfolder;
+    verifyjournal = journalfile;
+    verifybackground = background;
+    verifythreads = threads;
+    verified.clear();
+    memset(pathdone, 0, sizeof(pathdone));
+    nextpath = 0;
+    verifystop = false;
+    verifyfailed = false;
+    stats_checked = 0;
+    stats_skipped = 0;
+    stats_damaged = 0;
+    journal_load();
+
+    printf("verifying chunks (%u threads%s, %zu in journal)\n", threads, background ? ", background" : "", journal.size());
+    if (background) {
+        verifythread = std::thread(verify_run);
+        return true;
+    }
+    return verify_run();
+}
+
+void chunk_verify_stop(void)
+{
+    verifystop = true;
+    if (verifythread.joinable()) {
+        verifythread.join();
+    }
+}
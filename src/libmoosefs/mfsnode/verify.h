@@ -0,0 +1,20 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef MFSNODE_VERIFY_H
+#define MFSNODE_VERIFY_H
+
+#define VERIFY_JOURNAL_NAME "chunkverify.jnl"
+#define VERIFY_MAX_THREADS 16
+
+/* check all chunk files in chunkfolder using 'threads' workers (0 - auto); chunks recorded in
+ * journal with the same version, size and mtime are skipped
+ * foreground - returns false on first damaged chunk
+ * background - returns immediately, damaged chunks are only logged (and rechecked on next start) */
+bool chunk_verify_start(const char* chunkfolder, const char* journalfile, unsigned int threads, bool background);
+
+/* waits for background verification and writes journal */
+void chunk_verify_stop(void);
+
+#endif // MFSNODE_VERIFY_H
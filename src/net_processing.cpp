@@ -18,6 +18,7 @@
 #include <netmessagemaker.h>
 #include <netbase.h>
 #include <policy/policy.h>
+#include <pos/prevalidate.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <random.h>
@@ -3377,13 +3378,26 @@ bool static ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStrea
         {
         LOCK(cs_main);
 
-        if (!LookupBlockIndex(cmpctblock.header.hashPrevBlock)) {
+        const CBlockIndex* pindexPrev = LookupBlockIndex(cmpctblock.header.hashPrevBlock);
+        if (!pindexPrev) {
             // Doesn't connect (or is genesis), instead of DoSing in AcceptBlockHeader, request deeper headers
             if (!::ChainstateActive().IsInitialBlockDownload())
                 connman->PushMessage(pfrom, msgMaker.Make((pfrom->nServices & NODE_HEADERS_COMPRESSED) ? NetMsgType::GETHEADERS2 : NetMsgType::GETHEADERS, ::ChainActive().GetLocator(pindexBestHeader), uint256()));
             return true;
         }
 
+        // Reject bogus stake before storing the header or fetching any txn
+        CValidationState statePreValidate;
+        if (PreValidateStakeBlock(cmpctblock, pindexPrev, statePreValidate) == StakePreValidation::INVALID) {
+            int nDoS;
+            if (statePreValidate.IsInvalid(nDoS) && nDoS > 0) {
+                Misbehaving(pfrom->GetId(), nDoS, strprintf("Peer %d sent us invalid stake via cmpctblock", pfrom->GetId()));
+            } else {
+                LogPrint(BCLog::NET, "Peer %d sent us cmpctblock %s failing stake pre-validation (%s)\n", pfrom->GetId(), cmpctblock.header.GetHash().ToString(), FormatStateMessage(statePreValidate));
+            }
+            return true;
+        }
+
         if (!LookupBlockIndex(cmpctblock.header.GetHash())) {
             received_new_header = true;
         }
@@ -8,7 +8,9 @@
 #include <pos/kernel.h>
 
 #include <chainparams.h>
+#include <hash.h>
 #include <policy/policy.h>
+#include <pos/kernelcache.h>
 #include <rpc/blockchain.h>
 
 /**
@@ -65,9 +67,9 @@ uint256 ComputeStakeModifier(const CBlockIndex* pindexPrev, const uint256& kerne
 
     const uint256 stakeModifier = pindexPrev->IsProofOfStake() ? pindexPrev->nStakeModifier : pindexPrev->GetBlockHash();
 
-    CDataStream ss(SER_GETHASH, 0);
+    CHashWriter ss(SER_GETHASH, 0);
     ss << kernel << stakeModifier;
-    uint256 calcModifier = Hash(ss.begin(), ss.end());
+    uint256 calcModifier = ss.GetHash();
     LogPrint(BCLog::POS, "%s: height %d pprev %s modifier %s\n",
                          __func__, pindexPrev->nHeight + 1, pindexPrev->IsProofOfStake() ? "PoS" : "PoW", calcModifier.ToString());
 
@@ -127,10 +129,10 @@ bool CheckStakeKernelHash(const CBlockIndex* pindexPrev,
     int nStakeModifierHeight = pindexPrev->nHeight;
     int64_t nStakeModifierTime = pindexPrev->nTime;
 
-    CDataStream ss(SER_GETHASH, 0);
+    CHashWriter ss(SER_GETHASH, 0);
     ss << nStakeModifier;
     ss << nBlockFromTime << prevout.hash << prevout.n << nTime;
-    hashProofOfStake = Hash(ss.begin(), ss.end());
+    hashProofOfStake = ss.GetHash();
 
     if (fPrintProofOfStake) {
         LogPrint(BCLog::POS, "%s: using modifier=%s at height=%d timestamp=%s\n",
@@ -193,15 +195,20 @@ bool GetKernelInfo(const CBlockIndex* blockindex, const CTransaction& tx, uint25
     uint32_t nBlockFromTime = stakeIndex->nTime;
     uint32_t nTime = blockindex->nTime;
 
-    CDataStream ss(SER_GETHASH, 0);
+    CHashWriter ss(SER_GETHASH, 0);
     ss << blockindex->pprev->nStakeModifier;
     ss << nBlockFromTime << prevout.hash << prevout.n << nTime;
-    hash = Hash(ss.begin(), ss.end());
+    hash = ss.GetHash();
 
     return true;
 };
 
 bool CheckProofOfStake(CValidationState& state, const CBlockIndex* pindexPrev, const CTransaction& tx, int64_t nTime, unsigned int nBits, uint256& hashProofOfStake, uint256& targetProofOfStake, const Consensus::Params& params)
+{
+    return CheckProofOfStake(state, pindexPrev, tx, nTime, nBits, hashProofOfStake, targetProofOfStake, params, ::ChainstateActive().CoinsTip());
+}
+
+bool CheckProofOfStake(CValidationState& state, const CBlockIndex* pindexPrev, const CTransaction& tx, int64_t nTime, unsigned int nBits, uint256& hashProofOfStake, uint256& targetProofOfStake, const Consensus::Params& params, const CCoinsView& view)
 {
     // pindexPrev is the current tip, the block the new block will connect on to
     // nTime is the time of the new/next block
@@ -219,13 +226,20 @@ bool CheckProofOfStake(CValidationState& state, const CBlockIndex* pindexPrev, c
     CAmount amount;
 
     Coin coin;
-    if (!::ChainstateActive().CoinsTip().GetCoin(txin.prevout, coin) || coin.IsSpent()) {
+    if (!view.GetCoin(txin.prevout, coin) || coin.IsSpent()) {
         return false;
     }
 
-    CBlockIndex* pindex = ::ChainActive()[coin.nHeight];
-    if (!pindex) {
-        return false;
+    // Kernel inputs are usually cached from when they were connected
+    CStakeKernelInput input;
+    if (stakeKernelCache.Lookup(txin.prevout, input) && input.nHeight == (int)coin.nHeight) {
+        nBlockFromTime = input.nBlockTime;
+    } else {
+        CBlockIndex* pindex = ::ChainActive()[coin.nHeight];
+        if (!pindex) {
+            return false;
+        }
+        nBlockFromTime = pindex->GetBlockTime();
     }
 
     nDepth = pindexPrev->nHeight - coin.nHeight;
@@ -237,7 +251,6 @@ bool CheckProofOfStake(CValidationState& state, const CBlockIndex* pindexPrev, c
 
     kernelPubKey = coin.out.scriptPubKey;
     amount = coin.out.nValue;
-    nBlockFromTime = pindex->GetBlockTime();
     const CScript& scriptSig = txin.scriptSig;
     ScriptError serror = SCRIPT_ERR_OK;
 
@@ -276,34 +289,42 @@ bool CheckKernel(const CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTim
 {
     uint256 hashProofOfStake, targetProofOfStake;
 
-    Coin coin;
-    {
+    // The cache only holds unspent outputs of the active chain, so a hit
+    // saves taking cs_main for every coin tried by the staker
+    CStakeKernelInput input;
+    if (!stakeKernelCache.Lookup(prevout, input)) {
         LOCK(::cs_main);
+
+        Coin coin;
         if (!::ChainstateActive().CoinsTip().GetCoin(prevout, coin)) {
             return error("%s: prevout not found", __func__);
         }
-    }
 
-    if (coin.IsSpent()) {
-        return error("%s: prevout is spent", __func__);
-    }
+        if (coin.IsSpent()) {
+            return error("%s: prevout is spent", __func__);
+        }
 
-    CBlockIndex* pindex = ::ChainActive()[coin.nHeight];
-    if (!pindex) {
-        return false;
+        CBlockIndex* pindex = ::ChainActive()[coin.nHeight];
+        if (!pindex) {
+            return false;
+        }
+
+        input.nHeight = coin.nHeight;
+        input.nBlockTime = pindex->nTime;
+        input.nValue = coin.out.nValue;
+        stakeKernelCache.Add(prevout, input);
     }
 
     int nRequiredDepth = std::min((int)(COINBASE_MATURITY - 1), (int)(pindexPrev->nHeight / 2));
-    int nDepth = pindexPrev->nHeight - coin.nHeight;
+    int nDepth = pindexPrev->nHeight - input.nHeight;
 
     if (nRequiredDepth > nDepth) {
         return false;
     }
 
     if (pBlockTime) {
-        *pBlockTime = pindex->GetBlockTime();
+        *pBlockTime = input.nBlockTime;
     }
 
-    CAmount amount = coin.out.nValue;
-    return CheckStakeKernelHash(pindexPrev, nBits, *pBlockTime, amount, prevout, nTime, hashProofOfStake, targetProofOfStake);
+    return CheckStakeKernelHash(pindexPrev, nBits, input.nBlockTime, input.nValue, prevout, nTime, hashProofOfStake, targetProofOfStake);
 }
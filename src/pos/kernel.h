@@ -42,6 +42,11 @@ bool GetKernelInfo(const CBlockIndex *blockindex, const CTransaction &tx, uint25
  */
 bool CheckProofOfStake(CValidationState &state, const CBlockIndex *pindexPrev, const CTransaction &tx, int64_t nTime, unsigned int nBits, uint256 &hashProofOfStake, uint256 &targetProofOfStake, const Consensus::Params& params) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * As above, with the kernel input looked up in view instead of the chain tip
+ */
+bool CheckProofOfStake(CValidationState &state, const CBlockIndex *pindexPrev, const CTransaction &tx, int64_t nTime, unsigned int nBits, uint256 &hashProofOfStake, uint256 &targetProofOfStake, const Consensus::Params& params, const CCoinsView& view) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /**
  * Check whether the coinstake timestamp meets protocol
  */
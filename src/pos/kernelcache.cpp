@@ -0,0 +1,77 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pos/kernelcache.h>
+
+#include <chain.h>
+#include <consensus/params.h>
+
+CStakeKernelCache stakeKernelCache;
+
+void CStakeKernelCache::Add(const COutPoint& prevout, const CStakeKernelInput& input)
+{
+    LOCK(cs);
+    cacheKernels.insert(prevout, input);
+}
+
+bool CStakeKernelCache::Lookup(const COutPoint& prevout, CStakeKernelInput& input) const
+{
+    LOCK(cs);
+    return cacheKernels.get(prevout, input);
+}
+
+void CStakeKernelCache::Remove(const COutPoint& prevout)
+{
+    LOCK(cs);
+    cacheKernels.erase(prevout);
+}
+
+void CStakeKernelCache::Clear()
+{
+    LOCK(cs);
+    cacheKernels.clear();
+}
+
+size_t CStakeKernelCache::Size() const
+{
+    LOCK(cs);
+    return cacheKernels.size();
+}
+
+void CStakeKernelCache::ConnectBlock(const CBlock& block, const CBlockIndex* pindex, const Consensus::Params& params)
+{
+    LOCK(cs);
+
+    for (const auto& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const auto& txin : tx->vin) {
+                cacheKernels.erase(txin.prevout);
+            }
+        }
+        const uint256& txhash = tx->GetHash();
+        for (unsigned int n = 0; n < tx->vout.size(); n++) {
+            const CTxOut& out = tx->vout[n];
+            if (out.nValue < params.nStakeMinValue || out.nValue > params.nStakeMaxValue) {
+                continue;
+            }
+            CStakeKernelInput input;
+            input.nHeight = pindex->nHeight;
+            input.nBlockTime = pindex->nTime;
+            input.nValue = out.nValue;
+            cacheKernels.insert(COutPoint(txhash, n), input);
+        }
+    }
+}
+
+void CStakeKernelCache::DisconnectBlock(const CBlock& block)
+{
+    LOCK(cs);
+
+    for (const auto& tx : block.vtx) {
+        const uint256& txhash = tx->GetHash();
+        for (unsigned int n = 0; n < tx->vout.size(); n++) {
+            cacheKernels.erase(COutPoint(txhash, n));
+        }
+    }
+}
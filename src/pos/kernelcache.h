@@ -0,0 +1,62 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef POS_KERNELCACHE_H
+#define POS_KERNELCACHE_H
+
+#include <amount.h>
+#include <coins.h>
+#include <primitives/block.h>
+#include <sync.h>
+#include <unordered_lru_cache.h>
+
+class CBlockIndex;
+
+namespace Consensus {
+struct Params;
+}
+
+static const size_t DEFAULT_STAKE_KERNEL_CACHE_SIZE = 250000;
+
+/** Everything needed about a kernel input besides its script */
+struct CStakeKernelInput {
+    int nHeight{0};
+    uint32_t nBlockTime{0};
+    CAmount nValue{0};
+};
+
+/**
+ * Cache of stakeable outputs on the active chain, filled as coins are created
+ * when a block becomes the tip and dropped when spent or disconnected. It lets
+ * kernel checks skip the block index walk for the block time, and lets the
+ * staker test kernels without taking cs_main. Entries are always a subset of
+ * the UTXO set of the active chain, so only ConnectTip and DisconnectTip may
+ * update it (never ConnectBlock, which also runs on scratch views). When full,
+ * the least recently used entries are dropped; a miss simply falls back to the
+ * coins view.
+ */
+class CStakeKernelCache
+{
+private:
+    mutable CCriticalSection cs;
+    mutable unordered_lru_cache<COutPoint, CStakeKernelInput, SaltedOutpointHasher> cacheKernels GUARDED_BY(cs);
+
+public:
+    explicit CStakeKernelCache(size_t nMaxSizeIn = DEFAULT_STAKE_KERNEL_CACHE_SIZE) : cacheKernels(nMaxSizeIn) {}
+
+    void Add(const COutPoint& prevout, const CStakeKernelInput& input);
+    bool Lookup(const COutPoint& prevout, CStakeKernelInput& input) const;
+    void Remove(const COutPoint& prevout);
+    void Clear();
+    size_t Size() const;
+
+    /** Drop inputs spent by the block and add its stakeable outputs */
+    void ConnectBlock(const CBlock& block, const CBlockIndex* pindex, const Consensus::Params& params);
+    /** Drop outputs created by the block, spent inputs are re-learnt lazily */
+    void DisconnectBlock(const CBlock& block);
+};
+
+extern CStakeKernelCache stakeKernelCache;
+
+#endif // POS_KERNELCACHE_H
@@ -0,0 +1,112 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pos/prevalidate.h>
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <hash.h>
+#include <pos/kernel.h>
+#include <pos/signature.h>
+
+static CCriticalSection cs_stakecandidates;
+static std::list<uint256> listStakeCandidates;
+static std::map<uint256, bool> mapStakeCandidates;
+static const size_t MAX_STAKE_CANDIDATES_SIZE = 1000;
+
+static bool SearchStakeCandidate(const uint256 &candidateHash, bool &fValid)
+{
+    LOCK(cs_stakecandidates);
+
+    std::map<uint256, bool>::const_iterator mi = mapStakeCandidates.find(candidateHash);
+    if (mi == mapStakeCandidates.end()) {
+        return false;
+    }
+    fValid = mi->second;
+
+    return true;
+}
+
+static void AddStakeCandidate(const uint256 &candidateHash, bool fValid)
+{
+    LOCK(cs_stakecandidates);
+
+    if (!mapStakeCandidates.emplace(candidateHash, fValid).second) {
+        return;
+    }
+    listStakeCandidates.push_back(candidateHash);
+
+    while (listStakeCandidates.size() > MAX_STAKE_CANDIDATES_SIZE) {
+        mapStakeCandidates.erase(listStakeCandidates.front());
+        listStakeCandidates.pop_front();
+    }
+}
+
+static StakePreValidation RejectStakeCandidate(const uint256 &candidateHash, CValidationState &state, int nDoS, const std::string &strRejectReason, const std::string &strDebugMessage)
+{
+    AddStakeCandidate(candidateHash, false);
+    state.DoS(nDoS, false, REJECT_INVALID, strRejectReason, false, strDebugMessage);
+    return StakePreValidation::INVALID;
+}
+
+StakePreValidation PreValidateStakeBlock(const CBlockHeaderAndShortTxIDs& cmpctblock, const CBlockIndex* pindexPrev, CValidationState& state)
+{
+    AssertLockHeld(cs_main);
+
+    const CBlockHeader& header = cmpctblock.header;
+    if (!header.IsProofOfStake() || !pindexPrev) {
+        return StakePreValidation::UNKNOWN;
+    }
+
+    // Peers which do not prefill the coinstake leave us nothing to check
+    const CTransactionRef coinstake = cmpctblock.GetCoinStake();
+    if (!coinstake) {
+        return StakePreValidation::UNKNOWN;
+    }
+
+    // Neither the coinstake nor the block signature are committed to by the
+    // header alone, so a candidate is identified by all three. Otherwise a peer
+    // could poison the cache for a valid block by pairing it with garbage.
+    const uint256 blockHash = header.GetHash();
+    const uint256 candidateHash = (CHashWriter(SER_GETHASH, 0) << blockHash << coinstake->GetHash() << cmpctblock.vchBlockSig).GetHash();
+    bool fValid;
+    if (SearchStakeCandidate(candidateHash, fValid)) {
+        if (fValid) {
+            return StakePreValidation::VALID;
+        }
+        state.DoS(0, false, REJECT_INVALID, "bad-cs-prevalidate", false, "stake candidate previously rejected");
+        return StakePreValidation::INVALID;
+    }
+
+    if (!coinstake->IsCoinStake()) {
+        return RejectStakeCandidate(candidateHash, state, 100, "bad-cs-missing", "second prefilled transaction is not a coinstake");
+    }
+
+    if (!CheckCoinStakeTimestamp(pindexPrev->nHeight + 1, header.GetBlockTime())) {
+        return RejectStakeCandidate(candidateHash, state, 100, "bad-cs-time", "coinstake timestamp violation");
+    }
+
+    if (!CheckBlockSignature(header, *coinstake, cmpctblock.vchBlockSig)) {
+        return RejectStakeCandidate(candidateHash, state, 100, "bad-blk-sign", "bad block signature");
+    }
+
+    // The kernel input can only be looked up when the block builds on our tip,
+    // as the coins view reflects the active chain
+    if (pindexPrev != ::ChainActive().Tip()) {
+        return StakePreValidation::UNKNOWN;
+    }
+
+    // Peers relay compact blocks before connecting them, so an honest peer
+    // may forward a bad kernel; refuse the download without punishing it
+    uint256 hashProofOfStake, targetProofOfStake;
+    CValidationState stateKernel;
+    if (!CheckProofOfStake(stateKernel, pindexPrev, *coinstake, header.nTime, header.nBits, hashProofOfStake, targetProofOfStake, Params().GetConsensus())) {
+        return RejectStakeCandidate(candidateHash, state, 0, "bad-cs-kernel", "stake kernel check failed");
+    }
+
+    LogPrint(BCLog::POS, "%s: stake candidate %s passed pre-validation\n", __func__, blockHash.ToString());
+    AddStakeCandidate(candidateHash, true);
+
+    return StakePreValidation::VALID;
+}
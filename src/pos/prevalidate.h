@@ -0,0 +1,27 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef POS_PREVALIDATE_H
+#define POS_PREVALIDATE_H
+
+#include <blockencodings.h>
+#include <validation.h>
+
+/** Outcome of checking a proof-of-stake announcement before the full block is fetched */
+enum class StakePreValidation {
+    UNKNOWN,    //!< not enough context to decide (no prefilled coinstake, or prev is not our tip)
+    VALID,      //!< block signature and stake kernel check out
+    INVALID,    //!< announcement is bogus, state holds the reason
+};
+
+/**
+ * Cheaply pre-validate a proof-of-stake compact block using only its header,
+ * block signature and prefilled coinstake. The block signature is always
+ * checked; the stake kernel is checked against the cached stake modifier of
+ * pindexPrev when it is our active tip. Decisive results are remembered in a
+ * bounded candidate cache so repeated announcements are not re-verified.
+ */
+StakePreValidation PreValidateStakeBlock(const CBlockHeaderAndShortTxIDs& cmpctblock, const CBlockIndex* pindexPrev, CValidationState& state) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+#endif // POS_PREVALIDATE_H
@@ -26,19 +26,22 @@ bool SignBlockWithKey(CBlock& block, const CKey& key)
     return true;
 }
 
-bool CheckBlockSignature(const CBlock& block)
+bool CheckBlockSignature(const CBlockHeader& header, const CTransaction& coinstake, const std::vector<unsigned char>& vchBlockSig)
 {
+    if (coinstake.vout.size() < 2) return false;
+
     std::vector<valtype> vSolutions;
     txnouttype whichType;
-    const CTxOut& txout = block.vtx[1]->vout[1];
+    const CTxOut& txout = coinstake.vout[1];
 
     whichType = Solver(txout.scriptPubKey, vSolutions);
+    if (vSolutions.empty()) return false;
     valtype& vchPubKey = vSolutions[0];
     if (whichType == TX_PUBKEY)
     {
         CPubKey key(vchPubKey);
-        if (block.vchBlockSig.empty()) return false;
-        return key.Verify(block.GetHash(), block.vchBlockSig);
+        if (vchBlockSig.empty()) return false;
+        return key.Verify(header.GetHash(), vchBlockSig);
     }
     else if (whichType == TX_PUBKEYHASH)
     {
@@ -47,9 +50,15 @@ bool CheckBlockSignature(const CBlock& block)
         CPubKey pubkey(vchPubKey);
 
         if (!pubkey.IsValid()) return false;
-        if (block.vchBlockSig.empty()) return false;
-        return pubkey.Verify(block.GetHash(), block.vchBlockSig);
+        if (vchBlockSig.empty()) return false;
+        return pubkey.Verify(header.GetHash(), vchBlockSig);
     }
 
     return false;
 }
+
+bool CheckBlockSignature(const CBlock& block)
+{
+    if (block.vtx.size() < 2) return false;
+    return CheckBlockSignature(block, *block.vtx[1], block.vchBlockSig);
+}
@@ -11,6 +11,7 @@
 using valtype = std::vector<unsigned char>;
 
 bool SignBlockWithKey(CBlock& block, const CKey& key);
+bool CheckBlockSignature(const CBlockHeader& header, const CTransaction& coinstake, const std::vector<unsigned char>& vchBlockSig);
 bool CheckBlockSignature(const CBlock& block);
 
 #endif // POS_SIGNATURE_H
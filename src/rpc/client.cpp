@@ -73,6 +73,17 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getblocktemplate", 0, "template_request" },
     { "submitproof", 0, "hexstring"},
     { "submitproof", 1, "privatekey"},
+    { "storageworkers", 0, "min" },
+    { "storageworkers", 1, "max" },
+    { "storageworkers", 2, "idle" },
+    { "storagereplication", 0, "window" },
+    { "storagereplication", 1, "bandwidth" },
+    { "getstoragenodestats", 0, "histograms" },
+    { "storagechallenge", 1, "chunks" },
+    { "storagechallenge", 2, "samples" },
+    { "storagechallenge", 3, "deadline" },
+    { "verifystoragechallenge", 1, "chunks" },
+    { "verifystoragechallenge", 2, "samples" },
     { "listsinceblock", 1, "target_confirmations" },
     { "listsinceblock", 2, "include_watchonly" },
     { "listsinceblock", 3, "include_removed" },
@@ -0,0 +1,207 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <storage/challenge.h>
+
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+#include <hash.h>
+#include <streams.h>
+#include <version.h>
+
+#include <libmoosefs/mfscommon/MFSCommunication.h>
+#ifdef __linux__
+#include <libmoosefs/mfschunkserver/hddspacemgr.h>
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+static const char STORAGE_CHALLENGE_TAG[] = "storagechallenge";
+
+static_assert(STORAGE_CHALLENGE_BLOCKSIZE == MFSBLOCKSIZE, "sampled block is a whole chunk block");
+
+uint256 StorageChallengeSeed(const uint256& blockHash)
+{
+    CHashWriter hw(SER_GETHASH, PROTOCOL_VERSION);
+    hw << std::string(STORAGE_CHALLENGE_TAG) << blockHash;
+    return hw.GetHash();
+}
+
+uint256 StorageChallengeCommitment(const std::vector<StorageChunkRef>& chunks)
+{
+    CHashWriter hw(SER_GETHASH, PROTOCOL_VERSION);
+    hw << chunks;
+    return hw.GetHash();
+}
+
+StorageChallengeSample StorageChallengeDerive(const uint256& seed, const uint256& commitment, const std::vector<StorageChunkRef>& chunks, uint32_t i)
+{
+    StorageChallengeSample s;
+    unsigned char idx[4];
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+
+    WriteLE32(idx, i);
+    CSHA256().Write(seed.begin(), seed.size()).Write(commitment.begin(), commitment.size()).Write(idx, sizeof(idx)).Finalize(hash);
+    const StorageChunkRef& chunk = chunks[ReadLE64(hash) % chunks.size()];
+    s.chunkid = chunk.chunkid;
+    s.version = chunk.version;
+    s.blocknum = chunk.blocks > 0 ? ReadLE64(hash + 8) % chunk.blocks : 0;
+    return s;
+}
+
+uint64_t StorageChallengeTag(const uint256& seed, const StorageChallengeSample& s, const uint8_t* data)
+{
+    unsigned char hdr[8 + 4 + 2];
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+
+    WriteLE64(hdr, s.chunkid);
+    WriteLE32(hdr + 8, s.version);
+    WriteLE16(hdr + 12, s.blocknum);
+    CSHA256().Write(seed.begin(), seed.size()).Write(hdr, sizeof(hdr)).Write(data, STORAGE_CHALLENGE_BLOCKSIZE).Finalize(hash);
+    return ReadLE64(hash);
+}
+
+uint256 StorageChallengeDigest(const uint256& seed, const uint256& commitment, const std::vector<StorageChallengeSample>& samples)
+{
+    CHashWriter hw(SER_GETHASH, PROTOCOL_VERSION);
+    hw << seed << commitment << samples;
+    return hw.GetHash();
+}
+
+uint8_t StorageChallengeLocalRead(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* data, uint32_t& crc)
+{
+#ifdef __linux__
+    uint8_t crcbuff[4];
+    int status = hdd_read(chunkid, version, blocknum, data, 0, MFSBLOCKSIZE, crcbuff);
+    if (status == MFS_STATUS_OK) {
+        crc = ReadBE32(crcbuff);
+    }
+    return status;
+#else
+    return MFS_ERROR_NOCHUNK;
+#endif
+}
+
+/**
+ * State shared by the readers of one challenge. Readers are detached, so a read blocked past the deadline keeps only
+ * this alive (never the caller's response) and its late result is dropped.
+ */
+struct StorageChallengeReaders {
+    uint256 seed;
+    StorageBlockReader reader;
+    std::chrono::steady_clock::time_point deadline;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<StorageChallengeSample> samples; //!< status stays MFS_ERROR_NOTDONE until read before the deadline
+    uint32_t next{0};
+    uint32_t running{0};
+};
+
+/** Reads sampled blocks taken from a shared index until all are taken or the deadline passes */
+static void StorageChallengeReader(std::shared_ptr<StorageChallengeReaders> state)
+{
+    std::vector<uint8_t> data(STORAGE_CHALLENGE_BLOCKSIZE);
+    std::unique_lock<std::mutex> lock(state->mutex);
+
+    while (state->next < state->samples.size() && std::chrono::steady_clock::now() < state->deadline) {
+        uint32_t i = state->next++;
+        StorageChallengeSample s = state->samples[i];
+        lock.unlock();
+        s.status = state->reader(s.chunkid, s.version, s.blocknum, data.data(), s.crc);
+        if (s.status == MFS_STATUS_OK) {
+            s.tag = StorageChallengeTag(state->seed, s, data.data());
+        }
+        lock.lock();
+        // the read itself may have run past the deadline - such a sample is not done
+        if (std::chrono::steady_clock::now() >= state->deadline) {
+            break;
+        }
+        if (s.status != MFS_STATUS_OK) {
+            s.crc = 0;
+            s.tag = 0;
+        }
+        state->samples[i] = s;
+    }
+    state->running--;
+    state->cond.notify_all();
+}
+
+bool StorageChallengeRespond(const uint256& seed, const std::vector<StorageChunkRef>& chunks, uint32_t count, std::chrono::milliseconds deadline, StorageChallengeResponse& response, const StorageBlockReader& reader)
+{
+    if (chunks.empty()) {
+        return false;
+    }
+    count = std::min(count, STORAGE_CHALLENGE_MAX_SAMPLES);
+    auto state = std::make_shared<StorageChallengeReaders>();
+    state->seed = seed;
+    state->reader = reader;
+    state->deadline = std::chrono::steady_clock::now() + deadline;
+
+    response.seed = seed;
+    response.commitment = StorageChallengeCommitment(chunks);
+    for (uint32_t i = 0; i < count; i++) {
+        state->samples.push_back(StorageChallengeDerive(seed, response.commitment, chunks, i));
+        state->samples.back().status = MFS_ERROR_NOTDONE;
+    }
+
+    // samples are spread over all folders, so parallel reads are served by different disks
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->running = std::min(count, STORAGE_CHALLENGE_READERS);
+    for (uint32_t t = 0; t < state->running; t++) {
+        std::thread(StorageChallengeReader, state).detach();
+    }
+    // don't wait for reads still blocked at the deadline - they finish (and are dropped) on their own
+    state->cond.wait_until(lock, state->deadline, [&state] { return state->running == 0; });
+    response.samples = state->samples;
+    lock.unlock();
+
+    response.digest = StorageChallengeDigest(response.seed, response.commitment, response.samples);
+    return true;
+}
+
+StorageChallengeCheck StorageChallengeVerify(const StorageChallengeResponse& response, const std::vector<StorageChunkRef>& chunks, uint32_t count, const StorageBlockReader& reader)
+{
+    StorageChallengeCheck check;
+    std::vector<uint8_t> data(STORAGE_CHALLENGE_BLOCKSIZE);
+    uint32_t crc;
+
+    check.digestValid = StorageChallengeDigest(response.seed, response.commitment, response.samples) == response.digest;
+    check.commitmentValid = !chunks.empty() && StorageChallengeCommitment(chunks) == response.commitment;
+    // a truncated response would let the prover drop the samples it can't answer
+    check.countValid = response.samples.size() == std::min(count, STORAGE_CHALLENGE_MAX_SAMPLES);
+    if (!check.countValid) {
+        return check;
+    }
+    for (uint32_t i = 0; i < response.samples.size(); i++) {
+        const StorageChallengeSample& s = response.samples[i];
+        // prover must not pick chunks or blocks itself - every sample has to be the derived one
+        if (!check.commitmentValid) {
+            check.forged++;
+            continue;
+        }
+        StorageChallengeSample expected = StorageChallengeDerive(response.seed, response.commitment, chunks, i);
+        if (s.chunkid != expected.chunkid || s.version != expected.version || s.blocknum != expected.blocknum) {
+            check.forged++;
+            continue;
+        }
+        if (s.status != MFS_STATUS_OK) {
+            check.failed++;
+            continue;
+        }
+        if (reader(s.chunkid, s.version, s.blocknum, data.data(), crc) != MFS_STATUS_OK) {
+            check.unavailable++;
+            continue;
+        }
+        if (crc == s.crc && StorageChallengeTag(response.seed, s, data.data()) == s.tag) {
+            check.verified++;
+        } else {
+            check.mismatched++;
+        }
+    }
+    return check;
+}
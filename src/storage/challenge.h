@@ -0,0 +1,116 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef STORAGE_CHALLENGE_H
+#define STORAGE_CHALLENGE_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+/** Samples read per challenge by default and at most (every sample reads one 64KiB block) */
+static const uint32_t STORAGE_CHALLENGE_DEFAULT_SAMPLES = 32;
+static const uint32_t STORAGE_CHALLENGE_MAX_SAMPLES = 256;
+/** Reads issued in parallel */
+static const uint32_t STORAGE_CHALLENGE_READERS = 8;
+static const std::chrono::milliseconds STORAGE_CHALLENGE_DEFAULT_DEADLINE{2000};
+/** Size of a sampled block (MFSBLOCKSIZE) */
+static const uint32_t STORAGE_CHALLENGE_BLOCKSIZE = 0x10000;
+
+/** Chunk both sides agree on (committed to be stored by the prover) - samples are picked only among such chunks */
+struct StorageChunkRef {
+    uint64_t chunkid{0};
+    uint32_t version{0};
+    uint16_t blocks{0};
+
+    SERIALIZE_METHODS(StorageChunkRef, obj)
+    {
+        READWRITE(obj.chunkid, obj.version, obj.blocks);
+    }
+};
+
+/** One sampled block: status is MFS_STATUS_OK or the error which prevented the read (MFS_ERROR_NOTDONE - deadline passed) */
+struct StorageChallengeSample {
+    uint64_t chunkid{0};
+    uint32_t version{0};
+    uint16_t blocknum{0};
+    uint8_t status{0};
+    uint32_t crc{0};
+    /** first 8 bytes of SHA256(seed, chunkid, version, blocknum, block data) */
+    uint64_t tag{0};
+
+    SERIALIZE_METHODS(StorageChallengeSample, obj)
+    {
+        READWRITE(obj.chunkid, obj.version, obj.blocknum, obj.status, obj.crc, obj.tag);
+    }
+};
+
+/** Answer to a challenge: samples plus SHA256 over the seed, the chunk list commitment and all samples */
+struct StorageChallengeResponse {
+    uint256 seed;
+    uint256 commitment;
+    std::vector<StorageChallengeSample> samples;
+    uint256 digest;
+
+    SERIALIZE_METHODS(StorageChallengeResponse, obj)
+    {
+        READWRITE(obj.seed, obj.commitment, obj.samples, obj.digest);
+    }
+};
+
+/** Outcome of checking a response against the committed chunk list and local copies of the sampled chunks */
+struct StorageChallengeCheck {
+    bool digestValid{false};
+    bool commitmentValid{false}; //!< response was made for the same chunk list
+    bool countValid{false}; //!< response has exactly the requested number of samples (no sample is checked otherwise)
+    uint32_t forged{0};     //!< sample is not the one derived from the seed and the chunk list (not checked further)
+    uint32_t verified{0};   //!< block read locally and crc and tag match
+    uint32_t mismatched{0}; //!< block read locally and crc or tag differ
+    uint32_t unavailable{0}; //!< chunk (in this version) is not stored here
+    uint32_t failed{0};     //!< prover reported an error for the sample
+};
+
+/** Reads one whole block (STORAGE_CHALLENGE_BLOCKSIZE bytes) and its crc - returns MFS_STATUS_OK or MFS error code */
+using StorageBlockReader = std::function<uint8_t(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* data, uint32_t& crc)>;
+
+/** Challenge seed derived from a block hash - unknown before the block exists, the same for every node */
+uint256 StorageChallengeSeed(const uint256& blockHash);
+
+/** SHA256 over the chunk list (in the given order) */
+uint256 StorageChallengeCommitment(const std::vector<StorageChunkRef>& chunks);
+
+/** Sample i: chunk index and block index are taken from SHA256(seed, commitment, i) - chunks must not be empty */
+StorageChallengeSample StorageChallengeDerive(const uint256& seed, const uint256& commitment, const std::vector<StorageChunkRef>& chunks, uint32_t i);
+
+/** First 8 bytes of SHA256(seed, chunkid, version, blocknum, data) - binds block data to the seed */
+uint64_t StorageChallengeTag(const uint256& seed, const StorageChallengeSample& sample, const uint8_t* data);
+
+/** Aggregated digest of a response (SHA256 over seed, commitment and serialized samples) */
+uint256 StorageChallengeDigest(const uint256& seed, const uint256& commitment, const std::vector<StorageChallengeSample>& samples);
+
+/** Reads blocks through the local chunkserver (hdd_read) - every read fails where there is no chunkserver */
+uint8_t StorageChallengeLocalRead(uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* data, uint32_t& crc);
+
+/**
+ * Derive 'count' samples from the seed and the committed chunk list and read them in parallel. Samples not read
+ * before the deadline (including reads that return after it) are reported as failed with MFS_ERROR_NOTDONE, and
+ * the call returns at the deadline at the latest. The reader is copied: a read still blocked at the deadline runs
+ * on after the call returned, so the reader must not refer to anything the caller destroys. Returns false when
+ * the chunk list is empty.
+ */
+bool StorageChallengeRespond(const uint256& seed, const std::vector<StorageChunkRef>& chunks, uint32_t count, std::chrono::milliseconds deadline, StorageChallengeResponse& response, const StorageBlockReader& reader = StorageChallengeLocalRead);
+
+/**
+ * Check the digest, the commitment and the number of samples (the 'count' the challenge asked for), re-derive every
+ * sample from the seed and the committed chunk list (samples naming other chunks or blocks are forged) and verify
+ * the others whose chunk can be read here
+ */
+StorageChallengeCheck StorageChallengeVerify(const StorageChallengeResponse& response, const std::vector<StorageChunkRef>& chunks, uint32_t count, const StorageBlockReader& reader = StorageChallengeLocalRead);
+
+#endif // STORAGE_CHALLENGE_H
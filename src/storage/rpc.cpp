@@ -8,18 +8,30 @@
 #include <rpc/request.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
+#include <storage/challenge.h>
 #include <storage/manager.h>
 #include <storage/netproof.h>
 #include <storage/preauth.h>
 #include <storage/proof.h>
 #include <storage/serialize.h>
+#include <storage/stats.h>
 #include <streams.h>
 #include <util/strencodings.h>
+#include <util/time.h>
 #include <validation.h>
 #include <version.h>
 
 #include <univalue.h>
 
+#include <libmoosefs/mfscommon/MFSCommunication.h>
+#ifdef __linux__
+#include <libmoosefs/mfschunkserver/bgjobs.h>
+#include <libmoosefs/mfschunkserver/hddspacemgr.h>
+#include <libmoosefs/mfschunkserver/replicator.h>
+#endif
+
+#include <limits>
+
 const unsigned int proof_string_sz = 1048576;
 
 bool DecodeHexProof(CProof& proof, const std::string& strHexProof)
@@ -276,6 +288,528 @@ static UniValue verifypreauth(const JSONRPCRequest& request)
     return result;
 }
 
+static UniValue storageworkers(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 3)
+        throw std::runtime_error(
+            RPCHelpMan{"storageworkers",
+                "\nShow chunkserver worker pool state and optionally change its limits (applied within 50ms).\n",
+                {
+                    {"min", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "workers started up front and always kept"},
+                    {"max", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "maximum number of workers"},
+                    {"idle", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "idle workers kept above the minimum"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "min", "minimum number of workers"},
+                        {RPCResult::Type::NUM, "max", "maximum number of workers"},
+                        {RPCResult::Type::NUM, "idle", "idle workers kept above the minimum"},
+                        {RPCResult::Type::NUM, "workers", "current number of workers"},
+                        {RPCResult::Type::NUM, "available", "workers waiting for jobs"},
+                        {RPCResult::Type::NUM, "queued", "jobs waiting for a worker"},
+                        {RPCResult::Type::NUM, "queuewait", "average time spent by jobs in queue (us)"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("storageworkers", "")
+            + HelpExampleCli("storageworkers", "32 500 64")
+            + HelpExampleRpc("storageworkers", "32, 500, 64")
+                },
+            }.ToString());
+
+#ifdef __linux__
+    uint32_t minworkers, maxworkers, maxidle;
+    job_get_limits(&minworkers, &maxworkers, &maxidle);
+    if (request.params.size() > 0) {
+        int64_t newmin = request.params[0].get_int64();
+        int64_t newmax = request.params.size() > 1 ? request.params[1].get_int64() : maxworkers;
+        int64_t newidle = request.params.size() > 2 ? request.params[2].get_int64() : maxidle;
+        if (newmin < 0 || newmax < 1 || newidle < 0 || newmin > newmax || newmax > 10000 || newidle > newmax) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid worker limits (expected 0 <= min <= max <= 10000 and idle <= max)");
+        }
+        job_set_limits(newmin, newmax, newidle);
+        job_get_limits(&minworkers, &maxworkers, &maxidle);
+    }
+
+    uint32_t total, idle, queued, qwait;
+    job_pool_stats(&total, &idle, &queued, &qwait);
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("min", (int64_t)minworkers);
+    result.pushKV("max", (int64_t)maxworkers);
+    result.pushKV("idle", (int64_t)maxidle);
+    result.pushKV("workers", (int64_t)total);
+    result.pushKV("available", (int64_t)idle);
+    result.pushKV("queued", (int64_t)queued);
+    result.pushKV("queuewait", (int64_t)qwait);
+    return result;
+#else
+    throw JSONRPCError(RPC_MISC_ERROR, "Storage node is not supported on this platform");
+#endif
+}
+
+static UniValue storagereplication(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw std::runtime_error(
+            RPCHelpMan{"storagereplication",
+                "\nShow chunk replication limits and optionally change them (applied to replications started afterwards).\n",
+                {
+                    {"window", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "replications streaming from one peer at a time"},
+                    {"bandwidth", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "bandwidth limit of all replications in MiB/s (0 - unlimited)"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "window", "replications streaming from one peer at a time"},
+                        {RPCResult::Type::NUM, "bandwidth", "bandwidth limit in MiB/s (0 - unlimited)"},
+                        {RPCResult::Type::NUM, "inflight", "replications streaming from peers"},
+                        {RPCResult::Type::NUM, "waiting", "replications waiting for a peer window slot"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("storagereplication", "")
+            + HelpExampleCli("storagereplication", "16 200")
+            + HelpExampleRpc("storagereplication", "16, 200")
+                },
+            }.ToString());
+
+#ifdef __linux__
+    uint32_t window, mbps;
+    replicator_get_limits(&window, &mbps);
+    if (request.params.size() > 0) {
+        int64_t newwindow = request.params[0].get_int64();
+        int64_t newmbps = request.params.size() > 1 ? request.params[1].get_int64() : mbps;
+        if (newwindow < 1 || newwindow > 1000 || newmbps < 0 || newmbps > 1000000) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid replication limits (expected 1 <= window <= 1000 and 0 <= bandwidth <= 1000000)");
+        }
+        replicator_set_limits(newwindow, newmbps);
+        replicator_get_limits(&window, &mbps);
+    }
+
+    uint32_t inflight, waiting;
+    replicator_window_stats(&inflight, &waiting);
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("window", (int64_t)window);
+    result.pushKV("bandwidth", (int64_t)mbps);
+    result.pushKV("inflight", (int64_t)inflight);
+    result.pushKV("waiting", (int64_t)waiting);
+    return result;
+#else
+    throw JSONRPCError(RPC_MISC_ERROR, "Storage node is not supported on this platform");
+#endif
+}
+
+static UniValue getstoragenodestats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            RPCHelpMan{"getstoragenodestats",
+                "\nReturns chunkserver counters (accumulated since start), worker pool load and per folder I/O latency and queue depth.\n",
+                {
+                    {"histograms", RPCArg::Type::BOOL, /* default */ "false", "include per folder latency histograms"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::BOOL, "running", "whether chunkserver statistics are being collected"},
+                        {RPCResult::Type::OBJ_DYN, "counters", "counters grouped by module (hdd, chunkops, mainserv, replicator, csserv, master)",
+                        {
+                            {RPCResult::Type::OBJ_DYN, "group", "",
+                            {
+                                {RPCResult::Type::NUM, "name", "counter value"},
+                            }},
+                        }},
+                        {RPCResult::Type::OBJ, "jobs", "",
+                        {
+                            {RPCResult::Type::NUM, "load", "jobs in progress or queued"},
+                            {RPCResult::Type::NUM, "hlstatus", "heavy load status reported to master"},
+                            {RPCResult::Type::NUM, "workers", "current number of workers"},
+                            {RPCResult::Type::NUM, "available", "workers waiting for jobs"},
+                            {RPCResult::Type::NUM, "queued", "jobs waiting for a worker"},
+                            {RPCResult::Type::NUM, "queuewait", "average time spent by jobs in queue (us)"},
+                        }},
+                        {RPCResult::Type::NUM, "iosaturation", "percent of folders with client I/O latency above target"},
+                        {RPCResult::Type::OBJ, "replication", "",
+                        {
+                            {RPCResult::Type::NUM, "inflight", "replications streaming from peers"},
+                            {RPCResult::Type::NUM, "waiting", "replications waiting for a peer window slot"},
+                            {RPCResult::Type::NUM, "throughput", "bytes received by replications per second (last second)"},
+                            {RPCResult::Type::NUM, "avgtime", "average time of successful replication (us)"},
+                        }},
+                        {RPCResult::Type::OBJ, "cache", "",
+                        {
+                            {RPCResult::Type::NUM, "hits", "block cache hits"},
+                            {RPCResult::Type::NUM, "misses", "block cache misses"},
+                            {RPCResult::Type::NUM, "used", "bytes in block cache"},
+                            {RPCResult::Type::NUM, "size", "block cache size in bytes"},
+                        }},
+                        {RPCResult::Type::OBJ, "space", "",
+                        {
+                            {RPCResult::Type::NUM, "used", "used bytes"},
+                            {RPCResult::Type::NUM, "total", "total bytes"},
+                            {RPCResult::Type::NUM, "chunks", "number of chunks"},
+                        }},
+                        {RPCResult::Type::ARR, "folders", "",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR, "path", "folder path"},
+                                {RPCResult::Type::BOOL, "damaged", "folder is damaged"},
+                                {RPCResult::Type::BOOL, "removing", "folder is marked for removal"},
+                                {RPCResult::Type::NUM, "avail", "available bytes"},
+                                {RPCResult::Type::NUM, "total", "total bytes"},
+                                {RPCResult::Type::NUM, "chunks", "number of chunks"},
+                                {RPCResult::Type::NUM, "scrubage", "seconds since verification of the least recently verified chunk"},
+                                {RPCResult::Type::OBJ, "read", "same fields for \"write\" and \"fsync\" (without bytes)",
+                                {
+                                    {RPCResult::Type::NUM, "ops", "operations"},
+                                    {RPCResult::Type::NUM, "bytes", "bytes transferred"},
+                                    {RPCResult::Type::NUM, "avglatency", "average latency (us)"},
+                                    {RPCResult::Type::NUM, "p50", "upper bound of median latency (us)"},
+                                    {RPCResult::Type::NUM, "p99", "upper bound of 99th percentile latency (us)"},
+                                    {RPCResult::Type::ARR, "histogram", "only with histograms=true - operations that took [2^i,2^(i+1)) us",
+                                    {
+                                        {RPCResult::Type::NUM, "", ""},
+                                    }},
+                                }},
+                                {RPCResult::Type::OBJ, "queues", "",
+                                {
+                                    {RPCResult::Type::OBJ, "client", "same fields for \"replication\", \"rebalance\" and \"test\"",
+                                    {
+                                        {RPCResult::Type::NUM, "depth", "current queue depth"},
+                                        {RPCResult::Type::NUM, "maxdepth", "max queue depth in last second"},
+                                        {RPCResult::Type::NUM, "p99", "I/O latency p99 in last second (us)"},
+                                        {RPCResult::Type::NUM, "ops", "operations"},
+                                        {RPCResult::Type::NUM, "avgwait", "average time spent waiting for I/O budget (us)"},
+                                    }},
+                                }},
+                            }},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getstoragenodestats", "")
+            + HelpExampleCli("getstoragenodestats", "true")
+            + HelpExampleRpc("getstoragenodestats", "true")
+                },
+            }.ToString());
+
+#ifdef __linux__
+    static const char* const opnames[HDD_LATHIST_OPS] = {"read", "write", "fsync"};
+    static const char* const classnames[HDDSCHED_CLASSES] = {"client", "replication", "rebalance", "test"};
+    bool histograms = request.params.size() > 0 && request.params[0].get_bool();
+
+    csstats_data d;
+    csstats_get(&d);
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("running", d.collected != 0);
+
+    UniValue counters(UniValue::VOBJ);
+    UniValue group(UniValue::VOBJ);
+    for (size_t i = 0; i < storageCounterFieldsCount; i++) {
+        const StorageCounterField& f = storageCounterFields[i];
+        group.pushKV(f.name, d.total.*(f.field));
+        if (i + 1 == storageCounterFieldsCount || std::string(f.group) != storageCounterFields[i + 1].group) {
+            counters.pushKV(f.group, group);
+            group = UniValue(UniValue::VOBJ);
+        }
+    }
+    result.pushKV("counters", counters);
+
+    UniValue jobs(UniValue::VOBJ);
+    jobs.pushKV("load", (int64_t)d.load);
+    jobs.pushKV("hlstatus", (int64_t)d.hlstatus);
+    jobs.pushKV("workers", (int64_t)d.workers);
+    jobs.pushKV("available", (int64_t)d.workersidle);
+    jobs.pushKV("queued", (int64_t)d.queued);
+    jobs.pushKV("queuewait", (int64_t)d.queuewaitusec);
+    result.pushKV("jobs", jobs);
+    result.pushKV("iosaturation", (int64_t)d.iosaturation);
+
+    UniValue replication(UniValue::VOBJ);
+    replication.pushKV("inflight", (int64_t)d.replinflight);
+    replication.pushKV("waiting", (int64_t)d.replwaiting);
+    replication.pushKV("throughput", d.replbps);
+    replication.pushKV("avgtime", d.total.replok > 0 ? d.total.replusec / d.total.replok : 0);
+    result.pushKV("replication", replication);
+
+    UniValue cache(UniValue::VOBJ);
+    cache.pushKV("hits", d.cachehits);
+    cache.pushKV("misses", d.cachemisses);
+    cache.pushKV("used", d.cacheused);
+    cache.pushKV("size", d.cachesize);
+    result.pushKV("cache", cache);
+
+    UniValue space(UniValue::VOBJ);
+    space.pushKV("used", d.usedspace);
+    space.pushKV("total", d.totalspace);
+    space.pushKV("chunks", (int64_t)d.chunkcount);
+    result.pushKV("space", space);
+
+    hdd_foldermetrics* fmtab;
+    uint32_t cnt = hdd_folder_metrics(&fmtab);
+    UniValue folders(UniValue::VARR);
+    for (uint32_t i = 0; i < cnt; i++) {
+        const hdd_foldermetrics& fm = fmtab[i];
+        UniValue folder(UniValue::VOBJ);
+        folder.pushKV("path", fm.path);
+        folder.pushKV("damaged", fm.damaged != 0);
+        folder.pushKV("removing", fm.toremove != 0);
+        folder.pushKV("avail", fm.avail);
+        folder.pushKV("total", fm.total);
+        folder.pushKV("chunks", (int64_t)fm.chunkcount);
+        folder.pushKV("scrubage", (int64_t)fm.scrubage);
+        for (uint32_t op = 0; op < HDD_LATHIST_OPS; op++) {
+            UniValue lat(UniValue::VOBJ);
+            lat.pushKV("ops", fm.ops[op]);
+            if (op != HDD_LATHIST_FSYNC) {
+                lat.pushKV("bytes", fm.bytes[op]);
+            }
+            lat.pushKV("avglatency", fm.ops[op] ? fm.nsecsum[op] / fm.ops[op] / 1000 : 0);
+            lat.pushKV("p50", StorageLatencyQuantile(fm.hist[op], HDD_LATHIST_BUCKETS, 0.50));
+            lat.pushKV("p99", StorageLatencyQuantile(fm.hist[op], HDD_LATHIST_BUCKETS, 0.99));
+            if (histograms) {
+                UniValue hist(UniValue::VARR);
+                for (uint32_t b = 0; b < HDD_LATHIST_BUCKETS; b++) {
+                    hist.push_back(fm.hist[op][b]);
+                }
+                lat.pushKV("histogram", hist);
+            }
+            folder.pushKV(opnames[op], lat);
+        }
+        UniValue queues(UniValue::VOBJ);
+        for (uint32_t k = 0; k < HDDSCHED_CLASSES; k++) {
+            const hddsched_classstats& st = fm.sched[k];
+            UniValue queue(UniValue::VOBJ);
+            queue.pushKV("depth", (int64_t)st.depth);
+            queue.pushKV("maxdepth", (int64_t)st.maxdepth);
+            queue.pushKV("p99", (int64_t)st.p99usec);
+            queue.pushKV("ops", st.ops);
+            queue.pushKV("avgwait", st.ops ? st.waitusec / st.ops : 0);
+            queues.pushKV(classnames[k], queue);
+        }
+        folder.pushKV("queues", queues);
+        folders.push_back(folder);
+    }
+    if (cnt > 0) {
+        hdd_folder_metrics_free(fmtab, cnt);
+    }
+    result.pushKV("folders", folders);
+    return result;
+#else
+    throw JSONRPCError(RPC_MISC_ERROR, "Storage node is not supported on this platform");
+#endif
+}
+
+/** Committed chunk list: [{"chunkid":"hex","version":n,"blocks":n},...] */
+static std::vector<StorageChunkRef> ParseStorageChunks(const UniValue& value)
+{
+    std::vector<StorageChunkRef> chunks;
+    for (const UniValue& entry : value.get_array().getValues()) {
+        RPCTypeCheckObj(entry.get_obj(),
+            {
+                {"chunkid", UniValueType(UniValue::VSTR)},
+                {"version", UniValueType(UniValue::VNUM)},
+                {"blocks", UniValueType(UniValue::VNUM)},
+            });
+        const std::string& chunkid = find_value(entry, "chunkid").get_str();
+        int64_t version = find_value(entry, "version").get_int64();
+        int64_t blocks = find_value(entry, "blocks").get_int64();
+        if (chunkid.empty() || chunkid.size() > 16 || !IsHex(std::string(chunkid.size() % 2, '0') + chunkid)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("chunkid %s is not a 64-bit hex number", chunkid));
+        }
+        if (version < 0 || version > std::numeric_limits<uint32_t>::max() || blocks < 1 || blocks > MFSBLOCKSINCHUNK) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("chunk %s: version or blocks out of range", chunkid));
+        }
+        StorageChunkRef ref;
+        ref.chunkid = std::stoull(chunkid, nullptr, 16);
+        ref.version = version;
+        ref.blocks = blocks;
+        chunks.push_back(ref);
+    }
+    if (chunks.empty()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "chunk list is empty");
+    }
+    return chunks;
+}
+
+/** Number of sampled blocks given as an optional argument */
+static uint32_t ParseStorageSamples(const JSONRPCRequest& request, size_t index)
+{
+    if (request.params.size() <= index) {
+        return STORAGE_CHALLENGE_DEFAULT_SAMPLES;
+    }
+    int value = request.params[index].get_int();
+    if (value < 1 || (uint32_t)value > STORAGE_CHALLENGE_MAX_SAMPLES) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("samples must be between 1 and %u", STORAGE_CHALLENGE_MAX_SAMPLES));
+    }
+    return value;
+}
+
+static UniValue StorageChallengeToJSON(const StorageChallengeResponse& response)
+{
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("seed", response.seed.GetHex());
+    result.pushKV("commitment", response.commitment.GetHex());
+    UniValue samples(UniValue::VARR);
+    for (const StorageChallengeSample& s : response.samples) {
+        UniValue sample(UniValue::VOBJ);
+        sample.pushKV("chunkid", strprintf("%016X", s.chunkid));
+        sample.pushKV("version", (int64_t)s.version);
+        sample.pushKV("block", (int64_t)s.blocknum);
+        sample.pushKV("status", (int64_t)s.status);
+        sample.pushKV("crc", strprintf("%08X", s.crc));
+        sample.pushKV("tag", strprintf("%016X", s.tag));
+        samples.push_back(sample);
+    }
+    result.pushKV("samples", samples);
+    result.pushKV("digest", response.digest.GetHex());
+    return result;
+}
+
+static UniValue storagechallenge(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 2 || request.params.size() > 4)
+        throw std::runtime_error(
+            RPCHelpMan{"storagechallenge",
+                "\nAnswer a proof-of-retrievability challenge derived from a block hash: read blocks sampled from the committed chunk list and return their crcs and an aggregated digest.\n",
+                {
+                    {"blockhash", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "block hash the challenge seed is derived from"},
+                    {"chunks", RPCArg::Type::ARR, RPCArg::Optional::NO, "chunks this node is committed to store (the verifier uses the same list, in the same order)",
+                        {
+                            {"", RPCArg::Type::OBJ, RPCArg::Optional::OMITTED, "",
+                                {
+                                    {"chunkid", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "chunk id"},
+                                    {"version", RPCArg::Type::NUM, RPCArg::Optional::NO, "chunk version"},
+                                    {"blocks", RPCArg::Type::NUM, RPCArg::Optional::NO, "number of blocks in the chunk"},
+                                },
+                            },
+                        },
+                    },
+                    {"samples", RPCArg::Type::NUM, /* default */ strprintf("%u", STORAGE_CHALLENGE_DEFAULT_SAMPLES), strprintf("number of sampled blocks (at most %u)", STORAGE_CHALLENGE_MAX_SAMPLES)},
+                    {"deadline", RPCArg::Type::NUM, /* default */ strprintf("%d", STORAGE_CHALLENGE_DEFAULT_DEADLINE.count()), "milliseconds after which remaining samples are reported as not done"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::STR_HEX, "seed", "challenge seed"},
+                        {RPCResult::Type::STR_HEX, "commitment", "hash of the committed chunk list"},
+                        {RPCResult::Type::ARR, "samples", "",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR_HEX, "chunkid", "chunk id"},
+                                {RPCResult::Type::NUM, "version", "chunk version"},
+                                {RPCResult::Type::NUM, "block", "block number"},
+                                {RPCResult::Type::NUM, "status", "0 - block read, otherwise error code"},
+                                {RPCResult::Type::STR_HEX, "crc", "block crc"},
+                                {RPCResult::Type::STR_HEX, "tag", "block tag bound to the seed"},
+                            }},
+                        }},
+                        {RPCResult::Type::STR_HEX, "digest", "aggregated digest of all samples"},
+                        {RPCResult::Type::NUM, "elapsed", "time taken (us)"},
+                        {RPCResult::Type::STR_HEX, "hex", "serialized response (for verifystoragechallenge)"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("storagechallenge", "\"00000000000000000000000000000000000000000000000000000000000000ff\" \"[{\\\"chunkid\\\":\\\"2A\\\",\\\"version\\\":1,\\\"blocks\\\":1024}]\" 64 1000")
+            + HelpExampleRpc("storagechallenge", "\"00000000000000000000000000000000000000000000000000000000000000ff\", [{\"chunkid\":\"2A\",\"version\":1,\"blocks\":1024}], 64, 1000")
+                },
+            }.ToString());
+
+    uint256 blockHash = ParseHashV(request.params[0], "blockhash");
+    std::vector<StorageChunkRef> chunks = ParseStorageChunks(request.params[1]);
+    uint32_t samples = ParseStorageSamples(request, 2);
+    std::chrono::milliseconds deadline = STORAGE_CHALLENGE_DEFAULT_DEADLINE;
+    if (request.params.size() > 3) {
+        int value = request.params[3].get_int();
+        if (value < 1) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "deadline must be positive");
+        }
+        deadline = std::chrono::milliseconds(value);
+    }
+
+    StorageChallengeResponse response;
+    int64_t start = GetTimeMicros();
+    if (!StorageChallengeRespond(StorageChallengeSeed(blockHash), chunks, samples, deadline, response)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Challenge failed");
+    }
+    int64_t elapsed = GetTimeMicros() - start;
+
+    UniValue result = StorageChallengeToJSON(response);
+    result.pushKV("elapsed", elapsed);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << response;
+    result.pushKV("hex", HexStr(ss));
+    return result;
+}
+
+static UniValue verifystoragechallenge(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
+        throw std::runtime_error(
+            RPCHelpMan{"verifystoragechallenge",
+                "\nCheck that every sample of a storagechallenge response is the one derived from its seed and the committed chunk list, and verify the samples against chunks stored on this node.\n",
+                {
+                    {"hexstring", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "serialized response returned by storagechallenge"},
+                    {"chunks", RPCArg::Type::ARR, RPCArg::Optional::NO, "chunk list the prover is committed to (same as given to storagechallenge)",
+                        {
+                            {"", RPCArg::Type::OBJ, RPCArg::Optional::OMITTED, "",
+                                {
+                                    {"chunkid", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "chunk id"},
+                                    {"version", RPCArg::Type::NUM, RPCArg::Optional::NO, "chunk version"},
+                                    {"blocks", RPCArg::Type::NUM, RPCArg::Optional::NO, "number of blocks in the chunk"},
+                                },
+                            },
+                        },
+                    },
+                    {"samples", RPCArg::Type::NUM, /* default */ strprintf("%u", STORAGE_CHALLENGE_DEFAULT_SAMPLES), "number of sampled blocks the challenge asked for (same as given to storagechallenge)"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::BOOL, "digest", "aggregated digest matches the samples"},
+                        {RPCResult::Type::BOOL, "commitment", "response was made for the given chunk list"},
+                        {RPCResult::Type::BOOL, "samples", "response has exactly the requested number of samples (no sample is checked otherwise)"},
+                        {RPCResult::Type::NUM, "forged", "samples other than the ones derived from the seed and the chunk list"},
+                        {RPCResult::Type::NUM, "verified", "samples read locally with matching crc and tag"},
+                        {RPCResult::Type::NUM, "mismatched", "samples read locally with different crc or tag"},
+                        {RPCResult::Type::NUM, "unavailable", "samples of chunks not stored on this node"},
+                        {RPCResult::Type::NUM, "failed", "samples the prover couldn't read"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("verifystoragechallenge", "\"hexstring\" \"[{\\\"chunkid\\\":\\\"2A\\\",\\\"version\\\":1,\\\"blocks\\\":1024}]\" 64")
+            + HelpExampleRpc("verifystoragechallenge", "\"hexstring\", [{\"chunkid\":\"2A\",\"version\":1,\"blocks\":1024}], 64")
+                },
+            }.ToString());
+
+    StorageChallengeResponse response;
+    try {
+        CDataStream ss(ParseHexV(request.params[0], "hexstring"), SER_NETWORK, PROTOCOL_VERSION);
+        ss >> response;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Response decode failed");
+    }
+    if (response.samples.size() > STORAGE_CHALLENGE_MAX_SAMPLES) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Too many samples");
+    }
+
+    std::vector<StorageChunkRef> chunks = ParseStorageChunks(request.params[1]);
+    uint32_t samples = ParseStorageSamples(request, 2);
+
+    StorageChallengeCheck check = StorageChallengeVerify(response, chunks, samples);
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("digest", check.digestValid);
+    result.pushKV("commitment", check.commitmentValid);
+    result.pushKV("samples", check.countValid);
+    result.pushKV("forged", (int64_t)check.forged);
+    result.pushKV("verified", (int64_t)check.verified);
+    result.pushKV("mismatched", (int64_t)check.mismatched);
+    result.pushKV("unavailable", (int64_t)check.unavailable);
+    result.pushKV("failed", (int64_t)check.failed);
+    return result;
+}
+
 // clang-format off
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)
@@ -286,6 +820,11 @@ static const CRPCCommand commands[] =
     { "storage",            "parseproof",             &parseproof,             {}  },
     { "storage",            "mockpreauth",            &mockpreauth,            {"hostaddress"} },
     { "storage",            "verifypreauth",          &verifypreauth,          {"hostaddress", "hexsignature"} },
+    { "storage",            "storageworkers",         &storageworkers,         {"min", "max", "idle"} },
+    { "storage",            "storagereplication",     &storagereplication,     {"window", "bandwidth"} },
+    { "storage",            "getstoragenodestats",    &getstoragenodestats,    {"histograms"} },
+    { "storage",            "storagechallenge",       &storagechallenge,       {"blockhash", "chunks", "samples", "deadline"} },
+    { "storage",            "verifystoragechallenge", &verifystoragechallenge, {"hexstring", "chunks", "samples"} },
 };
 
 // clang-format on
@@ -0,0 +1,197 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <storage/stats.h>
+
+#include <statsd_client.h>
+#include <tinyformat.h>
+
+#ifdef __linux__
+#include <libmoosefs/mfschunkserver/hddspacemgr.h>
+#endif
+
+#include <ctype.h>
+#include <string.h>
+
+#include <map>
+
+#ifdef __linux__
+const StorageCounterField storageCounterFields[] = {
+    {"hdd", "bytesRead", &csstats_counters::hddbytesr},
+    {"hdd", "bytesWritten", &csstats_counters::hddbytesw},
+    {"hdd", "readOps", &csstats_counters::hddopr},
+    {"hdd", "writeOps", &csstats_counters::hddopw},
+    {"hdd", "dataBytesRead", &csstats_counters::databytesr},
+    {"hdd", "dataBytesWritten", &csstats_counters::databytesw},
+    {"hdd", "dataReadOps", &csstats_counters::dataopr},
+    {"hdd", "dataWriteOps", &csstats_counters::dataopw},
+    {"hdd", "dataReadNsec", &csstats_counters::datansecr},
+    {"hdd", "dataWriteNsec", &csstats_counters::datansecw},
+    {"hdd", "movesLowSpeed", &csstats_counters::movels},
+    {"hdd", "movesHighSpeed", &csstats_counters::movehs},
+    {"chunkops", "create", &csstats_counters::opcreate},
+    {"chunkops", "delete", &csstats_counters::opdelete},
+    {"chunkops", "version", &csstats_counters::opversion},
+    {"chunkops", "duplicate", &csstats_counters::opduplicate},
+    {"chunkops", "truncate", &csstats_counters::optruncate},
+    {"chunkops", "duptrunc", &csstats_counters::opduptrunc},
+    {"chunkops", "test", &csstats_counters::optest},
+    {"mainserv", "bytesIn", &csstats_counters::mainbytesin},
+    {"mainserv", "bytesOut", &csstats_counters::mainbytesout},
+    {"mainserv", "readOps", &csstats_counters::hlopr},
+    {"mainserv", "writeOps", &csstats_counters::hlopw},
+    {"replicator", "bytesIn", &csstats_counters::replbytesin},
+    {"replicator", "bytesOut", &csstats_counters::replbytesout},
+    {"replicator", "replications", &csstats_counters::repl},
+    {"replicator", "succeeded", &csstats_counters::replok},
+    {"replicator", "connectionsReused", &csstats_counters::replconnreused},
+    {"replicator", "connectionsOpened", &csstats_counters::replconnnew},
+    {"replicator", "usec", &csstats_counters::replusec},
+    {"csserv", "bytesIn", &csstats_counters::csservbytesin},
+    {"csserv", "bytesOut", &csstats_counters::csservbytesout},
+    {"master", "bytesIn", &csstats_counters::masterbytesin},
+    {"master", "bytesOut", &csstats_counters::masterbytesout},
+};
+
+const size_t storageCounterFieldsCount = sizeof(storageCounterFields) / sizeof(storageCounterFields[0]);
+#endif
+
+uint64_t StorageLatencyQuantile(const uint64_t* hist, size_t buckets, double q)
+{
+    uint64_t total = 0;
+    for (size_t b = 0; b < buckets; b++) {
+        total += hist[b];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t limit = (uint64_t)(q * total);
+    if (limit == 0) {
+        limit = 1;
+    }
+    uint64_t cnt = 0;
+    size_t b = 0;
+    for (; b + 1 < buckets; b++) {
+        cnt += hist[b];
+        if (cnt >= limit) {
+            break;
+        }
+    }
+    return UINT64_C(2) << b;
+}
+
+std::string StorageFolderKey(const std::string& path)
+{
+    std::string key;
+    for (char c : path) {
+        if (isalnum((unsigned char)c) || c == '-') {
+            key += c;
+        } else if (!key.empty() && key.back() != '_') {
+            key += '_';
+        }
+    }
+    while (!key.empty() && key.back() == '_') {
+        key.pop_back();
+    }
+    return key.empty() ? "root" : key;
+}
+
+#ifdef __linux__
+static const char* const storageOpNames[HDD_LATHIST_OPS] = {"read", "write", "fsync"};
+static const char* const storageClassNames[HDDSCHED_CLASSES] = {"client", "replication", "rebalance", "test"};
+
+struct StorageFolderSample {
+    uint64_t ops[HDD_LATHIST_OPS];
+    uint64_t nsecsum[HDD_LATHIST_OPS];
+    uint64_t hist[HDD_LATHIST_OPS][HDD_LATHIST_BUCKETS];
+};
+
+// previous sample - rates and latency quantiles are reported for the time between two pushes
+static csstats_data prevStats;
+static std::map<std::string, StorageFolderSample> prevFolders;
+#endif
+
+void PeriodicStorageStats()
+{
+#ifdef __linux__
+    // called only from scheduler thread
+    csstats_data d;
+    csstats_get(&d);
+    if (d.collected == 0) {
+        return;
+    }
+
+    if (prevStats.collected != 0 && d.collected > prevStats.collected) {
+        double secs = (d.collected - prevStats.collected) / 1000000.0;
+        for (size_t i = 0; i < storageCounterFieldsCount; i++) {
+            const StorageCounterField& f = storageCounterFields[i];
+            uint64_t delta = d.total.*(f.field) - prevStats.total.*(f.field);
+            statsClient.gaugeDouble(strprintf("storage.%s.%sPerSecond", f.group, f.name), delta / secs);
+        }
+        uint64_t lookups = (d.cachehits - prevStats.cachehits) + (d.cachemisses - prevStats.cachemisses);
+        if (lookups > 0) {
+            statsClient.gaugeDouble("storage.cache.hitRatio", (double)(d.cachehits - prevStats.cachehits) / lookups);
+        }
+    }
+    prevStats = d;
+
+    statsClient.gauge("storage.jobs.load", d.load, 1.0f);
+    statsClient.gauge("storage.jobs.hlstatus", d.hlstatus, 1.0f);
+    statsClient.gauge("storage.jobs.workers", d.workers, 1.0f);
+    statsClient.gauge("storage.jobs.available", d.workersidle, 1.0f);
+    statsClient.gauge("storage.jobs.queued", d.queued, 1.0f);
+    statsClient.timing("storage.jobs.queueWait", d.queuewaitusec / 1000, 1.0f);
+    statsClient.gauge("storage.hdd.ioSaturation", d.iosaturation, 1.0f);
+    statsClient.gauge("storage.replicator.inflight", d.replinflight, 1.0f);
+    statsClient.gauge("storage.replicator.waiting", d.replwaiting, 1.0f);
+    statsClient.gauge("storage.replicator.throughputBytes", d.replbps, 1.0f);
+    statsClient.gauge("storage.cache.usedBytes", d.cacheused, 1.0f);
+    statsClient.gauge("storage.space.usedBytes", d.usedspace, 1.0f);
+    statsClient.gauge("storage.space.totalBytes", d.totalspace, 1.0f);
+    statsClient.gauge("storage.space.chunks", d.chunkcount, 1.0f);
+
+    hdd_foldermetrics* fmtab;
+    uint32_t cnt = hdd_folder_metrics(&fmtab);
+    std::map<std::string, StorageFolderSample> folders;
+    for (uint32_t i = 0; i < cnt; i++) {
+        const hdd_foldermetrics& fm = fmtab[i];
+        std::string prefix = "storage.folder." + StorageFolderKey(fm.path);
+
+        for (uint32_t k = 0; k < HDDSCHED_CLASSES; k++) {
+            statsClient.gauge(strprintf("%s.queue.%s.depth", prefix, storageClassNames[k]), fm.sched[k].depth, 1.0f);
+            statsClient.gauge(strprintf("%s.queue.%s.maxDepth", prefix, storageClassNames[k]), fm.sched[k].maxdepth, 1.0f);
+        }
+        statsClient.gauge(prefix + ".scrub.ageSeconds", fm.scrubage, 1.0f);
+
+        StorageFolderSample& cur = folders[fm.path];
+        memcpy(cur.ops, fm.ops, sizeof(cur.ops));
+        memcpy(cur.nsecsum, fm.nsecsum, sizeof(cur.nsecsum));
+        memcpy(cur.hist, fm.hist, sizeof(cur.hist));
+
+        auto it = prevFolders.find(fm.path);
+        if (it == prevFolders.end()) {
+            continue;
+        }
+        const StorageFolderSample& prev = it->second;
+        for (uint32_t op = 0; op < HDD_LATHIST_OPS; op++) {
+            uint64_t ops = cur.ops[op] - prev.ops[op];
+            statsClient.gauge(strprintf("%s.%s.ops", prefix, storageOpNames[op]), ops, 1.0f);
+            if (ops == 0) {
+                continue;
+            }
+            uint64_t hist[HDD_LATHIST_BUCKETS];
+            for (uint32_t b = 0; b < HDD_LATHIST_BUCKETS; b++) {
+                hist[b] = cur.hist[op][b] - prev.hist[op][b];
+            }
+            statsClient.timing(strprintf("%s.%s.latency", prefix, storageOpNames[op]), (cur.nsecsum[op] - prev.nsecsum[op]) / ops / 1000000, 1.0f);
+            statsClient.gauge(strprintf("%s.%s.p50us", prefix, storageOpNames[op]), StorageLatencyQuantile(hist, HDD_LATHIST_BUCKETS, 0.50), 1.0f);
+            statsClient.gauge(strprintf("%s.%s.p99us", prefix, storageOpNames[op]), StorageLatencyQuantile(hist, HDD_LATHIST_BUCKETS, 0.99), 1.0f);
+        }
+    }
+    if (cnt > 0) {
+        hdd_folder_metrics_free(fmtab, cnt);
+    }
+    prevFolders.swap(folders);
+#endif
+}
@@ -0,0 +1,36 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef STORAGE_STATS_H
+#define STORAGE_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#ifdef __linux__
+#include <libmoosefs/mfschunkserver/csstats.h>
+
+/** Chunkserver counter exposed as <group>.<name> by getstoragenodestats and statsd */
+struct StorageCounterField {
+    const char* group;
+    const char* name;
+    uint64_t csstats_counters::*field;
+};
+
+extern const StorageCounterField storageCounterFields[];
+extern const size_t storageCounterFieldsCount;
+#endif
+
+/** Upper bound (us) of the log2 latency histogram bucket holding quantile q of the recorded operations */
+uint64_t StorageLatencyQuantile(const uint64_t* hist, size_t buckets, double q);
+
+/** Folder path turned into a single statsd key component */
+std::string StorageFolderKey(const std::string& path);
+
+/** Push chunkserver metrics (rates over the last period, queue depths and folder latencies) to statsd */
+void PeriodicStorageStats();
+
+#endif // STORAGE_STATS_H
@@ -5,7 +5,12 @@
 #include <blockencodings.h>
 #include <chainparams.h>
 #include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <pos/kernel.h>
+#include <pos/prevalidate.h>
+#include <pos/signature.h>
 #include <pow.h>
+#include <script/interpreter.h>
 #include <streams.h>
 
 #include <test/util/setup_common.h>
@@ -301,6 +306,181 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(CoinStakePrefilledRoundTripTest)
+{
+    CTxMemPool pool;
+    CBlock block(BuildBlockTestCase());
+
+    // Proof-of-work blocks only prefill the coinbase
+    {
+        CBlockHeaderAndShortTxIDs shortIDs(block);
+        BOOST_CHECK(!shortIDs.GetCoinStake());
+    }
+
+    // Turn the second transaction into a coinstake
+    CMutableTransaction coinstake(*block.vtx[1]);
+    coinstake.vout.resize(2);
+    coinstake.vout[0].SetEmpty();
+    block.vtx[1] = MakeTransactionRef(coinstake);
+    BOOST_CHECK(block.IsProofOfStake());
+
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+
+    CBlockHeaderAndShortTxIDs shortIDs(block);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << shortIDs;
+
+    CBlockHeaderAndShortTxIDs shortIDs2;
+    stream >> shortIDs2;
+
+    BOOST_CHECK_EQUAL(shortIDs2.BlockTxCount(), block.vtx.size());
+    BOOST_REQUIRE(shortIDs2.GetCoinStake());
+    BOOST_CHECK_EQUAL(shortIDs2.GetCoinStake()->GetHash().ToString(), block.vtx[1]->GetHash().ToString());
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_OK);
+    BOOST_CHECK( partialBlock.IsTxAvailable(0));
+    BOOST_CHECK( partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(!partialBlock.IsTxAvailable(2));
+}
+
+struct StakeBlockSetup : public TestChain100Setup {
+    // Proof-of-stake block on top of pindexPrev staking the first coinbase of the test chain
+    CBlock CreateStakeBlock(const CBlockIndex* pindexPrev, bool fPassKernel)
+    {
+        const CTransactionRef& kernelTx = m_coinbase_txns[0];
+        const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+        const COutPoint prevout(kernelTx->GetHash(), 0);
+        const CAmount amount = kernelTx->vout[0].nValue;
+        BOOST_REQUIRE(amount > 0);
+
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << OP_0;
+        coinbase.vout.resize(1);
+
+        CMutableTransaction coinstake;
+        coinstake.vin.resize(1);
+        coinstake.vin[0].prevout = prevout;
+        coinstake.vout.resize(2);
+        coinstake.vout[0].SetEmpty();
+        coinstake.vout[1].nValue = amount;
+        coinstake.vout[1].scriptPubKey = scriptPubKey;
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(kernelTx->vout[0].scriptPubKey, coinstake, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        coinstake.vin[0].scriptSig << vchSig;
+
+        CBlock block;
+        block.nVersion = 42;
+        block.hashPrevBlock = pindexPrev->GetBlockHash();
+        block.nNonce = 0;
+        block.vtx.push_back(MakeTransactionRef(coinbase));
+        block.vtx.push_back(MakeTransactionRef(coinstake));
+        bool mutated;
+        block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+
+        // A target of about 2^255 / amount passes every other kernel, search for one of them.
+        // The smallest possible target (1 * amount) never passes.
+        const Consensus::Params& params = Params().GetConsensus();
+        const uint32_t nBlockFromTime = ::ChainActive()[1]->GetBlockTime();
+        const arith_uint256 bnTarget = ~arith_uint256() / amount / 2;
+        block.nBits = fPassKernel ? bnTarget.GetCompact() : 0x03000001;
+        block.nTime = (nBlockFromTime + params.nStakeMinAge + nStakeTimestampMask) & ~nStakeTimestampMask;
+        uint256 hashProofOfStake, targetProofOfStake;
+        while (fPassKernel && !CheckStakeKernelHash(pindexPrev, block.nBits, nBlockFromTime, amount, prevout, block.nTime, hashProofOfStake, targetProofOfStake)) {
+            block.nTime += nStakeTimestampMask + 1;
+        }
+        BOOST_CHECK(block.IsProofOfStake());
+        BOOST_CHECK(SignBlockWithKey(block, coinbaseKey));
+        return block;
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE(PreValidateStakeBlockAcceptTest, StakeBlockSetup)
+{
+    LOCK(cs_main);
+    const CBlockIndex* tip = ::ChainActive().Tip();
+    CBlock block = CreateStakeBlock(tip, true);
+
+    CValidationState state;
+    BOOST_CHECK(PreValidateStakeBlock(CBlockHeaderAndShortTxIDs(block), tip, state) == StakePreValidation::VALID);
+    BOOST_CHECK(state.IsValid());
+
+    // Proof-of-work blocks are left to full validation
+    CBlock powBlock(block);
+    powBlock.nNonce = 1;
+    BOOST_CHECK(PreValidateStakeBlock(CBlockHeaderAndShortTxIDs(powBlock), tip, state) == StakePreValidation::UNKNOWN);
+
+    // A valid signature on a block which does not build on our tip cannot have its kernel checked
+    CBlock forkBlock = CreateStakeBlock(tip->pprev, true);
+    BOOST_CHECK(PreValidateStakeBlock(CBlockHeaderAndShortTxIDs(forkBlock), tip->pprev, state) == StakePreValidation::UNKNOWN);
+    BOOST_CHECK(state.IsValid());
+}
+
+BOOST_FIXTURE_TEST_CASE(PreValidateStakeBlockRejectTest, StakeBlockSetup)
+{
+    LOCK(cs_main);
+    const CBlockIndex* tip = ::ChainActive().Tip();
+    int nDoS;
+
+    CBlock block = CreateStakeBlock(tip, true);
+    block.vchBlockSig.back() ^= 1;
+    CValidationState stateSig;
+    BOOST_CHECK(PreValidateStakeBlock(CBlockHeaderAndShortTxIDs(block), tip, stateSig) == StakePreValidation::INVALID);
+    BOOST_CHECK(stateSig.IsInvalid(nDoS) && nDoS == 100);
+    BOOST_CHECK_EQUAL(stateSig.GetRejectReason(), "bad-blk-sign");
+
+    block = CreateStakeBlock(tip, true);
+    block.nTime += 1;
+    BOOST_CHECK(SignBlockWithKey(block, coinbaseKey));
+    CValidationState stateTime;
+    BOOST_CHECK(PreValidateStakeBlock(CBlockHeaderAndShortTxIDs(block), tip, stateTime) == StakePreValidation::INVALID);
+    BOOST_CHECK_EQUAL(stateTime.GetRejectReason(), "bad-cs-time");
+
+    // Kernel failures are not punished, the peer may have relayed the block before connecting it
+    block = CreateStakeBlock(tip, false);
+    CValidationState stateKernel;
+    BOOST_CHECK(PreValidateStakeBlock(CBlockHeaderAndShortTxIDs(block), tip, stateKernel) == StakePreValidation::INVALID);
+    BOOST_CHECK(stateKernel.IsInvalid(nDoS) && nDoS == 0);
+    BOOST_CHECK_EQUAL(stateKernel.GetRejectReason(), "bad-cs-kernel");
+}
+
+BOOST_FIXTURE_TEST_CASE(PreValidateStakeBlockCacheTest, StakeBlockSetup)
+{
+    LOCK(cs_main);
+    const CBlockIndex* tip = ::ChainActive().Tip();
+    CBlock block = CreateStakeBlock(tip, true);
+    const CBlockHeaderAndShortTxIDs cmpctblock(block);
+
+    CValidationState state;
+    BOOST_CHECK(PreValidateStakeBlock(cmpctblock, tip, state) == StakePreValidation::VALID);
+    // Only a cache hit can decide a block whose kernel cannot be checked against our tip
+    BOOST_CHECK(PreValidateStakeBlock(cmpctblock, tip->pprev, state) == StakePreValidation::VALID);
+
+    // The same header with a bogus signature is rejected, then answered from the cache without punishment
+    CBlock forged(block);
+    forged.vchBlockSig.back() ^= 1;
+    const CBlockHeaderAndShortTxIDs cmpctforged(forged);
+    int nDoS;
+    CValidationState stateForged;
+    BOOST_CHECK(PreValidateStakeBlock(cmpctforged, tip, stateForged) == StakePreValidation::INVALID);
+    BOOST_CHECK_EQUAL(stateForged.GetRejectReason(), "bad-blk-sign");
+    CValidationState stateCached;
+    BOOST_CHECK(PreValidateStakeBlock(cmpctforged, tip, stateCached) == StakePreValidation::INVALID);
+    BOOST_CHECK(stateCached.IsInvalid(nDoS) && nDoS == 0);
+    BOOST_CHECK_EQUAL(stateCached.GetRejectReason(), "bad-cs-prevalidate");
+
+    // ... which does not poison the entry of the valid block
+    CValidationState stateValid;
+    BOOST_CHECK(PreValidateStakeBlock(cmpctblock, tip, stateValid) == StakePreValidation::VALID);
+    BOOST_CHECK(stateValid.IsValid());
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
@@ -67,4 +67,89 @@ BOOST_AUTO_TEST_CASE(simplifiedmns_merkleroots)
 
     BOOST_CHECK(expectedMerkleRoot == calculatedMerkleRoot);
 }
+
+static CSimplifiedMNListEntry MakeTestEntry(size_t i, size_t confirmed)
+{
+    CSimplifiedMNListEntry smle;
+    smle.proRegTxHash.SetHex(strprintf("%064x", i * 7919 % 1000));
+    smle.confirmedHash.SetHex(strprintf("%064x", confirmed));
+
+    std::string ip = strprintf("%d.%d.%d.%d", 0, 0, 0, i);
+    Lookup(ip.c_str(), smle.service, i, false);
+
+    std::vector<unsigned char> vecBytes{static_cast<unsigned char>(i)};
+    vecBytes.resize(CBLSSecretKey::SerSize);
+
+    smle.pubKeyOperator.Set(CBLSSecretKey(vecBytes).GetPublicKey());
+    smle.keyIDVoting.SetHex(strprintf("%040x", i));
+    smle.isValid = true;
+    return smle;
+}
+
+BOOST_AUTO_TEST_CASE(simplifiedmns_merkletree_incremental)
+{
+    std::map<uint256, CSimplifiedMNListEntry> entries;
+    auto check = [&](const CSimplifiedMNListMerkleTree& tree) {
+        std::vector<CSimplifiedMNListEntry> v;
+        for (const auto& p : entries) {
+            v.emplace_back(p.second);
+        }
+        bool mutated1 = true, mutated2 = true;
+        BOOST_CHECK_EQUAL(tree.Size(), v.size());
+        BOOST_CHECK(tree.GetMerkleRoot(&mutated1) == CSimplifiedMNList(v).CalcMerkleRoot(&mutated2));
+        BOOST_CHECK_EQUAL(mutated1, mutated2);
+    };
+
+    CSimplifiedMNListMerkleTree tree;
+    tree.Build(std::vector<CSimplifiedMNListEntry>{});
+    check(tree);
+
+    // grow one by one (tree gets higher), shrink from both ends, update in the middle
+    for (size_t i = 0; i < 40; i++) {
+        auto e = MakeTestEntry(i, 0);
+        entries[e.proRegTxHash] = e;
+        tree.Update({e}, {});
+        check(tree);
+    }
+    for (size_t i = 0; i < 40; i += 3) {
+        auto e = MakeTestEntry(i, i + 1);
+        entries[e.proRegTxHash] = e;
+        tree.Update({e}, {});
+        check(tree);
+    }
+    std::vector<CSimplifiedMNListEntry> added;
+    std::vector<uint256> removed;
+    for (size_t i = 40; i < 50; i++) {
+        added.emplace_back(MakeTestEntry(i, 0));
+        entries[added.back().proRegTxHash] = added.back();
+    }
+    removed.emplace_back(entries.begin()->first);
+    removed.emplace_back(entries.rbegin()->first);
+    removed.emplace_back(uint256S("0xff")); // not in the tree
+    entries.erase(entries.begin());
+    entries.erase(std::prev(entries.end()));
+    tree.Update(added, removed);
+    check(tree);
+    while (!entries.empty()) {
+        auto it = std::next(entries.begin(), entries.size() / 2);
+        tree.Update({}, {it->first});
+        entries.erase(it);
+        check(tree);
+    }
+
+    // the same as a tree built at once
+    for (size_t i = 0; i < 15; i++) {
+        auto e = MakeTestEntry(i, i);
+        entries[e.proRegTxHash] = e;
+        tree.Update({e}, {});
+    }
+    CSimplifiedMNListMerkleTree built;
+    std::vector<CSimplifiedMNListEntry> v;
+    for (const auto& p : entries) {
+        v.emplace_back(p.second);
+    }
+    built.Build(v);
+    BOOST_CHECK(built.GetMerkleRoot() == tree.GetMerkleRoot());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
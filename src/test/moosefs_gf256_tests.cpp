@@ -0,0 +1,208 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <random.h>
+
+#include <libmoosefs/mfscommon/gf256.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string.h>
+#include <vector>
+
+/* blocks are shorter than MFSBLOCKSIZE to keep the test fast, but longer than one SIMD loop and not a multiple of it */
+static const uint32_t TEST_BLOCK_SIZE = 1037;
+static const uint8_t TEST_MAX_DATA_PARTS = 8;
+static const uint8_t TEST_MAX_PARITY_PARTS = 4;
+
+typedef std::vector<uint8_t> Block;
+
+static Block RandomBlock(FastRandomContext& rng, uint32_t size)
+{
+    Block b(size);
+    for (auto& x : b) {
+        x = rng.randbits(8);
+    }
+    return b;
+}
+
+/* part 'target' as combination of the parts listed in 'avail' (one block of every part) */
+static Block RebuildPart(uint8_t k, uint8_t m, const std::vector<uint8_t>& avail, uint8_t target, const std::vector<Block>& parts)
+{
+    uint8_t coefs[GF256_MAX_SOURCES];
+    std::vector<const uint8_t*> srcs;
+    Block dst(TEST_BLOCK_SIZE);
+
+    BOOST_REQUIRE_EQUAL(gf256_rs_coefs(k, m, avail.data(), target, coefs), 0);
+    for (uint8_t p : avail) {
+        srcs.push_back(parts[p].data());
+    }
+    gf256_region(dst.data(), srcs.data(), coefs, k, TEST_BLOCK_SIZE);
+    return dst;
+}
+
+/* data parts followed by parity parts computed from them */
+static std::vector<Block> EncodeParts(FastRandomContext& rng, uint8_t k, uint8_t m)
+{
+    std::vector<Block> parts;
+    std::vector<uint8_t> data;
+
+    for (uint8_t q = 0; q < k; q++) {
+        parts.push_back(RandomBlock(rng, TEST_BLOCK_SIZE));
+        data.push_back(q);
+    }
+    for (uint8_t p = k; p < k + m; p++) {
+        parts.push_back(RebuildPart(k, m, data, p, parts));
+    }
+    return parts;
+}
+
+BOOST_FIXTURE_TEST_SUITE(moosefs_gf256_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(region_matches_generic)
+{
+    FastRandomContext rng(true);
+    std::vector<Block> src;
+    std::vector<const uint8_t*> srcs(GF256_MAX_SOURCES);
+    uint8_t coefs[GF256_MAX_SOURCES];
+
+    gf256_init();
+    BOOST_TEST_MESSAGE("gf256 implementation: " << gf256_implementation());
+    for (uint32_t i = 0; i < GF256_MAX_SOURCES; i++) {
+        src.push_back(RandomBlock(rng, TEST_BLOCK_SIZE + 64));
+    }
+    for (uint32_t cnt = 1; cnt <= GF256_MAX_SOURCES; cnt++) {
+        for (uint32_t leng : {1U, 15U, 16U, 31U, 32U, 33U, 63U, 64U, 65U, 127U, 128U, 200U, TEST_BLOCK_SIZE}) {
+            Block d1(leng + 1), d2(leng + 1);
+            for (uint32_t i = 0; i < cnt; i++) {
+                srcs[i] = src[i].data() + rng.randrange(64); // misaligned sources
+                coefs[i] = rng.randbits(8);
+            }
+            gf256_region_generic(d1.data() + 1, srcs.data(), coefs, cnt, leng);
+            gf256_region(d2.data() + 1, srcs.data(), coefs, cnt, leng);
+            BOOST_CHECK_MESSAGE(d1 == d2, "cnt=" << cnt << " leng=" << leng);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(region_single_source)
+{
+    FastRandomContext rng(true);
+    Block src = RandomBlock(rng, TEST_BLOCK_SIZE);
+    Block dst(TEST_BLOCK_SIZE);
+    const uint8_t* srcs[1] = {src.data()};
+    uint8_t coef;
+
+    gf256_init();
+    coef = 1;
+    gf256_region(dst.data(), srcs, &coef, 1, TEST_BLOCK_SIZE);
+    BOOST_CHECK(dst == src);
+    coef = 0x53;
+    gf256_region(dst.data(), srcs, &coef, 1, TEST_BLOCK_SIZE);
+    for (uint32_t i = 0; i < TEST_BLOCK_SIZE; i++) {
+        BOOST_REQUIRE_EQUAL(dst[i], gf256_mul(0x53, src[i]));
+    }
+    for (uint32_t a = 1; a < 256; a++) {
+        BOOST_REQUIRE_EQUAL(gf256_mul(a, gf256_inv(a)), 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rs_rebuild_from_every_subset)
+{
+    FastRandomContext rng(true);
+
+    gf256_init();
+    for (uint8_t k = 1; k <= TEST_MAX_DATA_PARTS; k++) {
+        for (uint8_t m = 0; m <= TEST_MAX_PARITY_PARTS; m++) {
+            uint8_t n = k + m;
+            std::vector<Block> parts = EncodeParts(rng, k, m);
+            // every k-subset of n parts (as bit mask) must rebuild every part
+            for (uint32_t mask = 0; mask < (1U << n); mask++) {
+                if (__builtin_popcount(mask) != k) {
+                    continue;
+                }
+                std::vector<uint8_t> avail;
+                for (uint8_t p = 0; p < n; p++) {
+                    if (mask & (1U << p)) {
+                        avail.push_back(p);
+                    }
+                }
+                for (uint8_t target = 0; target < n; target++) {
+                    BOOST_REQUIRE_MESSAGE(RebuildPart(k, m, avail, target, parts) == parts[target], "k=" << int(k) << " m=" << int(m) << " mask=" << mask << " target=" << int(target));
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rs_invalid_arguments)
+{
+    uint8_t coefs[GF256_MAX_SOURCES];
+    const uint8_t twice[3] = {0, 4, 4};
+    const uint8_t outside[3] = {0, 1, 7};
+    const uint8_t ok[3] = {0, 1, 2};
+
+    gf256_init();
+    BOOST_CHECK_EQUAL(gf256_rs_coefs(3, 2, twice, 1, coefs), -1);
+    BOOST_CHECK_EQUAL(gf256_rs_coefs(3, 2, outside, 3, coefs), -1);
+    BOOST_CHECK_EQUAL(gf256_rs_coefs(3, 2, ok, 5, coefs), -1);
+    BOOST_CHECK_EQUAL(gf256_rs_coefs(0, 2, ok, 0, coefs), -1);
+    BOOST_CHECK_EQUAL(gf256_rs_coefs(GF256_MAX_SOURCES + 1, 0, ok, 0, coefs), -1);
+    // available part is copied as is
+    BOOST_CHECK_EQUAL(gf256_rs_coefs(3, 2, ok, 1, coefs), 0);
+    BOOST_CHECK(coefs[0] == 0 && coefs[1] == 1 && coefs[2] == 0);
+}
+
+/* full copy is striped into rows the way replicate_ec does: data part q holds blocks q, q+k, q+2k ... of the chunk */
+BOOST_AUTO_TEST_CASE(rs_full_copy_stripes)
+{
+    FastRandomContext rng(true);
+    Block zero(TEST_BLOCK_SIZE, 0);
+
+    gf256_init();
+    for (uint8_t k = 1; k <= TEST_MAX_DATA_PARTS; k++) {
+        for (uint8_t m = 0; m <= TEST_MAX_PARITY_PARTS; m++) {
+            uint8_t n = k + m;
+            std::vector<uint8_t> data;
+            for (uint8_t q = 0; q < k; q++) {
+                data.push_back(q);
+            }
+            // short last row included
+            for (uint32_t blocks : {1U, uint32_t(k), uint32_t(3 * k + 1), uint32_t(5 * k - 1)}) {
+                std::vector<Block> chunk;
+                for (uint32_t b = 0; b < blocks; b++) {
+                    chunk.push_back(RandomBlock(rng, TEST_BLOCK_SIZE));
+                }
+                uint32_t rows = gf256_rs_stripe_rows(k, blocks);
+                BOOST_REQUIRE(rows * k >= blocks && (rows - 1) * k < blocks);
+                for (uint32_t row = 0; row < rows; row++) {
+                    // k consecutive blocks of the chunk (zeros past its end) are the data parts of this row
+                    std::vector<Block> rowparts;
+                    for (uint8_t q = 0; q < k; q++) {
+                        uint32_t b = gf256_rs_stripe_block(k, q, row);
+                        BOOST_REQUIRE_EQUAL(b, row * k + q);
+                        rowparts.push_back(b < blocks ? chunk[b] : zero);
+                    }
+                    std::vector<Block> encoded = rowparts;
+                    for (uint8_t p = k; p < n; p++) {
+                        encoded.push_back(RebuildPart(k, m, data, p, rowparts));
+                    }
+                    // last k parts of the row (parity first) give back the chunk blocks
+                    std::vector<uint8_t> tail;
+                    for (uint8_t p = n - k; p < n; p++) {
+                        tail.push_back(p);
+                    }
+                    for (uint8_t q = 0; q < k; q++) {
+                        uint32_t b = row * k + q;
+                        BOOST_REQUIRE(RebuildPart(k, m, tail, q, encoded) == (b < blocks ? chunk[b] : zero));
+                    }
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
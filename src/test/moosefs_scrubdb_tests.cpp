@@ -0,0 +1,204 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+#include <random.h>
+
+#include <libmoosefs/mfschunkserver/chunkdigest.h>
+#include <libmoosefs/mfschunkserver/scrubdb.h>
+#include <libmoosefs/mfscommon/MFSCommunication.h>
+#include <libmoosefs/mfscommon/crc.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+typedef std::vector<uint8_t> Digest;
+
+static std::vector<uint8_t> RandomCrcTable(FastRandomContext& rng, uint32_t blocks)
+{
+    std::vector<uint8_t> crctab(4 * blocks);
+    for (uint32_t i = 0; i < blocks; i++) {
+        WriteBE32(crctab.data() + 4 * i, rng.rand32());
+    }
+    return crctab;
+}
+
+static Digest BlocksDigest(const std::vector<uint8_t>& crctab, uint16_t blocks)
+{
+    Digest d(CHUNKDIGEST_SIZE);
+    chunkdigest_blocks(crctab.data(), blocks, d.data());
+    return d;
+}
+
+static Digest Sha256(uint8_t prefix, const uint8_t* data, size_t leng)
+{
+    Digest d(CSHA256::OUTPUT_SIZE);
+    CSHA256().Write(&prefix, 1).Write(data, leng).Finalize(d.data());
+    return d;
+}
+
+static std::vector<scrubrec> RandomRecords(FastRandomContext& rng, uint32_t count)
+{
+    std::vector<scrubrec> recs(count);
+    for (uint32_t i = 0; i < count; i++) {
+        recs[i].chunkid = (uint64_t(i) << 20) | rng.randbits(20); // unique ids
+        recs[i].version = rng.rand32();
+        recs[i].testtime = rng.rand32();
+        recs[i].digestvalid = rng.randbool();
+        for (uint32_t j = 0; j < CHUNKDIGEST_SIZE; j++) {
+            recs[i].digest[j] = rng.randbits(8);
+        }
+    }
+    // encoder has to sort them
+    for (uint32_t i = count; i > 1; i--) {
+        std::swap(recs[i - 1], recs[rng.randrange(i)]);
+    }
+    return recs;
+}
+
+static bool SameRecord(const scrubrec& a, const scrubrec& b)
+{
+    return a.chunkid == b.chunkid && a.version == b.version && a.testtime == b.testtime && a.digestvalid == b.digestvalid && memcmp(a.digest, b.digest, CHUNKDIGEST_SIZE) == 0;
+}
+
+static std::vector<uint8_t> Encode(std::vector<scrubrec> recs)
+{
+    uint64_t leng;
+    uint8_t* buff = scrubdb_encode(recs.data(), recs.size(), &leng);
+    std::vector<uint8_t> image(buff, buff + leng);
+    free(buff);
+    return image;
+}
+
+static bool Decodes(const std::vector<uint8_t>& image)
+{
+    uint32_t count;
+    scrubrec* recs = scrubdb_decode(image.data(), image.size(), &count);
+    free(recs);
+    return recs != NULL;
+}
+
+BOOST_FIXTURE_TEST_SUITE(moosefs_scrubdb_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(chunkdigest_tree)
+{
+    FastRandomContext rng(true);
+    std::vector<uint8_t> crctab = RandomCrcTable(rng, MFSBLOCKSINCHUNK);
+
+    // up to one leaf - digest is the leaf itself
+    BOOST_CHECK(BlocksDigest(crctab, 0) == Sha256(0, crctab.data(), 0));
+    BOOST_CHECK(BlocksDigest(crctab, 1) == Sha256(0, crctab.data(), 4));
+    BOOST_CHECK(BlocksDigest(crctab, CHUNKDIGEST_LEAFBLOCKS) == Sha256(0, crctab.data(), 4 * CHUNKDIGEST_LEAFBLOCKS));
+
+    // two and three leaves (third one is carried up)
+    Digest l0 = Sha256(0, crctab.data(), 4 * CHUNKDIGEST_LEAFBLOCKS);
+    Digest l1 = Sha256(0, crctab.data() + 4 * CHUNKDIGEST_LEAFBLOCKS, 4);
+    Digest l1full = Sha256(0, crctab.data() + 4 * CHUNKDIGEST_LEAFBLOCKS, 4 * CHUNKDIGEST_LEAFBLOCKS);
+    Digest l2 = Sha256(0, crctab.data() + 8 * CHUNKDIGEST_LEAFBLOCKS, 4);
+    std::vector<uint8_t> pair(l0);
+    pair.insert(pair.end(), l1.begin(), l1.end());
+    BOOST_CHECK(BlocksDigest(crctab, CHUNKDIGEST_LEAFBLOCKS + 1) == Sha256(1, pair.data(), pair.size()));
+    pair.assign(l0.begin(), l0.end());
+    pair.insert(pair.end(), l1full.begin(), l1full.end());
+    Digest n01 = Sha256(1, pair.data(), pair.size());
+    pair.assign(n01.begin(), n01.end());
+    pair.insert(pair.end(), l2.begin(), l2.end());
+    BOOST_CHECK(BlocksDigest(crctab, 2 * CHUNKDIGEST_LEAFBLOCKS + 1) == Sha256(1, pair.data(), pair.size()));
+
+    // more blocks than a chunk can have are ignored
+    BOOST_CHECK(BlocksDigest(crctab, MFSBLOCKSINCHUNK) == BlocksDigest(crctab, 0xFFFF));
+}
+
+BOOST_AUTO_TEST_CASE(chunkdigest_detects_changes)
+{
+    FastRandomContext rng(true);
+
+    for (uint32_t blocks : {1U, 15U, 16U, 17U, 33U, 100U, 1023U, uint32_t(MFSBLOCKSINCHUNK)}) {
+        std::vector<uint8_t> crctab = RandomCrcTable(rng, blocks);
+        Digest d = BlocksDigest(crctab, blocks);
+        BOOST_CHECK(d == BlocksDigest(crctab, blocks));
+        // shorter table (even with a zero crc appended) gives a different digest
+        BOOST_CHECK(d != BlocksDigest(crctab, blocks - 1));
+        // any changed bit of any crc changes the digest
+        for (uint32_t n = 0; n < 8; n++) {
+            uint32_t pos = rng.randrange(crctab.size());
+            uint8_t bit = 1 << rng.randrange(8);
+            crctab[pos] ^= bit;
+            BOOST_CHECK(d != BlocksDigest(crctab, blocks));
+            crctab[pos] ^= bit;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scrubdb_roundtrip)
+{
+    FastRandomContext rng(true);
+
+    mycrc32_init();
+    for (uint32_t count : {0U, 1U, 2U, 1000U}) {
+        std::vector<scrubrec> recs = RandomRecords(rng, count);
+        std::vector<uint8_t> image = Encode(recs);
+        uint32_t dcount = 12345;
+        scrubrec* drecs = scrubdb_decode(image.data(), image.size(), &dcount);
+        BOOST_REQUIRE(drecs != NULL);
+        BOOST_REQUIRE_EQUAL(dcount, count);
+        for (uint32_t i = 1; i < dcount; i++) {
+            BOOST_CHECK(drecs[i - 1].chunkid < drecs[i].chunkid);
+        }
+        for (const scrubrec& r : recs) {
+            const scrubrec* f = scrubdb_find(drecs, dcount, r.chunkid);
+            BOOST_REQUIRE(f != NULL);
+            BOOST_CHECK(SameRecord(*f, r));
+        }
+        BOOST_CHECK(scrubdb_find(drecs, dcount, UINT64_C(0xFFFFFFFFFFFFFFFF)) == NULL);
+        free(drecs);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(scrubdb_damaged)
+{
+    FastRandomContext rng(true);
+    std::vector<uint8_t> image, bad;
+    uint32_t count;
+
+    mycrc32_init();
+    image = Encode(RandomRecords(rng, 50));
+    BOOST_REQUIRE(Decodes(image));
+
+    // any flipped byte is detected (header, records, crc)
+    for (size_t pos = 0; pos < image.size(); pos++) {
+        bad = image;
+        bad[pos] ^= 0x5A;
+        BOOST_CHECK_MESSAGE(!Decodes(bad), "pos=" << pos);
+    }
+    // truncated or extended image
+    for (size_t leng : {size_t(0), size_t(4), size_t(15), size_t(20), image.size() - 1}) {
+        bad.assign(image.begin(), image.begin() + leng);
+        BOOST_CHECK(!Decodes(bad));
+    }
+    bad = image;
+    bad.push_back(0);
+    BOOST_CHECK(!Decodes(bad));
+    // version 1 files (md5 digests) are not read
+    bad = image;
+    memcpy(bad.data(), "MFS SCRUBDB1", 12);
+    BOOST_CHECK(!Decodes(bad));
+    // records out of order (with valid crc) would break lookups
+    std::vector<scrubrec> recs = RandomRecords(rng, 2);
+    bad = Encode(recs);
+    std::vector<uint8_t> rec0(bad.begin() + 16, bad.begin() + 16 + 17 + CHUNKDIGEST_SIZE);
+    std::copy(bad.begin() + 16 + 17 + CHUNKDIGEST_SIZE, bad.begin() + 16 + 2 * (17 + CHUNKDIGEST_SIZE), bad.begin() + 16);
+    std::copy(rec0.begin(), rec0.end(), bad.begin() + 16 + 17 + CHUNKDIGEST_SIZE);
+    WriteBE32(bad.data() + bad.size() - 4, mycrc32(0, bad.data(), bad.size() - 4));
+    BOOST_CHECK(scrubdb_decode(bad.data(), bad.size(), &count) == NULL);
+    BOOST_CHECK_EQUAL(count, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,99 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <random.h>
+
+#include <libmoosefs/mfscommon/xorblock.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string.h>
+#include <vector>
+
+static const uint32_t TEST_MAX_SOURCES = 9;
+/* longer than a few unrolled SIMD loops, so every kernel runs its main loop and its tail */
+static const uint32_t TEST_MAX_LENG = 1100;
+
+typedef std::vector<uint8_t> Block;
+
+static Block RandomBlock(FastRandomContext& rng, uint32_t size)
+{
+    Block b(size);
+    for (auto& x : b) {
+        x = rng.randbits(8);
+    }
+    return b;
+}
+
+BOOST_FIXTURE_TEST_SUITE(moosefs_xorblock_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(kernels_match_generic)
+{
+    FastRandomContext rng(true);
+    std::vector<Block> src;
+    std::vector<const uint8_t*> srcs(TEST_MAX_SOURCES);
+    uint32_t tested = 0;
+
+    for (uint32_t i = 0; i < TEST_MAX_SOURCES; i++) {
+        src.push_back(RandomBlock(rng, TEST_MAX_LENG + 64));
+    }
+    for (const char* name : {"standard", "avx2", "avx512f", "neon"}) {
+        if (!xorblock_select(name)) {
+            BOOST_TEST_MESSAGE("xorblock implementation not available: " << name);
+            continue;
+        }
+        BOOST_CHECK_EQUAL(xorblock_implementation(), name);
+        tested++;
+        for (uint32_t cnt = 0; cnt <= TEST_MAX_SOURCES; cnt++) {
+            for (uint32_t leng : {0U, 1U, 7U, 31U, 32U, 33U, 63U, 64U, 65U, 127U, 128U, 129U, 255U, 256U, 257U, 1000U, TEST_MAX_LENG}) {
+                // guard bytes around dst catch writes past leng
+                Block d1(leng + 2, 0xA5), d2(leng + 2, 0xA5);
+                for (uint32_t i = 0; i < cnt; i++) {
+                    srcs[i] = src[i].data() + rng.randrange(64); // misaligned sources
+                }
+                if (cnt > 0) {
+                    xorblock_generic(d1.data() + 1, srcs.data(), cnt, leng);
+                } else {
+                    memset(d1.data() + 1, 0, leng);
+                }
+                xorblock(d2.data() + 1, srcs.data(), cnt, leng);
+                BOOST_CHECK_MESSAGE(d1 == d2, name << " cnt=" << cnt << " leng=" << leng);
+            }
+        }
+    }
+    BOOST_CHECK(tested >= 1);
+    xorblock_init();
+}
+
+BOOST_AUTO_TEST_CASE(in_place_and_identities)
+{
+    FastRandomContext rng(true);
+    Block a = RandomBlock(rng, TEST_MAX_LENG), b = RandomBlock(rng, TEST_MAX_LENG);
+
+    xorblock_init();
+    BOOST_TEST_MESSAGE("xorblock implementation: " << xorblock_implementation());
+    // dst may be one of the sources
+    Block d = a;
+    const uint8_t* srcs[3] = {d.data(), b.data(), b.data()};
+    xorblock(d.data(), srcs, 2, TEST_MAX_LENG);
+    for (uint32_t i = 0; i < TEST_MAX_LENG; i++) {
+        BOOST_REQUIRE_EQUAL(d[i], a[i] ^ b[i]);
+    }
+    // x ^ b ^ b == x
+    srcs[0] = a.data();
+    xorblock(d.data(), srcs, 3, TEST_MAX_LENG);
+    BOOST_CHECK(d == a);
+}
+
+BOOST_AUTO_TEST_CASE(unknown_implementation)
+{
+    xorblock_init();
+    const char* name = xorblock_implementation();
+    BOOST_CHECK(!xorblock_select("sse9"));
+    BOOST_CHECK_EQUAL(xorblock_implementation(), name);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,154 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <pos/kernel.h>
+#include <pos/kernelcache.h>
+#include <script/interpreter.h>
+#include <validation.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pos_kernelcache_tests, TestChain100Setup)
+
+static CBlock MakeCacheTestBlock(const std::vector<COutPoint>& spends, size_t nOutputs)
+{
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 0;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : spends) {
+        tx.vin.emplace_back(prevout);
+    }
+    tx.vout.resize(nOutputs);
+    for (auto& out : tx.vout) {
+        out.nValue = 10 * COIN;
+    }
+    block.vtx.push_back(MakeTransactionRef(tx));
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(kernelcache_connect_spend_disconnect)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+    CStakeKernelCache cache;
+    CStakeKernelInput input;
+
+    CBlockIndex index1, index2;
+    index1.nHeight = 1;
+    index1.nTime = 1600000000;
+    index2.nHeight = 2;
+    index2.nTime = 1600000016;
+
+    CBlock block1 = MakeCacheTestBlock({COutPoint(InsecureRand256(), 0)}, 2);
+    const COutPoint created(block1.vtx[1]->GetHash(), 0);
+    const COutPoint untouched(block1.vtx[1]->GetHash(), 1);
+
+    cache.ConnectBlock(block1, &index1, params);
+    BOOST_CHECK(cache.Lookup(created, input));
+    BOOST_CHECK_EQUAL(input.nHeight, 1);
+    BOOST_CHECK_EQUAL(input.nBlockTime, index1.nTime);
+    BOOST_CHECK_EQUAL(input.nValue, 10 * COIN);
+
+    // spending drops the input, outputs of the spending block are added
+    CBlock block2 = MakeCacheTestBlock({created}, 1);
+    const COutPoint change(block2.vtx[1]->GetHash(), 0);
+    cache.ConnectBlock(block2, &index2, params);
+    BOOST_CHECK(!cache.Lookup(created, input));
+    BOOST_CHECK(cache.Lookup(untouched, input));
+    BOOST_CHECK(cache.Lookup(change, input));
+    BOOST_CHECK_EQUAL(input.nHeight, 2);
+
+    // disconnecting drops the outputs again, the spent input is only re-learnt from the coins view
+    cache.DisconnectBlock(block2);
+    BOOST_CHECK(!cache.Lookup(change, input));
+    BOOST_CHECK(!cache.Lookup(created, input));
+    BOOST_CHECK(cache.Lookup(untouched, input));
+
+    cache.DisconnectBlock(block1);
+    BOOST_CHECK(!cache.Lookup(untouched, input));
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(kernelcache_evicts_least_recently_used)
+{
+    CStakeKernelCache cache(2);
+    CStakeKernelInput input;
+
+    std::vector<COutPoint> prevouts;
+    for (int i = 0; i < 6; i++) {
+        prevouts.emplace_back(InsecureRand256(), i);
+    }
+    for (int i = 0; i < 5; i++) {
+        input.nHeight = i;
+        cache.Add(prevouts[i], input);
+    }
+    // entries are only truncated once the cache holds twice its size, keep the first one in use
+    BOOST_CHECK(cache.Lookup(prevouts[0], input));
+    cache.Add(prevouts[5], input);
+
+    BOOST_CHECK(cache.Lookup(prevouts[0], input));
+    BOOST_CHECK_EQUAL(input.nHeight, 0);
+    BOOST_CHECK(cache.Lookup(prevouts[4], input));
+    BOOST_CHECK(cache.Lookup(prevouts[5], input));
+    for (int i = 1; i < 4; i++) {
+        BOOST_CHECK(!cache.Lookup(prevouts[i], input));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(kernelcache_follows_active_chain)
+{
+    CStakeKernelInput input;
+    const COutPoint kernel(m_coinbase_txns[0]->GetHash(), 0);
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // spend the first coinbase
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = kernel;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = m_coinbase_txns[0]->vout[0].nValue - CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    const COutPoint created(spend.GetHash(), 0);
+
+    CreateAndProcessBlock({spend}, scriptPubKey);
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    BOOST_CHECK(!stakeKernelCache.Lookup(kernel, input));
+    BOOST_CHECK(stakeKernelCache.Lookup(created, input));
+    BOOST_CHECK_EQUAL(input.nHeight, tip->nHeight);
+    BOOST_CHECK(!CheckKernel(tip, tip->nBits, tip->nTime, kernel));
+
+    // reconnecting old blocks on a scratch view must not bring back spent outputs
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(CVerifyDB().VerifyDB(Params(), &::ChainstateActive().CoinsTip(), 4, ::ChainActive().Height()));
+    }
+    BOOST_CHECK(!stakeKernelCache.Lookup(kernel, input));
+    BOOST_CHECK(!CheckKernel(tip, tip->nBits, tip->nTime, kernel));
+
+    // disconnecting the spending block drops its outputs, the kernel is re-learnt from the coins view
+    CValidationState state;
+    BOOST_CHECK(InvalidateBlock(state, Params(), WITH_LOCK(cs_main, return ::ChainActive().Tip())));
+    BOOST_CHECK(!stakeKernelCache.Lookup(created, input));
+    BOOST_CHECK(!stakeKernelCache.Lookup(kernel, input));
+    tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    CheckKernel(tip, tip->nBits, tip->nTime, kernel);
+    BOOST_CHECK(stakeKernelCache.Lookup(kernel, input));
+    BOOST_CHECK_EQUAL(input.nHeight, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -314,6 +314,27 @@ BOOST_AUTO_TEST_CASE(rpc_ban)
     BOOST_CHECK_EQUAL(adr.get_str(), "2001:4d48:ac57:400:cacf:e9ff:fe1d:9c63/128");
 }
 
+BOOST_AUTO_TEST_CASE(rpc_storagechallenge_params)
+{
+    const std::string hash(64, 'f');
+    const std::string chunk = "[{\"chunkid\":\"2A\",\"version\":1,\"blocks\":1}]";
+    // serialized response without samples: seed, commitment, empty vector, digest
+    const std::string empty = std::string(128, '0') + "00" + std::string(64, '0');
+    UniValue r;
+
+    // a chunk without blocks has nothing to sample
+    BOOST_CHECK_EXCEPTION(CallRPC("storagechallenge " + hash + " [{\"chunkid\":\"2A\",\"version\":1,\"blocks\":0}]"), std::runtime_error, HasReason("out of range"));
+    BOOST_CHECK_EXCEPTION(CallRPC("storagechallenge " + hash + " [{\"chunkid\":\"2A\",\"version\":1,\"blocks\":1025}]"), std::runtime_error, HasReason("out of range"));
+    BOOST_CHECK_EXCEPTION(CallRPC("storagechallenge " + hash + " " + chunk + " 0"), std::runtime_error, HasReason("samples must be"));
+    BOOST_CHECK_EXCEPTION(CallRPC("verifystoragechallenge " + empty + " [{\"chunkid\":\"2A\",\"version\":1,\"blocks\":0}]"), std::runtime_error, HasReason("out of range"));
+    BOOST_CHECK_EXCEPTION(CallRPC("verifystoragechallenge " + empty + " " + chunk + " 0"), std::runtime_error, HasReason("samples must be"));
+
+    // an empty response does not answer the challenge
+    BOOST_CHECK_NO_THROW(r = CallRPC("verifystoragechallenge " + empty + " " + chunk));
+    BOOST_CHECK(!find_value(r.get_obj(), "samples").get_bool());
+    BOOST_CHECK_EQUAL(find_value(r.get_obj(), "verified").get_int(), 0);
+}
+
 #if ENABLE_MINER
 BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
 {
@@ -0,0 +1,368 @@
+// Copyright (c) 2023 datos
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <random.h>
+#include <storage/challenge.h>
+
+#include <libmoosefs/mfscommon/MFSCommunication.h>
+
+#include <test/util/setup_common.h>
+#include <util/time.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string.h>
+#include <tuple>
+#include <vector>
+
+typedef std::tuple<uint64_t, uint32_t, uint16_t> BlockKey;
+
+/** In-memory chunk store standing in for the local disks */
+struct TestStore {
+    std::map<BlockKey, std::vector<uint8_t>> blocks;
+
+    void Add(FastRandomContext& rng, const StorageChunkRef& chunk)
+    {
+        for (uint16_t b = 0; b < chunk.blocks; b++) {
+            std::vector<uint8_t> data(STORAGE_CHALLENGE_BLOCKSIZE);
+            for (auto& x : data) {
+                x = rng.randbits(8);
+            }
+            blocks[BlockKey(chunk.chunkid, chunk.version, b)] = data;
+        }
+    }
+
+    /** crc is not the real one - the verifier only compares it with what the prover reported */
+    static uint32_t Crc(const std::vector<uint8_t>& data)
+    {
+        uint32_t crc = 0;
+        for (uint32_t i = 0; i < data.size(); i += 4) {
+            crc = crc * 31 + (data[i] | (data[i + 1] << 8) | (data[i + 2] << 16) | (uint32_t(data[i + 3]) << 24));
+        }
+        return crc;
+    }
+
+    StorageBlockReader Reader() const
+    {
+        return [this](uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* data, uint32_t& crc) -> uint8_t {
+            auto it = blocks.find(BlockKey(chunkid, version, blocknum));
+            if (it == blocks.end()) {
+                return MFS_ERROR_NOCHUNK;
+            }
+            memcpy(data, it->second.data(), STORAGE_CHALLENGE_BLOCKSIZE);
+            crc = Crc(it->second);
+            return MFS_STATUS_OK;
+        };
+    }
+};
+
+static std::vector<StorageChunkRef> RandomChunks(FastRandomContext& rng, uint32_t count)
+{
+    std::vector<StorageChunkRef> chunks(count);
+    for (uint32_t i = 0; i < count; i++) {
+        chunks[i].chunkid = (uint64_t(i + 1) << 32) | rng.rand32();
+        chunks[i].version = 1 + rng.randrange(5);
+        chunks[i].blocks = 1 + rng.randrange(8);
+    }
+    return chunks;
+}
+
+static uint256 RandomSeed(FastRandomContext& rng)
+{
+    return StorageChallengeSeed(rng.rand256());
+}
+
+static bool SameSample(const StorageChallengeSample& a, const StorageChallengeSample& b)
+{
+    return a.chunkid == b.chunkid && a.version == b.version && a.blocknum == b.blocknum;
+}
+
+BOOST_FIXTURE_TEST_SUITE(storage_challenge_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(derive_is_deterministic)
+{
+    FastRandomContext rng(true);
+    std::vector<StorageChunkRef> chunks = RandomChunks(rng, 20);
+    uint256 seed = RandomSeed(rng);
+    uint256 commitment = StorageChallengeCommitment(chunks);
+    std::set<uint64_t> picked;
+    uint32_t sameSeed = 0, sameCommitment = 0;
+
+    BOOST_CHECK(commitment == StorageChallengeCommitment(chunks));
+    for (uint32_t i = 0; i < 200; i++) {
+        StorageChallengeSample s = StorageChallengeDerive(seed, commitment, chunks, i);
+        BOOST_CHECK(SameSample(s, StorageChallengeDerive(seed, commitment, chunks, i)));
+        // always a block of a committed chunk, in its committed version
+        bool found = false;
+        for (const StorageChunkRef& c : chunks) {
+            if (c.chunkid == s.chunkid) {
+                found = c.version == s.version && s.blocknum < c.blocks;
+            }
+        }
+        BOOST_CHECK(found);
+        picked.insert(s.chunkid);
+        sameSeed += SameSample(s, StorageChallengeDerive(RandomSeed(rng), commitment, chunks, i));
+        sameCommitment += SameSample(s, StorageChallengeDerive(seed, rng.rand256(), chunks, i));
+    }
+    // samples are spread over the list and depend on both the seed and the commitment
+    BOOST_CHECK(picked.size() > 10);
+    BOOST_CHECK(sameSeed < 50);
+    BOOST_CHECK(sameCommitment < 50);
+
+    // order of the list is committed too
+    std::vector<StorageChunkRef> swapped = chunks;
+    std::swap(swapped[0], swapped[1]);
+    BOOST_CHECK(StorageChallengeCommitment(swapped) != commitment);
+}
+
+BOOST_AUTO_TEST_CASE(digest_covers_samples)
+{
+    FastRandomContext rng(true);
+    std::vector<StorageChunkRef> chunks = RandomChunks(rng, 5);
+    TestStore store;
+    StorageChallengeResponse response;
+
+    for (const StorageChunkRef& c : chunks) {
+        store.Add(rng, c);
+    }
+    BOOST_REQUIRE(StorageChallengeRespond(RandomSeed(rng), chunks, 8, std::chrono::seconds(60), response, store.Reader()));
+    BOOST_CHECK(StorageChallengeDigest(response.seed, response.commitment, response.samples) == response.digest);
+    BOOST_CHECK(StorageChallengeDigest(RandomSeed(rng), response.commitment, response.samples) != response.digest);
+    BOOST_CHECK(StorageChallengeDigest(response.seed, rng.rand256(), response.samples) != response.digest);
+
+    std::vector<StorageChallengeSample> samples = response.samples;
+    samples[3].crc ^= 1;
+    BOOST_CHECK(StorageChallengeDigest(response.seed, response.commitment, samples) != response.digest);
+    samples = response.samples;
+    samples[5].tag ^= 1;
+    BOOST_CHECK(StorageChallengeDigest(response.seed, response.commitment, samples) != response.digest);
+    samples = response.samples;
+    samples.pop_back();
+    BOOST_CHECK(StorageChallengeDigest(response.seed, response.commitment, samples) != response.digest);
+}
+
+BOOST_AUTO_TEST_CASE(verify_honest_response)
+{
+    FastRandomContext rng(true);
+    std::vector<StorageChunkRef> chunks = RandomChunks(rng, 10);
+    TestStore store;
+    StorageChallengeResponse response;
+
+    for (const StorageChunkRef& c : chunks) {
+        store.Add(rng, c);
+    }
+    BOOST_CHECK(!StorageChallengeRespond(RandomSeed(rng), {}, 16, std::chrono::seconds(60), response, store.Reader()));
+    BOOST_REQUIRE(StorageChallengeRespond(RandomSeed(rng), chunks, 16, std::chrono::seconds(60), response, store.Reader()));
+    BOOST_REQUIRE_EQUAL(response.samples.size(), 16U);
+
+    StorageChallengeCheck check = StorageChallengeVerify(response, chunks, 16, store.Reader());
+    BOOST_CHECK(check.digestValid);
+    BOOST_CHECK(check.commitmentValid);
+    BOOST_CHECK(check.countValid);
+    BOOST_CHECK_EQUAL(check.verified, 16U);
+    BOOST_CHECK_EQUAL(check.forged + check.mismatched + check.unavailable + check.failed, 0U);
+
+    // samples the prover could not read are reported as failed, not verified
+    TestStore partial = store;
+    const StorageChallengeSample& first = response.samples[0];
+    partial.blocks.erase(BlockKey(first.chunkid, first.version, first.blocknum));
+    BOOST_REQUIRE(StorageChallengeRespond(response.seed, chunks, 16, std::chrono::seconds(60), response, partial.Reader()));
+    check = StorageChallengeVerify(response, chunks, 16, store.Reader());
+    BOOST_CHECK(check.digestValid);
+    BOOST_CHECK(check.failed >= 1);
+    BOOST_CHECK_EQUAL(check.failed + check.verified, 16U);
+}
+
+BOOST_AUTO_TEST_CASE(verify_rejects_forged_samples)
+{
+    FastRandomContext rng(true);
+    std::vector<StorageChunkRef> chunks = RandomChunks(rng, 10);
+    TestStore store;
+    StorageChallengeResponse honest, response;
+    StorageChallengeCheck check;
+
+    for (const StorageChunkRef& c : chunks) {
+        store.Add(rng, c);
+    }
+    BOOST_REQUIRE(StorageChallengeRespond(RandomSeed(rng), chunks, 16, std::chrono::seconds(60), honest, store.Reader()));
+    StorageBlockReader reader = store.Reader();
+    std::vector<uint8_t> data(STORAGE_CHALLENGE_BLOCKSIZE);
+
+    // prover answers a block it has instead of the derived one, with correct crc, tag and digest
+    response = honest;
+    StorageChallengeSample& s = response.samples[2];
+    for (const StorageChunkRef& c : chunks) {
+        if (c.chunkid == s.chunkid) {
+            BOOST_REQUIRE(c.blocks > 1 || chunks.size() > 1);
+            if (c.blocks > 1) {
+                s.blocknum = (s.blocknum + 1) % c.blocks;
+            } else {
+                s.chunkid = chunks[0].chunkid == c.chunkid ? chunks[1].chunkid : chunks[0].chunkid;
+                s.version = chunks[0].chunkid == c.chunkid ? chunks[1].version : chunks[0].version;
+                s.blocknum = 0;
+            }
+        }
+    }
+    BOOST_REQUIRE_EQUAL(reader(s.chunkid, s.version, s.blocknum, data.data(), s.crc), MFS_STATUS_OK);
+    s.tag = StorageChallengeTag(response.seed, s, data.data());
+    response.digest = StorageChallengeDigest(response.seed, response.commitment, response.samples);
+    check = StorageChallengeVerify(response, chunks, 16, reader);
+    BOOST_CHECK(check.digestValid);
+    BOOST_CHECK(check.commitmentValid);
+    BOOST_CHECK_EQUAL(check.forged, 1U);
+    BOOST_CHECK_EQUAL(check.verified, 15U);
+
+    // same with another chunk (first chunk of the list, block 0)
+    response = honest;
+    StorageChallengeSample& t = response.samples[4];
+    const StorageChunkRef& other = chunks[0].chunkid != t.chunkid ? chunks[0] : chunks[1];
+    t.chunkid = other.chunkid;
+    t.version = other.version;
+    t.blocknum = 0;
+    BOOST_REQUIRE_EQUAL(reader(t.chunkid, t.version, t.blocknum, data.data(), t.crc), MFS_STATUS_OK);
+    t.tag = StorageChallengeTag(response.seed, t, data.data());
+    response.digest = StorageChallengeDigest(response.seed, response.commitment, response.samples);
+    check = StorageChallengeVerify(response, chunks, 16, reader);
+    BOOST_CHECK(check.digestValid);
+    BOOST_CHECK_EQUAL(check.forged, 1U);
+
+    // response made over a list other than the committed one (e.g. only the chunks the prover still has)
+    std::vector<StorageChunkRef> kept(chunks.begin(), chunks.begin() + 3);
+    BOOST_REQUIRE(StorageChallengeRespond(honest.seed, kept, 16, std::chrono::seconds(60), response, reader));
+    check = StorageChallengeVerify(response, chunks, 16, reader);
+    BOOST_CHECK(check.digestValid);
+    BOOST_CHECK(!check.commitmentValid);
+    BOOST_CHECK_EQUAL(check.forged, 16U);
+    BOOST_CHECK_EQUAL(check.verified, 0U);
+    check = StorageChallengeVerify(honest, {}, 16, reader);
+    BOOST_CHECK(!check.commitmentValid);
+    BOOST_CHECK_EQUAL(check.forged, 16U);
+}
+
+BOOST_AUTO_TEST_CASE(verify_detects_wrong_data)
+{
+    FastRandomContext rng(true);
+    std::vector<StorageChunkRef> chunks = RandomChunks(rng, 4);
+    TestStore store;
+    StorageChallengeResponse honest, response;
+    StorageChallengeCheck check;
+
+    for (const StorageChunkRef& c : chunks) {
+        store.Add(rng, c);
+    }
+    BOOST_REQUIRE(StorageChallengeRespond(RandomSeed(rng), chunks, 8, std::chrono::seconds(60), honest, store.Reader()));
+
+    // prover holds damaged data
+    TestStore damaged = store;
+    for (auto& b : damaged.blocks) {
+        b.second[rng.randrange(STORAGE_CHALLENGE_BLOCKSIZE)] ^= 0x01;
+    }
+    BOOST_REQUIRE(StorageChallengeRespond(honest.seed, chunks, 8, std::chrono::seconds(60), response, damaged.Reader()));
+    check = StorageChallengeVerify(response, chunks, 8, store.Reader());
+    BOOST_CHECK(check.digestValid);
+    BOOST_CHECK_EQUAL(check.mismatched, 8U);
+
+    // reported crc changed (digest recomputed)
+    response = honest;
+    response.samples[1].crc ^= 0x80000000;
+    response.digest = StorageChallengeDigest(response.seed, response.commitment, response.samples);
+    check = StorageChallengeVerify(response, chunks, 8, store.Reader());
+    BOOST_CHECK_EQUAL(check.mismatched, 1U);
+    BOOST_CHECK_EQUAL(check.verified, 7U);
+
+    // digest not recomputed
+    response = honest;
+    response.samples[1].tag ^= 1;
+    check = StorageChallengeVerify(response, chunks, 8, store.Reader());
+    BOOST_CHECK(!check.digestValid);
+
+    // verifier does not hold the chunks
+    check = StorageChallengeVerify(honest, chunks, 8, TestStore().Reader());
+    BOOST_CHECK_EQUAL(check.unavailable, 8U);
+}
+
+BOOST_AUTO_TEST_CASE(verify_rejects_truncated_response)
+{
+    FastRandomContext rng(true);
+    std::vector<StorageChunkRef> chunks = RandomChunks(rng, 4);
+    TestStore store;
+    StorageChallengeResponse honest, response;
+    StorageChallengeCheck check;
+
+    for (const StorageChunkRef& c : chunks) {
+        store.Add(rng, c);
+    }
+    BOOST_REQUIRE(StorageChallengeRespond(RandomSeed(rng), chunks, 8, std::chrono::seconds(60), honest, store.Reader()));
+    check = StorageChallengeVerify(honest, chunks, 8, store.Reader());
+    BOOST_CHECK(check.countValid);
+    BOOST_CHECK_EQUAL(check.verified, 8U);
+
+    // prover drops the samples it can't answer (digest recomputed) - nothing is verified
+    response = honest;
+    response.samples.resize(5);
+    response.digest = StorageChallengeDigest(response.seed, response.commitment, response.samples);
+    check = StorageChallengeVerify(response, chunks, 8, store.Reader());
+    BOOST_CHECK(check.digestValid);
+    BOOST_CHECK(check.commitmentValid);
+    BOOST_CHECK(!check.countValid);
+    BOOST_CHECK_EQUAL(check.verified, 0U);
+
+    response.samples.clear();
+    response.digest = StorageChallengeDigest(response.seed, response.commitment, response.samples);
+    check = StorageChallengeVerify(response, chunks, 8, store.Reader());
+    BOOST_CHECK(check.digestValid);
+    BOOST_CHECK(!check.countValid);
+    BOOST_CHECK_EQUAL(check.verified + check.forged + check.failed, 0U);
+
+    // more samples than asked for are rejected as well
+    check = StorageChallengeVerify(honest, chunks, 4, store.Reader());
+    BOOST_CHECK(!check.countValid);
+    BOOST_CHECK_EQUAL(check.verified, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(respond_stops_at_deadline)
+{
+    FastRandomContext rng(true);
+    std::vector<StorageChunkRef> chunks = RandomChunks(rng, 4);
+    auto store = std::make_shared<TestStore>();
+    StorageChallengeResponse response;
+
+    for (const StorageChunkRef& c : chunks) {
+        store->Add(rng, c);
+    }
+    uint256 seed = RandomSeed(rng);
+    StorageChallengeSample first = StorageChallengeDerive(seed, StorageChallengeCommitment(chunks), chunks, 0);
+
+    // reads of the first sampled block hang far past the deadline - the reader outlives the call, so it owns the store
+    StorageBlockReader fast = store->Reader();
+    StorageBlockReader slow = [store, fast, first](uint64_t chunkid, uint32_t version, uint16_t blocknum, uint8_t* data, uint32_t& crc) -> uint8_t {
+        if (chunkid == first.chunkid && version == first.version && blocknum == first.blocknum) {
+            UninterruptibleSleep(std::chrono::milliseconds{2000});
+        }
+        return fast(chunkid, version, blocknum, data, crc);
+    };
+    int64_t start = GetTimeMillis();
+    BOOST_REQUIRE(StorageChallengeRespond(seed, chunks, 16, std::chrono::milliseconds(200), response, slow));
+    BOOST_CHECK(GetTimeMillis() - start < 1500);
+    BOOST_REQUIRE_EQUAL(response.samples.size(), 16U);
+    for (const StorageChallengeSample& s : response.samples) {
+        if (SameSample(s, first)) {
+            BOOST_CHECK_EQUAL(s.status, MFS_ERROR_NOTDONE);
+            BOOST_CHECK_EQUAL(s.crc, 0U);
+            BOOST_CHECK_EQUAL(s.tag, 0U);
+        }
+    }
+
+    // late samples count as failed, the others still verify
+    StorageChallengeCheck check = StorageChallengeVerify(response, chunks, 16, fast);
+    BOOST_CHECK(check.digestValid);
+    BOOST_CHECK(check.countValid);
+    BOOST_CHECK(check.failed >= 1);
+    BOOST_CHECK_EQUAL(check.failed + check.verified, 16U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -24,6 +24,7 @@
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <pos/kernel.h>
+#include <pos/kernelcache.h>
 #include <pos/signature.h>
 #include <pos/prevstake.h>
 #include <pow.h>
@@ -2715,6 +2716,8 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
         assert(flushed);
         dbTx->Commit();
     }
+    // outputs of the block are gone from the active chain, the inputs it spent are re-learnt lazily
+    stakeKernelCache.DisconnectBlock(block);
     LogPrint(BCLog::BENCHMARK, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(chainparams, state, FlushStateMode::IF_NEEDED))
@@ -2853,6 +2856,8 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
         assert(flushed);
         dbTx->Commit();
     }
+    // remember new stakeable outputs of the active chain for later kernel checks
+    stakeKernelCache.ConnectBlock(blockConnecting, pindexNew, chainparams.GetConsensus());
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCHMARK, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
     // Write the chain state to disk, if necessary.